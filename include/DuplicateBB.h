@@ -20,6 +20,8 @@
 #include <memory>
 
 namespace llvm {
+class BlockFrequencyInfo;
+class ProfileSummaryInfo;
 class RandomNumberGenerator;
 } // namespace llvm
 
@@ -40,8 +42,12 @@ struct DuplicateBB : public llvm::PassInfoMixin<DuplicateBB> {
   using ValueToPhiMap = std::map<llvm::Value *, llvm::Value *>;
 
   // Creates a BBToSingleRIVMap of BasicBlocks that are suitable for cloning.
+  // When BFI is provided, only cold blocks are considered (PSI, if available,
+  // is used to classify the blocks based on the profile data).
   BBToSingleRIVMap findBBsToDuplicate(llvm::Function &F,
-                                      const RIV::Result &RIVResult);
+                                      LazyRIV::Result &RIVResult,
+                                      llvm::BlockFrequencyInfo *BFI = nullptr,
+                                      llvm::ProfileSummaryInfo *PSI = nullptr);
 
   // Clones the input basic block:
   //  * injects an `if-then-else` construct using ContextValue
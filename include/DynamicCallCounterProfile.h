@@ -0,0 +1,271 @@
+//==============================================================================
+// FILE:
+//    DynamicCallCounterProfile.h
+//
+// DESCRIPTION:
+//    Describes the binary profiles written by DynamicCallCounter (with
+//    `-dynamic-cc-output=binary` or `-dynamic-cc-edges`) and EdgeProfiler, as
+//    well as the traces written by InjectFuncCall (with
+//    `-inject-func-call-output=trace`). All of them are read by
+//    `dcc-profdata` (so are the LoopTripCounter profiles, see
+//    LoopTripCounterProfile.h). Every profile is a single, flat image of the
+//    section that the instrumented module updates at runtime.
+//
+//    DynamicCallCounter profile:
+//
+//      +------------------------------------------+
+//      | DCCProfileHeader                         |
+//      +------------------------------------------+
+//      | DCCProfileRecord[Header.NumFunctions]    |
+//      +------------------------------------------+
+//      | function names (Header.NamesSize bytes)  |
+//      +------------------------------------------+
+//
+//    DynamicCallCounter call-edge profile (with `-dynamic-cc-edges`):
+//
+//      +------------------------------------------+
+//      | CallEdgeProfileHeader                    |
+//      +------------------------------------------+
+//      | CallEdgeProfileFunction[NumFunctions]    |
+//      +------------------------------------------+
+//      | CallEdgeProfileSite[Header.NumSites]     |
+//      +------------------------------------------+
+//      | CallEdgeProfileTarget[NumTargets]        |
+//      +------------------------------------------+
+//      | CallEdgeProfileAddress[NumAddresses]     |
+//      +------------------------------------------+
+//      | function names (Header.NamesSize bytes)  |
+//      +------------------------------------------+
+//
+//    The targets of indirect calls are recorded by their run-time address.
+//    The address table maps the addresses of the functions that the module
+//    takes the address of back to their names - it is only meaningful within
+//    the profile that contains it.
+//
+//    EdgeProfiler profile:
+//
+//      +------------------------------------------+
+//      | EdgeProfileHeader                        |
+//      +------------------------------------------+
+//      | EdgeProfileFunction[Header.NumFunctions] |
+//      +------------------------------------------+
+//      | uint64_t counters[Header.NumCounters]    |
+//      +------------------------------------------+
+//      | EdgeProfileEdge[Header.NumEdges]         |
+//      +------------------------------------------+
+//      | function names (Header.NamesSize bytes)  |
+//      +------------------------------------------+
+//
+//    InjectFuncCall trace:
+//
+//      +------------------------------------------+
+//      | TraceHeader                              |
+//      +------------------------------------------+
+//      | TraceFunction[Header.NumFunctions]       |
+//      +------------------------------------------+
+//      | function names (Header.NamesSize bytes)  |
+//      +------------------------------------------+
+//      | TraceChunkHeader                         |
+//      | TraceRecord[Chunk.NumRecords]            |
+//      +------------------------------------------+
+//      | ... (more chunks until the end of file)  |
+//      +------------------------------------------+
+//
+//    Every thread buffers its records and appends them to the trace, as one
+//    chunk, whenever its buffer fills up (and on exit). Within a chunk the
+//    records are in the order in which they were generated.
+//
+//    In all the formats the names are stored back-to-back and are not
+//    NUL-terminated. In traces the name table is zero-padded to a multiple of
+//    8 bytes (the padding is included in NamesSize). All the fields are
+//    naturally aligned, so that a profile can be mmap-ed and used in place.
+//    Integers are stored in the byte order of the machine that generated the
+//    profile.
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_DYNAMIC_CALL_COUNTER_PROFILE_H
+#define LLVM_TUTOR_DYNAMIC_CALL_COUNTER_PROFILE_H
+
+#include <cstdint>
+
+// "\xffltdccp" when read as a little-endian integer
+constexpr uint64_t DCCProfileMagic = 0x70636364746cffULL;
+// Bump this every time the layout below changes
+constexpr uint32_t DCCProfileVersion = 1;
+
+struct DCCProfileHeader {
+  uint64_t Magic;
+  uint32_t Version;
+  uint32_t NumFunctions;
+  // The size of the name table in bytes
+  uint64_t NamesSize;
+};
+
+struct DCCProfileRecord {
+  uint64_t CallCount;
+  // The location of the function name in the name table
+  uint32_t NameOffset;
+  uint32_t NameSize;
+};
+
+static_assert(sizeof(DCCProfileHeader) == 24, "Unexpected header layout");
+static_assert(sizeof(DCCProfileRecord) == 16, "Unexpected record layout");
+
+// "\xffltdcce" when read as a little-endian integer
+constexpr uint64_t CallEdgeProfileMagic = 0x65636364746cffULL;
+constexpr uint32_t CallEdgeProfileVersion = 1;
+
+// The callee of indirect call sites
+constexpr uint32_t CallEdgeProfileIndirect = ~0U;
+// The line offset of call sites without a (usable) debug location
+constexpr uint32_t CallEdgeProfileNoLocation = ~0U;
+
+struct CallEdgeProfileHeader {
+  uint64_t Magic;
+  uint32_t Version;
+  uint32_t NumFunctions;
+  uint32_t NumSites;
+  uint32_t NumTargets;
+  uint32_t NumAddresses;
+  uint32_t Reserved;
+  // The size of the name table in bytes
+  uint64_t NamesSize;
+};
+
+// Every function (except the intrinsics) that is defined or declared in the
+// module
+struct CallEdgeProfileFunction {
+  // The number of times the function was entered (always 0 for the functions
+  // that are only declared in the module)
+  uint64_t EntryCount;
+  // The location of the function name in the name table
+  uint32_t NameOffset;
+  uint32_t NameSize;
+  uint32_t IsDefined;
+  uint32_t Reserved;
+};
+
+struct CallEdgeProfileSite {
+  // The number of times the call was executed
+  uint64_t Count;
+  // Indices into the CallEdgeProfileFunction table
+  uint32_t Caller;
+  uint32_t Callee;
+  // The location of the call in the same form as in LLVM's sample profiles,
+  // i.e. the line relative to the first line of the caller (or
+  // CallEdgeProfileNoLocation) and the base discriminator
+  uint32_t LineOffset;
+  uint32_t Discriminator;
+  // The value profile of indirect calls is
+  // Targets[FirstTarget, FirstTarget + NumTargets)
+  uint32_t FirstTarget;
+  uint32_t NumTargets;
+};
+
+struct CallEdgeProfileTarget {
+  // The run-time address of the callee (0 for unused slots)
+  uint64_t Address;
+  uint64_t Count;
+};
+
+struct CallEdgeProfileAddress {
+  // The run-time address of function Function
+  uint64_t Address;
+  uint32_t Function;
+  uint32_t Reserved;
+};
+
+static_assert(sizeof(CallEdgeProfileHeader) == 40, "Unexpected header layout");
+static_assert(sizeof(CallEdgeProfileFunction) == 24,
+              "Unexpected record layout");
+static_assert(sizeof(CallEdgeProfileSite) == 32, "Unexpected site layout");
+static_assert(sizeof(CallEdgeProfileTarget) == 16, "Unexpected target layout");
+static_assert(sizeof(CallEdgeProfileAddress) == 16,
+              "Unexpected address layout");
+
+// "\xffltedgep" when read as a little-endian integer
+constexpr uint64_t EdgeProfileMagic = 0x7065676465746cffULL;
+constexpr uint32_t EdgeProfileVersion = 1;
+
+// The CFG node that represents "outside of the function". Every function has
+// a virtual edge from this node to the entry block and from every exit block
+// (i.e. a block without successors, or a block with a call that may not
+// return) to this node. Real basic blocks are numbered from 1 in the order in
+// which they appear in the function.
+constexpr uint32_t EdgeProfileVirtualNode = 0;
+// The counter index of edges that are not instrumented (i.e. that are on the
+// spanning tree). Their counts are reconstructed from the other edges.
+constexpr uint32_t EdgeProfileNoCounter = ~0U;
+
+struct EdgeProfileHeader {
+  uint64_t Magic;
+  uint32_t Version;
+  uint32_t NumFunctions;
+  uint32_t NumCounters;
+  uint32_t NumEdges;
+  // The size of the name table in bytes
+  uint64_t NamesSize;
+};
+
+struct EdgeProfileFunction {
+  // The location of the function name in the name table
+  uint32_t NameOffset;
+  uint32_t NameSize;
+  // The number of basic blocks (excluding the virtual node)
+  uint32_t NumBlocks;
+  // The edges of this function are Edges[FirstEdge, FirstEdge + NumEdges)
+  uint32_t FirstEdge;
+  uint32_t NumEdges;
+  uint32_t Reserved;
+};
+
+struct EdgeProfileEdge {
+  uint32_t Src;
+  uint32_t Dst;
+  // Index into the counters or EdgeProfileNoCounter
+  uint32_t CounterIdx;
+};
+
+static_assert(sizeof(EdgeProfileHeader) == 32, "Unexpected header layout");
+static_assert(sizeof(EdgeProfileFunction) == 24, "Unexpected record layout");
+static_assert(sizeof(EdgeProfileEdge) == 12, "Unexpected edge layout");
+
+// "\xffltifct" when read as a little-endian integer
+constexpr uint64_t TraceMagic = 0x74636669746cffULL;
+constexpr uint32_t TraceVersion = 1;
+
+struct TraceHeader {
+  uint64_t Magic;
+  uint32_t Version;
+  uint32_t NumFunctions;
+  // The size of the (padded) name table in bytes
+  uint64_t NamesSize;
+};
+
+struct TraceFunction {
+  // The location of the function name in the name table
+  uint32_t NameOffset;
+  uint32_t NameSize;
+};
+
+struct TraceChunkHeader {
+  // Threads are numbered from 0 in the order of their first traced call
+  uint32_t ThreadIdx;
+  uint32_t NumRecords;
+};
+
+struct TraceRecord {
+  // Index into the TraceFunction table
+  uint32_t FuncIdx;
+  uint32_t NumArgs;
+  // The value of the cycle counter (`llvm.readcyclecounter`) on entry
+  uint64_t Timestamp;
+};
+
+static_assert(sizeof(TraceHeader) == 24, "Unexpected header layout");
+static_assert(sizeof(TraceFunction) == 8, "Unexpected record layout");
+static_assert(sizeof(TraceChunkHeader) == 8, "Unexpected chunk layout");
+static_assert(sizeof(TraceRecord) == 16, "Unexpected record layout");
+
+#endif // LLVM_TUTOR_DYNAMIC_CALL_COUNTER_PROFILE_H
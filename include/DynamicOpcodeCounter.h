@@ -0,0 +1,31 @@
+//==============================================================================
+// FILE:
+//    DynamicOpcodeCounter.h
+//
+// DESCRIPTION:
+//    Declares the DynamicOpcodeCounter pass for the new pass manager.
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_DYNAMIC_OPCODE_COUNTER_H
+#define LLVM_TUTOR_DYNAMIC_OPCODE_COUNTER_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct DynamicOpcodeCounter : public llvm::PassInfoMixin<DynamicOpcodeCounter> {
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &);
+  bool runOnModule(llvm::Module &M);
+
+  // Without isRequired returning true, this pass will be skipped for functions
+  // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
+  // all functions with optnone.
+  static bool isRequired() { return true; }
+};
+
+#endif
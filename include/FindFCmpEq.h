@@ -12,6 +12,8 @@
 #ifndef LLVM_TUTOR_FIND_FCMP_EQ_H
 #define LLVM_TUTOR_FIND_FCMP_EQ_H
 
+#include "ResultWriter.h"
+
 #include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
 #include <vector>
@@ -51,13 +53,16 @@ private:
 //------------------------------------------------------------------------------
 class FindFCmpEqPrinter : public llvm::PassInfoMixin<FindFCmpEqPrinter> {
 public:
-  explicit FindFCmpEqPrinter(llvm::raw_ostream &OutStream) : OS(OutStream){};
+  explicit FindFCmpEqPrinter(llvm::raw_ostream &OutStream,
+                             ResultFormat Format = ResultFormat::Text)
+      : OS(OutStream), Format(Format){};
 
   llvm::PreservedAnalyses run(llvm::Function &Func,
                               llvm::FunctionAnalysisManager &FAM);
 
 private:
   llvm::raw_ostream &OS;
+  ResultFormat Format;
 };
 
 #endif // !LLVM_TUTOR_FIND_FCMP_EQ_H
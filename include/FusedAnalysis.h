@@ -0,0 +1,45 @@
+//==============================================================================
+// FILE:
+//    FusedAnalysis.h
+//
+// DESCRIPTION:
+//    Declares FusedAnalysis, a function analysis that computes the results of
+//    StaticCallCounter, OpcodeCounter and FindFCmpEq in one walk over the
+//    instructions of a function.
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_FUSED_ANALYSIS_H
+#define LLVM_TUTOR_FUSED_ANALYSIS_H
+
+#include "FindFCmpEq.h"
+#include "OpcodeCounter.h"
+#include "StaticCallCounter.h"
+
+#include "llvm/IR/PassManager.h"
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+// OpcodeCounter, FindFCmpEq and StaticCallCounter take their results from
+// this analysis whenever it is registered with the function analysis manager
+// (e.g. by the combined LLVMTutor plugin), so requesting all of them visits
+// every instruction once rather than three times. When it isn't registered
+// (e.g. in the individual plugins), they compute the results themselves.
+struct FusedAnalysis : public llvm::AnalysisInfoMixin<FusedAnalysis> {
+  struct Result {
+    // The direct calls made from this function (see StaticCallCounter)
+    ResultStaticCC DirectCalls;
+    ResultOpcodeCounter Opcodes;
+    FindFCmpEq::Result FCmpEqs;
+  };
+  Result run(llvm::Function &F, llvm::FunctionAnalysisManager &);
+
+private:
+  // Defined inline, so that the analyses above can check whether this one is
+  // registered without linking FusedAnalysis.cpp into their plugins.
+  static inline llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<FusedAnalysis>;
+};
+
+#endif // LLVM_TUTOR_FUSED_ANALYSIS_H
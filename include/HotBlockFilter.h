@@ -0,0 +1,70 @@
+//==============================================================================
+// FILE:
+//    HotBlockFilter.h
+//
+// DESCRIPTION:
+//    Declares a helper shared by the obfuscation passes (e.g. MBAAdd and
+//    MBASub) that limits the transformations in hot basic blocks, so that the
+//    slowdown of obfuscated builds is bounded.
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_HOT_BLOCK_FILTER_H
+#define LLVM_TUTOR_HOT_BLOCK_FILTER_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/PassManager.h"
+
+#include <cstdint>
+
+namespace llvm {
+class BasicBlock;
+class BlockFrequencyInfo;
+class Function;
+} // namespace llvm
+
+// A block is hot when it is estimated to run more than Threshold times. The
+// estimate is the frequency of the block relative to the entry block (as
+// computed by BlockFrequencyInfo), multiplied by the number of calls of the
+// function. The latter is taken from:
+//   * the DynamicCallCounter profile ProfileFile (generated with
+//     `-dynamic-cc-output=binary`) if one is provided, otherwise
+//   * the function entry count (if the module carries profile data),
+//     otherwise
+//   * it is 1, i.e. the threshold is relative to one call of the function.
+// Only HotPercentage percent of the eligible instructions in hot blocks are
+// transformed (all of them are transformed in the other blocks).
+class HotBlockFilter {
+public:
+  HotBlockFilter(uint64_t Threshold, unsigned HotPercentage,
+                 llvm::StringRef ProfileFile);
+
+  // Prepares the filter for the blocks of F. BlockFrequencyInfo is only
+  // requested when the filter is enabled.
+  void startFunction(llvm::Function &F, llvm::FunctionAnalysisManager &FAM);
+
+  // Returns the percentage of the eligible instructions in BB to transform
+  unsigned getPercentage(const llvm::BasicBlock &BB) const;
+
+  // Spreads the transformed instructions evenly over the block: returns true
+  // if the Idx-th eligible instruction (counting from 0) is to be transformed
+  // when only Percentage percent of them are.
+  static bool isSelected(unsigned Idx, unsigned Percentage) {
+    return (uint64_t(Idx) + 1) * Percentage / 100 >
+           uint64_t(Idx) * Percentage / 100;
+  }
+
+private:
+  uint64_t Threshold;
+  unsigned HotPercentage;
+  // The call counts read from the profile (null without a profile)
+  const llvm::StringMap<uint64_t> *CallCounts = nullptr;
+
+  // The state for the current function (BFI is null when the filter is
+  // disabled)
+  llvm::BlockFrequencyInfo *BFI = nullptr;
+  uint64_t NumCalls = 1;
+};
+
+#endif // LLVM_TUTOR_HOT_BLOCK_FILTER_H
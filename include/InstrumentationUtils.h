@@ -0,0 +1,85 @@
+//==============================================================================
+// FILE:
+//    InstrumentationUtils.h
+//
+// DESCRIPTION:
+//    Declares helpers shared by the instrumentation passes (e.g.
+//    DynamicCallCounter and EdgeProfiler) for generating the runtime code
+//    that is injected into the instrumented modules.
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_INSTRUMENTATION_UTILS_H
+#define LLVM_TUTOR_INSTRUMENTATION_UTILS_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+
+// Emits code at the insertion point of Builder that opens the file Path for
+// writing, i.e. `fopen(Path, "wb")`, and returns the resulting `FILE *` (null
+// on failure). `%p` in Path is replaced with the process ID of the
+// instrumented program.
+llvm::Value *emitFileOpen(llvm::IRBuilder<> &Builder, llvm::StringRef Path);
+
+// Emits code at the insertion point of Builder that writes Size bytes,
+// starting at Data, to the file Path. `%p` in Path is replaced with the
+// process ID of the instrumented program (so that every process writes its
+// own file). Nothing is written if the file cannot be opened.
+//
+// The insertion block of Builder is terminated. On return, Builder points at
+// a new, empty block in which the caller can continue inserting code.
+void emitWriteToFile(llvm::IRBuilder<> &Builder, llvm::Value *Data,
+                     uint64_t Size, llvm::StringRef Path);
+
+// Creates the thread-local countdown, `i32 Name`, that is used by
+// emitSamplingCheck. Every thread starts with the countdown set to Period.
+llvm::GlobalVariable *createSamplingCountdown(llvm::Module &M,
+                                              llvm::StringRef Name,
+                                              uint32_t Period);
+
+// Emits the following check at the top of F (after the static allocas in the
+// entry block):
+// ```
+//    if (--Countdown == 0) {
+//      Countdown = Period;
+//      // <- the returned insertion point
+//    }
+// ```
+// i.e. the code inserted at the returned instruction runs once every Period
+// entries to F (per thread). Entries that are not sampled only cost a
+// decrement and a branch (marked as likely).
+llvm::Instruction *emitSamplingCheck(llvm::Function &F,
+                                     llvm::GlobalVariable *Countdown,
+                                     uint32_t Period);
+
+// Defines `ptr Name()` that returns a buffer of type BufferTy owned by the
+// calling thread. It's equivalent to the following C function:
+// ```
+//    static _Thread_local struct Buffer *ThreadBuffer;
+//    static _Atomic uint32_t NextThread;
+//    struct Buffer *Name() {
+//      if (!ThreadBuffer) {
+//        struct Buffer *Buf = calloc(1, sizeof(struct Buffer));
+//        if (!Buf)
+//          return NULL;
+//        Buf->ThreadIdx = atomic_fetch_add_relaxed(&NextThread, 1);
+//        do
+//          Buf->Next = atomic_load_relaxed(List);
+//        while (!atomic_compare_exchange_release(List, Buf->Next, Buf));
+//        ThreadBuffer = Buf;
+//      }
+//      return ThreadBuffer;
+//    }
+// ```
+// i.e. the buffer is allocated (and zeroed) on the first call of every thread
+// and pushed onto List (an internal pointer global), so that the buffers of
+// all the threads can be read on exit. They are never freed. BufferTy must
+// start with `{ ptr Next, i32 ThreadIdx, ... }`. The names of the globals
+// that back the function start with Prefix.
+llvm::Function *createPerThreadBufferFunc(llvm::Module &M, llvm::StringRef Name,
+                                          llvm::StringRef Prefix,
+                                          llvm::StructType *BufferTy,
+                                          llvm::GlobalVariable *List);
+
+#endif // LLVM_TUTOR_INSTRUMENTATION_UTILS_H
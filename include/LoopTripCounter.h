@@ -0,0 +1,103 @@
+//==============================================================================
+// FILE:
+//    LoopTripCounter.h
+//
+// DESCRIPTION:
+//    Declares the LoopTripCounter passes for the new pass manager:
+//      * LoopTripCounter instruments the loops of a module to record their
+//        trip counts at runtime, and
+//      * LoopTripCountAnnotator attaches the recorded trip counts to the
+//        loops as loop metadata.
+//    It also defines the helpers that the loop passes (e.g. SimpleLICM and
+//    DerivedInductionVars) use to read that metadata. These are inline, so
+//    that the passes don't need to link against this plugin.
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_LOOP_TRIP_COUNTER_H
+#define LLVM_TUTOR_LOOP_TRIP_COUNTER_H
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+
+#include <cstdint>
+#include <optional>
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct LoopTripCounter : public llvm::PassInfoMixin<LoopTripCounter> {
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+  bool runOnModule(llvm::Module &M, llvm::FunctionAnalysisManager &FAM);
+
+  // Without isRequired returning true, this pass will be skipped for functions
+  // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
+  // all functions with optnone.
+  static bool isRequired() { return true; }
+};
+
+struct LoopTripCountAnnotator
+    : public llvm::PassInfoMixin<LoopTripCountAnnotator> {
+  llvm::PreservedAnalyses run(llvm::Function &F,
+                              llvm::FunctionAnalysisManager &FAM);
+};
+
+//------------------------------------------------------------------------------
+// Loop metadata
+//------------------------------------------------------------------------------
+// LoopTripCountAnnotator adds the following properties to the loop ID of
+// every loop in the profile:
+//    !{!"llvm-tutor.loop.trip_count", i64 Entries, i64 Iterations, i64 Max}
+//    !{!"llvm-tutor.loop.trip_count.histogram", i64 Bucket0, i64 Bucket1, ...}
+// (see LoopProfileLoop in LoopTripCounterProfile.h for the meaning of the
+// values). Trailing empty buckets are left out of the histogram.
+constexpr const char *LoopTripCountMDName = "llvm-tutor.loop.trip_count";
+constexpr const char *LoopTripCountHistogramMDName =
+    "llvm-tutor.loop.trip_count.histogram";
+
+// The trip counts recorded for one loop
+struct LoopTripCountInfo {
+  uint64_t Entries;
+  uint64_t Iterations;
+  uint64_t MaxTripCount;
+
+  // The mean trip count (0 for loops that were never entered)
+  double getMean() const {
+    return Entries ? double(Iterations) / double(Entries) : 0.0;
+  }
+};
+
+// Returns the trip counts attached to L, if any
+inline std::optional<LoopTripCountInfo>
+getLoopTripCountInfo(const llvm::Loop &L) {
+  llvm::MDNode *MD = llvm::findOptionMDForLoop(&L, LoopTripCountMDName);
+  if (!MD || MD->getNumOperands() != 4)
+    return std::nullopt;
+
+  uint64_t Values[3];
+  for (unsigned Idx = 0; Idx != 3; ++Idx) {
+    auto *Value =
+        llvm::mdconst::dyn_extract<llvm::ConstantInt>(MD->getOperand(Idx + 1));
+    if (!Value)
+      return std::nullopt;
+    Values[Idx] = Value->getZExtValue();
+  }
+  return LoopTripCountInfo{Values[0], Values[1], Values[2]};
+}
+
+// Returns true if L has a profile and its mean trip count is below MinTripCount
+// (0 disables the check). Loops without a profile are never below the
+// threshold, so that passes keep their default behaviour for them.
+inline bool isBelowMinTripCount(const llvm::Loop &L, unsigned MinTripCount) {
+  if (!MinTripCount)
+    return false;
+  std::optional<LoopTripCountInfo> Info = getLoopTripCountInfo(L);
+  return Info && Info->getMean() < double(MinTripCount);
+}
+
+#endif // LLVM_TUTOR_LOOP_TRIP_COUNTER_H
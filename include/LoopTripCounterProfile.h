@@ -0,0 +1,86 @@
+//==============================================================================
+// FILE:
+//    LoopTripCounterProfile.h
+//
+// DESCRIPTION:
+//    Describes the binary profiles written by LoopTripCounter and read by
+//    `loop-tc-annotate` and `dcc-profdata`. Like the other profiles (see
+//    DynamicCallCounterProfile.h), a profile is a single, flat image of the
+//    section that the instrumented module updates at runtime:
+//
+//      +------------------------------------------+
+//      | LoopProfileHeader                        |
+//      +------------------------------------------+
+//      | LoopProfileFunction[Header.NumFunctions] |
+//      +------------------------------------------+
+//      | LoopProfileLoop[Header.NumLoops]         |
+//      +------------------------------------------+
+//      | function names (Header.NamesSize bytes)  |
+//      +------------------------------------------+
+//
+//    The names are stored back-to-back and are not NUL-terminated. All the
+//    fields are naturally aligned, so that a profile can be mmap-ed and used
+//    in place. Integers are stored in the byte order of the machine that
+//    generated the profile.
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_LOOP_TRIP_COUNTER_PROFILE_H
+#define LLVM_TUTOR_LOOP_TRIP_COUNTER_PROFILE_H
+
+#include <cstdint>
+
+// "\xffltloop" when read as a little-endian integer
+constexpr uint64_t LoopProfileMagic = 0x706f6f6c746cffULL;
+constexpr uint32_t LoopProfileVersion = 2;
+
+// The trip counts of every loop are recorded in a histogram with power-of-two
+// buckets: bucket 0 counts the loop entries with a trip count of 0 and bucket
+// B > 0 those with a trip count in [2^(B-1), 2^B). The last bucket also counts
+// all the longer trips.
+constexpr unsigned LoopProfileNumBuckets = 16;
+
+struct LoopProfileHeader {
+  uint64_t Magic;
+  uint32_t Version;
+  uint32_t NumFunctions;
+  uint32_t NumLoops;
+  uint32_t Reserved;
+  // The size of the name table in bytes
+  uint64_t NamesSize;
+};
+
+struct LoopProfileFunction {
+  // The location of the function name in the name table
+  uint32_t NameOffset;
+  uint32_t NameSize;
+  // The number of basic blocks (used to detect stale profiles)
+  uint32_t NumBlocks;
+  // The loops of this function are Loops[FirstLoop, FirstLoop + NumLoops)
+  uint32_t FirstLoop;
+  uint32_t NumLoops;
+  uint32_t Reserved;
+};
+
+// The trip count of a loop is the number of iterations that it runs between
+// entering the loop and leaving it. Entries that the loop guard skips (if
+// any) count as trips of 0 (see LoopTripCounter.cpp).
+struct LoopProfileLoop {
+  // The position of the loop header in the function (starting from 1)
+  uint32_t Header;
+  // The loop depth (1 for the outermost loops)
+  uint32_t Depth;
+  // The number of times the loop was entered and left, i.e. the number of
+  // recorded trips
+  uint64_t Entries;
+  // The sum and the maximum of the recorded trip counts
+  uint64_t Iterations;
+  uint64_t MaxTripCount;
+  uint64_t Buckets[LoopProfileNumBuckets];
+};
+
+static_assert(sizeof(LoopProfileHeader) == 32, "Unexpected header layout");
+static_assert(sizeof(LoopProfileFunction) == 24, "Unexpected record layout");
+static_assert(sizeof(LoopProfileLoop) == 160, "Unexpected loop layout");
+
+#endif // LLVM_TUTOR_LOOP_TRIP_COUNTER_PROFILE_H
@@ -20,7 +20,8 @@
 struct MBAAdd : public llvm::PassInfoMixin<MBAAdd> {
   llvm::PreservedAnalyses run(llvm::Function &F,
                               llvm::FunctionAnalysisManager &);
-  bool runOnBasicBlock(llvm::BasicBlock &B);
+  // Obfuscates Percentage percent of the eligible additions in B
+  bool runOnBasicBlock(llvm::BasicBlock &B, unsigned Percentage = 100);
 
   // Without isRequired returning true, this pass will be skipped for functions
   // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
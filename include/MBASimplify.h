@@ -0,0 +1,31 @@
+//========================================================================
+// FILE:
+//    MBASimplify.h
+//
+// DESCRIPTION:
+//    Declares the MBASimplify pass for the new pass manager.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_MBA_SIMPLIFY_H
+#define LLVM_TUTOR_MBA_SIMPLIFY_H
+
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+
+// PassInfoMixIn is a CRTP mix-in to automatically provide informational APIs
+// needed for passes. Currently it provides only the 'name' method.
+struct MBASimplify : public llvm::PassInfoMixin<MBASimplify> {
+  llvm::PreservedAnalyses run(llvm::Function &F,
+                              llvm::FunctionAnalysisManager &);
+  // Tries to simplify the expression rooted at I. Returns the replacement
+  // for I (already inserted before I) or nullptr.
+  llvm::Value *simplify(llvm::Instruction &I);
+
+  // Without isRequired returning true, this pass will be skipped for functions
+  // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
+  // all functions with optnone.
+  static bool isRequired() { return true; }
+};
+#endif
@@ -10,6 +10,9 @@
 #ifndef LLVM_TUTOR_MERGEBBS_H
 #define LLVM_TUTOR_MERGEBBS_H
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/DomTreeUpdater.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
@@ -24,59 +27,58 @@ struct MergeBB : public llvm::PassInfoMixin<MergeBB> {
   llvm::PreservedAnalyses run(llvm::Function &F,
                               llvm::FunctionAnalysisManager &);
 
-  // Checks whether the input instruction Inst (that has exactly one use) can be
-  // removed. This is the case when its only user is either:
-  //  1) a PHI (it can be easily updated if Inst is removed), or
+  // Maps instructions from one block to the corresponding instructions (i.e.
+  // at the same position) in another block
+  using InstMap = llvm::DenseMap<const llvm::Value *, const llvm::Value *>;
+
+  // Checks whether the input instruction Inst can be removed. This is the case
+  // when all its users are either:
+  //  1) PHIs for the edges from Inst's block (they can be easily updated if
+  //     Inst is removed), or
   //  2) located in the same block as Inst (if that block is removed then the
-  //     user will also be removed)
+  //     users will also be removed)
   bool canRemoveInst(const llvm::Instruction *Inst);
 
-  // Instructions in Insts belong to different blocks that unconditionally
-  // branch to a common successor. Analyze them and return true if it would be
-  // possible to merge them, i.e. replace Inst1 with Inst2 (or vice-versa).
-  bool canMergeInstructions(llvm::ArrayRef<llvm::Instruction *> Insts);
+  // Instructions in Insts belong to different blocks, at the same position.
+  // Analyze them and return true if it would be possible to merge them, i.e.
+  // replace Inst1 with Inst2. Corresponding maps the instructions from the
+  // block of Inst1 to the instructions from the block of Inst2.
+  bool canMergeInstructions(llvm::ArrayRef<llvm::Instruction *> Insts,
+                            const InstMap &Corresponding);
+
+  // Returns true if V1 and V2 are the same value, or if V1 is defined by an
+  // instruction that corresponds to V2
+  static bool areValuesEquivalent(const llvm::Value *V1, const llvm::Value *V2,
+                                  const InstMap &Corresponding);
+
+  // Returns true if BB1 can be replaced with BB2
+  bool areBlocksIdentical(llvm::BasicBlock *BB1, llvm::BasicBlock *BB2);
 
-  // Replace the destination of incoming edges of BBToErase by BBToRetain
+  // Replace the destination of incoming edges of BBToErase by BBToRetain. If
+  // DTU is set, the dominator tree is updated accordingly.
   unsigned updateBranchTargets(llvm::BasicBlock *BBToErase,
-                               llvm::BasicBlock *BBToRetain);
+                               llvm::BasicBlock *BBToRetain,
+                               llvm::DomTreeUpdater *DTU = nullptr);
 
-  // If BB is duplicated, then merges BB with its duplicate and adds BB to
-  // DeleteList. DeleteList contains the list of blocks to be deleted.
+  // If BB is identical to one of Candidates, then merges BB with that block
+  // and adds BB to DeleteList. DeleteList contains the list of blocks to be
+  // deleted.
   bool
   mergeDuplicatedBlock(llvm::BasicBlock *BB,
+                       llvm::ArrayRef<llvm::BasicBlock *> Candidates,
                        llvm::SmallPtrSet<llvm::BasicBlock *, 8> &DeleteList);
 
+  // Merges the identical blocks in F until there's nothing left to merge
+  // (i.e. also the blocks that only become identical after other blocks are
+  // merged). After every merge, only the blocks affected by it are
+  // revisited. The merged blocks are deleted straight away. Returns true if
+  // F was changed.
+  bool mergeToFixpoint(llvm::Function &F, llvm::DomTreeUpdater &DTU);
+
   // Without isRequired returning true, this pass will be skipped for functions
   // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
   // all functions with optnone.
   static bool isRequired() { return true; }
 };
 
-//------------------------------------------------------------------------------
-// Helper data structures
-//------------------------------------------------------------------------------
-// Iterates through instructions in BB1 and BB2 in reverse order from the first
-// non-debug instruction. For example (assume all blocks have size n):
-//   LockstepReverseIterator I(BB1, BB2);
-//   *I-- = [BB1[n], BB2[n]];
-//   *I-- = [BB1[n-1], BB2[n-1]];
-//   *I-- = [BB1[n-2], BB2[n-2]];
-//   ...
-class LockstepReverseIterator {
-  llvm::BasicBlock *BB1;
-  llvm::BasicBlock *BB2;
-
-  llvm::SmallVector<llvm::Instruction *, 2> Insts;
-  bool Fail;
-
-public:
-  LockstepReverseIterator(llvm::BasicBlock *BB1In, llvm::BasicBlock *BB2In);
-
-  llvm::Instruction *getLastNonDbgInst(llvm::BasicBlock *BB);
-  bool isValid() const { return !Fail; }
-
-  void operator--();
-
-  llvm::ArrayRef<llvm::Instruction *> operator*() const { return Insts; }
-};
 #endif
@@ -6,14 +6,18 @@
 //    Declares the OpcodeCounter Passes:
 //      * new pass manager interface
 //      * printer pass for the new pass manager
+//      * module-level printer pass for the new pass manager
 //
 // License: MIT
 //==============================================================================
 #ifndef LLVM_TUTOR_OPCODECOUNTER_H
 #define LLVM_TUTOR_OPCODECOUNTER_H
 
-#include "llvm/ADT/StringMap.h"
+#include "OpcodeHistogram.h"
+#include "ResultWriter.h"
+
 #include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
@@ -21,7 +25,7 @@
 //------------------------------------------------------------------------------
 // New PM interface
 //------------------------------------------------------------------------------
-using ResultOpcodeCounter = llvm::StringMap<unsigned>;
+using ResultOpcodeCounter = OpcodeHistogram;
 
 struct OpcodeCounter : public llvm::AnalysisInfoMixin<OpcodeCounter> {
   using Result = ResultOpcodeCounter;
@@ -29,6 +33,9 @@ struct OpcodeCounter : public llvm::AnalysisInfoMixin<OpcodeCounter> {
                               llvm::FunctionAnalysisManager &);
 
   OpcodeCounter::Result generateOpcodeMap(llvm::Function &F);
+  // Returns an empty histogram, configured by the command line options (e.g.
+  // -opcode-counter-by-type)
+  static Result createEmptyResult();
   // Part of the official API:
   //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
   static bool isRequired() { return true; }
@@ -45,7 +52,9 @@ private:
 //------------------------------------------------------------------------------
 class OpcodeCounterPrinter : public llvm::PassInfoMixin<OpcodeCounterPrinter> {
 public:
-  explicit OpcodeCounterPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  explicit OpcodeCounterPrinter(llvm::raw_ostream &OutS,
+                                ResultFormat Format = ResultFormat::Text)
+      : OS(OutS), Format(Format) {}
   llvm::PreservedAnalyses run(llvm::Function &Func,
                               llvm::FunctionAnalysisManager &FAM);
   // Part of the official API:
@@ -54,5 +63,26 @@ public:
 
 private:
   llvm::raw_ostream &OS;
+  ResultFormat Format;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the module-level printer pass
+//------------------------------------------------------------------------------
+// Merges the per-function results (obtained via the function analysis
+// manager, so cached results are reused) into one histogram for the module.
+class OpcodeCounterModulePrinter
+    : public llvm::PassInfoMixin<OpcodeCounterModulePrinter> {
+public:
+  explicit OpcodeCounterModulePrinter(llvm::raw_ostream &OutS,
+                                      ResultFormat Format = ResultFormat::Text)
+      : OS(OutS), Format(Format) {}
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+  ResultFormat Format;
 };
 #endif
@@ -0,0 +1,66 @@
+//==============================================================================
+// FILE:
+//    OpcodeHistogram.h
+//
+// DESCRIPTION:
+//    Declares OpcodeHistogram, the opcode counting engine shared by
+//    OpcodeCounter and DynamicOpcodeCounter.
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_OPCODE_HISTOGRAM_H
+#define LLVM_TUTOR_OPCODE_HISTOGRAM_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Instruction.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Opcode histogram
+//------------------------------------------------------------------------------
+// A dense histogram of opcodes, indexed by Instruction::getOpcode() (and,
+// for the per-type breakdown, by the class of the result type). Counting an
+// instruction is a couple of array increments - the opcode names are only
+// looked up when the histogram is printed.
+struct OpcodeHistogram {
+  // Opcodes are numbered from 1 (see llvm/IR/Instruction.def)
+  static constexpr unsigned NumOpcodes = llvm::Instruction::OtherOpsEnd;
+
+  // The coarse classes of the result types used for the breakdown
+  enum TypeClass : unsigned { Void, Int, FP, Ptr, Vector, Other };
+  static constexpr unsigned NumTypeClasses = Other + 1;
+  static TypeClass getTypeClass(const llvm::Type *Ty);
+  static const char *getTypeClassName(unsigned TC);
+
+  explicit OpcodeHistogram(bool TrackTypes = false) {
+    if (TrackTypes)
+      CountsByType.resize(NumOpcodes);
+  }
+
+  std::array<uint64_t, NumOpcodes> Counts{};
+  // Empty unless the histogram tracks the result types (the breakdown is
+  // much larger than Counts and is only computed when requested)
+  std::vector<std::array<uint64_t, NumTypeClasses>> CountsByType;
+  // The opcodes that occur at least once, in the order of their first
+  // occurrence. This makes the order of the printed results independent of
+  // the numbering of opcodes.
+  llvm::SmallVector<unsigned, 16> Opcodes;
+
+  void add(const llvm::Instruction &Inst) {
+    unsigned Opcode = Inst.getOpcode();
+    if (0 == Counts[Opcode]++)
+      Opcodes.push_back(Opcode);
+    if (!CountsByType.empty())
+      ++CountsByType[Opcode][getTypeClass(Inst.getType())];
+  }
+  void merge(const OpcodeHistogram &Other);
+
+  // Returns Opcodes in the order in which the results are printed (see
+  // OpcodeCounterPrinter)
+  llvm::SmallVector<unsigned, 16> getPrintOrder() const;
+};
+
+#endif
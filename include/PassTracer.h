@@ -0,0 +1,94 @@
+//==============================================================================
+// FILE:
+//    PassTracer.h
+//
+// DESCRIPTION:
+//    Declares PassTracer, which records the wall time and the change of the
+//    resident set size of every pass and every analysis run by the new pass
+//    manager (through PassInstrumentationCallbacks).
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_PASS_TRACER_H
+#define LLVM_TUTOR_PASS_TRACER_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class Any;
+class PassInstrumentationCallbacks;
+class raw_ostream;
+} // namespace llvm
+
+class PassTracer {
+public:
+  // One completed run of a pass or an analysis
+  struct Event {
+    // The name of the pass (these names are static strings)
+    llvm::StringRef PassName;
+    // The IR unit that it ran on, and the function that contains it (empty
+    // for modules and SCCs)
+    std::string IRName;
+    std::string FunctionName;
+    // In nanoseconds since the tracer was created
+    uint64_t BeginNs = 0;
+    uint64_t DurationNs = 0;
+    // The duration minus the durations of the nested passes and analyses
+    uint64_t SelfNs = 0;
+    int64_t RSSDeltaKB = 0;
+    bool IsAnalysis = false;
+  };
+
+  PassTracer();
+  // Writes the trace and the summary
+  ~PassTracer();
+
+  void registerCallbacks(llvm::PassInstrumentationCallbacks &PIC);
+
+  // Writes all the events in the Chrome trace format (see
+  // https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU)
+  void writeChromeTrace(llvm::raw_ostream &OS) const;
+  // Prints the TopN passes and functions that take the most (self) time
+  void printSummary(llvm::raw_ostream &OS, unsigned TopN) const;
+
+private:
+  // A pass or an analysis that has started and not finished yet
+  struct OpenFrame {
+    llvm::StringRef PassName;
+    std::string IRName;
+    std::string FunctionName;
+    uint64_t BeginNs;
+    uint64_t ChildNs;
+    uint64_t RSSKB;
+    bool IsAnalysis;
+  };
+
+  // The events of one thread. Only that thread appends to it, so no locking
+  // is needed on the hot path.
+  struct ThreadBuffer {
+    unsigned ThreadIdx;
+    std::vector<Event> Events;
+    llvm::SmallVector<OpenFrame, 16> Stack;
+  };
+
+  ThreadBuffer &getThreadBuffer();
+  uint64_t now() const;
+  void begin(llvm::StringRef PassName, const llvm::Any &IR, bool IsAnalysis);
+  void end();
+
+  std::chrono::steady_clock::time_point Start;
+  // Guards Buffers, which is only modified when a thread records its first
+  // event
+  mutable std::mutex BuffersLock;
+  std::vector<std::unique_ptr<ThreadBuffer>> Buffers;
+};
+
+#endif
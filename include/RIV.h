@@ -7,26 +7,182 @@
 //      * new pass manager interface
 //      * legacy pass manager interface
 //      * printer pass for the new pass manager
+//      * lazy (query-based) variant of RIV and its printer pass
 //
 // License: MIT
 //========================================================================
 #ifndef LLVM_TUTOR_RIV_H
 #define LLVM_TUTOR_RIV_H
 
-#include "llvm/ADT/MapVector.h"
-#include "llvm/ADT/SmallPtrSet.h"
+#include "ResultWriter.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/Pass.h"
 
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// RIV results
+//------------------------------------------------------------------------------
+// The RIV set of a block BB is made of the integer values defined in the
+// blocks that strictly dominate BB (the immediate dominator first, the entry
+// block last), followed by the integer globals and arguments. Rather than
+// copying these values into a separate set for every block, every block that
+// dominates other blocks contributes one node to a tree of "chains" that
+// mirrors the dominator tree. A node holds the values defined in its block
+// (stored contiguously in RIVChains::Values) and links to the node of the
+// immediate dominator. The RIV set of BB is then just the chain that starts
+// at the node of its immediate dominator, so the memory used by the analysis
+// is linear in the size of the function.
+struct RIVChains {
+  static constexpr unsigned NoParent = ~0U;
+
+  struct Node {
+    // The node of the immediate dominator (or NoParent)
+    unsigned Parent;
+    // The values contributed by this node are Values[Begin, End)
+    unsigned Begin;
+    unsigned End;
+    // The total number of values in the chain that starts at this node
+    size_t ChainSize;
+  };
+
+  std::vector<Node> Nodes;
+  std::vector<llvm::Value *> Values;
+};
+
+// A read-only view of the RIV set of one basic block. Iterating over it
+// visits the values in the order described above.
+class RIVSet {
+public:
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = llvm::Value *;
+    using difference_type = std::ptrdiff_t;
+    using pointer = llvm::Value *const *;
+    using reference = llvm::Value *const &;
+
+    iterator() = default;
+    reference operator*() const { return Chains->Values[Pos]; }
+    iterator &operator++() {
+      ++Pos;
+      skipExhaustedNodes();
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator Tmp = *this;
+      ++*this;
+      return Tmp;
+    }
+    bool operator==(const iterator &Other) const {
+      return NodeIdx == Other.NodeIdx && Pos == Other.Pos;
+    }
+    bool operator!=(const iterator &Other) const { return !(*this == Other); }
+
+  private:
+    friend class RIVSet;
+    iterator(const RIVChains *Chains, unsigned NodeIdx)
+        : Chains(Chains), NodeIdx(NodeIdx) {
+      if (RIVChains::NoParent != NodeIdx)
+        Pos = Chains->Nodes[NodeIdx].Begin;
+      skipExhaustedNodes();
+    }
+    // Moves to the next node in the chain that has values left
+    void skipExhaustedNodes() {
+      while (RIVChains::NoParent != NodeIdx &&
+             Pos == Chains->Nodes[NodeIdx].End) {
+        NodeIdx = Chains->Nodes[NodeIdx].Parent;
+        Pos = (RIVChains::NoParent == NodeIdx) ? 0
+                                                : Chains->Nodes[NodeIdx].Begin;
+      }
+    }
+
+    const RIVChains *Chains = nullptr;
+    unsigned NodeIdx = RIVChains::NoParent;
+    unsigned Pos = 0;
+  };
+
+  RIVSet() = default;
+  RIVSet(const RIVChains *Chains, unsigned Head) : Chains(Chains), Head(Head) {}
+
+  size_t size() const {
+    return (RIVChains::NoParent == Head) ? 0 : Chains->Nodes[Head].ChainSize;
+  }
+  bool empty() const { return 0 == size(); }
+  iterator begin() const { return iterator(Chains, Head); }
+  iterator end() const { return iterator(Chains, RIVChains::NoParent); }
+
+  // Returns the Idx-th value of this set. The cost is proportional to the
+  // number of dominators that have to be skipped, not to Idx.
+  llvm::Value *operator[](size_t Idx) const {
+    unsigned NodeIdx = Head;
+    for (;;) {
+      const RIVChains::Node &N = Chains->Nodes[NodeIdx];
+      if (Idx < N.End - N.Begin)
+        return Chains->Values[N.Begin + Idx];
+      Idx -= N.End - N.Begin;
+      NodeIdx = N.Parent;
+    }
+  }
+
+private:
+  const RIVChains *Chains = nullptr;
+  unsigned Head = RIVChains::NoParent;
+};
+
+// The results of RIV: the RIV set of every basic block reachable from the
+// entry block, in the order in which the dominator tree is traversed.
+// Iterating over it yields (block, RIVSet) pairs.
+class RIVResult {
+public:
+  using value_type = std::pair<const llvm::BasicBlock *, RIVSet>;
+  using const_iterator = std::vector<value_type>::const_iterator;
+
+  RIVResult() : Chains(std::make_unique<RIVChains>()) {}
+  // The sets refer to the chains owned by this object, so copying is not
+  // allowed (moving is fine)
+  RIVResult(RIVResult &&) = default;
+  RIVResult &operator=(RIVResult &&) = default;
+  RIVResult(const RIVResult &) = delete;
+  RIVResult &operator=(const RIVResult &) = delete;
+
+  // Returns the RIV set of BB (empty if BB is unreachable)
+  RIVSet lookup(const llvm::BasicBlock *BB) const {
+    auto Entry = BlockIdx.find(BB);
+    return (BlockIdx.end() == Entry) ? RIVSet() : Blocks[Entry->second].second;
+  }
+  size_t size() const { return Blocks.size(); }
+  const_iterator begin() const { return Blocks.begin(); }
+  const_iterator end() const { return Blocks.end(); }
+
+  // Creates a new node for the values in [Begin, End) (that have already
+  // been appended to getChains().Values) and returns its index
+  unsigned addNode(unsigned Parent, unsigned Begin, unsigned End);
+  // Records that Head is the RIV chain of BB
+  void addBlock(const llvm::BasicBlock *BB, unsigned Head);
+  RIVChains &getChains() { return *Chains; }
+
+private:
+  std::unique_ptr<RIVChains> Chains;
+  std::vector<value_type> Blocks;
+  llvm::DenseMap<const llvm::BasicBlock *, unsigned> BlockIdx;
+};
+
 //------------------------------------------------------------------------------
 // New PM interface
 //------------------------------------------------------------------------------
 struct RIV : public llvm::AnalysisInfoMixin<RIV> {
-  // A map that for every basic block holds a set of pointers to reachable
-  // integer values for that block.
-  using Result = llvm::MapVector<llvm::BasicBlock const *,
-                                 llvm::SmallPtrSet<llvm::Value *, 8>>;
+  // For every basic block, the set of pointers to reachable integer values
+  // for that block.
+  using Result = RIVResult;
   Result run(llvm::Function &F, llvm::FunctionAnalysisManager &);
   Result buildRIV(llvm::Function &F,
                   llvm::DomTreeNodeBase<llvm::BasicBlock> *CFGRoot);
@@ -38,17 +194,102 @@ private:
   friend struct llvm::AnalysisInfoMixin<RIV>;
 };
 
+//------------------------------------------------------------------------------
+// Lazy RIV queries
+//------------------------------------------------------------------------------
+// Answers queries about the RIV sets (as computed by RIV) without computing
+// any of the sets. The integer values defined in a block are only collected
+// when a query needs them, and "is V reachable in BB" is answered with the
+// DFS in/out numbers of the dominator tree. Users that only need a few
+// queries (e.g. one random value per block) don't pay for the rest.
+//
+// The values are indexed in the same order as RIVSet, i.e.
+// getRIV(BB, K) == RIV::Result::lookup(BB)[K].
+class LazyRIVResult {
+public:
+  LazyRIVResult(llvm::Function &F, llvm::DominatorTree &DT) : F(F), DT(DT) {}
+
+  // Is V a reachable integer value in BB?
+  bool isReachable(const llvm::Value *V, const llvm::BasicBlock *BB);
+  // The number of reachable integer values in BB
+  size_t getNumRIVs(const llvm::BasicBlock *BB);
+  // The K-th reachable integer value in BB (K < getNumRIVs(BB)). The cost is
+  // proportional to the number of dominators of BB that are skipped.
+  llvm::Value *getRIV(const llvm::BasicBlock *BB, size_t K);
+  // Answers many getRIV queries, given as (BB, K) pairs, at once. This
+  // traverses the dominator tree once, keeping the RIVs of the current block
+  // on a stack, so that every query is answered in O(1). Results[I] is the
+  // answer to Queries[I].
+  void getRIVs(llvm::ArrayRef<std::pair<const llvm::BasicBlock *, size_t>>
+                   Queries,
+               llvm::SmallVectorImpl<llvm::Value *> &Results);
+
+  // The result refers to the dominator tree, so it has to be invalidated
+  // together with it
+  bool invalidate(llvm::Function &F, const llvm::PreservedAnalyses &PA,
+                  llvm::FunctionAnalysisManager::Invalidator &Inv);
+
+private:
+  // Returns the integer values contributed by BB to the RIV sets of the
+  // blocks that it dominates (collected on first use). This is the same for
+  // the entry block: the globals and the arguments are kept separately (see
+  // getEntryRIVs).
+  llvm::ArrayRef<llvm::Value *> getDefs(const llvm::BasicBlock *BB);
+  // Returns the integer globals and arguments, i.e. the RIVs of the entry
+  llvm::ArrayRef<llvm::Value *> getEntryRIVs();
+
+  llvm::Function &F;
+  llvm::DominatorTree &DT;
+  bool DFSNumbersValid = false;
+
+  // Collected values - the values of a block are Values[Begin, End)
+  std::vector<llvm::Value *> Values;
+  llvm::DenseMap<const llvm::BasicBlock *, std::pair<unsigned, unsigned>>
+      DefsRange;
+  std::pair<unsigned, unsigned> EntryRIVsRange{0, 0};
+  bool EntryRIVsCollected = false;
+  // Memoised results of getNumRIVs
+  llvm::DenseMap<const llvm::BasicBlock *, size_t> NumRIVs;
+};
+
+struct LazyRIV : public llvm::AnalysisInfoMixin<LazyRIV> {
+  using Result = LazyRIVResult;
+  Result run(llvm::Function &F, llvm::FunctionAnalysisManager &);
+
+private:
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<LazyRIV>;
+};
+
 //------------------------------------------------------------------------------
 // New PM interface for the printer pass
 //------------------------------------------------------------------------------
 class RIVPrinter : public llvm::PassInfoMixin<RIVPrinter> {
 public:
-  explicit RIVPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  explicit RIVPrinter(llvm::raw_ostream &OutS,
+                      ResultFormat Format = ResultFormat::Text)
+      : OS(OutS), Format(Format) {}
+  llvm::PreservedAnalyses run(llvm::Function &F,
+                              llvm::FunctionAnalysisManager &FAM);
+
+private:
+  llvm::raw_ostream &OS;
+  ResultFormat Format;
+};
+
+// Prints the same results as RIVPrinter (in the layout order of the blocks),
+// but computed with LazyRIV queries
+class LazyRIVPrinter : public llvm::PassInfoMixin<LazyRIVPrinter> {
+public:
+  explicit LazyRIVPrinter(llvm::raw_ostream &OutS,
+                          ResultFormat Format = ResultFormat::Text)
+      : OS(OutS), Format(Format) {}
   llvm::PreservedAnalyses run(llvm::Function &F,
                               llvm::FunctionAnalysisManager &FAM);
 
 private:
   llvm::raw_ostream &OS;
+  ResultFormat Format;
 };
 
 #endif // LLVM_TUTOR_RIV_H
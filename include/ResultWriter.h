@@ -0,0 +1,134 @@
+//==============================================================================
+// FILE:
+//    ResultWriter.h
+//
+// DESCRIPTION:
+//    Declares ResultWriter, the structured output shared by the printer
+//    passes (e.g. `print<static-cc>`, `print<opcode-counter>` and
+//    `print<riv>`). Next to the human-readable tables (the default), every
+//    printer can write its results as a stream of flat records, either as
+//    JSON lines (one object per line) or in a compact binary format (see
+//    below, `dcc-profdata show` decodes it into JSON lines). The format is
+//    selected with `-<pass>-format` and the output file with
+//    `-<pass>-output`.
+//
+//    Records are written straight to the output stream, field by field, so
+//    nothing is buffered (or allocated) per record.
+//
+//    Binary result stream:
+//
+//      +------------------------------------------+
+//      | ResultStreamHeader                       |
+//      | record ... record                        |
+//      +------------------------------------------+
+//      | ... (more chunks until the end of file)  |
+//      +------------------------------------------+
+//
+//    Unlike the profiles (see DynamicCallCounterProfile.h), result streams
+//    are written sequentially and are not meant to be used in place. After
+//    the header, everything is encoded as ULEB128 integers and strings (a
+//    ULEB128 length followed by the bytes):
+//
+//      record := ResultRecordTag field* ResultRecordEnd
+//      field  := key (ResultFieldUnsigned integer | ResultFieldString string)
+//
+//    The key is the index of the field name + 1. Names are numbered in the
+//    order of their first use in the chunk; the first use of a name is
+//    followed by the name itself (as a string). Every chunk starts with a
+//    header and has its own numbering, so streams can be concatenated. The
+//    header is stored in the byte order of the machine that wrote it.
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_RESULT_WRITER_H
+#define LLVM_TUTOR_RESULT_WRITER_H
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <optional>
+
+namespace llvm {
+class ModuleSlotTracker;
+class Value;
+} // namespace llvm
+
+enum class ResultFormat { Text, JSONLines, Binary };
+
+// "\xffltrslt" when read as a little-endian integer
+constexpr uint64_t ResultStreamMagic = 0x746c7372746cffULL;
+constexpr uint32_t ResultStreamVersion = 1;
+
+struct ResultStreamHeader {
+  uint64_t Magic;
+  uint32_t Version;
+  uint32_t Reserved;
+};
+
+static_assert(sizeof(ResultStreamHeader) == 16, "Unexpected header layout");
+
+// The tags of the records and of the field types in result streams
+constexpr uint8_t ResultRecordTag = 1;
+constexpr uint8_t ResultRecordEnd = 0;
+constexpr uint8_t ResultFieldUnsigned = 0;
+constexpr uint8_t ResultFieldString = 1;
+
+// The values of the `-<pass>-format` options, i.e.
+//    cl::opt<ResultFormat> Format("<pass>-format", ...,
+//                                 getResultFormatValues(),
+//                                 cl::init(ResultFormat::Text));
+llvm::cl::ValuesClass getResultFormatValues();
+
+// Returns the (buffered) stream for the results written to Path, or Default
+// if Path is empty (or cannot be opened). The file is created on the first
+// call and shared by all the callers that use the same Path, so that several
+// printers can write to one file. It's closed on exit.
+llvm::raw_ostream &getResultStream(llvm::StringRef Path,
+                                   llvm::raw_ostream &Default);
+
+// Writes records of Analysis (the name of the printer, e.g. "static-cc") to
+// OS. Every record starts with {"analysis": Analysis} and is followed by the
+// fields added between beginRecord() and endRecord().
+//
+// The field names must outlive the writer (in practice, they are string
+// literals).
+class ResultWriter {
+public:
+  // Format must not be ResultFormat::Text (the printers print the tables
+  // themselves)
+  ResultWriter(llvm::raw_ostream &OS, ResultFormat Format,
+               llvm::StringRef Analysis);
+
+  void beginRecord();
+  void endRecord();
+
+  void attribute(llvm::StringRef Key, llvm::StringRef Value);
+  void attribute(llvm::StringRef Key, uint64_t Value);
+  // Adds V as printed by the IR printer (MST avoids re-numbering the
+  // function for every value). With AsOperand, only the name of V (e.g.
+  // "%add") is printed, otherwise its definition (e.g. "%add = add i32 ...").
+  void attribute(llvm::StringRef Key, const llvm::Value &V,
+                 llvm::ModuleSlotTracker &MST, bool AsOperand);
+
+private:
+  // Writes the key of a binary field (defining it if necessary)
+  void writeKey(llvm::StringRef Key);
+  void writeString(llvm::StringRef Str);
+
+  llvm::raw_ostream &OS;
+  ResultFormat Format;
+  llvm::StringRef Analysis;
+  // JSON lines: the current record
+  std::optional<llvm::json::OStream> JOS;
+  // Binary: the field names defined so far (in the order of their numbers)
+  llvm::SmallVector<llvm::StringRef, 8> Keys;
+  // Reused for printing the values, so that they are only allocated once
+  llvm::SmallString<128> Scratch;
+};
+
+#endif // LLVM_TUTOR_RESULT_WRITER_H
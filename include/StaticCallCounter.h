@@ -13,6 +13,8 @@
 #ifndef LLVM_TUTOR_STATICCALLCOUNTER_H
 #define LLVM_TUTOR_STATICCALLCOUNTER_H
 
+#include "ResultWriter.h"
+
 #include "llvm/ADT/MapVector.h"
 #include "llvm/IR/AbstractCallSite.h"
 #include "llvm/IR/Module.h"
@@ -20,15 +22,26 @@
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <string>
+#include <utility>
+#include <vector>
+
 //------------------------------------------------------------------------------
 // New PM interface
 //------------------------------------------------------------------------------
 using ResultStaticCC = llvm::MapVector<const llvm::Function *, unsigned>;
+// The same results, but keyed by the name of the callee (in the order of the
+// first call). Unlike ResultStaticCC, these remain valid once the module (and
+// its LLVMContext) is destroyed and can be merged across modules.
+using NamedResultStaticCC = std::vector<std::pair<std::string, unsigned>>;
 
 struct StaticCallCounter : public llvm::AnalysisInfoMixin<StaticCallCounter> {
   using Result = ResultStaticCC;
   Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
   Result runOnModule(llvm::Module &M);
+  // Adds the direct calls in F to Res. Used to count the calls one function
+  // at a time, e.g. when the module is materialized lazily.
+  static void countCallsInFunction(const llvm::Function &F, Result &Res);
   // Part of the official API:
   //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
   static bool isRequired() { return true; }
@@ -46,7 +59,9 @@ private:
 class StaticCallCounterPrinter
     : public llvm::PassInfoMixin<StaticCallCounterPrinter> {
 public:
-  explicit StaticCallCounterPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  explicit StaticCallCounterPrinter(llvm::raw_ostream &OutS,
+                                    ResultFormat Format = ResultFormat::Text)
+      : OS(OutS), Format(Format) {}
   llvm::PreservedAnalyses run(llvm::Module &M,
                               llvm::ModuleAnalysisManager &MAM);
   // Part of the official API:
@@ -55,6 +70,21 @@ public:
 
 private:
   llvm::raw_ostream &OS;
+  ResultFormat Format;
 };
 
+//------------------------------------------------------------------------------
+// Helper functions
+//------------------------------------------------------------------------------
+// Adds the counts from DirectCalls to Result (merging by the callee name)
+void mergeStaticCCResult(NamedResultStaticCC &Result,
+                         const ResultStaticCC &DirectCalls);
+// Adds the counts from Other to Result
+void mergeStaticCCResult(NamedResultStaticCC &Result,
+                         const NamedResultStaticCC &Other);
+// Prints Result in the same format as StaticCallCounterPrinter
+void printStaticCCResult(llvm::raw_ostream &OutS,
+                         const NamedResultStaticCC &Result,
+                         ResultFormat Format = ResultFormat::Text);
+
 #endif // LLVM_TUTOR_STATICCALLCOUNTER_H
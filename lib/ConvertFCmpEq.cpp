@@ -13,6 +13,13 @@
 //    stream). It also demonstrates how instructions can be modified without
 //    having to completely replace them.
 //
+//    `a == b` is rewritten as `|a - b| < epsilon`, where epsilon is the machine
+//    epsilon of the type of a and b. Scalar and vector (compared element-wise)
+//    operands of any floating-point type are supported. The absolute value is
+//    computed by clearing the sign bit (bitcast to an integer of the same
+//    width) or, with `-convert-fcmp-eq-lowering=fabs`, with the `llvm.fabs`
+//    intrinsic. The latter is understood by the loop and SLP vectorizers.
+//
 //    Originally developed for [1].
 //
 //    [1] "Writing an LLVM Optimization" by Jonathan Smith
@@ -20,6 +27,9 @@
 // USAGE:
 //      opt --load-pass-plugin libConvertFCmpEq.dylib [--stats] `\`
 //        --passes='convert-fcmp-eq' --disable-output <input-llvm-file>
+//      opt --load-pass-plugin libConvertFCmpEq.dylib `\`
+//        --passes='convert-fcmp-eq' --convert-fcmp-eq-lowering=fabs `\`
+//        -S <input-llvm-file>
 //
 // License: MIT
 //=============================================================================
@@ -33,6 +43,7 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
@@ -40,12 +51,29 @@
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
 #include <cassert>
 
 using namespace llvm;
 
+//------------------------------------------------------------------------------
+// Command line options
+//------------------------------------------------------------------------------
+enum class FCmpEqLowering { Bitcast, FAbs };
+
+static cl::opt<FCmpEqLowering> Lowering(
+    "convert-fcmp-eq-lowering",
+    cl::desc("How to compute the absolute value of the difference"),
+    cl::values(clEnumValN(FCmpEqLowering::Bitcast, "bitcast",
+                          "Clear the sign bit of the difference bitcast to "
+                          "an integer (default)"),
+               clEnumValN(FCmpEqLowering::FAbs, "fabs",
+                          "Use the llvm.fabs intrinsic, which is friendlier "
+                          "to the vectorizers")),
+    cl::init(FCmpEqLowering::Bitcast));
+
 // Unnamed namespace for private functions
 static FCmpInst *convertFCmpEqInstruction(FCmpInst *FCmp) noexcept {
   assert(FCmp && "The given fcmp instruction is null");
@@ -76,39 +104,55 @@ static FCmpInst *convertFCmpEqInstruction(FCmpInst *FCmp) noexcept {
   }();
 
   // Create the objects and values needed to perform the equality comparison
-  // conversion.
+  // conversion. The operands are either scalars or vectors (which are
+  // compared element-wise) of any floating-point type.
   Module *M = FCmp->getModule();
   assert(M && "The given fcmp instruction does not belong to a module");
   LLVMContext &Ctx = M->getContext();
-  IntegerType *I64Ty = IntegerType::get(Ctx, 64);
-  Type *DoubleTy = Type::getDoubleTy(Ctx);
+  Type *FPTy = LHS->getType();
+  Type *ScalarTy = FPTy->getScalarType();
+  const fltSemantics &Semantics = ScalarTy->getFltSemantics();
 
-  // Define the sign-mask and double-precision machine epsilon constants.
-  ConstantInt *SignMask = ConstantInt::get(I64Ty, ~(1L << 63));
-  // The machine epsilon value for IEEE 754 double-precision values is 2 ^ -52
-  // or (b / 2) * b ^ -(p - 1) where b (base) = 2 and p (precision) = 53.
-  APInt EpsilonBits(64, 0x3CB0000000000000);
-  Constant *EpsilonValue =
-      ConstantFP::get(DoubleTy, EpsilonBits.bitsToDouble());
+  // Define the machine epsilon constant (splatted for vectors). The machine
+  // epsilon is (b / 2) * b ^ -(p - 1) = 2 ^ -(p - 1), where b (base) = 2 and
+  // p is the precision, e.g. 2 ^ -52 for IEEE 754 double-precision values.
+  APFloat Epsilon =
+      scalbn(APFloat(Semantics, 1),
+             -int(APFloat::semanticsPrecision(Semantics) - 1),
+             APFloat::rmNearestTiesToEven);
+  Constant *EpsilonValue = ConstantFP::get(FPTy, Epsilon);
 
   // Create an IRBuilder with an insertion point set to the given fcmp
   // instruction.
   IRBuilder<> Builder(FCmp);
-  // Create the subtraction, casting, absolute value, and new comparison
-  // instructions one at a time.
+  // Create the subtraction and absolute value instructions one at a time.
   // %0 = fsub double %a, %b
-  auto *FSubInst = Builder.CreateFSub(LHS, RHS);
-  // %1 = bitcast double %0 to i64
-  auto *CastToI64 = Builder.CreateBitCast(FSubInst, I64Ty);
-  // %2 = and i64 %1, 0x7fffffffffffffff
-  auto *AbsValue = Builder.CreateAnd(CastToI64, SignMask);
-  // %3 = bitcast i64 %2 to double
-  auto *CastToDouble = Builder.CreateBitCast(AbsValue, DoubleTy);
+  Value *FSubInst = Builder.CreateFSub(LHS, RHS);
+  Value *AbsValue = nullptr;
+  // The sign bit of ppc_fp128 is not the top bit of the corresponding i128,
+  // so clearing it requires llvm.fabs.
+  if (Lowering == FCmpEqLowering::FAbs || ScalarTy->isPPC_FP128Ty()) {
+    // %1 = call double @llvm.fabs.f64(double %0)
+    AbsValue = Builder.CreateUnaryIntrinsic(Intrinsic::fabs, FSubInst);
+  } else {
+    // The integer type with the same shape as FPTy, e.g. i64 for double
+    unsigned NumBits = ScalarTy->getPrimitiveSizeInBits();
+    Type *IntTy = FPTy->getWithNewType(IntegerType::get(Ctx, NumBits));
+    // Define the sign-mask constant (splatted for vectors).
+    Constant *SignMask =
+        ConstantInt::get(IntTy, APInt::getSignedMaxValue(NumBits));
+    // %1 = bitcast double %0 to i64
+    auto *CastToInt = Builder.CreateBitCast(FSubInst, IntTy);
+    // %2 = and i64 %1, 0x7fffffffffffffff
+    auto *AbsInt = Builder.CreateAnd(CastToInt, SignMask);
+    // %3 = bitcast i64 %2 to double
+    AbsValue = Builder.CreateBitCast(AbsInt, FPTy);
+  }
   // %4 = fcmp <olt/ult/oge/uge> double %3, 0x3cb0000000000000
   // Rather than creating a new instruction, we'll just change the predicate and
   // operands of the existing fcmp instruction to match what we want.
   FCmp->setPredicate(CmpPred);
-  FCmp->setOperand(0, CastToDouble);
+  FCmp->setOperand(0, AbsValue);
   FCmp->setOperand(1, EpsilonValue);
   return FCmp;
 }
@@ -29,6 +29,14 @@
 //    All newly created basic blocks are suffixed with the original basic
 //    block's numeric ID.
 //
+//    The growth of the function can be limited with
+//    `-duplicate-bb-max-growth=<percent>`: candidates are considered in layout
+//    order and the ones that would push the number of new instructions past
+//    the budget are skipped. With `-duplicate-bb-cold-only`, only cold blocks
+//    are duplicated. Cold blocks are identified with the profile data (via
+//    ProfileSummaryInfo) when available, and with the block frequencies
+//    estimated by BlockFrequencyInfo otherwise.
+//
 //  ALGORITHM:
 //    --------------------------------------------------------------------------
 //    The following CFG graph represents function 'F' before and after applying
@@ -79,6 +87,8 @@
 #include "DuplicateBB.h"
 
 #include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Passes/PassBuilder.h"
@@ -95,22 +105,75 @@ STATISTIC(DuplicateBBCountStats, "The # of duplicated blocks");
 
 using namespace llvm;
 
+//------------------------------------------------------------------------------
+// Command line options
+//------------------------------------------------------------------------------
+static cl::opt<unsigned> MaxGrowth{
+    "duplicate-bb-max-growth",
+    cl::desc{"The maximum growth (in percent of the original number of "
+             "instructions) of every function (0 = no limit)"},
+    cl::value_desc{"percent"}, cl::init(0)};
+
+static cl::opt<bool> ColdOnly{
+    "duplicate-bb-cold-only",
+    cl::desc{"Only duplicate cold blocks (based on the profile data if "
+             "available, and on the estimated block frequencies otherwise)"},
+    cl::init(false)};
+
+// Without profile data, a block is treated as cold when it is estimated to
+// run at most once every ColdFreqDivisor executions of the entry block.
+static constexpr uint64_t ColdFreqDivisor = 8;
+
+//------------------------------------------------------------------------------
+// Helper functions
+//------------------------------------------------------------------------------
+// Returns the number of instructions that cloneBB adds to the function when
+// duplicating BB. Both clones contain a copy of every (non-PHI, non-terminator)
+// instruction, these are replaced in the tail with one PHI per produced value,
+// and `if-then-else` adds a comparison and three branches.
+static unsigned getDuplicationCost(const BasicBlock &BB) {
+  unsigned NumCloned = 0, NumValues = 0;
+  for (const Instruction &I :
+       make_range(BB.getFirstNonPHIIt(), BB.getTerminator()->getIterator())) {
+    ++NumCloned;
+    if (!I.getType()->isVoidTy())
+      ++NumValues;
+  }
+
+  return NumCloned + NumValues + 4;
+}
+
+static bool isColdBlock(const BasicBlock &BB, BlockFrequencyInfo &BFI,
+                        ProfileSummaryInfo *PSI) {
+  if (PSI && PSI->hasProfileSummary())
+    return PSI->isColdBlock(&BB, &BFI);
+
+  return BFI.getBlockFreq(&BB).getFrequency() <=
+         BFI.getEntryFreq().getFrequency() / ColdFreqDivisor;
+}
+
 //------------------------------------------------------------------------------
 // DuplicateBB Implementation
 //------------------------------------------------------------------------------
 DuplicateBB::BBToSingleRIVMap
-DuplicateBB::findBBsToDuplicate(Function &F, const RIV::Result &RIVResult) {
+DuplicateBB::findBBsToDuplicate(Function &F, LazyRIV::Result &RIVResult,
+                                BlockFrequencyInfo *BFI,
+                                ProfileSummaryInfo *PSI) {
   BBToSingleRIVMap BlocksToDuplicate;
 
+  // STEP 1: Pick a random RIV (i.e. its index) for every candidate. This is
+  // done for all the candidates, so that the sequence of random numbers
+  // doesn't depend on the budget or on the block frequencies.
+  SmallVector<std::pair<const BasicBlock *, size_t>, 16> Picks;
   for (BasicBlock &BB : F) {
     // Basic blocks which are landing pads are used for handling exceptions.
     // That's out of scope of this pass.
     if (BB.isLandingPad())
       continue;
 
-    // Get the set of RIVs for this block
-    auto const &ReachableValues = RIVResult.lookup(&BB);
-    size_t ReachableValuesCount = ReachableValues.size();
+    // Get the number of RIVs for this block. Only the one value picked below
+    // is actually looked up.
+    size_t ReachableValuesCount = RIVResult.getNumRIVs(&BB);
 
     // Are there any RIVs for this BB? We need at least one to be able to
     // duplicate this BB.
@@ -119,22 +182,51 @@ DuplicateBB::findBBsToDuplicate(Function &F, const RIV::Result &RIVResult) {
       continue;
     }
 
-    // Get a random context value from the RIV set
-    auto Iter = ReachableValues.begin();
+    // Get a random context value from the RIV set. The RNG is consumed as
+    // when the sets were iterated, but the index now follows the RIVSet
+    // order. The original per-block SmallPtrSets kept the insertion order
+    // only while they held 8 values or fewer, so the picked values match
+    // the original ones only for such blocks.
     std::uniform_int_distribution<> Dist(0, ReachableValuesCount - 1);
-    std::advance(Iter, Dist(*pRNG));
+    Picks.emplace_back(&BB, Dist(*pRNG));
+  }
+
+  // STEP 2: Look up the picked values. This walks the dominator tree once
+  // rather than once per block.
+  SmallVector<Value *, 16> ContextValues;
+  RIVResult.getRIVs(Picks, ContextValues);
 
-    if (dyn_cast<GlobalValue>(*Iter)) {
+  // STEP 3: Filter the candidates
+  uint64_t Budget = uint64_t(F.getInstructionCount()) * MaxGrowth / 100;
+  uint64_t Growth = 0;
+  for (auto [Pick, ContextValue] : zip_equal(Picks, ContextValues)) {
+    BasicBlock *BB = const_cast<BasicBlock *>(Pick.first);
+
+    if (dyn_cast<GlobalValue>(ContextValue)) {
       LLVM_DEBUG(errs() << "Random context value is a global variable. "
                         << "Skipping this BB\n");
       continue;
     }
 
-    LLVM_DEBUG(errs() << "Random context value: " << **Iter << "\n");
+    if (BFI && !isColdBlock(*BB, *BFI, PSI)) {
+      LLVM_DEBUG(errs() << "BB is not cold. Skipping this BB\n");
+      continue;
+    }
+
+    if (MaxGrowth) {
+      unsigned Cost = getDuplicationCost(*BB);
+      if (Growth + Cost > Budget) {
+        LLVM_DEBUG(errs() << "Growth budget exceeded. Skipping this BB\n");
+        continue;
+      }
+      Growth += Cost;
+    }
+
+    LLVM_DEBUG(errs() << "Random context value: " << *ContextValue << "\n");
 
     // Store the binding between the current BB and the context variable that
     // will be used for the `if-then-else` construct.
-    BlocksToDuplicate.emplace_back(&BB, *Iter);
+    BlocksToDuplicate.emplace_back(BB, ContextValue);
   }
 
   return BlocksToDuplicate;
@@ -238,8 +330,19 @@ PreservedAnalyses DuplicateBB::run(llvm::Function &F,
                                    llvm::FunctionAnalysisManager &FAM) {
   if (!pRNG)
     pRNG = F.getParent()->createRNG("duplicate-bb");
-  
-  BBToSingleRIVMap Targets = findBBsToDuplicate(F, FAM.getResult<RIV>(F));
+
+  BlockFrequencyInfo *BFI = nullptr;
+  ProfileSummaryInfo *PSI = nullptr;
+  if (ColdOnly) {
+    BFI = &FAM.getResult<BlockFrequencyAnalysis>(F);
+    // Only use the profile summary if it has already been computed - a
+    // function pass cannot run module analyses.
+    PSI = FAM.getResult<ModuleAnalysisManagerFunctionProxy>(F)
+              .getCachedResult<ProfileSummaryAnalysis>(*F.getParent());
+  }
+
+  BBToSingleRIVMap Targets =
+      findBBsToDuplicate(F, FAM.getResult<LazyRIV>(F), BFI, PSI);
 
   // This map is used to keep track of the new bindings. Otherwise, the
   // information from RIV will become obsolete.
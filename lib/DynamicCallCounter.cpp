@@ -36,24 +36,157 @@
 //    module. Functions that are only _declared_ (and defined elsewhere) are not
 //    counted.
 //
+//    The `-dynamic-cc-counter` option selects how the counters are
+//    implemented:
+//      * plain   - the default, a 32-bit `load/add/store` sequence as above.
+//                  This is not thread-safe.
+//      * atomic  - a 64-bit counter per function, incremented with a relaxed
+//                  (monotonic) `atomicrmw add`. This is thread-safe, but all
+//                  threads calling F compete for the cache line that holds
+//                  `CounterFor_F`.
+//      * sharded - 64-bit counters stored in `-dynamic-cc-shards` per-thread
+//                  rows, each padded to a whole number of cache lines. Every
+//                  thread is assigned one row on its first instrumented call
+//                  and then only ever touches that row. The rows are summed
+//                  in `printf_wrapper`. Increments are still relaxed atomics
+//                  so that counts aren't lost when there are more threads
+//                  than shards, but they are uncontended otherwise.
+//
+//    With `-dynamic-cc-sample-period=N` (N > 1) only every N-th function entry
+//    (per thread) is recorded: every entry decrements a thread-local
+//    countdown and the counter is only updated (by N) when it reaches 0. The
+//    reported counts become estimates, but entries that are not sampled only
+//    cost a decrement and a branch.
+//
 // USAGE:
 //      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
 //        -passes=-"dynamic-cc" <bitcode-file> -o instrumentend.bin
 //      $ lli instrumented.bin
+//    The `-dynamic-cc-output` option selects how the results are reported:
+//      * text   - the default, `printf_wrapper` prints a table on exit.
+//      * binary - the counters and the function names are laid out in a
+//                 single, versioned global variable (see
+//                 DynamicCallCounterProfile.h) that lives in its own section
+//                 (`lt_dcc_prof`). On exit, `dcc_write_profile` writes that
+//                 global, in one go, to `-dynamic-cc-profile-file` (`%p` is
+//                 replaced with the process ID). Use `dcc-profdata` to print
+//                 or merge such profiles.
+//
+//    With `-dynamic-cc-edges`, the calls are counted per call site instead,
+//    i.e. per caller -> callee edge. The targets of indirect calls are
+//    recorded too (value profiling of the called pointer, up to
+//    `-dynamic-cc-icall-targets` distinct targets per call site). The call
+//    sites are identified by their debug locations in the same way as in
+//    LLVM's sample profiles. The results are always written to
+//    `-dynamic-cc-profile-file` as a call-edge profile (see
+//    DynamicCallCounterProfile.h), which `dcc-profdata` converts into a
+//    sample profile that clang (`-fprofile-sample-use`) and `llvm-profdata`
+//    understand. In this mode, the sharded counters are replaced with
+//    atomic counters and sampling is not supported.
+//
+//    To use sharded counters:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc" -dynamic-cc-counter=sharded `\`
+//        <bitcode-file> -o instrumentend.bin
+//    To generate binary profiles:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc" -dynamic-cc-output=binary `\`
+//        -dynamic-cc-profile-file=prof.%p <bitcode-file> -o instrumentend.bin
+//      $ lli instrumented.bin
+//      $ <BUILD_DIR>/bin/dcc-profdata show prof.*
+//    To generate call-edge profiles for PGO (the input must have debug info,
+//    e.g. `clang -g -O0 -Xclang -disable-O0-optnone -emit-llvm`):
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc" -dynamic-cc-edges `\`
+//        -dynamic-cc-profile-file=prof.%p <bitcode-file> -o instrumentend.bin
+//      $ lli instrumented.bin
+//      $ <BUILD_DIR>/bin/dcc-profdata merge -o app.prof prof.*
+//      $ clang -O2 -g -fprofile-sample-use=app.prof <source-files>
+//    To sample 1 in 1000 calls:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc" -dynamic-cc-counter=sharded `\`
+//        -dynamic-cc-sample-period=1000 <bitcode-file> -o instrumentend.bin
 //
 // License: MIT
 //========================================================================
 #include "DynamicCallCounter.h"
+#include "DynamicCallCounterProfile.h"
+#include "InstrumentationUtils.h"
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/TargetParser/Triple.h"
 #include "llvm/Transforms/Utils/ModuleUtils.h"
 
 using namespace llvm;
 
 #define DEBUG_TYPE "dynamic-cc"
 
+//-----------------------------------------------------------------------------
+// Command line options
+//-----------------------------------------------------------------------------
+enum class CounterKind { Plain, Atomic, Sharded };
+
+static cl::opt<CounterKind> CounterMode(
+    "dynamic-cc-counter", cl::desc("How to implement the call counters"),
+    cl::values(clEnumValN(CounterKind::Plain, "plain",
+                          "32-bit load/add/store (not thread-safe)"),
+               clEnumValN(CounterKind::Atomic, "atomic",
+                          "64-bit relaxed atomic increments"),
+               clEnumValN(CounterKind::Sharded, "sharded",
+                          "64-bit per-thread counter shards, summed at exit")),
+    cl::init(CounterKind::Plain));
+
+static cl::opt<unsigned> NumCounterShards(
+    "dynamic-cc-shards",
+    cl::desc("Number of per-thread counter shards used by "
+             "-dynamic-cc-counter=sharded (rounded up to a power of 2)"),
+    cl::init(64));
+
+enum class OutputKind { Text, Binary };
+
+static cl::opt<OutputKind> OutputFormat(
+    "dynamic-cc-output", cl::desc("How to report the results on exit"),
+    cl::values(clEnumValN(OutputKind::Text, "text", "Print a table to stdout"),
+               clEnumValN(OutputKind::Binary, "binary",
+                          "Write a binary profile to -dynamic-cc-profile-file")),
+    cl::init(OutputKind::Text));
+
+static cl::opt<std::string> ProfileFile(
+    "dynamic-cc-profile-file",
+    cl::desc("The binary profile to write on exit (%p expands to the "
+             "process ID)"),
+    cl::value_desc("filename"), cl::init("dcc.profdata"));
+
+static cl::opt<unsigned> SamplePeriod(
+    "dynamic-cc-sample-period",
+    cl::desc("Only record every N-th function entry (per thread) and scale "
+             "the counts by N (1 disables sampling)"),
+    cl::value_desc("N"), cl::init(1));
+
+static cl::opt<bool> CallEdges(
+    "dynamic-cc-edges",
+    cl::desc("Count the calls made by every call site (including the targets "
+             "of indirect calls) and write a call-edge profile to "
+             "-dynamic-cc-profile-file"),
+    cl::init(false));
+
+static cl::opt<unsigned> NumIndirectTargets(
+    "dynamic-cc-icall-targets",
+    cl::desc("The number of distinct targets recorded per indirect call site "
+             "with -dynamic-cc-edges"),
+    cl::init(4));
+
+// Counter rows in the sharded mode are padded to a multiple of this size so
+// that no two threads write to the same cache line.
+static constexpr unsigned CacheLineSize = 64;
+
 Constant *CreateGlobalCounter(Module &M, StringRef GlobalVarName) {
   auto &CTX = M.getContext();
 
@@ -70,46 +203,750 @@ Constant *CreateGlobalCounter(Module &M, StringRef GlobalVarName) {
   return NewGlobalVar;
 }
 
+Constant *CreateGlobalCounter64(Module &M, StringRef GlobalVarName) {
+  auto &CTX = M.getContext();
+
+  Constant *NewGlobalVar =
+      M.getOrInsertGlobal(GlobalVarName, IntegerType::getInt64Ty(CTX));
+
+  GlobalVariable *NewGV = M.getNamedGlobal(GlobalVarName);
+  NewGV->setLinkage(GlobalValue::CommonLinkage);
+  NewGV->setAlignment(MaybeAlign(8));
+  NewGV->setInitializer(llvm::ConstantInt::get(CTX, APInt(64, 0)));
+
+  return NewGlobalVar;
+}
+
+// Creates `[NumShards x [RowLen x i64]]`, i.e. one row of 64-bit counters per
+// shard. RowLen is NumCounters rounded up to a whole number of cache lines.
+static GlobalVariable *CreateShardedCounters(Module &M, unsigned NumCounters,
+                                             unsigned NumShards,
+                                             uint64_t &RowLen) {
+  auto &CTX = M.getContext();
+  RowLen = alignTo(NumCounters, CacheLineSize / sizeof(uint64_t));
+
+  ArrayType *RowTy = ArrayType::get(IntegerType::getInt64Ty(CTX), RowLen);
+  ArrayType *ShardsTy = ArrayType::get(RowTy, NumShards);
+
+  auto *Shards = new GlobalVariable(M, ShardsTy, /*isConstant=*/false,
+                                    GlobalValue::InternalLinkage,
+                                    Constant::getNullValue(ShardsTy),
+                                    "DynamicCallCounterShards");
+  Shards->setAlignment(Align(CacheLineSize));
+  return Shards;
+}
+
+// Defines `i64 dcc_shard_index()` that returns the shard assigned to the
+// calling thread. It is equivalent to the following C function:
+// ```
+//    static _Thread_local unsigned ShardId; // 0 means "not assigned yet"
+//    static unsigned NextShard;
+//    uint64_t dcc_shard_index() {
+//      if (ShardId == 0)
+//        ShardId = (atomic_fetch_add_relaxed(&NextShard, 1) & (N - 1)) + 1;
+//      return ShardId - 1;
+//    }
+// ```
+// Threads are assigned shards in a round-robin fashion.
+static Function *CreateShardIndexFunc(Module &M, unsigned NumShards) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+
+  auto *ShardId = new GlobalVariable(
+      M, Int32Ty, /*isConstant=*/false, GlobalValue::InternalLinkage,
+      ConstantInt::get(Int32Ty, 0), "DynamicCallCounterShardId",
+      /*InsertBefore=*/nullptr, GlobalValue::InitialExecTLSModel);
+  auto *NextShard = new GlobalVariable(
+      M, Int32Ty, /*isConstant=*/false, GlobalValue::InternalLinkage,
+      ConstantInt::get(Int32Ty, 0), "DynamicCallCounterNextShard");
+
+  FunctionType *ShardIndexTy = FunctionType::get(Int64Ty, {},
+                                                 /*IsVarArgs=*/false);
+  Function *ShardIndexF = Function::Create(
+      ShardIndexTy, GlobalValue::InternalLinkage, "dcc_shard_index", M);
+  ShardIndexF->setDoesNotThrow();
+
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", ShardIndexF);
+  BasicBlock *Assign = BasicBlock::Create(CTX, "assign", ShardIndexF);
+  BasicBlock *Done = BasicBlock::Create(CTX, "done", ShardIndexF);
+
+  IRBuilder<> Builder(Entry);
+  Value *IdPtr = Builder.CreateThreadLocalAddress(ShardId);
+  Value *Id = Builder.CreateLoad(Int32Ty, IdPtr);
+  Builder.CreateCondBr(Builder.CreateIsNull(Id), Assign, Done);
+
+  Builder.SetInsertPoint(Assign);
+  Value *Ticket = Builder.CreateAtomicRMW(
+      AtomicRMWInst::Add, NextShard, Builder.getInt32(1), MaybeAlign(4),
+      AtomicOrdering::Monotonic);
+  Value *NewId = Builder.CreateAdd(
+      Builder.CreateAnd(Ticket, Builder.getInt32(NumShards - 1)),
+      Builder.getInt32(1));
+  Builder.CreateStore(NewId, IdPtr);
+  Builder.CreateBr(Done);
+
+  Builder.SetInsertPoint(Done);
+  PHINode *AssignedId = Builder.CreatePHI(Int32Ty, 2);
+  AssignedId->addIncoming(Id, Entry);
+  AssignedId->addIncoming(NewId, Assign);
+  Builder.CreateRet(Builder.CreateZExt(
+      Builder.CreateSub(AssignedId, Builder.getInt32(1)), Int64Ty));
+
+  return ShardIndexF;
+}
+
+// Defines `i64 dcc_read_counter(i64 Idx)` that sums counter Idx across all
+// the shards in Shards.
+static Function *CreateReadCounterFunc(Module &M, GlobalVariable *Shards,
+                                       unsigned NumShards) {
+  auto &CTX = M.getContext();
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+
+  FunctionType *ReadCounterTy = FunctionType::get(Int64Ty, {Int64Ty},
+                                                  /*IsVarArgs=*/false);
+  Function *ReadCounterF = Function::Create(
+      ReadCounterTy, GlobalValue::InternalLinkage, "dcc_read_counter", M);
+  ReadCounterF->setDoesNotThrow();
+  Value *Idx = ReadCounterF->getArg(0);
+
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", ReadCounterF);
+  BasicBlock *Loop = BasicBlock::Create(CTX, "loop", ReadCounterF);
+  BasicBlock *Exit = BasicBlock::Create(CTX, "exit", ReadCounterF);
+
+  IRBuilder<> Builder(Entry);
+  Builder.CreateBr(Loop);
+
+  Builder.SetInsertPoint(Loop);
+  PHINode *Shard = Builder.CreatePHI(Int64Ty, 2, "shard");
+  PHINode *Sum = Builder.CreatePHI(Int64Ty, 2, "sum");
+  Value *Slot = Builder.CreateInBoundsGEP(Shards->getValueType(), Shards,
+                                          {Builder.getInt64(0), Shard, Idx});
+  LoadInst *Count = Builder.CreateAlignedLoad(Int64Ty, Slot, MaybeAlign(8));
+  // Other threads might still be running
+  Count->setAtomic(AtomicOrdering::Monotonic);
+  Value *NewSum = Builder.CreateAdd(Sum, Count);
+  Value *NextShard = Builder.CreateAdd(Shard, Builder.getInt64(1));
+  Builder.CreateCondBr(
+      Builder.CreateICmpULT(NextShard, Builder.getInt64(NumShards)), Loop,
+      Exit);
+  Shard->addIncoming(Builder.getInt64(0), Entry);
+  Shard->addIncoming(NextShard, Loop);
+  Sum->addIncoming(Builder.getInt64(0), Entry);
+  Sum->addIncoming(NewSum, Loop);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateRet(NewSum);
+
+  return ReadCounterF;
+}
+
+// Creates the global variable, initialised with Profile, that holds the
+// binary profile (of either kind) in its own section
+static GlobalVariable *CreateProfileGlobal(Module &M, Constant *Profile) {
+  auto *ProfileGV = new GlobalVariable(
+      M, Profile->getType(), /*isConstant=*/false,
+      GlobalValue::InternalLinkage, Profile, "DynamicCallCounterProfile");
+  ProfileGV->setAlignment(Align(CacheLineSize));
+  ProfileGV->setSection(Triple(M.getTargetTriple()).isOSBinFormatMachO()
+                            ? "__DATA,__lt_dcc_prof"
+                            : "lt_dcc_prof");
+  // The profile is only ever accessed through the writer, make sure that it
+  // survives even if nothing else references it.
+  appendToUsed(M, {ProfileGV});
+
+  return ProfileGV;
+}
+
+// Creates the global variable that holds the binary profile. Its type
+// mirrors the layout described in DynamicCallCounterProfile.h:
+//    { DCCProfileHeader, [N x DCCProfileRecord], [NamesSize x i8] }
+// All the counters are initialised with 0.
+static GlobalVariable *CreateProfileData(Module &M,
+                                         ArrayRef<Function *> Funcs) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+
+  std::string Names;
+  SmallVector<Constant *, 16> Records;
+  StructType *RecordTy = StructType::get(CTX, {Int64Ty, Int32Ty, Int32Ty});
+  for (Function *F : Funcs) {
+    Records.push_back(ConstantStruct::get(
+        RecordTy, {ConstantInt::get(Int64Ty, 0),
+                   ConstantInt::get(Int32Ty, Names.size()),
+                   ConstantInt::get(Int32Ty, F->getName().size())}));
+    Names += F->getName();
+  }
+
+  StructType *HeaderTy =
+      StructType::get(CTX, {Int64Ty, Int32Ty, Int32Ty, Int64Ty});
+  Constant *Header = ConstantStruct::get(
+      HeaderTy, {ConstantInt::get(Int64Ty, DCCProfileMagic),
+                 ConstantInt::get(Int32Ty, DCCProfileVersion),
+                 ConstantInt::get(Int32Ty, Funcs.size()),
+                 ConstantInt::get(Int64Ty, Names.size())});
+
+  ArrayType *RecordsTy = ArrayType::get(RecordTy, Records.size());
+  Constant *NamesData =
+      ConstantDataArray::getString(CTX, Names, /*AddNull=*/false);
+  Constant *Profile = ConstantStruct::getAnon(
+      CTX, {Header, ConstantArray::get(RecordsTy, Records), NamesData});
+
+  return CreateProfileGlobal(M, Profile);
+}
+
+// Returns the address of the field SubField of the element Idx of the array
+// Field in Profile
+static Constant *GetProfileField(GlobalVariable *Profile, unsigned Field,
+                                 unsigned Idx, unsigned SubField) {
+  auto &CTX = Profile->getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  return ConstantExpr::getInBoundsGetElementPtr(
+      Profile->getValueType(), Profile,
+      ArrayRef<Constant *>{ConstantInt::get(Int32Ty, 0),
+                           ConstantInt::get(Int32Ty, Field),
+                           ConstantInt::get(Int32Ty, Idx),
+                           ConstantInt::get(Int32Ty, SubField)});
+}
+
+// Returns the address of the `CallCount` field of the record Idx in Profile
+static Constant *GetProfileCounter(GlobalVariable *Profile, unsigned Idx) {
+  return GetProfileField(Profile, /*Field=*/1, Idx, /*SubField=*/0);
+}
+
+// Defines `void dcc_write_profile()` that writes the first ProfileSize bytes
+// of Profile to ProfileFile. It is equivalent to the following C function:
+// ```
+//    void dcc_write_profile() {
+//      // Sharded mode only
+//      for (uint64_t i = 0; i < NumFunctions; i++)
+//        Profile.Records[i].CallCount = dcc_read_counter(i);
+//
+//      // See emitWriteToFile
+//      write_to_file(ProfileFile, &Profile, ProfileSize);
+//    }
+// ```
+static Function *CreateProfileWriterFunc(Module &M, GlobalVariable *Profile,
+                                         unsigned NumFuncs,
+                                         uint64_t ProfileSize,
+                                         Function *ReadCounterF) {
+  auto &CTX = M.getContext();
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+
+  FunctionType *WriterTy =
+      FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false);
+  Function *WriterF = Function::Create(WriterTy, GlobalValue::InternalLinkage,
+                                       "dcc_write_profile", M);
+
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", WriterF);
+  IRBuilder<> Builder(Entry);
+
+  // STEP 1: Sum the shards into the profile (sharded mode only)
+  if (ReadCounterF) {
+    BasicBlock *Loop = BasicBlock::Create(CTX, "sum.shards", WriterF);
+    BasicBlock *LoopExit = BasicBlock::Create(CTX, "write.profile", WriterF);
+    Builder.CreateBr(Loop);
+
+    Builder.SetInsertPoint(Loop);
+    PHINode *Idx = Builder.CreatePHI(Int64Ty, 2, "idx");
+    Value *Count = Builder.CreateCall(ReadCounterF, {Idx});
+    Value *Slot = Builder.CreateInBoundsGEP(
+        Profile->getValueType(), Profile,
+        {Builder.getInt32(0), Builder.getInt32(1), Idx, Builder.getInt32(0)});
+    Builder.CreateStore(Count, Slot);
+    Value *NextIdx = Builder.CreateAdd(Idx, Builder.getInt64(1));
+    Builder.CreateCondBr(
+        Builder.CreateICmpULT(NextIdx, Builder.getInt64(NumFuncs)), Loop,
+        LoopExit);
+    Idx->addIncoming(Builder.getInt64(0), Entry);
+    Idx->addIncoming(NextIdx, Loop);
+
+    Builder.SetInsertPoint(LoopExit);
+  }
+
+  // STEP 2: Write the profile in one go
+  emitWriteToFile(Builder, Profile, ProfileSize, ProfileFile);
+  Builder.CreateRetVoid();
+
+  return WriterF;
+}
+
+//-----------------------------------------------------------------------------
+// Call-edge profiles (-dynamic-cc-edges)
+//-----------------------------------------------------------------------------
+namespace {
+// A call site instrumented in the call-edge mode (see CallEdgeProfileSite)
+struct CallEdgeSite {
+  CallBase *Call;
+  unsigned Caller;
+  unsigned Callee;
+  uint32_t LineOffset;
+  uint32_t Discriminator;
+  unsigned FirstTarget;
+  unsigned NumTargets;
+};
+} // namespace
+
+// Returns the location of Call in the form used by sample profiles (see
+// FunctionSamples::getCallSiteIdentifier), i.e. the line relative to the
+// start of the enclosing function and the base discriminator. Calls that
+// were inlined into the enclosing function have no location - describing
+// them would require the inlining context. Neither do the calls before the
+// start of the function or 64K lines (or more) after it: sample profiles
+// keep only the low 16 bits of the offset, which would alias another line.
+static std::pair<uint32_t, uint32_t> GetCallSiteLocation(const CallBase &Call) {
+  const DILocation *DIL = Call.getDebugLoc().get();
+  if (!DIL || DIL->getInlinedAt())
+    return {CallEdgeProfileNoLocation, 0};
+
+  const DISubprogram *SP = DIL->getScope()->getSubprogram();
+  if (!SP)
+    return {CallEdgeProfileNoLocation, 0};
+
+  int64_t LineOffset = int64_t(DIL->getLine()) - int64_t(SP->getLine());
+  if (LineOffset < 0 || LineOffset > 0xffff) {
+    LLVM_DEBUG(dbgs() << " Line offset " << LineOffset << " out of range: "
+                      << Call << "\n");
+    return {CallEdgeProfileNoLocation, 0};
+  }
+
+  return {uint32_t(LineOffset), DIL->getBaseDiscriminator()};
+}
+
+// Creates the global variable that holds the call-edge profile. Its type
+// mirrors the layout described in DynamicCallCounterProfile.h:
+//    { CallEdgeProfileHeader, [F x CallEdgeProfileFunction],
+//      [S x CallEdgeProfileSite], [T x CallEdgeProfileTarget],
+//      [A x CallEdgeProfileAddress], [NamesSize x i8] }
+// All the counters are initialised with 0. The address table is populated
+// with the addresses of all the functions in Funcs whose address is taken
+// (these are resolved when the program is loaded). ProfileSize is set to
+// the size of the profile in bytes.
+static GlobalVariable *CreateCallEdgeProfileData(Module &M,
+                                                 ArrayRef<Function *> Funcs,
+                                                 ArrayRef<CallEdgeSite> Sites,
+                                                 unsigned NumTargets,
+                                                 uint64_t &ProfileSize) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  auto GetInt32 = [&](uint64_t V) { return ConstantInt::get(Int32Ty, V); };
+  auto GetInt64 = [&](uint64_t V) { return ConstantInt::get(Int64Ty, V); };
+
+  std::string Names;
+  SmallVector<Constant *, 16> FuncRecords;
+  SmallVector<Constant *, 16> Addresses;
+  StructType *FuncTy =
+      StructType::get(CTX, {Int64Ty, Int32Ty, Int32Ty, Int32Ty, Int32Ty});
+  StructType *AddressTy = StructType::get(CTX, {Int64Ty, Int32Ty, Int32Ty});
+  for (unsigned Idx = 0, NumFuncs = Funcs.size(); Idx != NumFuncs; ++Idx) {
+    Function *F = Funcs[Idx];
+    FuncRecords.push_back(ConstantStruct::get(
+        FuncTy, {GetInt64(0), GetInt32(Names.size()),
+                 GetInt32(F->getName().size()),
+                 GetInt32(!F->isDeclaration()), GetInt32(0)}));
+    Names += F->getName();
+
+    if (F->hasAddressTaken())
+      Addresses.push_back(ConstantStruct::get(
+          AddressTy, {ConstantExpr::getPtrToInt(F, Int64Ty), GetInt32(Idx),
+                      GetInt32(0)}));
+  }
+
+  SmallVector<Constant *, 16> SiteRecords;
+  StructType *SiteTy = StructType::get(
+      CTX, {Int64Ty, Int32Ty, Int32Ty, Int32Ty, Int32Ty, Int32Ty, Int32Ty});
+  for (const CallEdgeSite &Site : Sites)
+    SiteRecords.push_back(ConstantStruct::get(
+        SiteTy, {GetInt64(0), GetInt32(Site.Caller), GetInt32(Site.Callee),
+                 GetInt32(Site.LineOffset), GetInt32(Site.Discriminator),
+                 GetInt32(Site.FirstTarget), GetInt32(Site.NumTargets)}));
+
+  StructType *HeaderTy =
+      StructType::get(CTX, {Int64Ty, Int32Ty, Int32Ty, Int32Ty, Int32Ty,
+                            Int32Ty, Int32Ty, Int64Ty});
+  Constant *Header = ConstantStruct::get(
+      HeaderTy,
+      {GetInt64(CallEdgeProfileMagic), GetInt32(CallEdgeProfileVersion),
+       GetInt32(Funcs.size()), GetInt32(Sites.size()), GetInt32(NumTargets),
+       GetInt32(Addresses.size()), GetInt32(0), GetInt64(Names.size())});
+
+  StructType *TargetTy = StructType::get(CTX, {Int64Ty, Int64Ty});
+  ArrayType *TargetsTy = ArrayType::get(TargetTy, NumTargets);
+  Constant *Profile = ConstantStruct::getAnon(
+      CTX,
+      {Header,
+       ConstantArray::get(ArrayType::get(FuncTy, FuncRecords.size()),
+                          FuncRecords),
+       ConstantArray::get(ArrayType::get(SiteTy, SiteRecords.size()),
+                          SiteRecords),
+       Constant::getNullValue(TargetsTy),
+       ConstantArray::get(ArrayType::get(AddressTy, Addresses.size()),
+                          Addresses),
+       ConstantDataArray::getString(CTX, Names, /*AddNull=*/false)});
+
+  ProfileSize = sizeof(CallEdgeProfileHeader) +
+                Funcs.size() * sizeof(CallEdgeProfileFunction) +
+                Sites.size() * sizeof(CallEdgeProfileSite) +
+                NumTargets * sizeof(CallEdgeProfileTarget) +
+                Addresses.size() * sizeof(CallEdgeProfileAddress) +
+                Names.size();
+  return CreateProfileGlobal(M, Profile);
+}
+
+// Emits code at the insertion point of Builder that adds 1 to the i64
+// counter at Counter (with a relaxed atomic increment if Atomic is set)
+static void EmitIncrement(IRBuilder<> &Builder, Value *Counter, bool Atomic) {
+  if (Atomic) {
+    Builder.CreateAtomicRMW(AtomicRMWInst::Add, Counter, Builder.getInt64(1),
+                            MaybeAlign(8), AtomicOrdering::Monotonic);
+    return;
+  }
+
+  LoadInst *Load = Builder.CreateLoad(Builder.getInt64Ty(), Counter);
+  Builder.CreateStore(Builder.CreateAdd(Builder.getInt64(1), Load), Counter);
+}
+
+// Defines `void dcc_record_target(ptr Slots, i64 Target)` that records one
+// call of Target in the value profile of an indirect call site, i.e. in the
+// NumSlots CallEdgeProfileTarget entries at Slots. It is equivalent to the
+// following C function:
+// ```
+//    void dcc_record_target(CallEdgeProfileTarget *Slots, uint64_t Target) {
+//      for (uint64_t i = 0; i < NumSlots; i++) {
+//        if (Slots[i].Address == 0)
+//          Slots[i].Address = Target;
+//        if (Slots[i].Address == Target) {
+//          Slots[i].Count++;
+//          return;
+//        }
+//      }
+//      // All the slots are taken by other targets - the call is only
+//      // reflected in the count of the call site
+//    }
+// ```
+// With Atomic, the slots are claimed with a `cmpxchg` (so that two threads
+// never claim the same slot) and the counts are incremented atomically.
+static Function *CreateRecordTargetFunc(Module &M, unsigned NumSlots,
+                                        bool Atomic) {
+  auto &CTX = M.getContext();
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  StructType *TargetTy = StructType::get(CTX, {Int64Ty, Int64Ty});
+
+  FunctionType *RecordTargetTy =
+      FunctionType::get(Type::getVoidTy(CTX),
+                        {PointerType::getUnqual(CTX), Int64Ty},
+                        /*IsVarArgs=*/false);
+  Function *RecordTargetF = Function::Create(
+      RecordTargetTy, GlobalValue::InternalLinkage, "dcc_record_target", M);
+  RecordTargetF->setDoesNotThrow();
+  Value *Slots = RecordTargetF->getArg(0);
+  Value *Target = RecordTargetF->getArg(1);
+
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", RecordTargetF);
+  BasicBlock *Loop = BasicBlock::Create(CTX, "loop", RecordTargetF);
+  BasicBlock *Claim = BasicBlock::Create(CTX, "claim", RecordTargetF);
+  BasicBlock *Check = BasicBlock::Create(CTX, "check", RecordTargetF);
+  BasicBlock *Next = BasicBlock::Create(CTX, "next", RecordTargetF);
+  BasicBlock *Hit = BasicBlock::Create(CTX, "hit", RecordTargetF);
+  BasicBlock *Exit = BasicBlock::Create(CTX, "exit", RecordTargetF);
+
+  IRBuilder<> Builder(Entry);
+  Builder.CreateBr(Loop);
+
+  // Load the address recorded in slot Idx
+  Builder.SetInsertPoint(Loop);
+  PHINode *Idx = Builder.CreatePHI(Int64Ty, 2, "idx");
+  Value *AddressPtr = Builder.CreateInBoundsGEP(
+      TargetTy, Slots, {Idx, Builder.getInt32(0)});
+  LoadInst *Address =
+      Builder.CreateAlignedLoad(Int64Ty, AddressPtr, MaybeAlign(8));
+  if (Atomic)
+    Address->setAtomic(AtomicOrdering::Monotonic);
+  Builder.CreateCondBr(Builder.CreateIsNull(Address), Claim, Check);
+
+  // The slot is free, claim it for Target
+  Builder.SetInsertPoint(Claim);
+  Value *Claimed = Target;
+  if (Atomic) {
+    Value *Pair = Builder.CreateAtomicCmpXchg(
+        AddressPtr, Builder.getInt64(0), Target, MaybeAlign(8),
+        AtomicOrdering::Monotonic, AtomicOrdering::Monotonic);
+    // On failure, another thread has claimed the slot in the meantime
+    Claimed = Builder.CreateSelect(Builder.CreateExtractValue(Pair, 1),
+                                   Target,
+                                   Builder.CreateExtractValue(Pair, 0));
+  } else {
+    Builder.CreateAlignedStore(Target, AddressPtr, MaybeAlign(8));
+  }
+  Builder.CreateBr(Check);
+
+  Builder.SetInsertPoint(Check);
+  PHINode *SlotAddress = Builder.CreatePHI(Int64Ty, 2);
+  SlotAddress->addIncoming(Address, Loop);
+  SlotAddress->addIncoming(Claimed, Claim);
+  Builder.CreateCondBr(Builder.CreateICmpEQ(SlotAddress, Target), Hit, Next);
+
+  Builder.SetInsertPoint(Next);
+  Value *NextIdx = Builder.CreateAdd(Idx, Builder.getInt64(1));
+  Builder.CreateCondBr(
+      Builder.CreateICmpULT(NextIdx, Builder.getInt64(NumSlots)), Loop, Exit);
+  Idx->addIncoming(Builder.getInt64(0), Entry);
+  Idx->addIncoming(NextIdx, Next);
+
+  Builder.SetInsertPoint(Hit);
+  EmitIncrement(Builder,
+                Builder.CreateInBoundsGEP(TargetTy, Slots,
+                                          {Idx, Builder.getInt32(1)}),
+                Atomic);
+  Builder.CreateRetVoid();
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateRetVoid();
+
+  return RecordTargetF;
+}
+
+// Implements `-dynamic-cc-edges`: counts the entries of every function
+// defined in M and the executions of every call site in these functions, and
+// records the targets of the indirect calls. The results are written as a
+// call-edge profile on exit.
+static bool InstrumentCallEdges(Module &M) {
+  if (SamplePeriod > 1)
+    errs() << "warning: -dynamic-cc-sample-period is ignored with "
+              "-dynamic-cc-edges\n";
+  // The sharded mode is not supported for the call sites, use atomic
+  // counters instead
+  bool Atomic = (CounterMode != CounterKind::Plain);
+
+  // STEP 1: Collect the functions and the call sites to instrument (before
+  // adding any helpers)
+  // ---------------------------------------------------------------------
+  SmallVector<Function *, 16> Funcs;
+  DenseMap<const Function *, unsigned> FuncIdxMap;
+  for (auto &F : M) {
+    if (F.isIntrinsic())
+      continue;
+    FuncIdxMap[&F] = Funcs.size();
+    Funcs.push_back(&F);
+  }
+
+  std::vector<CallEdgeSite> Sites;
+  unsigned NumTargets = 0;
+  bool HasDefinitions = false;
+  for (Function *F : Funcs) {
+    if (F->isDeclaration())
+      continue;
+    HasDefinitions = true;
+
+    for (auto &Inst : instructions(*F)) {
+      auto *CB = dyn_cast<CallBase>(&Inst);
+      if (nullptr == CB)
+        continue;
+
+      auto [LineOffset, Discriminator] = GetCallSiteLocation(*CB);
+      CallEdgeSite Site{CB,         FuncIdxMap[F],
+                        CallEdgeProfileIndirect,
+                        LineOffset, Discriminator,
+                        /*FirstTarget=*/0, /*NumTargets=*/0};
+      if (auto *Callee = dyn_cast<Function>(
+              CB->getCalledOperand()->stripPointerCastsAndAliases())) {
+        if (Callee->isIntrinsic())
+          continue;
+        Site.Callee = FuncIdxMap[Callee];
+      } else if (CB->isIndirectCall()) {
+        Site.FirstTarget = NumTargets;
+        Site.NumTargets = NumIndirectTargets;
+        NumTargets += NumIndirectTargets;
+      } else {
+        // E.g. inline assembly
+        continue;
+      }
+      Sites.push_back(Site);
+    }
+  }
+
+  // Stop here if there are no function definitions in this module
+  if (!HasDefinitions)
+    return false;
+
+  uint64_t ProfileSize = 0;
+  GlobalVariable *Profile =
+      CreateCallEdgeProfileData(M, Funcs, Sites, NumTargets, ProfileSize);
+  Function *RecordTargetF = nullptr;
+  if (NumTargets)
+    RecordTargetF = CreateRecordTargetFunc(M, NumIndirectTargets, Atomic);
+
+  // STEP 2: Count the entries of every function
+  // -------------------------------------------
+  for (unsigned FuncIdx = 0, NumFuncs = Funcs.size(); FuncIdx != NumFuncs;
+       ++FuncIdx) {
+    Function *F = Funcs[FuncIdx];
+    if (F->isDeclaration())
+      continue;
+
+    IRBuilder<> Builder(&*F->getEntryBlock().getFirstInsertionPt());
+    EmitIncrement(Builder,
+                  GetProfileField(Profile, /*Field=*/1, FuncIdx,
+                                  /*SubField=*/0),
+                  Atomic);
+    LLVM_DEBUG(dbgs() << " Instrumented: " << F->getName() << "\n");
+  }
+
+  // STEP 3: Count the executions of every call site (and record the targets
+  // of the indirect calls)
+  // -----------------------------------------------------------------------
+  for (unsigned SiteIdx = 0, NumSites = Sites.size(); SiteIdx != NumSites;
+       ++SiteIdx) {
+    const CallEdgeSite &Site = Sites[SiteIdx];
+
+    IRBuilder<> Builder(Site.Call);
+    EmitIncrement(Builder,
+                  GetProfileField(Profile, /*Field=*/2, SiteIdx,
+                                  /*SubField=*/0),
+                  Atomic);
+    if (Site.NumTargets)
+      Builder.CreateCall(
+          RecordTargetF,
+          {GetProfileField(Profile, /*Field=*/3, Site.FirstTarget,
+                           /*SubField=*/0),
+           Builder.CreatePtrToInt(Site.Call->getCalledOperand(),
+                                  Builder.getInt64Ty())});
+  }
+
+  // STEP 4: Write the profile on exit
+  // ---------------------------------
+  Function *WriterF = CreateProfileWriterFunc(M, Profile, /*NumFuncs=*/0,
+                                              ProfileSize,
+                                              /*ReadCounterF=*/nullptr);
+  appendToGlobalDtors(M, WriterF, /*Priority=*/0);
+  return true;
+}
+
 //-----------------------------------------------------------------------------
 // DynamicCallCounter implementation
 //-----------------------------------------------------------------------------
 bool DynamicCallCounter::runOnModule(Module &M) {
+  if (CallEdges)
+    return InstrumentCallEdges(M);
+
   bool Instrumented = false;
 
   // Function name <--> IR variable that holds the call counter
   llvm::StringMap<Constant *> CallCounterMap;
   // Function name <--> IR variable that holds the function name
   llvm::StringMap<Constant *> FuncNameMap;
+  // Function name <--> index of its counter in the shards (sharded mode only)
+  llvm::StringMap<unsigned> CounterIdxMap;
 
   auto &CTX = M.getContext();
 
+  // Collect the functions to instrument first - the sharded counters are
+  // sized by the number of functions and the helpers created below must not
+  // be instrumented themselves.
+  SmallVector<Function *, 16> FuncsToInstrument;
+  for (auto &F : M)
+    if (!F.isDeclaration())
+      FuncsToInstrument.push_back(&F);
+
+  bool BinaryOutput = (OutputFormat == OutputKind::Binary);
+  GlobalVariable *Profile = nullptr;
+  if (BinaryOutput && !FuncsToInstrument.empty())
+    Profile = CreateProfileData(M, FuncsToInstrument);
+
+  GlobalVariable *Shards = nullptr;
+  Function *ShardIndexF = nullptr;
+  unsigned NumShards = PowerOf2Ceil(std::max(1u, NumCounterShards.getValue()));
+  if (CounterMode == CounterKind::Sharded && !FuncsToInstrument.empty()) {
+    uint64_t RowLen = 0;
+    Shards = CreateShardedCounters(M, FuncsToInstrument.size(), NumShards,
+                                   RowLen);
+    ShardIndexF = CreateShardIndexFunc(M, NumShards);
+  }
+
+  // Every sampled call accounts for Period calls
+  unsigned Period = std::max(1u, SamplePeriod.getValue());
+  GlobalVariable *Countdown = nullptr;
+  if (Period > 1 && !FuncsToInstrument.empty())
+    Countdown =
+        createSamplingCountdown(M, "DynamicCallCounterCountdown", Period);
+
   // STEP 1: For each function in the module, inject a call-counting code
   // --------------------------------------------------------------------
-  for (auto &F : M) {
-    if (F.isDeclaration())
-      continue;
+  for (unsigned FuncIdx = 0, NumFuncs = FuncsToInstrument.size();
+       FuncIdx != NumFuncs; ++FuncIdx) {
+    Function *F = FuncsToInstrument[FuncIdx];
 
     // Get an IR builder. Sets the insertion point to the top of the function
-    IRBuilder<> Builder(&*F.getEntryBlock().getFirstInsertionPt());
-
-    // Create a global variable to count the calls to this function
-    std::string CounterName = "CounterFor_" + std::string(F.getName());
-    Constant *Var = CreateGlobalCounter(M, CounterName);
-    CallCounterMap[F.getName()] = Var;
-
-    // Create a global variable to hold the name of this function
-    auto FuncName = Builder.CreateGlobalString(F.getName());
-    FuncNameMap[F.getName()] = FuncName;
+    // (or to the sampled path when sampling)
+    IRBuilder<> Builder(&*F->getEntryBlock().getFirstInsertionPt());
+    if (Countdown)
+      Builder.SetInsertPoint(emitSamplingCheck(*F, Countdown, Period));
 
     // Inject instruction to increment the call count each time this function
     // executes
-    LoadInst *Load2 = Builder.CreateLoad(IntegerType::getInt32Ty(CTX), Var);
-    Value *Inc2 = Builder.CreateAdd(Builder.getInt32(1), Load2);
-    Builder.CreateStore(Inc2, Var);
+    switch (CounterMode) {
+    case CounterKind::Plain: {
+      if (BinaryOutput) {
+        // The counters are part of the profile and are always 64-bit wide
+        Constant *Var = GetProfileCounter(Profile, FuncIdx);
+        LoadInst *Load = Builder.CreateLoad(IntegerType::getInt64Ty(CTX), Var);
+        Value *Inc = Builder.CreateAdd(Builder.getInt64(Period), Load);
+        Builder.CreateStore(Inc, Var);
+        break;
+      }
+
+      // Create a global variable to count the calls to this function
+      std::string CounterName = "CounterFor_" + std::string(F->getName());
+      Constant *Var = CreateGlobalCounter(M, CounterName);
+      CallCounterMap[F->getName()] = Var;
+
+      LoadInst *Load2 = Builder.CreateLoad(IntegerType::getInt32Ty(CTX), Var);
+      Value *Inc2 = Builder.CreateAdd(Builder.getInt32(Period), Load2);
+      Builder.CreateStore(Inc2, Var);
+      break;
+    }
+    case CounterKind::Atomic: {
+      Constant *Var = nullptr;
+      if (BinaryOutput) {
+        Var = GetProfileCounter(Profile, FuncIdx);
+      } else {
+        std::string CounterName = "CounterFor_" + std::string(F->getName());
+        Var = CreateGlobalCounter64(M, CounterName);
+        CallCounterMap[F->getName()] = Var;
+      }
+
+      Builder.CreateAtomicRMW(AtomicRMWInst::Add, Var,
+                              Builder.getInt64(Period), MaybeAlign(8),
+                              AtomicOrdering::Monotonic);
+      break;
+    }
+    case CounterKind::Sharded: {
+      CounterIdxMap[F->getName()] = FuncIdx;
+
+      Value *Shard = Builder.CreateCall(ShardIndexF);
+      Value *Slot =
+          Builder.CreateInBoundsGEP(Shards->getValueType(), Shards,
+                                    {Builder.getInt64(0), Shard,
+                                     Builder.getInt64(FuncIdx)});
+      Builder.CreateAtomicRMW(AtomicRMWInst::Add, Slot,
+                              Builder.getInt64(Period), MaybeAlign(8),
+                              AtomicOrdering::Monotonic);
+      break;
+    }
+    }
+
+    // Create a global variable to hold the name of this function (in the
+    // binary mode the names are already stored in the profile)
+    if (!BinaryOutput) {
+      auto FuncName = Builder.CreateGlobalString(F->getName());
+      FuncNameMap[F->getName()] = FuncName;
+    }
 
     // The following is visible only if you pass -debug on the command line
     // *and* you have an assert build.
-    LLVM_DEBUG(dbgs() << " Instrumented: " << F.getName() << "\n");
+    LLVM_DEBUG(dbgs() << " Instrumented: " << F->getName() << "\n");
 
     Instrumented = true;
   }
@@ -118,6 +955,23 @@ bool DynamicCallCounter::runOnModule(Module &M) {
   if (false == Instrumented)
     return Instrumented;
 
+  // In the binary mode, write the profile on exit and stop here
+  if (BinaryOutput) {
+    Function *ReadCounterF = nullptr;
+    if (CounterMode == CounterKind::Sharded)
+      ReadCounterF = CreateReadCounterFunc(M, Shards, NumShards);
+
+    auto *NamesTy = cast<ArrayType>(
+        cast<StructType>(Profile->getValueType())->getElementType(2));
+    uint64_t ProfileSize = sizeof(DCCProfileHeader) +
+                           FuncsToInstrument.size() * sizeof(DCCProfileRecord) +
+                           NamesTy->getNumElements();
+    Function *WriterF = CreateProfileWriterFunc(
+        M, Profile, FuncsToInstrument.size(), ProfileSize, ReadCounterF);
+    appendToGlobalDtors(M, WriterF, /*Priority=*/0);
+    return true;
+  }
+
   // STEP 2: Inject the declaration of printf
   // ----------------------------------------
   // Create (or _get_ in cases where it's already available) the following
@@ -195,12 +1049,29 @@ bool DynamicCallCounter::runOnModule(Module &M) {
 
   Builder.CreateCall(Printf, {ResultHeaderStrPtr});
 
-  LoadInst *LoadCounter;
-  for (auto &item : CallCounterMap) {
-    LoadCounter = Builder.CreateLoad(IntegerType::getInt32Ty(CTX), item.second);
-    // LoadCounter = Builder.CreateLoad(item.second);
-    Builder.CreateCall(
-        Printf, {ResultFormatStrPtr, FuncNameMap[item.first()], LoadCounter});
+  if (CounterMode == CounterKind::Sharded) {
+    Function *ReadCounterF = CreateReadCounterFunc(M, Shards, NumShards);
+    for (auto &item : CounterIdxMap) {
+      Value *Count =
+          Builder.CreateCall(ReadCounterF, {Builder.getInt64(item.second)});
+      Builder.CreateCall(
+          Printf, {ResultFormatStrPtr, FuncNameMap[item.first()], Count});
+    }
+  } else {
+    LoadInst *LoadCounter;
+    for (auto &item : CallCounterMap) {
+      if (CounterMode == CounterKind::Atomic) {
+        LoadCounter = Builder.CreateAlignedLoad(IntegerType::getInt64Ty(CTX),
+                                                item.second, MaybeAlign(8));
+        // Other threads might still be running
+        LoadCounter->setAtomic(AtomicOrdering::Monotonic);
+      } else {
+        LoadCounter =
+            Builder.CreateLoad(IntegerType::getInt32Ty(CTX), item.second);
+      }
+      Builder.CreateCall(
+          Printf, {ResultFormatStrPtr, FuncNameMap[item.first()], LoadCounter});
+    }
   }
 
   // Finally, insert return instruction
@@ -0,0 +1,290 @@
+//========================================================================
+// FILE:
+//    DynamicOpcodeCounter.cpp
+//
+// DESCRIPTION:
+//    Counts how many times every LLVM IR opcode is executed (as opposed to
+//    OpcodeCounter, which counts how many times every opcode appears in the
+//    code) and prints the resulting histogram when the module exits.
+//
+//    Rather than updating a counter per instruction, this pass instruments
+//    the input module as follows:
+//      1. Every basic block B gets a counter, `BlockCounts[B]`, that is
+//         incremented (a single load/add/store) whenever B executes.
+//      2. The static opcode histogram of every block (computed with
+//         OpcodeHistogram, the engine behind OpcodeCounter) is embedded in
+//         the module as a sparse table: for every block, the list of
+//         (opcode, count) pairs.
+//      3. A module destructor, `dynamic_opcode_counter_print`, multiplies
+//         the block counts by the static histograms and prints the totals in
+//         the same format as OpcodeCounter.
+//    The runtime overhead is therefore one increment per executed block,
+//    regardless of the size of the block.
+//
+//    Every block is assumed to execute in full, i.e. the counts are not exact
+//    for blocks that are left early (e.g. via a call that never returns or
+//    that throws). Like the default counters of DynamicCallCounter, the
+//    block counters are not thread-safe.
+//
+// USAGE:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicOpcodeCounter.so `\`
+//        -passes="dynamic-opcode-counter" <bitcode-file> -o instrumented.bin
+//      $ lli instrumented.bin
+//
+// License: MIT
+//========================================================================
+#include "DynamicOpcodeCounter.h"
+#include "OpcodeHistogram.h"
+
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "dynamic-opcode-counter"
+
+// Defines the module destructor, `dynamic_opcode_counter_print`, that
+// computes and prints the number of times every opcode was executed:
+// ```
+//    for (unsigned B = 0; B < NumBlocks; B++)
+//      for (unsigned E = BlockStart[B]; E < BlockStart[B + 1]; E++)
+//        Totals[EntryOpcode[E]] += BlockCounts[B] * EntryCount[E];
+//
+//    printf(Header);
+//    for (unsigned Idx = 0; Idx < NumOpcodes; Idx++)
+//      printf("%-20s %-10lu\n", Names[Idx], Totals[Idx]);
+// ```
+// EntryOpcode indexes Opcodes (i.e. only the opcodes that occur in the
+// module get a total).
+static Function *CreatePrintFunc(Module &M, ArrayRef<unsigned> Opcodes,
+                                 GlobalVariable *BlockCounts,
+                                 GlobalVariable *BlockStart,
+                                 GlobalVariable *EntryOpcode,
+                                 GlobalVariable *EntryCount) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+  uint64_t NumBlocks =
+      cast<ArrayType>(BlockCounts->getValueType())->getNumElements();
+
+  // Declare printf (see DynamicCallCounter)
+  FunctionCallee Printf = M.getOrInsertFunction(
+      "printf", FunctionType::get(Int32Ty, PtrTy, /*IsVarArgs=*/true));
+  Function *PrintfF = dyn_cast<Function>(Printf.getCallee());
+  PrintfF->setDoesNotThrow();
+  PrintfF->addParamAttr(0, llvm::Attribute::getWithCaptureInfo(
+                               M.getContext(), llvm::CaptureInfo::none()));
+  PrintfF->addParamAttr(0, Attribute::ReadOnly);
+
+  Type *TotalsTy = ArrayType::get(Int64Ty, Opcodes.size());
+  auto *Totals = new GlobalVariable(M, TotalsTy, /*isConstant=*/false,
+                                    GlobalValue::InternalLinkage,
+                                    Constant::getNullValue(TotalsTy),
+                                    "DynamicOpcodeCounterTotals");
+
+  Function *PrintF = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "dynamic_opcode_counter_print", M);
+
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", PrintF);
+  BasicBlock *BlockLoop = BasicBlock::Create(CTX, "blocks", PrintF);
+  BasicBlock *EntryLoop = BasicBlock::Create(CTX, "entries", PrintF);
+  BasicBlock *NextBlock = BasicBlock::Create(CTX, "next", PrintF);
+  BasicBlock *Print = BasicBlock::Create(CTX, "print", PrintF);
+
+  // STEP 1: Compute the totals
+  IRBuilder<> Builder(Entry);
+  Builder.CreateBr(BlockLoop);
+
+  Builder.SetInsertPoint(BlockLoop);
+  PHINode *Block = Builder.CreatePHI(Int64Ty, 2, "block");
+  Value *BlockCount = Builder.CreateLoad(
+      Int64Ty, Builder.CreateInBoundsGEP(Int64Ty, BlockCounts, Block));
+  Value *Begin = Builder.CreateLoad(
+      Int32Ty, Builder.CreateInBoundsGEP(Int32Ty, BlockStart, Block));
+  Value *End = Builder.CreateLoad(
+      Int32Ty, Builder.CreateInBoundsGEP(
+                   Int32Ty, BlockStart,
+                   Builder.CreateAdd(Block, Builder.getInt64(1))));
+  Builder.CreateCondBr(Builder.CreateICmpEQ(Begin, End), NextBlock,
+                       EntryLoop);
+
+  Builder.SetInsertPoint(EntryLoop);
+  PHINode *Idx = Builder.CreatePHI(Int32Ty, 2, "idx");
+  Value *Idx64 = Builder.CreateZExt(Idx, Int64Ty);
+  Value *Opcode = Builder.CreateLoad(
+      Int32Ty, Builder.CreateInBoundsGEP(Int32Ty, EntryOpcode, Idx64));
+  Value *Count = Builder.CreateLoad(
+      Int32Ty, Builder.CreateInBoundsGEP(Int32Ty, EntryCount, Idx64));
+  Value *Total = Builder.CreateInBoundsGEP(
+      Int64Ty, Totals, Builder.CreateZExt(Opcode, Int64Ty));
+  Builder.CreateStore(
+      Builder.CreateAdd(
+          Builder.CreateLoad(Int64Ty, Total),
+          Builder.CreateMul(BlockCount, Builder.CreateZExt(Count, Int64Ty))),
+      Total);
+  Value *NextIdx = Builder.CreateAdd(Idx, Builder.getInt32(1));
+  Builder.CreateCondBr(Builder.CreateICmpEQ(NextIdx, End), NextBlock,
+                       EntryLoop);
+  Idx->addIncoming(Begin, BlockLoop);
+  Idx->addIncoming(NextIdx, EntryLoop);
+
+  Builder.SetInsertPoint(NextBlock);
+  Value *Next = Builder.CreateAdd(Block, Builder.getInt64(1));
+  Builder.CreateCondBr(Builder.CreateICmpEQ(Next, Builder.getInt64(NumBlocks)),
+                       Print, BlockLoop);
+  Block->addIncoming(Builder.getInt64(0), Entry);
+  Block->addIncoming(Next, NextBlock);
+
+  // STEP 2: Print the results
+  Builder.SetInsertPoint(Print);
+  std::string Header = "";
+  Header += "=================================================\n";
+  Header += "LLVM-TUTOR: dynamic OpcodeCounter results\n";
+  Header += "=================================================\n";
+  Header += "OPCODE               #TIMES EXECUTED\n";
+  Header += "-------------------------------------------------\n";
+  Builder.CreateCall(Printf, {Builder.CreateGlobalString(Header)});
+  Value *Format = Builder.CreateGlobalString("%-20s %-10lu\n");
+  for (unsigned OpcodeIdx = 0; OpcodeIdx != Opcodes.size(); ++OpcodeIdx) {
+    Value *OpcodeTotal = Builder.CreateLoad(
+        Int64Ty, Builder.CreateInBoundsGEP(Int64Ty, Totals,
+                                           Builder.getInt64(OpcodeIdx)));
+    Builder.CreateCall(
+        Printf,
+        {Format,
+         Builder.CreateGlobalString(
+             Instruction::getOpcodeName(Opcodes[OpcodeIdx])),
+         OpcodeTotal});
+  }
+  Builder.CreateCall(
+      Printf, {Builder.CreateGlobalString(
+                  "-------------------------------------------------\n\n")});
+  Builder.CreateRetVoid();
+
+  return PrintF;
+}
+
+//-----------------------------------------------------------------------------
+// DynamicOpcodeCounter implementation
+//-----------------------------------------------------------------------------
+bool DynamicOpcodeCounter::runOnModule(Module &M) {
+  auto &CTX = M.getContext();
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+
+  // STEP 1: Compute the static histogram of every block and store it as a
+  // sparse table: the (opcode, count) pairs of block B are entries
+  // [BlockStart[B], BlockStart[B + 1]). Blocks without an insertion point
+  // (e.g. those holding just a catchswitch) are not counted.
+  SmallVector<BasicBlock *, 64> Blocks;
+  SmallVector<uint32_t, 64> BlockStart;
+  SmallVector<uint32_t, 256> EntryOpcode;
+  SmallVector<uint32_t, 256> EntryCount;
+  OpcodeHistogram ModuleHistogram;
+  for (auto &F : M) {
+    for (auto &BB : F) {
+      if (BB.getFirstInsertionPt() == BB.end())
+        continue;
+
+      OpcodeHistogram Histogram;
+      for (auto &Inst : BB)
+        Histogram.add(Inst);
+      ModuleHistogram.merge(Histogram);
+
+      Blocks.push_back(&BB);
+      BlockStart.push_back(EntryOpcode.size());
+      for (unsigned Opcode : Histogram.Opcodes) {
+        EntryOpcode.push_back(Opcode);
+        EntryCount.push_back(Histogram.Counts[Opcode]);
+      }
+    }
+  }
+  BlockStart.push_back(EntryOpcode.size());
+
+  // Stop here if there are no function definitions in this module
+  if (Blocks.empty())
+    return false;
+
+  // STEP 2: Renumber the opcodes in the order in which they are printed, so
+  // that only the opcodes that occur in the module need a total.
+  SmallVector<unsigned, 16> Opcodes = ModuleHistogram.getPrintOrder();
+  SmallVector<uint32_t, OpcodeHistogram::NumOpcodes> OpcodeIdx(
+      OpcodeHistogram::NumOpcodes, 0);
+  for (unsigned Idx = 0; Idx != Opcodes.size(); ++Idx)
+    OpcodeIdx[Opcodes[Idx]] = Idx;
+  for (uint32_t &Opcode : EntryOpcode)
+    Opcode = OpcodeIdx[Opcode];
+
+  auto CreateTable = [&](ArrayRef<uint32_t> Data, StringRef Name) {
+    Constant *Init = ConstantDataArray::get(CTX, Data);
+    return new GlobalVariable(M, Init->getType(), /*isConstant=*/true,
+                              GlobalValue::PrivateLinkage, Init, Name);
+  };
+  GlobalVariable *BlockStartG =
+      CreateTable(BlockStart, "DynamicOpcodeCounterBlockStart");
+  GlobalVariable *EntryOpcodeG =
+      CreateTable(EntryOpcode, "DynamicOpcodeCounterEntryOpcode");
+  GlobalVariable *EntryCountG =
+      CreateTable(EntryCount, "DynamicOpcodeCounterEntryCount");
+
+  Type *BlockCountsTy = ArrayType::get(Int64Ty, Blocks.size());
+  auto *BlockCounts = new GlobalVariable(M, BlockCountsTy,
+                                         /*isConstant=*/false,
+                                         GlobalValue::InternalLinkage,
+                                         Constant::getNullValue(BlockCountsTy),
+                                         "DynamicOpcodeCounterBlockCounts");
+
+  // STEP 3: Increment the counter of every block on entry
+  for (unsigned BlockIdx = 0; BlockIdx != Blocks.size(); ++BlockIdx) {
+    BasicBlock *BB = Blocks[BlockIdx];
+    IRBuilder<> Builder(BB, BB->getFirstInsertionPt());
+    Value *Counter = Builder.CreateInBoundsGEP(
+        BlockCountsTy, BlockCounts,
+        {Builder.getInt32(0), Builder.getInt32(BlockIdx)});
+    Value *Count = Builder.CreateLoad(Int64Ty, Counter);
+    Builder.CreateStore(Builder.CreateAdd(Count, Builder.getInt64(1)),
+                        Counter);
+  }
+
+  // STEP 4: Print the results on exit
+  appendToGlobalDtors(M,
+                      CreatePrintFunc(M, Opcodes, BlockCounts, BlockStartG,
+                                      EntryOpcodeG, EntryCountG),
+                      /*Priority=*/0);
+
+  return true;
+}
+
+PreservedAnalyses DynamicOpcodeCounter::run(llvm::Module &M,
+                                            llvm::ModuleAnalysisManager &) {
+  bool Changed = runOnModule(M);
+
+  return (Changed ? llvm::PreservedAnalyses::none()
+                  : llvm::PreservedAnalyses::all());
+}
+
+//-----------------------------------------------------------------------------
+// New PM Registration
+//-----------------------------------------------------------------------------
+llvm::PassPluginLibraryInfo getDynamicOpcodeCounterPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "dynamic-opcode-counter",
+          LLVM_VERSION_STRING, [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "dynamic-opcode-counter") {
+                    MPM.addPass(DynamicOpcodeCounter());
+                    return true;
+                  }
+                  return false;
+                });
+          }};
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getDynamicOpcodeCounterPluginInfo();
+}
@@ -0,0 +1,432 @@
+//========================================================================
+// FILE:
+//    EdgeProfiler.cpp
+//
+// DESCRIPTION:
+//    Instruments a module so that, at runtime, it records how many times
+//    every CFG edge (and hence every basic block) of every function is
+//    executed. This is the edge counterpart of DynamicCallCounter.
+//
+//    Instrumenting every edge would be wasteful - flow conservation (for
+//    every block, the sum of the incoming edge counts is equal to the sum of
+//    the outgoing edge counts) means that the counts of the edges on any
+//    spanning tree of the CFG can be computed from the counts of the
+//    remaining edges. For every function F this pass:
+//      1. Builds the CFG of F extended with a virtual node that has an edge
+//         to the entry block and an edge from every exit block (i.e. a block
+//         without successors). Thanks to these edges flow conservation also
+//         holds for the entry and the exit blocks. Blocks with a call that
+//         may not return (i.e. that may unwind or that is `noreturn`) get an
+//         extra edge to the virtual node too, as the execution may leave the
+//         function in the middle of such a block.
+//      2. Weighs every edge with its estimated execution frequency (taken
+//         from BlockFrequencyInfo and BranchProbabilityInfo, so it also
+//         reflects PGO data if available). The virtual edge to the entry
+//         block gets the maximum weight.
+//      3. Computes the maximum spanning tree of the extended CFG (Kruskal's
+//         algorithm). As the hottest edges end up on the tree, they are not
+//         instrumented. The edges that leave the function from the middle of
+//         a block can't be instrumented, so these are added to the tree
+//         first.
+//      4. Inserts a 64-bit counter increment on every edge that is _not_ on
+//         the tree. Edges that are the only outgoing edge of their source, or
+//         the only incoming edge of their destination, are instrumented in
+//         place. The remaining (critical) edges are split.
+//
+//    The counters, the CFG of every function and the function names are laid
+//    out in a single global variable (see DynamicCallCounterProfile.h) that is
+//    written, in one go, to `-edge-prof-file` when the module exits. The
+//    counts of the edges on the spanning trees are reconstructed offline by
+//    `dcc-profdata show` (or `dcc-profdata merge`).
+//
+//    Functions with EH pads or with `indirectbr`/`callbr` terminators are not
+//    instrumented as some of their edges cannot be split.
+//
+// USAGE:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libEdgeProfiler.so `\`
+//        -passes="edge-prof" -edge-prof-file=edges.%p `\`
+//        <bitcode-file> -o instrumented.bin
+//      $ lli instrumented.bin
+//      $ <BUILD_DIR>/bin/dcc-profdata show edges.*
+//    Pass `-edge-prof-atomic` to make the counters thread-safe (the
+//    increments become relaxed atomics).
+//
+// License: MIT
+//========================================================================
+#include "EdgeProfiler.h"
+#include "DynamicCallCounterProfile.h"
+#include "InstrumentationUtils.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/EquivalenceClasses.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/TargetParser/Triple.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "edge-prof"
+
+//-----------------------------------------------------------------------------
+// Command line options
+//-----------------------------------------------------------------------------
+static cl::opt<bool>
+    AtomicCounters("edge-prof-atomic",
+                   cl::desc("Use relaxed atomic increments for the edge "
+                            "counters (thread-safe)"),
+                   cl::init(false));
+
+static cl::opt<std::string> ProfileFile(
+    "edge-prof-file",
+    cl::desc("The edge profile to write on exit (%p expands to the process "
+             "ID)"),
+    cl::value_desc("filename"), cl::init("edge.profdata"));
+
+static constexpr unsigned CacheLineSize = 64;
+
+namespace {
+// An edge of the extended CFG. A null Src/Dst is the virtual node.
+struct CFGEdge {
+  BasicBlock *Src;
+  BasicBlock *Dst;
+  uint64_t Weight;
+  // The edge can't be instrumented (it must be on the tree)
+  bool Uncountable = false;
+  bool OnTree = false;
+  uint32_t CounterIdx = EdgeProfileNoCounter;
+};
+
+// The instrumentation plan for one function
+struct FunctionPlan {
+  Function *F;
+  // Basic block <--> its ID in the profile (IDs start at 1)
+  DenseMap<BasicBlock *, uint32_t> BlockIDs;
+  std::vector<CFGEdge> Edges;
+};
+} // namespace
+
+// Returns true if all the edges of F can be instrumented
+static bool canInstrument(Function &F) {
+  for (BasicBlock &BB : F) {
+    if (BB.isEHPad())
+      return false;
+    Instruction *Term = BB.getTerminator();
+    if (isa<IndirectBrInst>(Term) || isa<CallBrInst>(Term))
+      return false;
+  }
+  return true;
+}
+
+// Returns true if the execution may leave F in the middle of BB (or before
+// the terminator of BB is executed), i.e. if BB contains a call that may
+// unwind (F has no EH pads, see canInstrument) or that doesn't return
+static bool mayExitEarly(const BasicBlock &BB) {
+  return any_of(BB, [](const Instruction &I) {
+    const auto *CB = dyn_cast<CallBase>(&I);
+    return CB && (CB->mayThrow() || CB->doesNotReturn());
+  });
+}
+
+// Builds the extended CFG of F and selects the edges to instrument, i.e. the
+// edges that are not on the maximum spanning tree. Counters are numbered from
+// NextCounter.
+static FunctionPlan planFunction(Function &F, BlockFrequencyInfo &BFI,
+                                 BranchProbabilityInfo &BPI,
+                                 uint32_t &NextCounter) {
+  FunctionPlan Plan;
+  Plan.F = &F;
+
+  uint32_t NextBlockID = 1;
+  for (BasicBlock &BB : F)
+    Plan.BlockIDs[&BB] = NextBlockID++;
+
+  // STEP 1: Collect the edges of the extended CFG
+  Plan.Edges.push_back({nullptr, &F.getEntryBlock(),
+                        std::numeric_limits<uint64_t>::max()});
+  for (BasicBlock &BB : F) {
+    uint64_t Freq = BFI.getBlockFreq(&BB).getFrequency();
+    // A counter on the exit edge (i.e. before the terminator) would miss the
+    // early exits, so both are counted as one uncountable edge
+    bool ExitsEarly = mayExitEarly(BB);
+    if (succ_empty(&BB)) {
+      Plan.Edges.push_back({&BB, nullptr, Freq, ExitsEarly});
+      continue;
+    }
+    if (ExitsEarly)
+      Plan.Edges.push_back({&BB, nullptr, 0, /*Uncountable=*/true});
+
+    // Multiple edges to the same successor (e.g. from a switch) are counted
+    // as one
+    SmallPtrSet<BasicBlock *, 4> Visited;
+    for (BasicBlock *Succ : successors(&BB)) {
+      if (!Visited.insert(Succ).second)
+        continue;
+      Plan.Edges.push_back(
+          {&BB, Succ, BPI.getEdgeProbability(&BB, Succ).scale(Freq)});
+    }
+  }
+
+  // STEP 2: Kruskal's algorithm - visit the edges from the hottest to the
+  // coldest and add to the tree the ones that don't form a cycle. The
+  // uncountable edges are visited first. They all lead to the virtual node
+  // from distinct blocks, so they never form a cycle.
+  std::vector<unsigned> Order(Plan.Edges.size());
+  for (unsigned Idx = 0; Idx != Order.size(); ++Idx)
+    Order[Idx] = Idx;
+  std::stable_sort(Order.begin(), Order.end(), [&](unsigned A, unsigned B) {
+    const CFGEdge &EdgeA = Plan.Edges[A], &EdgeB = Plan.Edges[B];
+    if (EdgeA.Uncountable != EdgeB.Uncountable)
+      return EdgeA.Uncountable;
+    return EdgeA.Weight > EdgeB.Weight;
+  });
+
+  auto NodeID = [&](BasicBlock *BB) {
+    return BB ? Plan.BlockIDs[BB] : EdgeProfileVirtualNode;
+  };
+  EquivalenceClasses<uint32_t> Components;
+  for (unsigned Idx : Order) {
+    CFGEdge &Edge = Plan.Edges[Idx];
+    uint32_t Src = NodeID(Edge.Src);
+    uint32_t Dst = NodeID(Edge.Dst);
+    if (Components.isEquivalent(Src, Dst)) {
+      assert(!Edge.Uncountable && "An uncountable edge is not on the tree");
+      continue;
+    }
+    Components.unionSets(Src, Dst);
+    Edge.OnTree = true;
+  }
+
+  // STEP 3: Assign counters to the remaining edges
+  for (CFGEdge &Edge : Plan.Edges)
+    if (!Edge.OnTree)
+      Edge.CounterIdx = NextCounter++;
+
+  return Plan;
+}
+
+// Returns the insertion point for the counter of Edge, splitting the edge if
+// that's required
+static Instruction *getCounterInsertPt(const CFGEdge &Edge) {
+  // The virtual edge to the entry block
+  if (!Edge.Src)
+    return &*Edge.Dst->getFirstInsertionPt();
+
+  // Edges to the virtual node and edges from blocks with one successor. Nothing
+  // may separate a musttail call from the return that follows it.
+  if (!Edge.Dst || Edge.Src->getUniqueSuccessor()) {
+    if (CallInst *MustTail = Edge.Src->getTerminatingMustTailCall())
+      return MustTail;
+    return Edge.Src->getTerminator();
+  }
+
+  // Edges to blocks with one predecessor
+  if (Edge.Dst->getUniquePredecessor() == Edge.Src)
+    return &*Edge.Dst->getFirstInsertionPt();
+
+  // Critical edges
+  Instruction *Term = Edge.Src->getTerminator();
+  for (unsigned SuccNum = 0; SuccNum != Term->getNumSuccessors(); ++SuccNum) {
+    if (Term->getSuccessor(SuccNum) != Edge.Dst)
+      continue;
+    BasicBlock *NewBB = SplitCriticalEdge(
+        Term, SuccNum, CriticalEdgeSplittingOptions().setMergeIdenticalEdges());
+    assert(NewBB && "Failed to split a critical edge");
+    return NewBB->getTerminator();
+  }
+  llvm_unreachable("Edge not found");
+}
+
+// Creates the global variable that holds the edge profile. Its type mirrors
+// the layout described in DynamicCallCounterProfile.h:
+//    { EdgeProfileHeader, [NF x EdgeProfileFunction], [NC x i64],
+//      [NE x EdgeProfileEdge], [NamesSize x i8] }
+// All the counters are initialised with 0.
+static GlobalVariable *CreateProfileData(Module &M,
+                                         ArrayRef<FunctionPlan> Plans,
+                                         uint32_t NumCounters,
+                                         uint64_t &ProfileSize) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  auto Int32 = [&](uint64_t V) { return ConstantInt::get(Int32Ty, V); };
+
+  StructType *FuncTy = StructType::get(
+      CTX, {Int32Ty, Int32Ty, Int32Ty, Int32Ty, Int32Ty, Int32Ty});
+  StructType *EdgeTy = StructType::get(CTX, {Int32Ty, Int32Ty, Int32Ty});
+
+  std::string Names;
+  SmallVector<Constant *, 16> Funcs;
+  std::vector<Constant *> Edges;
+  for (const FunctionPlan &Plan : Plans) {
+    StringRef Name = Plan.F->getName();
+    Funcs.push_back(ConstantStruct::get(
+        FuncTy, {Int32(Names.size()), Int32(Name.size()),
+                 Int32(Plan.BlockIDs.size()), Int32(Edges.size()),
+                 Int32(Plan.Edges.size()), Int32(0)}));
+    Names += Name;
+
+    for (const CFGEdge &Edge : Plan.Edges) {
+      uint32_t Src = Edge.Src ? Plan.BlockIDs.lookup(Edge.Src)
+                              : EdgeProfileVirtualNode;
+      uint32_t Dst = Edge.Dst ? Plan.BlockIDs.lookup(Edge.Dst)
+                              : EdgeProfileVirtualNode;
+      Edges.push_back(ConstantStruct::get(
+          EdgeTy, {Int32(Src), Int32(Dst), Int32(Edge.CounterIdx)}));
+    }
+  }
+
+  StructType *HeaderTy = StructType::get(
+      CTX, {Int64Ty, Int32Ty, Int32Ty, Int32Ty, Int32Ty, Int64Ty});
+  Constant *Header = ConstantStruct::get(
+      HeaderTy, {ConstantInt::get(Int64Ty, EdgeProfileMagic),
+                 Int32(EdgeProfileVersion), Int32(Funcs.size()),
+                 Int32(NumCounters), Int32(Edges.size()),
+                 ConstantInt::get(Int64Ty, Names.size())});
+
+  ArrayType *FuncsTy = ArrayType::get(FuncTy, Funcs.size());
+  ArrayType *CountersTy = ArrayType::get(Int64Ty, NumCounters);
+  ArrayType *EdgesTy = ArrayType::get(EdgeTy, Edges.size());
+  Constant *Profile = ConstantStruct::getAnon(
+      CTX, {Header, ConstantArray::get(FuncsTy, Funcs),
+            Constant::getNullValue(CountersTy),
+            ConstantArray::get(EdgesTy, Edges),
+            ConstantDataArray::getString(CTX, Names, /*AddNull=*/false)});
+
+  auto *ProfileGV = new GlobalVariable(M, Profile->getType(),
+                                       /*isConstant=*/false,
+                                       GlobalValue::InternalLinkage, Profile,
+                                       "EdgeProfile");
+  ProfileGV->setAlignment(Align(CacheLineSize));
+  ProfileGV->setSection(Triple(M.getTargetTriple()).isOSBinFormatMachO()
+                            ? "__DATA,__lt_edge_prof"
+                            : "lt_edge_prof");
+  appendToUsed(M, {ProfileGV});
+
+  ProfileSize = sizeof(EdgeProfileHeader) +
+                Funcs.size() * sizeof(EdgeProfileFunction) +
+                uint64_t(NumCounters) * sizeof(uint64_t) +
+                Edges.size() * sizeof(EdgeProfileEdge) + Names.size();
+  return ProfileGV;
+}
+
+// Defines `void edge_prof_write_profile()` that writes Profile to
+// ProfileFile (see emitWriteToFile)
+static Function *CreateProfileWriterFunc(Module &M, GlobalVariable *Profile,
+                                         uint64_t ProfileSize) {
+  auto &CTX = M.getContext();
+  FunctionType *WriterTy =
+      FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false);
+  Function *WriterF = Function::Create(
+      WriterTy, GlobalValue::InternalLinkage, "edge_prof_write_profile", M);
+
+  IRBuilder<> Builder(BasicBlock::Create(CTX, "entry", WriterF));
+  emitWriteToFile(Builder, Profile, ProfileSize, ProfileFile);
+  Builder.CreateRetVoid();
+
+  return WriterF;
+}
+
+//-----------------------------------------------------------------------------
+// EdgeProfiler implementation
+//-----------------------------------------------------------------------------
+bool EdgeProfiler::runOnModule(Module &M, FunctionAnalysisManager &FAM) {
+  // STEP 1: Plan the instrumentation of every function before modifying the
+  // module, so that the analyses are computed on the original CFGs
+  std::vector<FunctionPlan> Plans;
+  uint32_t NumCounters = 0;
+  for (Function &F : M) {
+    if (F.isDeclaration() || !canInstrument(F))
+      continue;
+
+    auto &BFI = FAM.getResult<BlockFrequencyAnalysis>(F);
+    auto &BPI = FAM.getResult<BranchProbabilityAnalysis>(F);
+    Plans.push_back(planFunction(F, BFI, BPI, NumCounters));
+  }
+
+  // Stop here if there are no function definitions in this module
+  if (Plans.empty())
+    return false;
+
+  // STEP 2: Create the profile
+  uint64_t ProfileSize = 0;
+  GlobalVariable *Profile =
+      CreateProfileData(M, Plans, NumCounters, ProfileSize);
+  Type *Int32Ty = IntegerType::getInt32Ty(M.getContext());
+  Type *Int64Ty = IntegerType::getInt64Ty(M.getContext());
+
+  // STEP 3: Inject the counter increments
+  for (const FunctionPlan &Plan : Plans) {
+    for (const CFGEdge &Edge : Plan.Edges) {
+      if (Edge.CounterIdx == EdgeProfileNoCounter)
+        continue;
+
+      Constant *Counter = ConstantExpr::getInBoundsGetElementPtr(
+          Profile->getValueType(), Profile,
+          ArrayRef<Constant *>{ConstantInt::get(Int32Ty, 0),
+                               ConstantInt::get(Int32Ty, 2),
+                               ConstantInt::get(Int32Ty, Edge.CounterIdx)});
+
+      IRBuilder<> Builder(getCounterInsertPt(Edge));
+      if (AtomicCounters) {
+        Builder.CreateAtomicRMW(AtomicRMWInst::Add, Counter,
+                                Builder.getInt64(1), MaybeAlign(8),
+                                AtomicOrdering::Monotonic);
+      } else {
+        LoadInst *Load = Builder.CreateLoad(Int64Ty, Counter);
+        Value *Inc = Builder.CreateAdd(Builder.getInt64(1), Load);
+        Builder.CreateStore(Inc, Counter);
+      }
+    }
+
+    LLVM_DEBUG(dbgs() << " Instrumented: " << Plan.F->getName() << "\n");
+  }
+
+  // STEP 4: Write the profile on exit
+  appendToGlobalDtors(M, CreateProfileWriterFunc(M, Profile, ProfileSize),
+                      /*Priority=*/0);
+
+  return true;
+}
+
+PreservedAnalyses EdgeProfiler::run(llvm::Module &M,
+                                    llvm::ModuleAnalysisManager &MAM) {
+  auto &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  bool Changed = runOnModule(M, FAM);
+
+  return (Changed ? llvm::PreservedAnalyses::none()
+                  : llvm::PreservedAnalyses::all());
+}
+
+//-----------------------------------------------------------------------------
+// New PM Registration
+//-----------------------------------------------------------------------------
+llvm::PassPluginLibraryInfo getEdgeProfilerPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "edge-prof", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "edge-prof") {
+                    MPM.addPass(EdgeProfiler());
+                    return true;
+                  }
+                  return false;
+                });
+          }};
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getEdgeProfilerPluginInfo();
+}
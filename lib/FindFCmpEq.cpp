@@ -19,13 +19,21 @@
 //
 //    [1] "Writing an LLVM Optimization" by Jonathan Smith
 //
+//    With `-find-fcmp-eq-format=jsonl|binary`, the comparisons are written as
+//    records (one per comparison) rather than as text, see ResultWriter.h.
+//    `-find-fcmp-eq-output=<file>` writes them to a file instead of stdout.
+//
 // USAGE:
 //      opt --load-pass-plugin libFindFCmpEq.dylib `\`
 //        --passes='print<find-fcmp-eq>' --disable-output <input-llvm-file>
+//      opt --load-pass-plugin libFindFCmpEq.dylib `\`
+//        --passes='print<find-fcmp-eq>' --find-fcmp-eq-format=jsonl `\`
+//        --disable-output <input-llvm-file>
 //
 // License: MIT
 //=============================================================================
 #include "FindFCmpEq.h"
+#include "FusedAnalysis.h"
 
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/StringRef.h"
@@ -37,6 +45,7 @@
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Compiler.h"
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/raw_ostream.h"
@@ -45,12 +54,36 @@
 
 using namespace llvm;
 
+static cl::opt<ResultFormat> OutputFormat(
+    "find-fcmp-eq-format",
+    cl::desc("The format of the results of print<find-fcmp-eq>"),
+    getResultFormatValues(), cl::init(ResultFormat::Text));
+
+static cl::opt<std::string>
+    OutputFile("find-fcmp-eq-output",
+               cl::desc("Write the results of print<find-fcmp-eq> to this "
+                        "file (rather than to stdout)"),
+               cl::value_desc("filename"), cl::init(""));
+
 static void
 printFCmpEqInstructions(raw_ostream &OS, Function &Func,
-                        const FindFCmpEq::Result &FCmpEqInsts) noexcept {
+                        const FindFCmpEq::Result &FCmpEqInsts,
+                        ResultFormat Format) noexcept {
   if (FCmpEqInsts.empty())
     return;
 
+  if (Format != ResultFormat::Text) {
+    ModuleSlotTracker Tracker(Func.getParent());
+    ResultWriter Writer(OS, Format, "find-fcmp-eq");
+    for (FCmpInst *FCmpEq : FCmpEqInsts) {
+      Writer.beginRecord();
+      Writer.attribute("function", Func.getName());
+      Writer.attribute("instruction", *FCmpEq, Tracker, /*AsOperand=*/false);
+      Writer.endRecord();
+    }
+    return;
+  }
+
   OS << "Floating-point equality comparisons in \"" << Func.getName()
      << "\":\n";
 
@@ -75,6 +108,10 @@ static constexpr char PluginName[] = "FindFCmpEq";
 //------------------------------------------------------------------------------
 FindFCmpEq::Result FindFCmpEq::run(Function &Func,
                                    FunctionAnalysisManager &FAM) {
+  // Share the walk over the instructions with the other analyses if possible
+  if (FAM.isPassRegistered<FusedAnalysis>())
+    return FAM.getResult<FusedAnalysis>(Func).FCmpEqs;
+
   return run(Func);
 }
 
@@ -97,7 +134,7 @@ FindFCmpEq::Result FindFCmpEq::run(Function &Func) {
 PreservedAnalyses FindFCmpEqPrinter::run(Function &Func,
                                          FunctionAnalysisManager &FAM) {
   auto &Comparisons = FAM.getResult<FindFCmpEq>(Func);
-  printFCmpEqInstructions(OS, Func, Comparisons);
+  printFCmpEqInstructions(OS, Func, Comparisons, Format);
   return PreservedAnalyses::all();
 }
 
@@ -124,7 +161,9 @@ PassPluginLibraryInfo getFindFCmpEqPluginInfo() {
                   std::string PrinterPassElement =
                       formatv("print<{0}>", PassArg);
                   if (!Name.compare(PrinterPassElement)) {
-                    FPM.addPass(FindFCmpEqPrinter(llvm::outs()));
+                    FPM.addPass(FindFCmpEqPrinter(
+                        getResultStream(OutputFile, llvm::outs()),
+                        OutputFormat));
                     return true;
                   }
 
@@ -0,0 +1,469 @@
+//========================================================================
+// FILE:
+//    FunctionLatency.cpp
+//
+// DESCRIPTION:
+//    Measures the latency (in cycles) of every function defined in a module
+//    and prints, when the module exits, the number of calls and the p50/p99
+//    latency of every function. Like DynamicCallCounter, this pass
+//    instruments the input module:
+//      1. At the beginning of every function F, the cycle counter is read
+//         (`llvm.readcyclecounter`).
+//      2. Before every return from F (and before every resume, i.e. when an
+//         exception propagates out of F), `func_latency_record` is called. It
+//         reads the cycle counter again and adds the difference to the
+//         latency histogram of F. Calls that may throw are turned into
+//         invokes (see llvm::EscapeEnumerator), so that exceptions thrown
+//         from callees are not missed.
+//      3. A module destructor, `func_latency_dump`, merges the histograms of
+//         all the threads and prints the results (the same way the call
+//         counts are printed by DynamicCallCounter).
+//
+//    The histograms are log-bucketed: every power of 2 is divided into 4
+//    buckets (i.e. the relative error of the reported latencies is below
+//    25%). Latencies below 8 cycles are recorded exactly. Every thread
+//    updates its own copy of the histograms, allocated on the first
+//    instrumented return of that thread (see createPerThreadBufferFunc), so
+//    the threads never share cache lines and no atomics are needed.
+//
+//    Note that the latency of a function includes the latency of its
+//    callees, and that for recursive functions every activation is recorded.
+//
+// USAGE:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libFunctionLatency.so `\`
+//        -passes="func-latency" <bitcode-file> -o instrumented.bin
+//      $ lli instrumented.bin
+//
+// License: MIT
+//========================================================================
+#include "FunctionLatency.h"
+#include "InstrumentationUtils.h"
+
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Transforms/Utils/EscapeEnumerator.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "func-latency"
+
+// Every power of 2 is split into 1 << SubBucketBits buckets
+static constexpr unsigned SubBucketBits = 2;
+static constexpr unsigned NumSubBuckets = 1 << SubBucketBits;
+// Buckets for [0, 2 * NumSubBuckets) are exact, followed by NumSubBuckets
+// buckets for every power of 2 up to 2^63
+static constexpr unsigned NumBuckets =
+    2 * NumSubBuckets + (63 - SubBucketBits) * NumSubBuckets;
+
+// The field of the per-thread buffer that holds the histograms
+static constexpr unsigned BufferHistogramsField = 3;
+
+// Emits the code that maps Latency to its histogram bucket:
+// ```
+//    Shift = max(log2(Latency), SubBucketBits) - SubBucketBits;
+//    Bucket = (Latency >> Shift) + Shift * NumSubBuckets;
+// ```
+// e.g. latencies in [8, 10) go to bucket 8, [10, 12) to bucket 9, ... and
+// [14, 16) to bucket 11.
+static Value *emitBucketIndex(IRBuilder<> &Builder, Value *Latency) {
+  Value *Log2 = Builder.CreateSub(
+      Builder.getInt64(63),
+      Builder.CreateBinaryIntrinsic(
+          Intrinsic::ctlz,
+          Builder.CreateOr(Latency, Builder.getInt64(NumSubBuckets)),
+          Builder.getTrue()));
+  Value *Shift = Builder.CreateSub(Log2, Builder.getInt64(SubBucketBits));
+  return Builder.CreateAdd(
+      Builder.CreateLShr(Latency, Shift),
+      Builder.CreateMul(Shift, Builder.getInt64(NumSubBuckets)));
+}
+
+// Emits the code that maps Bucket to the largest latency that it holds (i.e.
+// the inverse of emitBucketIndex)
+static Value *emitBucketUpperBound(IRBuilder<> &Builder, Value *Bucket) {
+  // Shift = Bucket / NumSubBuckets - 1 (only valid for Bucket >= NumSubBuckets)
+  Value *Shift = Builder.CreateSub(
+      Builder.CreateLShr(Bucket, Builder.getInt64(SubBucketBits)),
+      Builder.getInt64(1));
+  Value *Lower = Builder.CreateShl(
+      Builder.CreateSub(Bucket, Builder.CreateShl(Shift, SubBucketBits)),
+      Shift);
+  Value *Upper = Builder.CreateAdd(
+      Lower, Builder.CreateSub(Builder.CreateShl(Builder.getInt64(1), Shift),
+                               Builder.getInt64(1)));
+  return Builder.CreateSelect(
+      Builder.CreateICmpULT(Bucket, Builder.getInt64(NumSubBuckets)), Bucket,
+      Upper);
+}
+
+// Defines `void func_latency_record(i32 FuncIdx, i64 Start)`:
+// ```
+//    uint64_t End = readcyclecounter();
+//    struct Buffer *Buf = func_latency_get_buffer();
+//    if (Buf) {
+//      uint64_t Latency = End > Start ? End - Start : 0;
+//      Buf->Histograms[FuncIdx][getBucket(Latency)]++;
+//    }
+// ```
+static Function *CreateRecordFunc(Module &M, StructType *BufferTy,
+                                  GlobalVariable *Buffers) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+
+  Function *GetBufferF = createPerThreadBufferFunc(
+      M, "func_latency_get_buffer", "FunctionLatency", BufferTy, Buffers);
+  Function *RecordF = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), {Int32Ty, Int64Ty},
+                        /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "func_latency_record", M);
+  RecordF->setDoesNotThrow();
+  Value *FuncIdx = RecordF->getArg(0);
+  Value *Start = RecordF->getArg(1);
+
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", RecordF);
+  BasicBlock *Record = BasicBlock::Create(CTX, "record", RecordF);
+  BasicBlock *Exit = BasicBlock::Create(CTX, "exit", RecordF);
+
+  IRBuilder<> Builder(Entry);
+  Value *End = Builder.CreateIntrinsic(Intrinsic::readcyclecounter, {}, {});
+  Value *Buf = Builder.CreateCall(GetBufferF);
+  Builder.CreateCondBr(Builder.CreateIsNull(Buf), Exit, Record);
+
+  Builder.SetInsertPoint(Record);
+  // The cycle counter may go backwards, e.g. when a thread migrates
+  Value *Latency = Builder.CreateSelect(Builder.CreateICmpUGT(End, Start),
+                                        Builder.CreateSub(End, Start),
+                                        Builder.getInt64(0));
+  Value *Slot = Builder.CreateInBoundsGEP(
+      BufferTy, Buf,
+      {Builder.getInt32(0), Builder.getInt32(BufferHistogramsField), FuncIdx,
+       emitBucketIndex(Builder, Latency)});
+  Value *Count = Builder.CreateLoad(Int64Ty, Slot);
+  Builder.CreateStore(Builder.CreateAdd(Count, Builder.getInt64(1)), Slot);
+  Builder.CreateBr(Exit);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateRetVoid();
+
+  return RecordF;
+}
+
+// Defines `i64 func_latency_quantile(ptr Hist, i64 Total, i64 Percent)` that
+// returns the smallest latency (or rather, the upper bound of the bucket)
+// that is greater or equal to Percent% of the latencies in Hist:
+// ```
+//    uint64_t Target = (Total * Percent + 99) / 100, Sum = 0, Bucket = 0;
+//    for (; Bucket < NumBuckets - 1; Bucket++)
+//      if ((Sum += Hist[Bucket]) >= Target)
+//        break;
+//    return getUpperBound(Bucket);
+// ```
+static Function *CreateQuantileFunc(Module &M) {
+  auto &CTX = M.getContext();
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+
+  Function *QuantileF = Function::Create(
+      FunctionType::get(Int64Ty, {PtrTy, Int64Ty, Int64Ty},
+                        /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "func_latency_quantile", M);
+  Value *Hist = QuantileF->getArg(0);
+  Value *Total = QuantileF->getArg(1);
+  Value *Percent = QuantileF->getArg(2);
+
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", QuantileF);
+  BasicBlock *Loop = BasicBlock::Create(CTX, "loop", QuantileF);
+  BasicBlock *Latch = BasicBlock::Create(CTX, "latch", QuantileF);
+  BasicBlock *Found = BasicBlock::Create(CTX, "found", QuantileF);
+
+  IRBuilder<> Builder(Entry);
+  Value *Target = Builder.CreateUDiv(
+      Builder.CreateAdd(Builder.CreateMul(Total, Percent),
+                        Builder.getInt64(99)),
+      Builder.getInt64(100));
+  Builder.CreateBr(Loop);
+
+  Builder.SetInsertPoint(Loop);
+  PHINode *Bucket = Builder.CreatePHI(Int64Ty, 2, "bucket");
+  PHINode *Sum = Builder.CreatePHI(Int64Ty, 2, "sum");
+  Value *Count = Builder.CreateLoad(
+      Int64Ty, Builder.CreateInBoundsGEP(Int64Ty, Hist, Bucket));
+  Value *NewSum = Builder.CreateAdd(Sum, Count);
+  Builder.CreateCondBr(Builder.CreateICmpUGE(NewSum, Target), Found, Latch);
+
+  Builder.SetInsertPoint(Latch);
+  Value *NextBucket = Builder.CreateAdd(Bucket, Builder.getInt64(1));
+  Builder.CreateCondBr(
+      Builder.CreateICmpEQ(NextBucket, Builder.getInt64(NumBuckets - 1)),
+      Found, Loop);
+  Bucket->addIncoming(Builder.getInt64(0), Entry);
+  Bucket->addIncoming(NextBucket, Latch);
+  Sum->addIncoming(Builder.getInt64(0), Entry);
+  Sum->addIncoming(NewSum, Latch);
+
+  Builder.SetInsertPoint(Found);
+  PHINode *Result = Builder.CreatePHI(Int64Ty, 2);
+  Result->addIncoming(Bucket, Loop);
+  Result->addIncoming(NextBucket, Latch);
+  Builder.CreateRet(emitBucketUpperBound(Builder, Result));
+
+  return QuantileF;
+}
+
+// Defines `void func_latency_print(ptr Name, ptr Hist)` that prints the
+// results for one function:
+// ```
+//    uint64_t Total = 0;
+//    for (unsigned Bucket = 0; Bucket < NumBuckets; Bucket++)
+//      Total += Hist[Bucket];
+//    printf("%-20s %-10lu %-10lu %-10lu\n", Name, Total,
+//           func_latency_quantile(Hist, Total, 50),
+//           func_latency_quantile(Hist, Total, 99));
+// ```
+static Function *CreatePrintFunc(Module &M, FunctionCallee Printf) {
+  auto &CTX = M.getContext();
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+
+  Function *QuantileF = CreateQuantileFunc(M);
+  Function *PrintF = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), {PtrTy, PtrTy},
+                        /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "func_latency_print", M);
+  Value *Name = PrintF->getArg(0);
+  Value *Hist = PrintF->getArg(1);
+
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", PrintF);
+  BasicBlock *Loop = BasicBlock::Create(CTX, "loop", PrintF);
+  BasicBlock *Print = BasicBlock::Create(CTX, "print", PrintF);
+
+  IRBuilder<> Builder(Entry);
+  Builder.CreateBr(Loop);
+
+  Builder.SetInsertPoint(Loop);
+  PHINode *Bucket = Builder.CreatePHI(Int64Ty, 2, "bucket");
+  PHINode *Total = Builder.CreatePHI(Int64Ty, 2, "total");
+  Value *Count = Builder.CreateLoad(
+      Int64Ty, Builder.CreateInBoundsGEP(Int64Ty, Hist, Bucket));
+  Value *NewTotal = Builder.CreateAdd(Total, Count);
+  Value *NextBucket = Builder.CreateAdd(Bucket, Builder.getInt64(1));
+  Builder.CreateCondBr(
+      Builder.CreateICmpEQ(NextBucket, Builder.getInt64(NumBuckets)), Print,
+      Loop);
+  Bucket->addIncoming(Builder.getInt64(0), Entry);
+  Bucket->addIncoming(NextBucket, Loop);
+  Total->addIncoming(Builder.getInt64(0), Entry);
+  Total->addIncoming(NewTotal, Loop);
+
+  Builder.SetInsertPoint(Print);
+  Value *P50 =
+      Builder.CreateCall(QuantileF, {Hist, NewTotal, Builder.getInt64(50)});
+  Value *P99 =
+      Builder.CreateCall(QuantileF, {Hist, NewTotal, Builder.getInt64(99)});
+  Builder.CreateCall(Printf,
+                     {Builder.CreateGlobalString("%-20s %-10lu %-10lu %-10lu\n"),
+                      Name, NewTotal, P50, P99});
+  Builder.CreateRetVoid();
+
+  return PrintF;
+}
+
+// Defines the module destructor, `func_latency_dump`, that merges the
+// histograms of all the threads and prints the results:
+// ```
+//    for (struct Buffer *Buf = atomic_load_acquire(&Buffers); Buf;
+//         Buf = Buf->Next)
+//      for (unsigned Idx = 0; Idx < NumFuncs * NumBuckets; Idx++)
+//        Merged[Idx] += Buf->Histograms[Idx];
+//
+//    printf(Header);
+//    for (unsigned FuncIdx = 0; FuncIdx < NumFuncs; FuncIdx++)
+//      func_latency_print(Names[FuncIdx], Merged[FuncIdx]);
+// ```
+static Function *CreateDumpFunc(Module &M, ArrayRef<Function *> Funcs,
+                                StructType *BufferTy,
+                                GlobalVariable *Buffers) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+
+  // Declare printf (see DynamicCallCounter)
+  FunctionCallee Printf = M.getOrInsertFunction(
+      "printf", FunctionType::get(Int32Ty, PtrTy, /*IsVarArgs=*/true));
+  Function *PrintfF = dyn_cast<Function>(Printf.getCallee());
+  PrintfF->setDoesNotThrow();
+  PrintfF->addParamAttr(0, llvm::Attribute::getWithCaptureInfo(
+                               M.getContext(), llvm::CaptureInfo::none()));
+  PrintfF->addParamAttr(0, Attribute::ReadOnly);
+
+  Type *HistogramsTy = BufferTy->getElementType(BufferHistogramsField);
+  auto *Merged = new GlobalVariable(M, HistogramsTy, /*isConstant=*/false,
+                                    GlobalValue::InternalLinkage,
+                                    Constant::getNullValue(HistogramsTy),
+                                    "FunctionLatencyHistograms");
+  uint64_t NumCounters = uint64_t(Funcs.size()) * NumBuckets;
+
+  Function *PrintF = CreatePrintFunc(M, Printf);
+  Function *DumpF = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "func_latency_dump", M);
+
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", DumpF);
+  BasicBlock *BufLoop = BasicBlock::Create(CTX, "buffers", DumpF);
+  BasicBlock *MergeLoop = BasicBlock::Create(CTX, "merge", DumpF);
+  BasicBlock *NextBuf = BasicBlock::Create(CTX, "next", DumpF);
+  BasicBlock *Print = BasicBlock::Create(CTX, "print", DumpF);
+
+  // STEP 1: Merge the histograms
+  IRBuilder<> Builder(Entry);
+  LoadInst *Head = Builder.CreateAlignedLoad(PtrTy, Buffers, MaybeAlign(8));
+  Head->setAtomic(AtomicOrdering::Acquire);
+  Builder.CreateBr(BufLoop);
+
+  Builder.SetInsertPoint(BufLoop);
+  PHINode *Buf = Builder.CreatePHI(PtrTy, 2, "buf");
+  Builder.CreateCondBr(Builder.CreateIsNull(Buf), Print, MergeLoop);
+
+  Builder.SetInsertPoint(MergeLoop);
+  PHINode *Idx = Builder.CreatePHI(Int64Ty, 2, "idx");
+  Value *Hists = Builder.CreateStructGEP(BufferTy, Buf, BufferHistogramsField);
+  Value *Src = Builder.CreateInBoundsGEP(Int64Ty, Hists, Idx);
+  Value *Dst = Builder.CreateInBoundsGEP(Int64Ty, Merged, Idx);
+  Builder.CreateStore(Builder.CreateAdd(Builder.CreateLoad(Int64Ty, Dst),
+                                        Builder.CreateLoad(Int64Ty, Src)),
+                      Dst);
+  Value *NextIdx = Builder.CreateAdd(Idx, Builder.getInt64(1));
+  Builder.CreateCondBr(
+      Builder.CreateICmpEQ(NextIdx, Builder.getInt64(NumCounters)), NextBuf,
+      MergeLoop);
+  Idx->addIncoming(Builder.getInt64(0), BufLoop);
+  Idx->addIncoming(NextIdx, MergeLoop);
+
+  Builder.SetInsertPoint(NextBuf);
+  Value *Next = Builder.CreateLoad(
+      PtrTy, Builder.CreateStructGEP(BufferTy, Buf, 0));
+  Builder.CreateBr(BufLoop);
+  Buf->addIncoming(Head, Entry);
+  Buf->addIncoming(Next, NextBuf);
+
+  // STEP 2: Print the results
+  Builder.SetInsertPoint(Print);
+  std::string Header = "";
+  Header += "=================================================\n";
+  Header += "LLVM-TUTOR: function latency results (cycles)\n";
+  Header += "=================================================\n";
+  Header += "NAME                 #N CALLS   P50        P99\n";
+  Header += "-------------------------------------------------\n";
+  Builder.CreateCall(Printf, {Builder.CreateGlobalString(Header)});
+  for (unsigned FuncIdx = 0; FuncIdx != Funcs.size(); ++FuncIdx) {
+    Value *Hist = Builder.CreateInBoundsGEP(
+        HistogramsTy, Merged,
+        {Builder.getInt32(0), Builder.getInt32(FuncIdx)});
+    Builder.CreateCall(
+        PrintF, {Builder.CreateGlobalString(Funcs[FuncIdx]->getName()), Hist});
+  }
+  Builder.CreateRetVoid();
+
+  return DumpF;
+}
+
+//-----------------------------------------------------------------------------
+// FunctionLatency implementation
+//-----------------------------------------------------------------------------
+bool FunctionLatency::runOnModule(Module &M) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+
+  // Collect the functions to instrument first - the runtime created below
+  // must not be instrumented itself
+  SmallVector<Function *, 16> Funcs;
+  for (auto &F : M)
+    if (!F.isDeclaration())
+      Funcs.push_back(&F);
+
+  // Stop here if there are no function definitions in this module
+  if (Funcs.empty())
+    return false;
+
+  // STEP 1: Create the runtime. The per-thread buffers are:
+  //    struct Buffer {
+  //      struct Buffer *Next;
+  //      uint32_t ThreadIdx;
+  //      uint32_t Padding;
+  //      uint64_t Histograms[NumFuncs][NumBuckets];
+  //    };
+  StructType *BufferTy = StructType::get(
+      CTX, {PtrTy, Int32Ty, Int32Ty,
+            ArrayType::get(ArrayType::get(Int64Ty, NumBuckets), Funcs.size())});
+  auto *Buffers = new GlobalVariable(M, PtrTy, /*isConstant=*/false,
+                                     GlobalValue::InternalLinkage,
+                                     ConstantPointerNull::get(PtrTy),
+                                     "FunctionLatencyBuffers");
+  Buffers->setAlignment(Align(8));
+  Function *RecordF = CreateRecordFunc(M, BufferTy, Buffers);
+
+  // STEP 2: Instrument the entry and the exits of every function
+  for (unsigned FuncIdx = 0; FuncIdx != Funcs.size(); ++FuncIdx) {
+    Function &F = *Funcs[FuncIdx];
+
+    // Read the cycle counter after the static allocas
+    BasicBlock::iterator InsertPt = F.getEntryBlock().getFirstInsertionPt();
+    while (isa<AllocaInst>(*InsertPt))
+      ++InsertPt;
+    IRBuilder<> Builder(&F.getEntryBlock(), InsertPt);
+    Value *Start = Builder.CreateIntrinsic(Intrinsic::readcyclecounter, {}, {},
+                                           {}, "start");
+
+    // Returns, resumes and calls that may throw (these are turned into
+    // invokes that unwind to a new cleanup block)
+    EscapeEnumerator EE(F, "func_latency_cleanup");
+    while (IRBuilder<> *AtExit = EE.Next())
+      AtExit->CreateCall(RecordF, {AtExit->getInt32(FuncIdx), Start});
+
+    LLVM_DEBUG(dbgs() << " Instrumented: " << F.getName() << "\n");
+  }
+
+  // STEP 3: Print the results on exit
+  appendToGlobalDtors(M, CreateDumpFunc(M, Funcs, BufferTy, Buffers),
+                      /*Priority=*/0);
+
+  return true;
+}
+
+PreservedAnalyses FunctionLatency::run(llvm::Module &M,
+                                       llvm::ModuleAnalysisManager &) {
+  bool Changed = runOnModule(M);
+
+  return (Changed ? llvm::PreservedAnalyses::none()
+                  : llvm::PreservedAnalyses::all());
+}
+
+//-----------------------------------------------------------------------------
+// New PM Registration
+//-----------------------------------------------------------------------------
+llvm::PassPluginLibraryInfo getFunctionLatencyPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "func-latency", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "func-latency") {
+                    MPM.addPass(FunctionLatency());
+                    return true;
+                  }
+                  return false;
+                });
+          }};
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getFunctionLatencyPluginInfo();
+}
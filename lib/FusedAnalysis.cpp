@@ -0,0 +1,43 @@
+//==============================================================================
+// FILE:
+//    FusedAnalysis.cpp
+//
+// DESCRIPTION:
+//    Computes the results of StaticCallCounter, OpcodeCounter and FindFCmpEq
+//    in one walk over the instructions of a function. The results are exactly
+//    the same as those computed by the individual analyses (e.g. the callees
+//    and the opcodes are recorded in the order of their first occurrence).
+//
+//    This file is linked into the combined LLVMTutor plugin (see
+//    LLVMTutor.cpp) and into `static`, which register FusedAnalysis next to
+//    the analyses that it replaces.
+//
+// License: MIT
+//==============================================================================
+#include "FusedAnalysis.h"
+
+#include "llvm/IR/Instructions.h"
+
+using namespace llvm;
+
+FusedAnalysis::Result FusedAnalysis::run(Function &Func,
+                                         FunctionAnalysisManager &) {
+  Result Res{ResultStaticCC(), OpcodeCounter::createEmptyResult(),
+             FindFCmpEq::Result()};
+
+  for (auto &BB : Func) {
+    for (auto &Inst : BB) {
+      Res.Opcodes.add(Inst);
+
+      if (auto *CB = dyn_cast<CallBase>(&Inst)) {
+        if (auto *Callee = CB->getCalledFunction())
+          ++Res.DirectCalls[Callee];
+      } else if (auto *FCmp = dyn_cast<FCmpInst>(&Inst)) {
+        if (FCmp->isEquality())
+          Res.FCmpEqs.push_back(FCmp);
+      }
+    }
+  }
+
+  return Res;
+}
@@ -0,0 +1,119 @@
+//==============================================================================
+// FILE:
+//    HotBlockFilter.cpp
+//
+// DESCRIPTION:
+//    Implements the helper that limits the obfuscation of hot basic blocks.
+//    See HotBlockFilter.h for the details.
+//
+// License: MIT
+//==============================================================================
+#include "HotBlockFilter.h"
+#include "DynamicCallCounterProfile.h"
+
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+#include <mutex>
+
+using namespace llvm;
+
+//------------------------------------------------------------------------------
+// Profile loading
+//------------------------------------------------------------------------------
+// Reads the call counts from the DynamicCallCounter profile Path. Invalid
+// profiles are reported and ignored (i.e. no function is called).
+static StringMap<uint64_t> readCallCounts(StringRef Path) {
+  StringMap<uint64_t> Result;
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufOrErr =
+      MemoryBuffer::getFile(Path, /*IsText=*/false,
+                            /*RequiresNullTerminator=*/false);
+  if (!BufOrErr) {
+    errs() << "warning: cannot read the profile " << Path << ": "
+           << BufOrErr.getError().message() << "\n";
+    return Result;
+  }
+
+  const char *Data = (*BufOrErr)->getBufferStart();
+  size_t Size = (*BufOrErr)->getBufferSize();
+  const auto *Header = reinterpret_cast<const DCCProfileHeader *>(Data);
+  if (Size < sizeof(DCCProfileHeader) || Header->Magic != DCCProfileMagic ||
+      Header->Version != DCCProfileVersion) {
+    errs() << "warning: ignoring invalid DynamicCallCounter profile " << Path
+           << "\n";
+    return Result;
+  }
+
+  uint64_t RecordsSize =
+      uint64_t(Header->NumFunctions) * sizeof(DCCProfileRecord);
+  if (Size < sizeof(DCCProfileHeader) + RecordsSize + Header->NamesSize) {
+    errs() << "warning: ignoring truncated DynamicCallCounter profile " << Path
+           << "\n";
+    return Result;
+  }
+
+  const auto *Records = reinterpret_cast<const DCCProfileRecord *>(
+      Data + sizeof(DCCProfileHeader));
+  StringRef Names(Data + sizeof(DCCProfileHeader) + RecordsSize,
+                  Header->NamesSize);
+  for (uint32_t Idx = 0; Idx != Header->NumFunctions; ++Idx) {
+    const DCCProfileRecord &Rec = Records[Idx];
+    if (uint64_t(Rec.NameOffset) + Rec.NameSize > Names.size())
+      continue;
+    Result[Names.substr(Rec.NameOffset, Rec.NameSize)] += Rec.CallCount;
+  }
+
+  return Result;
+}
+
+// Returns the call counts from the profile Path. Every profile is read only
+// once and is shared by all the passes (possibly running on different
+// threads) that use it.
+static const StringMap<uint64_t> *getCallCounts(StringRef Path) {
+  static std::mutex Lock;
+  static StringMap<std::unique_ptr<StringMap<uint64_t>>> Profiles;
+
+  std::lock_guard<std::mutex> Guard(Lock);
+  std::unique_ptr<StringMap<uint64_t>> &Profile = Profiles[Path];
+  if (!Profile)
+    Profile = std::make_unique<StringMap<uint64_t>>(readCallCounts(Path));
+  return Profile.get();
+}
+
+//------------------------------------------------------------------------------
+// HotBlockFilter Implementation
+//------------------------------------------------------------------------------
+HotBlockFilter::HotBlockFilter(uint64_t Threshold, unsigned HotPercentage,
+                               StringRef ProfileFile)
+    : Threshold(Threshold), HotPercentage(std::min(HotPercentage, 100U)) {
+  if (Threshold && !ProfileFile.empty())
+    CallCounts = getCallCounts(ProfileFile);
+}
+
+void HotBlockFilter::startFunction(Function &F,
+                                   FunctionAnalysisManager &FAM) {
+  BFI = nullptr;
+  if (!Threshold)
+    return;
+
+  BFI = &FAM.getResult<BlockFrequencyAnalysis>(F);
+  NumCalls = 1;
+  if (CallCounts)
+    NumCalls = CallCounts->lookup(F.getName());
+  else if (auto EntryCount = F.getEntryCount())
+    NumCalls = EntryCount->getCount();
+}
+
+unsigned HotBlockFilter::getPercentage(const BasicBlock &BB) const {
+  if (!BFI)
+    return 100;
+
+  // The estimated number of executions of BB
+  double Count = double(BFI->getBlockFreq(&BB).getFrequency()) /
+                 double(BFI->getEntryFreq().getFrequency()) * double(NumCalls);
+  return Count > double(Threshold) ? HotPercentage : 100;
+}
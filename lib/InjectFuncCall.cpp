@@ -20,26 +20,566 @@
 //    (llvm-tutor)   number of arguments: 3
 //    ```
 //
+//    With `-inject-func-call-sample-period=N` (N > 1) the call to printf is
+//    only made on every N-th function entry (per thread). Every entry
+//    decrements a thread-local countdown and printf is called when it reaches
+//    0, so the entries that are not sampled only cost a decrement and a
+//    branch.
+//
+//    With `-inject-func-call-output=trace` the formatted (and locked) printf
+//    is replaced with a call to `ifc_trace(FuncIdx, NumArgs)`, which appends a
+//    fixed-size record (function index, number of arguments, cycle counter)
+//    to a buffer owned by the calling thread. No locks are taken and nothing
+//    is formatted on this path. The buffers are allocated on the first
+//    traced call of every thread and are kept on a global, lock-free list.
+//    The trace (see DynamicCallCounterProfile.h for the format) is written to
+//    `-inject-func-call-trace-file`:
+//      * the header and the function name table are written once, from a
+//        module constructor,
+//      * every thread appends its buffer to the trace, as one chunk, when the
+//        buffer fills up,
+//      * on exit, the remaining records of all the threads (including the
+//        threads that have already finished) are appended.
+//    The writes to the trace are serialised with a spin lock, which is only
+//    taken when a buffer is flushed. Records generated by other threads after
+//    the trace is closed on exit are dropped.
+//    Use `dcc-profdata show` to print the trace.
+//
 // USAGE:
 //      $ opt -load-pass-plugin <BUILD_DIR>/lib/libInjectFunctCall.so `\`
 //        -passes=-"inject-func-call" <bitcode-file>
+//    To trace the calls:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libInjectFunctCall.so `\`
+//        -passes=-"inject-func-call" -inject-func-call-output=trace `\`
+//        -inject-func-call-trace-file=trace.%p <bitcode-file> -o traced.bin
+//      $ lli traced.bin
+//      $ <BUILD_DIR>/bin/dcc-profdata show trace.*
 //
 // License: MIT
 //========================================================================
 #include "InjectFuncCall.h"
+#include "DynamicCallCounterProfile.h"
+#include "InstrumentationUtils.h"
 
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 
 using namespace llvm;
 
 #define DEBUG_TYPE "inject-func-call"
 
+//-----------------------------------------------------------------------------
+// Command line options
+//-----------------------------------------------------------------------------
+static cl::opt<unsigned> SamplePeriod(
+    "inject-func-call-sample-period",
+    cl::desc("Only call printf on every N-th function entry (per thread, 1 "
+             "disables sampling)"),
+    cl::value_desc("N"), cl::init(1));
+
+enum class InjectOutputKind { Printf, Trace };
+
+static cl::opt<InjectOutputKind> OutputMode(
+    "inject-func-call-output", cl::desc("What to inject into every function"),
+    cl::values(clEnumValN(InjectOutputKind::Printf, "printf",
+                          "A call to printf with the function name"),
+               clEnumValN(InjectOutputKind::Trace, "trace",
+                          "A call that records the entry in a binary trace")),
+    cl::init(InjectOutputKind::Printf));
+
+static cl::opt<std::string> TraceFile(
+    "inject-func-call-trace-file",
+    cl::desc("The trace file written by -inject-func-call-output=trace (%p "
+             "expands to the process ID)"),
+    cl::value_desc("filename"), cl::init("ifc.trace"));
+
+static cl::opt<unsigned> TraceBufferSize(
+    "inject-func-call-trace-buffer-size",
+    cl::desc("The number of trace records buffered by every thread"),
+    cl::init(4096));
+
+//-----------------------------------------------------------------------------
+// Trace runtime
+//-----------------------------------------------------------------------------
+// The runtime for `-inject-func-call-output=trace` is generated in the
+// instrumented module. It's equivalent to the following C code:
+// ```
+//    struct Buffer {
+//      struct Buffer *Next;
+//      uint32_t ThreadIdx;
+//      _Atomic uint32_t NumRecords;
+//      struct TraceRecord Records[N];
+//    };
+//
+//    static FILE *TraceFile;
+//    static struct Buffer *_Atomic Buffers;
+//
+//    static void ifc_trace_lock();
+//    static void ifc_trace_unlock();
+//    static void ifc_trace_flush(struct Buffer *Buf);
+//    // See createPerThreadBufferFunc
+//    static struct Buffer *ifc_trace_get_buffer();
+//
+//    static void ifc_trace(uint32_t FuncIdx, uint32_t NumArgs) {
+//      struct Buffer *Buf = ifc_trace_get_buffer();
+//      if (!Buf)
+//        return;
+//      uint32_t Idx = Buf->NumRecords;
+//      Buf->Records[Idx] =
+//          (struct TraceRecord){FuncIdx, NumArgs, readcyclecounter()};
+//      atomic_store_release(&Buf->NumRecords, Idx + 1);
+//      if (Idx + 1 == N)
+//        ifc_trace_flush(Buf);
+//    }
+// ```
+// Only the owning thread writes to a buffer. The destructor reads the
+// buffers of the other threads too, but only the records published by the
+// release store above. A thread can only reset its buffer (and overwrite
+// these records) in ifc_trace_flush, i.e. while holding the lock.
+//
+// See the functions below for the remaining bits.
+namespace {
+struct TraceRuntime {
+  StructType *BufferTy;
+  GlobalVariable *File;
+  GlobalVariable *Buffers;
+  GlobalVariable *Lock;
+  Function *LockF;
+  Function *UnlockF;
+  Function *WriteF;
+  Function *FlushF;
+  Function *TraceF;
+};
+} // namespace
+
+static constexpr unsigned BufferNextField = 0;
+static constexpr unsigned BufferThreadIdxField = 1;
+static constexpr unsigned BufferNumRecordsField = 2;
+static constexpr unsigned BufferRecordsField = 3;
+
+// Defines `void ifc_trace_lock()` and `void ifc_trace_unlock()`:
+// ```
+//    static _Atomic uint32_t TraceLock;
+//    static void ifc_trace_lock() {
+//      while (atomic_exchange_acquire(&TraceLock, 1))
+//        ;
+//    }
+//    static void ifc_trace_unlock() { atomic_store_release(&TraceLock, 0); }
+// ```
+// The lock is only held while a buffer is written to TraceFile (and while
+// TraceFile is closed), so there's no point in anything fancier.
+static void CreateTraceLockFuncs(Module &M, TraceRuntime &RT) {
+  auto &CTX = M.getContext();
+  FunctionType *VoidFnTy =
+      FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false);
+
+  RT.LockF = Function::Create(VoidFnTy, GlobalValue::InternalLinkage,
+                              "ifc_trace_lock", M);
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", RT.LockF);
+  BasicBlock *Spin = BasicBlock::Create(CTX, "spin", RT.LockF);
+  BasicBlock *Exit = BasicBlock::Create(CTX, "exit", RT.LockF);
+
+  IRBuilder<> Builder(Entry);
+  Builder.CreateBr(Spin);
+
+  Builder.SetInsertPoint(Spin);
+  Value *Locked =
+      Builder.CreateAtomicRMW(AtomicRMWInst::Xchg, RT.Lock, Builder.getInt32(1),
+                              MaybeAlign(4), AtomicOrdering::Acquire);
+  Builder.CreateCondBr(Builder.CreateIsNull(Locked), Exit, Spin);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateRetVoid();
+
+  RT.UnlockF = Function::Create(VoidFnTy, GlobalValue::InternalLinkage,
+                                "ifc_trace_unlock", M);
+  Builder.SetInsertPoint(BasicBlock::Create(CTX, "entry", RT.UnlockF));
+  Builder.CreateAlignedStore(Builder.getInt32(0), RT.Lock, MaybeAlign(4))
+      ->setAtomic(AtomicOrdering::Release);
+  Builder.CreateRetVoid();
+}
+
+// Defines `void ifc_trace_write(struct Buffer *Buf)` that appends the records
+// of Buf to the trace. The caller must hold the lock.
+// ```
+//    uint32_t NumRecords = atomic_load_acquire(&Buf->NumRecords);
+//    if (!TraceFile || !NumRecords)
+//      return;
+//    struct TraceChunkHeader Chunk = {Buf->ThreadIdx, NumRecords};
+//    fwrite(&Chunk, 1, sizeof(Chunk), TraceFile);
+//    fwrite(Buf->Records, 1, NumRecords * sizeof(TraceRecord), TraceFile);
+// ```
+// The chunk header is a copy, as the owning thread may still be appending to
+// Buf (i.e. updating Buf->NumRecords).
+static Function *CreateTraceWriteFunc(Module &M, const TraceRuntime &RT) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+
+  FunctionCallee Fwrite = M.getOrInsertFunction(
+      "fwrite", FunctionType::get(Int64Ty, {PtrTy, Int64Ty, Int64Ty, PtrTy},
+                                  /*IsVarArgs=*/false));
+
+  Function *WriteF = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), {PtrTy}, /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "ifc_trace_write", M);
+  Value *Buf = WriteF->getArg(0);
+
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", WriteF);
+  BasicBlock *Write = BasicBlock::Create(CTX, "write", WriteF);
+  BasicBlock *Exit = BasicBlock::Create(CTX, "exit", WriteF);
+
+  IRBuilder<> Builder(Entry);
+  StructType *ChunkTy = StructType::get(CTX, {Int32Ty, Int32Ty});
+  Value *Chunk = Builder.CreateAlloca(ChunkTy, nullptr, "chunk");
+  Value *File = Builder.CreateLoad(PtrTy, RT.File);
+  LoadInst *NumRecords = Builder.CreateAlignedLoad(
+      Int32Ty,
+      Builder.CreateStructGEP(RT.BufferTy, Buf, BufferNumRecordsField),
+      MaybeAlign(4));
+  NumRecords->setAtomic(AtomicOrdering::Acquire);
+  Builder.CreateCondBr(Builder.CreateOr(Builder.CreateIsNull(File),
+                                        Builder.CreateIsNull(NumRecords)),
+                       Exit, Write);
+
+  Builder.SetInsertPoint(Write);
+  Value *ThreadIdx = Builder.CreateLoad(
+      Int32Ty, Builder.CreateStructGEP(RT.BufferTy, Buf, BufferThreadIdxField));
+  Builder.CreateStore(ThreadIdx, Builder.CreateStructGEP(ChunkTy, Chunk, 0));
+  Builder.CreateStore(NumRecords, Builder.CreateStructGEP(ChunkTy, Chunk, 1));
+  Builder.CreateCall(Fwrite, {Chunk, Builder.getInt64(1),
+                              Builder.getInt64(sizeof(TraceChunkHeader)),
+                              File});
+  Value *Size =
+      Builder.CreateMul(Builder.CreateZExt(NumRecords, Int64Ty),
+                        Builder.getInt64(sizeof(TraceRecord)));
+  Builder.CreateCall(
+      Fwrite,
+      {Builder.CreateStructGEP(RT.BufferTy, Buf, BufferRecordsField),
+       Builder.getInt64(1), Size, File});
+  Builder.CreateBr(Exit);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateRetVoid();
+
+  return WriteF;
+}
+
+// Defines `void ifc_trace_flush(struct Buffer *Buf)` that's called by the
+// thread that owns Buf:
+// ```
+//    ifc_trace_lock();
+//    ifc_trace_write(Buf);
+//    atomic_store_relaxed(&Buf->NumRecords, 0);
+//    ifc_trace_unlock();
+// ```
+static Function *CreateTraceFlushFunc(Module &M, const TraceRuntime &RT) {
+  auto &CTX = M.getContext();
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+
+  Function *FlushF = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), {PtrTy}, /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "ifc_trace_flush", M);
+  Value *Buf = FlushF->getArg(0);
+
+  IRBuilder<> Builder(BasicBlock::Create(CTX, "entry", FlushF));
+  Builder.CreateCall(RT.LockF);
+  Builder.CreateCall(RT.WriteF, {Buf});
+  Builder
+      .CreateAlignedStore(
+          Builder.getInt32(0),
+          Builder.CreateStructGEP(RT.BufferTy, Buf, BufferNumRecordsField),
+          MaybeAlign(4))
+      ->setAtomic(AtomicOrdering::Monotonic);
+  Builder.CreateCall(RT.UnlockF);
+  Builder.CreateRetVoid();
+
+  return FlushF;
+}
+
+// Defines `void ifc_trace(uint32_t FuncIdx, uint32_t NumArgs)` (see above)
+static Function *CreateTraceFunc(Module &M, const TraceRuntime &RT,
+                                 uint32_t NumRecords) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+
+  Function *GetBufferF = createPerThreadBufferFunc(
+      M, "ifc_trace_get_buffer", "InjectFuncCall", RT.BufferTy, RT.Buffers);
+  Function *TraceF = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), {Int32Ty, Int32Ty},
+                        /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "ifc_trace", M);
+
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", TraceF);
+  BasicBlock *Record = BasicBlock::Create(CTX, "record", TraceF);
+  BasicBlock *Flush = BasicBlock::Create(CTX, "flush", TraceF);
+  BasicBlock *Exit = BasicBlock::Create(CTX, "exit", TraceF);
+
+  IRBuilder<> Builder(Entry);
+  Value *Buf = Builder.CreateCall(GetBufferF);
+  Builder.CreateCondBr(Builder.CreateIsNull(Buf), Exit, Record);
+
+  Builder.SetInsertPoint(Record);
+  Value *NumRecordsPtr =
+      Builder.CreateStructGEP(RT.BufferTy, Buf, BufferNumRecordsField);
+  Value *Idx = Builder.CreateLoad(Int32Ty, NumRecordsPtr);
+  Value *Rec = Builder.CreateInBoundsGEP(
+      RT.BufferTy, Buf,
+      {Builder.getInt32(0), Builder.getInt32(BufferRecordsField), Idx});
+  StructType *RecordTy = cast<StructType>(
+      cast<ArrayType>(RT.BufferTy->getElementType(BufferRecordsField))
+          ->getElementType());
+  Builder.CreateStore(TraceF->getArg(0),
+                      Builder.CreateStructGEP(RecordTy, Rec, 0));
+  Builder.CreateStore(TraceF->getArg(1),
+                      Builder.CreateStructGEP(RecordTy, Rec, 1));
+  Value *Timestamp =
+      Builder.CreateIntrinsic(Intrinsic::readcyclecounter, {}, {});
+  Builder.CreateStore(Timestamp, Builder.CreateStructGEP(RecordTy, Rec, 2));
+  Value *NewIdx = Builder.CreateAdd(Idx, Builder.getInt32(1));
+  // Publishes the record to ifc_trace_fini
+  Builder.CreateAlignedStore(NewIdx, NumRecordsPtr, MaybeAlign(4))
+      ->setAtomic(AtomicOrdering::Release);
+  Builder.CreateCondBr(
+      Builder.CreateICmpEQ(NewIdx, Builder.getInt32(NumRecords)), Flush,
+      Exit);
+
+  Builder.SetInsertPoint(Flush);
+  Builder.CreateCall(RT.FlushF, {Buf});
+  Builder.CreateBr(Exit);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateRetVoid();
+
+  return TraceF;
+}
+
+// Creates the trace header, i.e. `{ TraceHeader, [N x TraceFunction],
+// [NamesSize x i8] }`, for Funcs
+static GlobalVariable *CreateTraceHeader(Module &M,
+                                         ArrayRef<Function *> Funcs) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+
+  std::string Names;
+  SmallVector<Constant *, 16> Records;
+  StructType *RecordTy = StructType::get(CTX, {Int32Ty, Int32Ty});
+  for (Function *F : Funcs) {
+    Records.push_back(ConstantStruct::get(
+        RecordTy, {ConstantInt::get(Int32Ty, Names.size()),
+                   ConstantInt::get(Int32Ty, F->getName().size())}));
+    Names += F->getName();
+  }
+  // Keep the records that follow the names aligned
+  Names.resize(alignTo(Names.size(), alignof(TraceRecord)), '\0');
+
+  StructType *HeaderTy =
+      StructType::get(CTX, {Int64Ty, Int32Ty, Int32Ty, Int64Ty});
+  Constant *Header = ConstantStruct::get(
+      HeaderTy, {ConstantInt::get(Int64Ty, TraceMagic),
+                 ConstantInt::get(Int32Ty, TraceVersion),
+                 ConstantInt::get(Int32Ty, Funcs.size()),
+                 ConstantInt::get(Int64Ty, Names.size())});
+
+  ArrayType *RecordsTy = ArrayType::get(RecordTy, Records.size());
+  Constant *Init = ConstantStruct::getAnon(
+      CTX, {Header, ConstantArray::get(RecordsTy, Records),
+            ConstantDataArray::getString(CTX, Names, /*AddNull=*/false)});
+
+  auto *HeaderGV =
+      new GlobalVariable(M, Init->getType(), /*isConstant=*/true,
+                         GlobalValue::InternalLinkage, Init,
+                         "InjectFuncCallTraceHeader");
+  HeaderGV->setAlignment(Align(8));
+  return HeaderGV;
+}
+
+// Defines the module constructor, `ifc_trace_init`, that opens the trace and
+// writes Header into it:
+// ```
+//    TraceFile = fopen(TraceFile, "wb");
+//    if (TraceFile)
+//      fwrite(&Header, 1, sizeof(Header), TraceFile);
+// ```
+// and the module destructor, `ifc_trace_fini`, that writes the remaining
+// records of all the buffers and closes the trace:
+// ```
+//    ifc_trace_lock();
+//    for (struct Buffer *Buf = atomic_load_acquire(&Buffers); Buf;
+//         Buf = Buf->Next)
+//      ifc_trace_write(Buf);
+//    if (TraceFile)
+//      fclose(TraceFile);
+//    TraceFile = NULL;
+//    ifc_trace_unlock();
+// ```
+// The buffers are not reset, as other threads may still be running (and
+// appending to them). Once TraceFile is NULL, their flushes write nothing.
+static void CreateTraceInitFini(Module &M, const TraceRuntime &RT,
+                                GlobalVariable *Header) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+  FunctionType *VoidFnTy =
+      FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false);
+
+  FunctionCallee Fwrite = M.getOrInsertFunction(
+      "fwrite", FunctionType::get(Int64Ty, {PtrTy, Int64Ty, Int64Ty, PtrTy},
+                                  /*IsVarArgs=*/false));
+  FunctionCallee Fclose = M.getOrInsertFunction(
+      "fclose", FunctionType::get(Int32Ty, {PtrTy}, /*IsVarArgs=*/false));
+
+  // STEP 1: The constructor
+  Function *InitF = Function::Create(VoidFnTy, GlobalValue::InternalLinkage,
+                                     "ifc_trace_init", M);
+  IRBuilder<> Builder(BasicBlock::Create(CTX, "entry", InitF));
+  BasicBlock *Write = BasicBlock::Create(CTX, "write", InitF);
+  BasicBlock *Done = BasicBlock::Create(CTX, "done", InitF);
+
+  Value *File = emitFileOpen(Builder, TraceFile);
+  Builder.CreateStore(File, RT.File);
+  Builder.CreateCondBr(Builder.CreateIsNull(File), Done, Write);
+
+  Builder.SetInsertPoint(Write);
+  uint64_t HeaderSize = M.getDataLayout().getTypeAllocSize(
+      Header->getValueType());
+  Builder.CreateCall(
+      Fwrite, {Header, Builder.getInt64(1), Builder.getInt64(HeaderSize), File});
+  Builder.CreateBr(Done);
+
+  Builder.SetInsertPoint(Done);
+  Builder.CreateRetVoid();
+  appendToGlobalCtors(M, InitF, /*Priority=*/0);
+
+  // STEP 2: The destructor
+  Function *FiniF = Function::Create(VoidFnTy, GlobalValue::InternalLinkage,
+                                     "ifc_trace_fini", M);
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", FiniF);
+  BasicBlock *Loop = BasicBlock::Create(CTX, "loop", FiniF);
+  BasicBlock *Next = BasicBlock::Create(CTX, "next", FiniF);
+  BasicBlock *Close = BasicBlock::Create(CTX, "close", FiniF);
+  BasicBlock *DoClose = BasicBlock::Create(CTX, "do.close", FiniF);
+  BasicBlock *Exit = BasicBlock::Create(CTX, "exit", FiniF);
+
+  Builder.SetInsertPoint(Entry);
+  Builder.CreateCall(RT.LockF);
+  LoadInst *Head = Builder.CreateAlignedLoad(PtrTy, RT.Buffers, MaybeAlign(8));
+  Head->setAtomic(AtomicOrdering::Acquire);
+  Builder.CreateBr(Loop);
+
+  Builder.SetInsertPoint(Loop);
+  PHINode *Buf = Builder.CreatePHI(PtrTy, 2, "buf");
+  Builder.CreateCondBr(Builder.CreateIsNull(Buf), Close, Next);
+
+  Builder.SetInsertPoint(Next);
+  Builder.CreateCall(RT.WriteF, {Buf});
+  Value *NextBuf = Builder.CreateLoad(
+      PtrTy, Builder.CreateStructGEP(RT.BufferTy, Buf, BufferNextField));
+  Builder.CreateBr(Loop);
+  Buf->addIncoming(Head, Entry);
+  Buf->addIncoming(NextBuf, Next);
+
+  Builder.SetInsertPoint(Close);
+  File = Builder.CreateLoad(PtrTy, RT.File);
+  Builder.CreateCondBr(Builder.CreateIsNull(File), Exit, DoClose);
+
+  Builder.SetInsertPoint(DoClose);
+  Builder.CreateCall(Fclose, {File});
+  Builder.CreateStore(ConstantPointerNull::get(PtrTy), RT.File);
+  Builder.CreateBr(Exit);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateCall(RT.UnlockF);
+  Builder.CreateRetVoid();
+  appendToGlobalDtors(M, FiniF, /*Priority=*/0);
+}
+
+// Creates the trace runtime for Funcs and returns `ifc_trace`
+static Function *CreateTraceRuntime(Module &M, ArrayRef<Function *> Funcs) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+  uint32_t NumRecords = std::max(1u, TraceBufferSize.getValue());
+
+  TraceRuntime RT;
+  StructType *RecordTy = StructType::get(CTX, {Int32Ty, Int32Ty, Int64Ty});
+  RT.BufferTy = StructType::get(
+      CTX, {PtrTy, Int32Ty, Int32Ty, ArrayType::get(RecordTy, NumRecords)});
+  RT.File = new GlobalVariable(M, PtrTy, /*isConstant=*/false,
+                               GlobalValue::InternalLinkage,
+                               ConstantPointerNull::get(PtrTy),
+                               "InjectFuncCallTraceFile");
+  RT.Buffers = new GlobalVariable(M, PtrTy, /*isConstant=*/false,
+                                  GlobalValue::InternalLinkage,
+                                  ConstantPointerNull::get(PtrTy),
+                                  "InjectFuncCallTraceBuffers");
+  RT.Buffers->setAlignment(Align(8));
+  RT.Lock = new GlobalVariable(M, Int32Ty, /*isConstant=*/false,
+                               GlobalValue::InternalLinkage,
+                               ConstantInt::get(Int32Ty, 0),
+                               "InjectFuncCallTraceLock");
+  RT.Lock->setAlignment(Align(4));
+  CreateTraceLockFuncs(M, RT);
+  RT.WriteF = CreateTraceWriteFunc(M, RT);
+  RT.FlushF = CreateTraceFlushFunc(M, RT);
+  RT.TraceF = CreateTraceFunc(M, RT, NumRecords);
+  CreateTraceInitFini(M, RT, CreateTraceHeader(M, Funcs));
+
+  return RT.TraceF;
+}
+
 //-----------------------------------------------------------------------------
 // InjectFuncCall implementation
 //-----------------------------------------------------------------------------
+// Injects a call to `ifc_trace` at the beginning of every function defined
+// in M (-inject-func-call-output=trace)
+static bool injectTraceCalls(Module &M) {
+  // Collect the functions first - the runtime created below must not be
+  // traced itself
+  SmallVector<Function *, 16> Funcs;
+  for (auto &F : M)
+    if (!F.isDeclaration())
+      Funcs.push_back(&F);
+
+  if (Funcs.empty())
+    return false;
+
+  Function *TraceF = CreateTraceRuntime(M, Funcs);
+
+  // The thread-local countdown (sampling only)
+  GlobalVariable *Countdown = nullptr;
+  unsigned Period = SamplePeriod;
+  if (Period > 1)
+    Countdown = createSamplingCountdown(M, "InjectFuncCallCountdown", Period);
+
+  for (unsigned FuncIdx = 0; FuncIdx != Funcs.size(); ++FuncIdx) {
+    Function &F = *Funcs[FuncIdx];
+    IRBuilder<> Builder(&*F.getEntryBlock().getFirstInsertionPt());
+    if (Countdown)
+      Builder.SetInsertPoint(emitSamplingCheck(F, Countdown, Period));
+
+    LLVM_DEBUG(dbgs() << " Injecting call to ifc_trace inside " << F.getName()
+                      << "\n");
+    Builder.CreateCall(TraceF, {Builder.getInt32(FuncIdx),
+                                Builder.getInt32(F.arg_size())});
+  }
+
+  return true;
+}
+
 bool InjectFuncCall::runOnModule(Module &M) {
+  if (OutputMode == InjectOutputKind::Trace)
+    return injectTraceCalls(M);
+
   bool InsertedAtLeastOnePrintf = false;
 
   auto &CTX = M.getContext();
@@ -76,6 +616,10 @@ bool InjectFuncCall::runOnModule(Module &M) {
       M.getOrInsertGlobal("PrintfFormatStr", PrintfFormatStr->getType());
   dyn_cast<GlobalVariable>(PrintfFormatStrVar)->setInitializer(PrintfFormatStr);
 
+  // The thread-local countdown (sampling only)
+  GlobalVariable *Countdown = nullptr;
+  unsigned Period = SamplePeriod;
+
   // STEP 3: For each function in the module, inject a call to printf
   // ----------------------------------------------------------------
   for (auto &F : M) {
@@ -83,7 +627,14 @@ bool InjectFuncCall::runOnModule(Module &M) {
       continue;
 
     // Get an IR builder. Sets the insertion point to the top of the function
+    // (or to the sampled path when sampling)
     IRBuilder<> Builder(&*F.getEntryBlock().getFirstInsertionPt());
+    if (Period > 1) {
+      if (!Countdown)
+        Countdown =
+            createSamplingCountdown(M, "InjectFuncCallCountdown", Period);
+      Builder.SetInsertPoint(emitSamplingCheck(F, Countdown, Period));
+    }
 
     // Inject a global variable that contains the function name
     auto FuncName = Builder.CreateGlobalString(F.getName());
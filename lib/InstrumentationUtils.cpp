@@ -0,0 +1,211 @@
+//==============================================================================
+// FILE:
+//    InstrumentationUtils.cpp
+//
+// DESCRIPTION:
+//    Implements helpers shared by the instrumentation passes. See
+//    InstrumentationUtils.h for details.
+//
+// License: MIT
+//==============================================================================
+#include "InstrumentationUtils.h"
+
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+using namespace llvm;
+
+// The size of the buffer used to expand `%p` in file names
+static constexpr unsigned PathBufSize = 4096;
+
+Value *emitFileOpen(IRBuilder<> &Builder, StringRef Path) {
+  BasicBlock *CurBB = Builder.GetInsertBlock();
+  Function *F = CurBB->getParent();
+  Module &M = *F->getParent();
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+
+  FunctionCallee Fopen = M.getOrInsertFunction(
+      "fopen", FunctionType::get(PtrTy, {PtrTy, PtrTy}, /*IsVarArgs=*/false));
+
+  // STEP 1: Work out the file name. This is equivalent to:
+  //    char PathBuf[PathBufSize];
+  //    snprintf(PathBuf, sizeof(PathBuf), "%s%d%s", Prefix, getpid(), Suffix);
+  // where Path == Prefix + "%p" + Suffix.
+  Value *PathPtr = nullptr;
+  size_t PidPos = Path.find("%p");
+  if (StringRef::npos == PidPos) {
+    PathPtr = Builder.CreateGlobalString(Path);
+  } else {
+    FunctionCallee Snprintf = M.getOrInsertFunction(
+        "snprintf", FunctionType::get(Int32Ty, {PtrTy, Int64Ty, PtrTy},
+                                      /*IsVarArgs=*/true));
+    FunctionCallee Getpid = M.getOrInsertFunction(
+        "getpid", FunctionType::get(Int32Ty, {}, /*IsVarArgs=*/false));
+
+    // Allocate the buffer in the entry block so that it's a static alloca
+    BasicBlock &Entry = F->getEntryBlock();
+    IRBuilder<> EntryBuilder(&Entry, Entry.getFirstInsertionPt());
+    PathPtr = EntryBuilder.CreateAlloca(
+        ArrayType::get(Builder.getInt8Ty(), PathBufSize), nullptr, "path");
+    Builder.CreateCall(
+        Snprintf,
+        {PathPtr, Builder.getInt64(PathBufSize),
+         Builder.CreateGlobalString("%s%d%s"),
+         Builder.CreateGlobalString(Path.take_front(PidPos)),
+         Builder.CreateCall(Getpid),
+         Builder.CreateGlobalString(Path.drop_front(PidPos + 2))});
+  }
+
+  // STEP 2: Open the file, i.e. `fopen(PathBuf, "wb")`
+  return Builder.CreateCall(Fopen,
+                            {PathPtr, Builder.CreateGlobalString("wb")});
+}
+
+void emitWriteToFile(IRBuilder<> &Builder, Value *Data, uint64_t Size,
+                     StringRef Path) {
+  Function *F = Builder.GetInsertBlock()->getParent();
+  Module &M = *F->getParent();
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+
+  FunctionCallee Fwrite = M.getOrInsertFunction(
+      "fwrite", FunctionType::get(Int64Ty, {PtrTy, Int64Ty, Int64Ty, PtrTy},
+                                  /*IsVarArgs=*/false));
+  FunctionCallee Fclose = M.getOrInsertFunction(
+      "fclose", FunctionType::get(Int32Ty, {PtrTy}, /*IsVarArgs=*/false));
+
+  // Write the data in one go. This is equivalent to:
+  //    FILE *File = fopen(PathBuf, "wb");
+  //    if (File) {
+  //      fwrite(Data, 1, Size, File);
+  //      fclose(File);
+  //    }
+  Value *File = emitFileOpen(Builder, Path);
+  BasicBlock *Write = BasicBlock::Create(CTX, "write", F);
+  BasicBlock *Done = BasicBlock::Create(CTX, "done", F);
+  Builder.CreateCondBr(Builder.CreateIsNull(File), Done, Write);
+
+  Builder.SetInsertPoint(Write);
+  Builder.CreateCall(Fwrite,
+                     {Data, Builder.getInt64(1), Builder.getInt64(Size), File});
+  Builder.CreateCall(Fclose, {File});
+  Builder.CreateBr(Done);
+
+  Builder.SetInsertPoint(Done);
+}
+
+GlobalVariable *createSamplingCountdown(Module &M, StringRef Name,
+                                        uint32_t Period) {
+  Type *Int32Ty = IntegerType::getInt32Ty(M.getContext());
+  return new GlobalVariable(M, Int32Ty, /*isConstant=*/false,
+                            GlobalValue::InternalLinkage,
+                            ConstantInt::get(Int32Ty, Period), Name,
+                            /*InsertBefore=*/nullptr,
+                            GlobalValue::InitialExecTLSModel);
+}
+
+Instruction *emitSamplingCheck(Function &F, GlobalVariable *Countdown,
+                               uint32_t Period) {
+  // Splitting the entry block before a static alloca would make it dynamic
+  BasicBlock &Entry = F.getEntryBlock();
+  BasicBlock::iterator InsertPt = Entry.getFirstInsertionPt();
+  while (isa<AllocaInst>(*InsertPt))
+    ++InsertPt;
+
+  IRBuilder<> Builder(&Entry, InsertPt);
+  Type *Int32Ty = Builder.getInt32Ty();
+  Value *CountdownPtr = Builder.CreateThreadLocalAddress(Countdown);
+  Value *Count = Builder.CreateLoad(Int32Ty, CountdownPtr);
+  Value *NewCount = Builder.CreateSub(Count, Builder.getInt32(1));
+  Builder.CreateStore(NewCount, CountdownPtr);
+  Value *IsSampled = Builder.CreateIsNull(NewCount, "sampled");
+
+  MDNode *Weights = MDBuilder(F.getContext())
+                        .createBranchWeights(1, std::max(Period, 2u) - 1);
+  Instruction *Then = SplitBlockAndInsertIfThen(
+      IsSampled, Builder.GetInsertPoint(), /*Unreachable=*/false, Weights);
+
+  Builder.SetInsertPoint(Then);
+  Builder.CreateStore(Builder.getInt32(Period), CountdownPtr);
+  return Then;
+}
+
+Function *createPerThreadBufferFunc(Module &M, StringRef Name,
+                                    StringRef Prefix, StructType *BufferTy,
+                                    GlobalVariable *List) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+
+  auto *ThreadBuffer = new GlobalVariable(
+      M, PtrTy, /*isConstant=*/false, GlobalValue::InternalLinkage,
+      ConstantPointerNull::get(PtrTy), Prefix + "ThreadBuffer",
+      /*InsertBefore=*/nullptr, GlobalValue::InitialExecTLSModel);
+  auto *NextThread = new GlobalVariable(
+      M, Int32Ty, /*isConstant=*/false, GlobalValue::InternalLinkage,
+      ConstantInt::get(Int32Ty, 0), Prefix + "NextThread");
+
+  FunctionCallee Calloc = M.getOrInsertFunction(
+      "calloc",
+      FunctionType::get(PtrTy, {Int64Ty, Int64Ty}, /*IsVarArgs=*/false));
+
+  Function *GetBufferF =
+      Function::Create(FunctionType::get(PtrTy, {}, /*IsVarArgs=*/false),
+                       GlobalValue::InternalLinkage, Name, M);
+  GetBufferF->setDoesNotThrow();
+
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", GetBufferF);
+  BasicBlock *Alloc = BasicBlock::Create(CTX, "alloc", GetBufferF);
+  BasicBlock *Init = BasicBlock::Create(CTX, "init", GetBufferF);
+  BasicBlock *Push = BasicBlock::Create(CTX, "push", GetBufferF);
+  BasicBlock *Pushed = BasicBlock::Create(CTX, "pushed", GetBufferF);
+  BasicBlock *Done = BasicBlock::Create(CTX, "done", GetBufferF);
+
+  IRBuilder<> Builder(Entry);
+  Value *BufPtr = Builder.CreateThreadLocalAddress(ThreadBuffer);
+  Value *Buf = Builder.CreateLoad(PtrTy, BufPtr);
+  Builder.CreateCondBr(Builder.CreateIsNull(Buf), Alloc, Done);
+
+  Builder.SetInsertPoint(Alloc);
+  uint64_t BufferSize = M.getDataLayout().getTypeAllocSize(BufferTy);
+  Value *NewBuf = Builder.CreateCall(
+      Calloc, {Builder.getInt64(1), Builder.getInt64(BufferSize)});
+  Builder.CreateCondBr(Builder.CreateIsNull(NewBuf), Done, Init);
+
+  Builder.SetInsertPoint(Init);
+  Value *ThreadIdx = Builder.CreateAtomicRMW(
+      AtomicRMWInst::Add, NextThread, Builder.getInt32(1), MaybeAlign(4),
+      AtomicOrdering::Monotonic);
+  Builder.CreateStore(ThreadIdx, Builder.CreateStructGEP(BufferTy, NewBuf, 1));
+  Builder.CreateBr(Push);
+
+  // Push the new buffer onto the list that's read on exit
+  Builder.SetInsertPoint(Push);
+  LoadInst *Head = Builder.CreateAlignedLoad(PtrTy, List, MaybeAlign(8));
+  Head->setAtomic(AtomicOrdering::Monotonic);
+  Builder.CreateStore(Head, Builder.CreateStructGEP(BufferTy, NewBuf, 0));
+  Value *Result = Builder.CreateAtomicCmpXchg(
+      List, Head, NewBuf, MaybeAlign(8), AtomicOrdering::Release,
+      AtomicOrdering::Monotonic);
+  Builder.CreateCondBr(Builder.CreateExtractValue(Result, 1), Pushed, Push);
+
+  Builder.SetInsertPoint(Pushed);
+  Builder.CreateStore(NewBuf, BufPtr);
+  Builder.CreateBr(Done);
+
+  Builder.SetInsertPoint(Done);
+  PHINode *Ret = Builder.CreatePHI(PtrTy, 3);
+  Ret->addIncoming(Buf, Entry);
+  Ret->addIncoming(ConstantPointerNull::get(PtrTy), Alloc);
+  Ret->addIncoming(NewBuf, Pushed);
+  Builder.CreateRet(Ret);
+
+  return GetBufferF;
+}
@@ -0,0 +1,85 @@
+//==============================================================================
+// FILE:
+//    LLVMTutor.cpp
+//
+// DESCRIPTION:
+//    A single plugin with all the passes from lib/ (except PassTracer, which
+//    instruments every pass that opt runs and is only useful on demand).
+//    Loading it is equivalent to loading the individual plugins one by one,
+//    but there is only one shared object to open and the plugins share the
+//    helper code (e.g. OpcodeHistogram).
+//
+//    Every plugin exposes its registration callbacks via get<Name>PluginInfo
+//    (the same hook that is used when registering a pass statically, see
+//    utils/static_registration.sh) and defines llvmGetPassPluginInfo as a weak
+//    symbol. The definition below overrides those and registers all the
+//    plugins at once.
+//
+//    On top of that, this plugin registers FusedAnalysis, so StaticCallCounter,
+//    OpcodeCounter and FindFCmpEq (and the passes that use them, e.g.
+//    ConvertFCmpEq) share one walk over the instructions of every function.
+//
+// USAGE:
+//      opt -load-pass-plugin libLLVMTutor.dylib `\`
+//        -passes="print<opcode-counter>,print<find-fcmp-eq>" `\`
+//        -disable-output <input-llvm-file>
+//
+// License: MIT
+//==============================================================================
+#include "FusedAnalysis.h"
+
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+using namespace llvm;
+
+llvm::PassPluginLibraryInfo getStaticCallCounterPluginInfo();
+llvm::PassPluginLibraryInfo getDynamicCallCounterPluginInfo();
+llvm::PassPluginLibraryInfo getFindFCmpEqPluginInfo();
+llvm::PassPluginLibraryInfo getConvertFCmpEqPluginInfo();
+llvm::PassPluginLibraryInfo getInjectFuncCallPluginInfo();
+llvm::PassPluginLibraryInfo getMBAAddPluginInfo();
+llvm::PassPluginLibraryInfo getMBASubPluginInfo();
+llvm::PassPluginLibraryInfo getMBASimplifyPluginInfo();
+llvm::PassPluginLibraryInfo getRIVPluginInfo();
+llvm::PassPluginLibraryInfo getDuplicateBBPluginInfo();
+llvm::PassPluginLibraryInfo getOpcodeCounterPluginInfo();
+llvm::PassPluginLibraryInfo getMergeBBPluginInfo();
+llvm::PassPluginLibraryInfo getEdgeProfilerPluginInfo();
+llvm::PassPluginLibraryInfo getFunctionLatencyPluginInfo();
+llvm::PassPluginLibraryInfo getDynamicOpcodeCounterPluginInfo();
+llvm::PassPluginLibraryInfo getLoopTripCounterPluginInfo();
+
+//-----------------------------------------------------------------------------
+// New PM Registration
+//-----------------------------------------------------------------------------
+llvm::PassPluginLibraryInfo getLLVMTutorPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "LLVMTutor", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            // REGISTRATION FOR "FAM.getResult<FusedAnalysis>(Function)"
+            PB.registerAnalysisRegistrationCallback(
+                [](FunctionAnalysisManager &FAM) {
+                  FAM.registerPass([&] { return FusedAnalysis(); });
+                });
+
+            for (auto GetPluginInfo :
+                 {getStaticCallCounterPluginInfo,
+                  getDynamicCallCounterPluginInfo, getFindFCmpEqPluginInfo,
+                  getConvertFCmpEqPluginInfo, getInjectFuncCallPluginInfo,
+                  getMBAAddPluginInfo, getMBASubPluginInfo,
+                  getMBASimplifyPluginInfo, getRIVPluginInfo,
+                  getDuplicateBBPluginInfo, getOpcodeCounterPluginInfo,
+                  getMergeBBPluginInfo, getEdgeProfilerPluginInfo,
+                  getFunctionLatencyPluginInfo,
+                  getDynamicOpcodeCounterPluginInfo,
+                  getLoopTripCounterPluginInfo})
+              GetPluginInfo().RegisterPassBuilderCallbacks(PB);
+          }};
+}
+
+// This is the core interface for pass plugins. It guarantees that 'opt' will
+// be able to recognize the passes from all the plugins above when added to
+// the pass pipeline on the command line, i.e. via '-passes=...'
+extern "C" ::llvm::PassPluginLibraryInfo llvmGetPassPluginInfo() {
+  return getLLVMTutorPluginInfo();
+}
@@ -0,0 +1,582 @@
+//========================================================================
+// FILE:
+//    LoopTripCounter.cpp
+//
+// DESCRIPTION:
+//    Profiles the trip counts of loops - i.e. how many iterations a loop runs
+//    every time it is entered - and feeds them back to the loop passes (e.g.
+//    SimpleLICM and DerivedInductionVars).
+//
+//    The `loop-tc` pass instruments every loop (as computed by LoopInfo) that
+//    has a preheader and dedicated exits:
+//      * the preheader resets a per-loop counter (an alloca, so that
+//        recursion is fine),
+//      * the header increments it, and
+//      * every exit block records the resulting trip count, i.e. updates the
+//        number of entries, the total and the maximum trip count, and the
+//        power-of-two histogram of the loop.
+//    The trip count is the number of times the backedges are taken, plus one
+//    for the loops in rotated form (i.e. whose latch exits the loop), where
+//    the body runs once before the exit condition is first checked. So the
+//    counter starts at -1 in the loops whose header checks the exit
+//    condition: a `while` loop that exits straight away records 0. The
+//    rotated loops are usually guarded by a branch that skips them (see
+//    Loop::getLoopGuardBranch) instead, which records a trip of 0 whenever
+//    it's taken. Trips that end with an exception (or a call to `exit`) are
+//    not recorded. The records of all the loops and the function names are laid
+//    out in a single global variable (see LoopTripCounterProfile.h) that
+//    is written to `-loop-tc-file` when the module exits. Run `loop-simplify`
+//    first to instrument all the loops.
+//
+//    The `loop-tc-annotate` pass reads such a profile (`-loop-tc-profile`)
+//    and attaches the trip counts to the loops as loop metadata (see
+//    LoopTripCounter.h). Loops are identified by the position of their header
+//    in the function, so the annotated IR must have the same CFG as the
+//    instrumented IR. Functions whose number of blocks has changed are
+//    reported and left alone.
+//
+// USAGE:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libLoopTripCounter.so `\`
+//        -passes="function(loop-simplify),loop-tc" -loop-tc-file=loops.%p `\`
+//        <bitcode-file> -o instrumented.bin
+//      $ lli instrumented.bin
+//      $ <BUILD_DIR>/bin/dcc-profdata merge -o loops.profdata loops.*
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libLoopTripCounter.so `\`
+//        -passes="function(loop-simplify,loop-tc-annotate)" `\`
+//        -loop-tc-profile=loops.profdata <bitcode-file> -o annotated.bin
+//    Pass `-loop-tc-atomic` to make the updates of the records thread-safe
+//    (they become relaxed atomics).
+//
+// License: MIT
+//========================================================================
+#include "LoopTripCounter.h"
+#include "InstrumentationUtils.h"
+#include "LoopTripCounterProfile.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/TargetParser/Triple.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "loop-tc"
+
+//-----------------------------------------------------------------------------
+// Command line options
+//-----------------------------------------------------------------------------
+static cl::opt<bool>
+    AtomicRecords("loop-tc-atomic",
+                  cl::desc("Use relaxed atomic updates for the loop records "
+                           "(thread-safe)"),
+                  cl::init(false));
+
+static cl::opt<std::string> ProfileFile(
+    "loop-tc-file",
+    cl::desc("The loop profile to write on exit (%p expands to the process "
+             "ID)"),
+    cl::value_desc("filename"), cl::init("loop.profdata"));
+
+static cl::opt<std::string>
+    AnnotateProfile("loop-tc-profile",
+                    cl::desc("The loop profile to attach to the loops (see "
+                             "loop-tc-annotate)"),
+                    cl::value_desc("filename"), cl::init(""));
+
+static constexpr unsigned CacheLineSize = 64;
+
+namespace {
+// The instrumentation plan for one function
+struct FunctionPlan {
+  Function *F;
+  uint32_t NumBlocks;
+  // The loops to instrument and the positions of their headers
+  std::vector<std::pair<Loop *, uint32_t>> Loops;
+};
+} // namespace
+
+// Returns true if the trips of L can be counted, i.e. if there's a block to
+// reset the counter in and the exit blocks are only reachable from L
+static bool canInstrument(Loop &L) {
+  if (!L.getLoopPreheader() || !L.hasDedicatedExits())
+    return false;
+
+  SmallVector<BasicBlock *, 8> ExitBlocks;
+  L.getUniqueExitBlocks(ExitBlocks);
+  for (BasicBlock *ExitBB : ExitBlocks)
+    if (ExitBB->getFirstInsertionPt() == ExitBB->end())
+      return false;
+  return true;
+}
+
+static FunctionPlan planFunction(Function &F, LoopInfo &LI) {
+  FunctionPlan Plan{&F, static_cast<uint32_t>(F.size()), {}};
+
+  DenseMap<BasicBlock *, uint32_t> BlockIDs;
+  uint32_t NextBlockID = 1;
+  for (BasicBlock &BB : F)
+    BlockIDs[&BB] = NextBlockID++;
+
+  for (Loop *L : LI.getLoopsInPreorder())
+    if (canInstrument(*L))
+      Plan.Loops.push_back({L, BlockIDs.lookup(L->getHeader())});
+  return Plan;
+}
+
+// Creates the global variable that holds the loop profile. Its type mirrors
+// the layout described in LoopTripCounterProfile.h:
+//    { LoopProfileHeader, [NF x LoopProfileFunction], [NL x LoopProfileLoop],
+//      [NamesSize x i8] }
+// All the counts are initialised with 0.
+static GlobalVariable *CreateProfileData(Module &M,
+                                         ArrayRef<FunctionPlan> Plans,
+                                         StructType *LoopTy,
+                                         uint64_t &ProfileSize) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  auto Int32 = [&](uint64_t V) { return ConstantInt::get(Int32Ty, V); };
+  auto Int64 = [&](uint64_t V) { return ConstantInt::get(Int64Ty, V); };
+
+  StructType *FuncTy = StructType::get(
+      CTX, {Int32Ty, Int32Ty, Int32Ty, Int32Ty, Int32Ty, Int32Ty});
+  Constant *NoBuckets = Constant::getNullValue(LoopTy->getElementType(5));
+
+  std::string Names;
+  SmallVector<Constant *, 16> Funcs;
+  std::vector<Constant *> Loops;
+  for (const FunctionPlan &Plan : Plans) {
+    StringRef Name = Plan.F->getName();
+    Funcs.push_back(ConstantStruct::get(
+        FuncTy, {Int32(Names.size()), Int32(Name.size()),
+                 Int32(Plan.NumBlocks), Int32(Loops.size()),
+                 Int32(Plan.Loops.size()), Int32(0)}));
+    Names += Name;
+
+    for (auto &[L, Header] : Plan.Loops)
+      Loops.push_back(ConstantStruct::get(
+          LoopTy, {Int32(Header), Int32(L->getLoopDepth()), Int64(0),
+                   Int64(0), Int64(0), NoBuckets}));
+  }
+
+  StructType *HeaderTy = StructType::get(
+      CTX, {Int64Ty, Int32Ty, Int32Ty, Int32Ty, Int32Ty, Int64Ty});
+  Constant *Header = ConstantStruct::get(
+      HeaderTy, {Int64(LoopProfileMagic), Int32(LoopProfileVersion),
+                 Int32(Funcs.size()), Int32(Loops.size()), Int32(0),
+                 Int64(Names.size())});
+
+  ArrayType *FuncsTy = ArrayType::get(FuncTy, Funcs.size());
+  ArrayType *LoopsTy = ArrayType::get(LoopTy, Loops.size());
+  Constant *Profile = ConstantStruct::getAnon(
+      CTX, {Header, ConstantArray::get(FuncsTy, Funcs),
+            ConstantArray::get(LoopsTy, Loops),
+            ConstantDataArray::getString(CTX, Names, /*AddNull=*/false)});
+
+  auto *ProfileGV = new GlobalVariable(M, Profile->getType(),
+                                       /*isConstant=*/false,
+                                       GlobalValue::InternalLinkage, Profile,
+                                       "LoopProfile");
+  ProfileGV->setAlignment(Align(CacheLineSize));
+  ProfileGV->setSection(Triple(M.getTargetTriple()).isOSBinFormatMachO()
+                            ? "__DATA,__lt_loop_prof"
+                            : "lt_loop_prof");
+  appendToUsed(M, {ProfileGV});
+
+  ProfileSize = sizeof(LoopProfileHeader) +
+                Funcs.size() * sizeof(LoopProfileFunction) +
+                Loops.size() * sizeof(LoopProfileLoop) + Names.size();
+  return ProfileGV;
+}
+
+// Adds Val to the 64-bit integer at Ptr
+static void EmitAdd(IRBuilder<> &Builder, Value *Ptr, Value *Val,
+                    bool Atomic) {
+  if (Atomic) {
+    Builder.CreateAtomicRMW(AtomicRMWInst::Add, Ptr, Val, MaybeAlign(8),
+                            AtomicOrdering::Monotonic);
+    return;
+  }
+
+  LoadInst *Load = Builder.CreateLoad(Builder.getInt64Ty(), Ptr);
+  Builder.CreateStore(Builder.CreateAdd(Load, Val), Ptr);
+}
+
+// Defines `void loop_tc_record(ptr Loop, i64 Trip)` that records one trip of
+// the loop described by the LoopProfileLoop at Loop. It is equivalent to the
+// following C function:
+// ```
+//    void loop_tc_record(LoopProfileLoop *Loop, uint64_t Trip) {
+//      Loop->Entries++;
+//      Loop->Iterations += Trip;
+//      Loop->MaxTripCount = max(Loop->MaxTripCount, Trip);
+//      Loop->Buckets[min(64 - clz(Trip), NumBuckets - 1)]++;
+//    }
+// ```
+// (clz(0) is 64, so the trips of 0 go to the first bucket.)
+static Function *CreateRecordFunc(Module &M, StructType *LoopTy,
+                                  bool Atomic) {
+  auto &CTX = M.getContext();
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+
+  FunctionType *RecordTy =
+      FunctionType::get(Type::getVoidTy(CTX),
+                        {PointerType::getUnqual(CTX), Int64Ty},
+                        /*IsVarArgs=*/false);
+  Function *RecordF = Function::Create(
+      RecordTy, GlobalValue::InternalLinkage, "loop_tc_record", M);
+  RecordF->setDoesNotThrow();
+  Value *Rec = RecordF->getArg(0);
+  Value *Trip = RecordF->getArg(1);
+
+  IRBuilder<> Builder(BasicBlock::Create(CTX, "entry", RecordF));
+  EmitAdd(Builder, Builder.CreateStructGEP(LoopTy, Rec, 2),
+          Builder.getInt64(1), Atomic);
+  EmitAdd(Builder, Builder.CreateStructGEP(LoopTy, Rec, 3), Trip, Atomic);
+
+  Value *MaxPtr = Builder.CreateStructGEP(LoopTy, Rec, 4);
+  if (Atomic) {
+    Builder.CreateAtomicRMW(AtomicRMWInst::UMax, MaxPtr, Trip, MaybeAlign(8),
+                            AtomicOrdering::Monotonic);
+  } else {
+    LoadInst *Max = Builder.CreateLoad(Int64Ty, MaxPtr);
+    Builder.CreateStore(
+        Builder.CreateBinaryIntrinsic(Intrinsic::umax, Max, Trip), MaxPtr);
+  }
+
+  Value *Width = Builder.CreateSub(
+      Builder.getInt64(64),
+      Builder.CreateBinaryIntrinsic(Intrinsic::ctlz, Trip,
+                                    Builder.getFalse()));
+  Value *Bucket = Builder.CreateBinaryIntrinsic(
+      Intrinsic::umin, Width, Builder.getInt64(LoopProfileNumBuckets - 1));
+  EmitAdd(Builder,
+          Builder.CreateInBoundsGEP(
+              LoopTy, Rec, {Builder.getInt32(0), Builder.getInt32(5), Bucket}),
+          Builder.getInt64(1), Atomic);
+  Builder.CreateRetVoid();
+
+  return RecordF;
+}
+
+// Records a trip of 0 for the loop described by the LoopProfileLoop at Rec
+// whenever its guard branch skips the loop. The update doesn't depend on the
+// branch (Skipped is added to the counts), so that the CFG is left alone.
+static void EmitRecordSkip(BranchInst *Guard, BasicBlock *Preheader,
+                           StructType *LoopTy, Constant *Rec, bool Atomic) {
+  IRBuilder<> Builder(Guard);
+  Value *Skipped = Guard->getCondition();
+  if (Guard->getSuccessor(0) == Preheader)
+    Skipped = Builder.CreateNot(Skipped);
+  Skipped = Builder.CreateZExt(Skipped, Builder.getInt64Ty());
+
+  EmitAdd(Builder, Builder.CreateStructGEP(LoopTy, Rec, 2), Skipped, Atomic);
+  EmitAdd(Builder,
+          Builder.CreateInBoundsGEP(
+              LoopTy, Rec,
+              {Builder.getInt32(0), Builder.getInt32(5), Builder.getInt32(0)}),
+          Skipped, Atomic);
+}
+
+// Defines `void loop_tc_write_profile()` that writes Profile to ProfileFile
+// (see emitWriteToFile)
+static Function *CreateProfileWriterFunc(Module &M, GlobalVariable *Profile,
+                                         uint64_t ProfileSize) {
+  auto &CTX = M.getContext();
+  FunctionType *WriterTy =
+      FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false);
+  Function *WriterF = Function::Create(
+      WriterTy, GlobalValue::InternalLinkage, "loop_tc_write_profile", M);
+
+  IRBuilder<> Builder(BasicBlock::Create(CTX, "entry", WriterF));
+  emitWriteToFile(Builder, Profile, ProfileSize, ProfileFile);
+  Builder.CreateRetVoid();
+
+  return WriterF;
+}
+
+//-----------------------------------------------------------------------------
+// LoopTripCounter implementation
+//-----------------------------------------------------------------------------
+bool LoopTripCounter::runOnModule(Module &M, FunctionAnalysisManager &FAM) {
+  // STEP 1: Select the loops to instrument. The instrumentation doesn't
+  // change the CFG, so LoopInfo remains valid until the end.
+  std::vector<FunctionPlan> Plans;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+
+    FunctionPlan Plan = planFunction(F, FAM.getResult<LoopAnalysis>(F));
+    if (!Plan.Loops.empty())
+      Plans.push_back(std::move(Plan));
+  }
+
+  // Stop here if there are no loops in this module
+  if (Plans.empty())
+    return false;
+
+  // STEP 2: Create the profile and the function that updates it
+  auto &CTX = M.getContext();
+  Type *Int32Ty = IntegerType::getInt32Ty(CTX);
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  StructType *LoopTy = StructType::get(
+      CTX, {Int32Ty, Int32Ty, Int64Ty, Int64Ty, Int64Ty,
+            ArrayType::get(Int64Ty, LoopProfileNumBuckets)});
+
+  uint64_t ProfileSize = 0;
+  GlobalVariable *Profile = CreateProfileData(M, Plans, LoopTy, ProfileSize);
+  Function *RecordF = CreateRecordFunc(M, LoopTy, AtomicRecords);
+
+  // STEP 3: Count the trips of every loop
+  uint32_t LoopIdx = 0;
+  for (const FunctionPlan &Plan : Plans) {
+    // The counters are allocated up front, so that they stay together at the
+    // top of the entry block (which may be a preheader too)
+    IRBuilder<> EntryBuilder(&*Plan.F->getEntryBlock().getFirstInsertionPt());
+    SmallVector<AllocaInst *, 8> Trips;
+    for (unsigned Idx = 0; Idx != Plan.Loops.size(); ++Idx)
+      Trips.push_back(EntryBuilder.CreateAlloca(Int64Ty, nullptr, "loop.tc"));
+
+    for (unsigned Idx = 0; Idx != Plan.Loops.size(); ++Idx) {
+      Loop *L = Plan.Loops[Idx].first;
+      AllocaInst *Trip = Trips[Idx];
+      Constant *Rec = ConstantExpr::getInBoundsGetElementPtr(
+          Profile->getValueType(), Profile,
+          ArrayRef<Constant *>{ConstantInt::get(Int32Ty, 0),
+                               ConstantInt::get(Int32Ty, 2),
+                               ConstantInt::get(Int32Ty, LoopIdx++)});
+
+      // The first run of the header isn't an iteration if it may leave the
+      // loop straight away
+      BasicBlock *Preheader = L->getLoopPreheader();
+      IRBuilder<> Builder(Preheader->getTerminator());
+      Builder.CreateStore(Builder.getInt64(L->isRotatedForm() ? 0 : -1), Trip);
+      if (BranchInst *Guard = L->getLoopGuardBranch())
+        EmitRecordSkip(Guard, Preheader, LoopTy, Rec, AtomicRecords);
+
+      Builder.SetInsertPoint(&*L->getHeader()->getFirstInsertionPt());
+      LoadInst *Count = Builder.CreateLoad(Int64Ty, Trip);
+      Builder.CreateStore(Builder.CreateAdd(Count, Builder.getInt64(1)),
+                          Trip);
+
+      SmallVector<BasicBlock *, 8> ExitBlocks;
+      L->getUniqueExitBlocks(ExitBlocks);
+      for (BasicBlock *ExitBB : ExitBlocks) {
+        Builder.SetInsertPoint(&*ExitBB->getFirstInsertionPt());
+        Builder.CreateCall(RecordF, {Rec, Builder.CreateLoad(Int64Ty, Trip)});
+      }
+    }
+
+    LLVM_DEBUG(dbgs() << " Instrumented: " << Plan.F->getName() << "\n");
+  }
+
+  // STEP 4: Write the profile on exit
+  appendToGlobalDtors(M, CreateProfileWriterFunc(M, Profile, ProfileSize),
+                      /*Priority=*/0);
+
+  return true;
+}
+
+PreservedAnalyses LoopTripCounter::run(llvm::Module &M,
+                                       llvm::ModuleAnalysisManager &MAM) {
+  auto &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  bool Changed = runOnModule(M, FAM);
+
+  return (Changed ? llvm::PreservedAnalyses::none()
+                  : llvm::PreservedAnalyses::all());
+}
+
+//-----------------------------------------------------------------------------
+// Profile loading
+//-----------------------------------------------------------------------------
+namespace {
+// The recorded loops of one function
+struct FunctionLoops {
+  uint32_t NumBlocks = 0;
+  std::vector<LoopProfileLoop> Loops;
+};
+} // namespace
+
+using LoopProfile = StringMap<FunctionLoops>;
+
+// Reads the loop records from the LoopTripCounter profile Path. Invalid
+// profiles are reported and ignored (i.e. no loop has a profile).
+static LoopProfile readLoopProfile(StringRef Path) {
+  LoopProfile Result;
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufOrErr =
+      MemoryBuffer::getFile(Path, /*IsText=*/false,
+                            /*RequiresNullTerminator=*/false);
+  if (!BufOrErr) {
+    errs() << "warning: cannot read the profile " << Path << ": "
+           << BufOrErr.getError().message() << "\n";
+    return Result;
+  }
+
+  const char *Data = (*BufOrErr)->getBufferStart();
+  size_t Size = (*BufOrErr)->getBufferSize();
+  LoopProfileHeader Header;
+  if (Size >= sizeof(Header))
+    memcpy(&Header, Data, sizeof(Header));
+  if (Size < sizeof(Header) || Header.Magic != LoopProfileMagic ||
+      Header.Version != LoopProfileVersion) {
+    errs() << "warning: ignoring invalid LoopTripCounter profile " << Path
+           << "\n";
+    return Result;
+  }
+
+  uint64_t FuncsSize =
+      uint64_t(Header.NumFunctions) * sizeof(LoopProfileFunction);
+  uint64_t LoopsSize = uint64_t(Header.NumLoops) * sizeof(LoopProfileLoop);
+  if (Size < sizeof(Header) + FuncsSize + LoopsSize + Header.NamesSize) {
+    errs() << "warning: ignoring truncated LoopTripCounter profile " << Path
+           << "\n";
+    return Result;
+  }
+
+  // The buffer isn't necessarily aligned, so the records are copied out
+  std::vector<LoopProfileFunction> Funcs(Header.NumFunctions);
+  std::vector<LoopProfileLoop> Loops(Header.NumLoops);
+  memcpy(Funcs.data(), Data + sizeof(Header), FuncsSize);
+  memcpy(Loops.data(), Data + sizeof(Header) + FuncsSize, LoopsSize);
+  StringRef Names(Data + sizeof(Header) + FuncsSize + LoopsSize,
+                  Header.NamesSize);
+
+  for (const LoopProfileFunction &Func : Funcs) {
+    if (uint64_t(Func.NameOffset) + Func.NameSize > Names.size() ||
+        uint64_t(Func.FirstLoop) + Func.NumLoops > Loops.size())
+      continue;
+
+    FunctionLoops &Entry = Result[Names.substr(Func.NameOffset, Func.NameSize)];
+    Entry.NumBlocks = Func.NumBlocks;
+    Entry.Loops.assign(Loops.begin() + Func.FirstLoop,
+                       Loops.begin() + Func.FirstLoop + Func.NumLoops);
+  }
+
+  return Result;
+}
+
+// Returns the loop records from the profile Path. Every profile is read only
+// once and is shared by all the passes (possibly running on different
+// threads) that use it.
+static const LoopProfile *getLoopProfile(StringRef Path) {
+  static std::mutex Lock;
+  static StringMap<std::unique_ptr<LoopProfile>> Profiles;
+
+  std::lock_guard<std::mutex> Guard(Lock);
+  std::unique_ptr<LoopProfile> &Profile = Profiles[Path];
+  if (!Profile)
+    Profile = std::make_unique<LoopProfile>(readLoopProfile(Path));
+  return Profile.get();
+}
+
+//-----------------------------------------------------------------------------
+// LoopTripCountAnnotator implementation
+//-----------------------------------------------------------------------------
+PreservedAnalyses LoopTripCountAnnotator::run(Function &F,
+                                              FunctionAnalysisManager &FAM) {
+  if (AnnotateProfile.empty())
+    return PreservedAnalyses::all();
+
+  const LoopProfile *Profile = getLoopProfile(AnnotateProfile);
+  auto Func = Profile->find(F.getName());
+  if (Func == Profile->end())
+    return PreservedAnalyses::all();
+  if (Func->second.NumBlocks != F.size()) {
+    errs() << "warning: ignoring the stale loop profile of " << F.getName()
+           << " (the CFG has changed)\n";
+    return PreservedAnalyses::all();
+  }
+
+  std::vector<BasicBlock *> Blocks;
+  for (BasicBlock &BB : F)
+    Blocks.push_back(&BB);
+
+  auto &LI = FAM.getResult<LoopAnalysis>(F);
+  auto &CTX = F.getContext();
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  auto Int64 = [&](uint64_t V) {
+    return ConstantAsMetadata::get(ConstantInt::get(Int64Ty, V));
+  };
+
+  bool Changed = false;
+  for (const LoopProfileLoop &Rec : Func->second.Loops) {
+    Loop *L = nullptr;
+    if (Rec.Header >= 1 && Rec.Header <= Blocks.size())
+      L = LI.getLoopFor(Blocks[Rec.Header - 1]);
+    if (!L || L->getHeader() != Blocks[Rec.Header - 1] || !L->getLoopLatch()) {
+      errs() << "warning: ignoring the stale loop profile of " << F.getName()
+             << " (no loop with header " << Rec.Header << ")\n";
+      continue;
+    }
+
+    MDNode *TripCount = MDNode::get(
+        CTX, {MDString::get(CTX, LoopTripCountMDName), Int64(Rec.Entries),
+              Int64(Rec.Iterations), Int64(Rec.MaxTripCount)});
+
+    SmallVector<Metadata *, LoopProfileNumBuckets + 1> Histogram{
+        MDString::get(CTX, LoopTripCountHistogramMDName)};
+    unsigned NumBuckets = LoopProfileNumBuckets;
+    while (NumBuckets && !Rec.Buckets[NumBuckets - 1])
+      --NumBuckets;
+    for (unsigned Bucket = 0; Bucket != NumBuckets; ++Bucket)
+      Histogram.push_back(Int64(Rec.Buckets[Bucket]));
+
+    // Replaces the properties from a previous annotation (both names start
+    // with LoopTripCountMDName)
+    L->setLoopID(makePostTransformationMetadata(
+        CTX, L->getLoopID(), {LoopTripCountMDName},
+        {TripCount, MDNode::get(CTX, Histogram)}));
+    Changed = true;
+  }
+
+  if (!Changed)
+    return PreservedAnalyses::all();
+
+  // Only metadata has been added
+  PreservedAnalyses PA;
+  PA.preserveSet<CFGAnalyses>();
+  return PA;
+}
+
+//-----------------------------------------------------------------------------
+// New PM Registration
+//-----------------------------------------------------------------------------
+llvm::PassPluginLibraryInfo getLoopTripCounterPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "loop-tc", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "loop-tc") {
+                    MPM.addPass(LoopTripCounter());
+                    return true;
+                  }
+                  return false;
+                });
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, FunctionPassManager &FPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "loop-tc-annotate") {
+                    FPM.addPass(LoopTripCountAnnotator());
+                    return true;
+                  }
+                  return false;
+                });
+          }};
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getLoopTripCounterPluginInfo();
+}
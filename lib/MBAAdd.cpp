@@ -3,28 +3,39 @@
 //    MBAAdd.cpp
 //
 // DESCRIPTION:
-//    This pass performs a substitution for 8-bit integer add
-//    instruction based on this Mixed Boolean-Airthmetic expression:
-//      a + b == (((a ^ b) + 2 * (a & b)) * 39 + 23) * 151 + 111
-//    See formula (3) in [1].
+//    This pass performs a substitution for integer add instructions (8-bit or
+//    wider) based on this Mixed Boolean-Airthmetic expression:
+//      a + b == (((a ^ b) + 2 * (a & b)) * C1 + C2) * C3 + C4
+//    See formula (3) in [1]. This holds modulo 2^N whenever C1 * C3 == 1 and
+//    C2 * C3 + C4 == 0. The pass uses C1 = 39 and C2 = 23, and derives C3 and C4
+//    from them for every bit width (for 8-bit integers, C3 = 151 and C4 = 111).
+//
+//    With `-mba-add-hot-threshold`, additions in hot blocks are obfuscated
+//    only partially (see `-mba-add-hot-percentage` and HotBlockFilter.h). The
+//    hotness is estimated with BlockFrequencyInfo, scaled by the call counts
+//    from `-mba-add-profile` (a DynamicCallCounter binary profile) if
+//    provided.
 //
 // USAGE:
 //      $ opt -load-pass-plugin <BUILD_DIR>/lib/libMBAAdd.so `\`
 //        -passes=-"mba-add" <bitcode-file>
-//      The command line option is not available for the new PM
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libMBAAdd.so `\`
+//        -passes=-"mba-add" -mba-add-hot-threshold=1000 `\`
+//        -mba-add-profile=<dcc-profile> <bitcode-file>
 //
-//  
 // [1] "Defeating MBA-based Obfuscation" Ninon Eyrolles, Louis Goubin, Marion
 //     Videau
 //
 // License: MIT
 //==============================================================================
 #include "MBAAdd.h"
+#include "HotBlockFilter.h"
 
 #include "llvm/ADT/Statistic.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
 #include <random>
@@ -34,13 +45,35 @@ using namespace llvm;
 #define DEBUG_TYPE "mba-add"
 
 STATISTIC(SubstCount, "The # of substituted instructions");
+STATISTIC(HotSkipCount, "The # of instructions skipped in hot blocks");
+
+//-----------------------------------------------------------------------------
+// Command line options
+//-----------------------------------------------------------------------------
+static cl::opt<uint64_t> HotThreshold{
+    "mba-add-hot-threshold",
+    cl::desc{"Blocks estimated to run more than this many times are hot and "
+             "only partially obfuscated (0 = obfuscate all blocks)"},
+    cl::init(0)};
+
+static cl::opt<unsigned> HotPercentage{
+    "mba-add-hot-percentage",
+    cl::desc{"The percentage of the additions in hot blocks to obfuscate"},
+    cl::value_desc{"percent"}, cl::init(0)};
+
+static cl::opt<std::string> ProfileFile{
+    "mba-add-profile",
+    cl::desc{"The DynamicCallCounter profile with the call counts used to "
+             "identify hot blocks"},
+    cl::value_desc{"filename"}};
 
 //-----------------------------------------------------------------------------
 // MBAAdd Implementation
 //-----------------------------------------------------------------------------
-bool MBAAdd::runOnBasicBlock(BasicBlock &BB) {
+bool MBAAdd::runOnBasicBlock(BasicBlock &BB, unsigned Percentage) {
   bool Changed = false;
-  
+  unsigned NumEligible = 0;
+
   // Loop over all instructions in the block. Replacing instructions requires
   // iterators, hence a for-range loop wouldn't be suitable
   for (auto Inst = BB.begin(), IE = BB.end(); Inst != IE; ++Inst) {
@@ -53,38 +86,49 @@ bool MBAAdd::runOnBasicBlock(BasicBlock &BB) {
     if (BinOp->getOpcode() != Instruction::Add)
       continue;
 
-    // Skip if the result is not 8-bit wide (this implies that the operands are
-    // also 8-bit wide)
+    // Skip if the result is not an integer that is at least 8-bit wide (this
+    // implies that the operands are also integers of the same width)
     if (!BinOp->getType()->isIntegerTy() ||
-        !(BinOp->getType()->getIntegerBitWidth() == 8))
+        BinOp->getType()->getIntegerBitWidth() < 8)
+      continue;
+
+    // Only obfuscate the selected part of the additions
+    if (!HotBlockFilter::isSelected(NumEligible++, Percentage)) {
+      ++HotSkipCount;
       continue;
+    }
 
     // A uniform API for creating instructions and inserting
     // them into basic blocks
     IRBuilder<> Builder(BinOp);
 
-    // Constants used in building the instruction for substitution
-    auto Val39 = ConstantInt::get(BinOp->getType(), 39);
-    auto Val151 = ConstantInt::get(BinOp->getType(), 151);
-    auto Val23 = ConstantInt::get(BinOp->getType(), 23);
+    // Constants used in building the instruction for substitution. C3 is the
+    // multiplicative inverse of C1 modulo 2^N and C4 cancels out C2 * C3.
+    unsigned BitWidth = BinOp->getType()->getIntegerBitWidth();
+    APInt C1(BitWidth, 39), C2(BitWidth, 23);
+    APInt C3 = C1.multiplicativeInverse();
+    APInt C4 = -(C2 * C3);
+    auto ValC1 = ConstantInt::get(BinOp->getType(), C1);
+    auto ValC3 = ConstantInt::get(BinOp->getType(), C3);
+    auto ValC2 = ConstantInt::get(BinOp->getType(), C2);
     auto Val2 = ConstantInt::get(BinOp->getType(), 2);
-    auto Val111 = ConstantInt::get(BinOp->getType(), 111);
+    auto ValC4 = ConstantInt::get(BinOp->getType(), C4);
 
-    // Build an instruction representing `(((a ^ b) + 2 * (a & b)) * 39 + 23) *
-    // 151 + 111`
+    // Build an instruction representing `(((a ^ b) + 2 * (a & b)) * C1 + C2)
+    // * C3 + C4`
     Instruction *NewInst =
-        // E = e5 + 111
+        // E = e5 + C4
         BinaryOperator::CreateAdd(
-            Val111,
-            // e5 = e4 * 151
+            ValC4,
+            // e5 = e4 * C3
             Builder.CreateMul(
-                Val151,
-                // e4 = e2 + 23
+                ValC3,
+                // e4 = e3 + C2
                 Builder.CreateAdd(
-                    Val23,
-                    // e3 = e2 * 39
+                    ValC2,
+                    // e3 = e2 * C1
                     Builder.CreateMul(
-                        Val39,
+                        ValC1,
                         // e2 = e0 + e1
                         Builder.CreateAdd(
                             // e0 = a ^ b
@@ -94,17 +138,17 @@ bool MBAAdd::runOnBasicBlock(BasicBlock &BB) {
                             Builder.CreateMul(
                                 Val2, Builder.CreateAnd(BinOp->getOperand(0),
                                                         BinOp->getOperand(1))))
-                    ) // e3 = e2 * 39
-                ) // e4 = e2 + 23
-            ) // e5 = e4 * 151
-        ); // E = e5 + 111
+                    ) // e3 = e2 * C1
+                ) // e4 = e3 + C2
+            ) // e5 = e4 * C3
+        ); // E = e5 + C4
 
     // The following is visible only if you pass -debug on the command line
     // *and* you have an assert build.
     LLVM_DEBUG(dbgs() << *BinOp << " -> " << *NewInst << "\n");
 
     // Replace `(a + b)` (original instructions) with `(((a ^ b) + 2 * (a & b))
-    // * 39 + 23) * 151 + 111` (the new instruction)
+    // * C1 + C2) * C3 + C4` (the new instruction)
     ReplaceInstWithInst(&BB, Inst, NewInst);
     Changed = true;
 
@@ -115,11 +159,14 @@ bool MBAAdd::runOnBasicBlock(BasicBlock &BB) {
 }
 
 PreservedAnalyses MBAAdd::run(llvm::Function &F,
-                              llvm::FunctionAnalysisManager &) {
+                              llvm::FunctionAnalysisManager &FAM) {
   bool Changed = false;
 
+  HotBlockFilter Filter(HotThreshold, HotPercentage, ProfileFile);
+  Filter.startFunction(F, FAM);
+
   for (auto &BB : F) {
-    Changed |= runOnBasicBlock(BB);
+    Changed |= runOnBasicBlock(BB, Filter.getPercentage(BB));
   }
   return (Changed ? llvm::PreservedAnalyses::none()
                   : llvm::PreservedAnalyses::all());
@@ -0,0 +1,511 @@
+//==============================================================================
+// FILE:
+//    MBASimplify.cpp
+//
+// DESCRIPTION:
+//    Simplifies linear Mixed Boolean-Arithmetic (MBA) expressions, i.e. undoes
+//    the obfuscation implemented by MBAAdd and MBASub (and similar tools). The
+//    pass runs in two sweeps over the function:
+//      1. The exact idioms generated by MBAAdd and MBASub are matched and
+//         folded back into a single add/sub:
+//           (((a ^ b) + 2 * (a & b)) * C1 + C2) * C3 + C4 -> a + b
+//             (for any C1-C4 such that C1 * C3 == 1 and C2 * C3 + C4 == 0,
+//              e.g. 39, 23, 151 and 111 for 8-bit integers)
+//           (a + ~b) + 1 -> a - b
+//      2. Every other integer expression that is a linear MBA expression
+//         (i.e. a linear combination of bitwise expressions) of at most
+//         MaxVars variables is simplified. A linear MBA expression E is fully
+//         determined by its values for the inputs in which every variable is
+//         either 0 or 1 (see Theorem 1 in [1]). These values (the "signature"
+//         of E) are computed by walking the expression tree. The signature is
+//         then used to synthesise the cheapest equivalent expression - a
+//         bitwise expression of at most two variables, or a linear
+//         combination of conjunctions of the variables (e.g. a single add or
+//         sub). E is replaced if the new expression is cheaper.
+//    All of this is done modulo 2^N, so integers of any bit width are
+//    supported.
+//
+// USAGE:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libMBASimplify.so `\`
+//        -passes=-"mba-simplify" <bitcode-file>
+//
+// [1] "Efficient Deobfuscation of Linear Mixed Boolean-Arithmetic
+//     Expressions", Benjamin Reichenwallner, Peter Meerwald-Stadler
+//
+// License: MIT
+//==============================================================================
+#include "MBASimplify.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/IR/ValueHandle.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+#include <optional>
+
+using namespace llvm;
+using namespace llvm::PatternMatch;
+
+#define DEBUG_TYPE "mba-simplify"
+
+STATISTIC(NumMBAAdd, "The # of MBAAdd expressions folded into add");
+STATISTIC(NumMBASub, "The # of MBASub expressions folded into sub");
+STATISTIC(NumLinearMBA, "The # of simplified linear MBA expressions");
+
+namespace {
+// The maximum number of variables in a linear MBA expression. The size of a
+// signature is exponential in this number.
+constexpr unsigned MaxVars = 3;
+constexpr unsigned NumSignatureEntries = 1U << MaxVars;
+// The limits on the size of analysed expressions. Whatever lies beyond them
+// is treated as a variable.
+constexpr unsigned MaxDepth = 16;
+constexpr unsigned MaxNodes = 64;
+
+// The values of a linear MBA expression for the inputs in {0, 1}^MaxVars.
+// Bit K of the index of an entry is the value of the K-th variable.
+using Signature = SmallVector<APInt, NumSignatureEntries>;
+
+bool isBoolean(const Signature &S) {
+  return all_of(S, [](const APInt &V) { return V.isZero() || V.isOne(); });
+}
+
+//-----------------------------------------------------------------------------
+// Expression analysis
+//-----------------------------------------------------------------------------
+// Computes the signature of an integer expression. Sub-expressions that
+// aren't linear MBA expressions become variables. This is sound - if two
+// linear MBA expressions are equal for all values of the variables, then
+// they are also equal for the actual values of these sub-expressions.
+class LinearMBAAnalyzer {
+public:
+  LinearMBAAnalyzer(Instruction &Root, unsigned DepthLimit)
+      : BitWidth(Root.getType()->getIntegerBitWidth()),
+        DepthLimit(DepthLimit) {}
+
+  // Returns false if the expression has more than MaxVars variables. In that
+  // case, getOverflowDepth() is the depth of the first variable that didn't
+  // fit.
+  bool analyze(Value *V, Signature &Result) {
+    Result = get(V, 0);
+    return !Overflow;
+  }
+
+  ArrayRef<Value *> getVars() const { return Vars; }
+  unsigned getOverflowDepth() const { return OverflowDepth; }
+  // The number of instructions that will become dead when the root of the
+  // expression is replaced
+  unsigned getCost() const { return Cost; }
+
+private:
+  Signature get(Value *V, unsigned Depth);
+  Signature getVar(Value *V, unsigned Depth);
+  Signature getConstant(const APInt &C) const {
+    // C == -C * (-1), and -1 (all bits set) evaluates to 1 for every input
+    return Signature(NumSignatureEntries, -C);
+  }
+
+  unsigned BitWidth;
+  unsigned DepthLimit;
+  DenseMap<Value *, Signature> Cache;
+  SmallVector<Value *, MaxVars> Vars;
+  unsigned NumNodes = 0;
+  unsigned Cost = 0;
+  bool Overflow = false;
+  unsigned OverflowDepth = 0;
+};
+
+Signature LinearMBAAnalyzer::getVar(Value *V, unsigned Depth) {
+  auto *It = find(Vars, V);
+  unsigned Idx = It - Vars.begin();
+  if (Vars.end() == It) {
+    if (Vars.size() == MaxVars) {
+      if (!Overflow)
+        OverflowDepth = Depth;
+      Overflow = true;
+      return getConstant(APInt(BitWidth, 0));
+    }
+    Vars.push_back(V);
+  }
+
+  Signature Result;
+  for (unsigned Input = 0; Input < NumSignatureEntries; ++Input)
+    Result.push_back(APInt(BitWidth, (Input >> Idx) & 1));
+  return Result;
+}
+
+Signature LinearMBAAnalyzer::get(Value *V, unsigned Depth) {
+  if (auto *C = dyn_cast<ConstantInt>(V))
+    return getConstant(C->getValue());
+
+  auto Cached = Cache.find(V);
+  if (Cache.end() != Cached)
+    return Cached->second;
+
+  auto *BinOp = dyn_cast<BinaryOperator>(V);
+  if (!BinOp || Depth >= DepthLimit || NumNodes >= MaxNodes)
+    return getVar(V, Depth);
+
+  Value *X = nullptr;
+  const APInt *C = nullptr;
+  Signature Result;
+
+  // The operands of bitwise operations have to be bitwise expressions as
+  // well. Operands that aren't are treated as variables (and the variables
+  // found while analysing them are dropped).
+  auto GetBitwiseOperand = [&](Value *Op) {
+    auto SavedCache = Cache;
+    auto SavedVars = Vars;
+    unsigned SavedNumNodes = NumNodes, SavedCost = Cost;
+    Signature S = get(Op, Depth + 1);
+    if (isBoolean(S) || Overflow)
+      return S;
+    Cache = std::move(SavedCache);
+    Vars = std::move(SavedVars);
+    NumNodes = SavedNumNodes;
+    Cost = SavedCost;
+    return getVar(Op, Depth + 1);
+  };
+
+  switch (BinOp->getOpcode()) {
+  case Instruction::Add:
+  case Instruction::Sub: {
+    Signature LHS = get(BinOp->getOperand(0), Depth + 1);
+    Signature RHS = get(BinOp->getOperand(1), Depth + 1);
+    for (unsigned I = 0; I < NumSignatureEntries; ++I)
+      Result.push_back(Instruction::Add == BinOp->getOpcode() ? LHS[I] + RHS[I]
+                                                               : LHS[I] - RHS[I]);
+    break;
+  }
+  case Instruction::Mul:
+  case Instruction::Shl: {
+    // Only multiplications by constants are linear
+    APInt Factor;
+    if (match(BinOp, m_c_Mul(m_Value(X), m_APInt(C))))
+      Factor = *C;
+    else if (match(BinOp, m_Shl(m_Value(X), m_APInt(C))) && C->ult(BitWidth))
+      Factor = APInt::getOneBitSet(BitWidth, C->getZExtValue());
+    else
+      return getVar(V, Depth);
+    for (APInt &Entry : get(X, Depth + 1))
+      Result.push_back(Entry * Factor);
+    break;
+  }
+  case Instruction::Xor:
+    // ~X == -X - 1, which is linear for any linear X
+    if (match(BinOp, m_Not(m_Value(X)))) {
+      for (APInt &Entry : get(X, Depth + 1))
+        Result.push_back(1 - Entry);
+      break;
+    }
+    [[fallthrough]];
+  case Instruction::And:
+  case Instruction::Or: {
+    Signature LHS = GetBitwiseOperand(BinOp->getOperand(0));
+    Signature RHS = GetBitwiseOperand(BinOp->getOperand(1));
+    for (unsigned I = 0; I < NumSignatureEntries; ++I) {
+      if (Instruction::And == BinOp->getOpcode())
+        Result.push_back(LHS[I] & RHS[I]);
+      else if (Instruction::Or == BinOp->getOpcode())
+        Result.push_back(LHS[I] | RHS[I]);
+      else
+        Result.push_back(LHS[I] ^ RHS[I]);
+    }
+    break;
+  }
+  default:
+    return getVar(V, Depth);
+  }
+
+  // Instructions with other users outside the expression stay alive
+  ++NumNodes;
+  if (0 == Depth || BinOp->hasOneUse())
+    ++Cost;
+  Cache[V] = Result;
+  return Result;
+}
+
+//-----------------------------------------------------------------------------
+// Expression synthesis
+//-----------------------------------------------------------------------------
+// Builds (or, if Builder is null, only counts the instructions of) a linear
+// combination of conjunctions of Vars, given the coefficients for every
+// conjunction. Coeffs[0] corresponds to -1 (i.e. it is minus the constant
+// term).
+Value *buildLinearCombination(ArrayRef<APInt> Coeffs, ArrayRef<Value *> Vars,
+                              Type *Ty, IRBuilder<> *Builder, unsigned &Cost) {
+  Value *Result = nullptr;
+  Cost = 0;
+
+  // Start with the positive coefficients so that the negative ones can be
+  // subtracted
+  for (bool Positive : {true, false}) {
+    for (unsigned Mask = 1; Mask < Coeffs.size(); ++Mask) {
+      APInt C = Coeffs[Mask];
+      if (C.isZero() || C.isNegative() == Positive)
+        continue;
+
+      // The conjunction of the variables selected by Mask
+      Value *Term = nullptr;
+      for (unsigned Idx = 0; Idx < Vars.size(); ++Idx) {
+        if (!(Mask & (1U << Idx)))
+          continue;
+        Cost += Term ? 1 : 0;
+        if (Builder)
+          Term = Term ? Builder->CreateAnd(Term, Vars[Idx]) : Vars[Idx];
+        else
+          Term = Vars[Idx];
+      }
+
+      bool Subtract = !Positive && Result;
+      if (Subtract)
+        C.negate();
+      if (!C.isOne()) {
+        ++Cost;
+        if (Builder)
+          Term = C.isAllOnes()
+                     ? Builder->CreateNeg(Term)
+                     : Builder->CreateMul(Term, ConstantInt::get(Ty, C));
+      }
+
+      if (Result) {
+        ++Cost;
+        if (Builder)
+          Term = Subtract ? Builder->CreateSub(Result, Term)
+                          : Builder->CreateAdd(Result, Term);
+      }
+      Result = Term;
+    }
+  }
+
+  APInt Constant = -Coeffs[0];
+  if (!Result)
+    return ConstantInt::get(Ty, Constant);
+  if (!Constant.isZero()) {
+    ++Cost;
+    if (Builder)
+      Result = Builder->CreateAdd(Result, ConstantInt::get(Ty, Constant));
+  }
+  return Result;
+}
+
+// A bitwise expression of at most two variables: [~](Vars[LHS] Op Vars[RHS])
+struct BitwiseCandidate {
+  Instruction::BinaryOps Op;
+  unsigned LHS;
+  unsigned RHS;
+  bool Negate;
+
+  bool evaluate(unsigned Input) const {
+    bool L = (Input >> LHS) & 1;
+    bool R = (Input >> RHS) & 1;
+    bool V = (Instruction::And == Op)  ? L && R
+             : (Instruction::Or == Op) ? L || R
+                                       : L != R;
+    return V != Negate;
+  }
+
+  unsigned getCost() const {
+    return (LHS == RHS ? 0 : 1) + (Negate ? 1 : 0);
+  }
+
+  Value *build(ArrayRef<Value *> Vars, IRBuilder<> &Builder) const {
+    Value *V = Vars[LHS];
+    if (LHS != RHS)
+      V = Builder.CreateBinOp(Op, V, Vars[RHS]);
+    return Negate ? Builder.CreateNot(V) : V;
+  }
+};
+
+// Finds the cheapest bitwise expression of at most two variables with the
+// truth table S, if there is one
+std::optional<BitwiseCandidate> findBitwise(const Signature &S,
+                                            unsigned NumVars) {
+  unsigned NumInputs = 1U << NumVars;
+  std::optional<BitwiseCandidate> Best;
+
+  for (unsigned LHS = 0; LHS < NumVars; ++LHS) {
+    for (unsigned RHS = LHS; RHS < NumVars; ++RHS) {
+      for (auto Op : {Instruction::And, Instruction::Or, Instruction::Xor}) {
+        // With a single variable, the operation is irrelevant
+        if (LHS == RHS && Instruction::And != Op)
+          continue;
+        for (bool Negate : {false, true}) {
+          BitwiseCandidate Candidate{Op, LHS, RHS, Negate};
+          bool Matches = true;
+          for (unsigned Input = 0; Input < NumInputs && Matches; ++Input)
+            Matches = S[Input].isOne() == Candidate.evaluate(Input);
+          if (Matches && (!Best || Candidate.getCost() < Best->getCost()))
+            Best = Candidate;
+        }
+      }
+    }
+  }
+  return Best;
+}
+} // namespace
+
+//-----------------------------------------------------------------------------
+// MBASimplify Implementation
+//-----------------------------------------------------------------------------
+// Folds the exact expressions generated by MBAAdd and MBASub
+static Value *simplifyKnownIdiom(Instruction &I) {
+  Value *A = nullptr, *B = nullptr;
+  const APInt *C1 = nullptr, *C2 = nullptr, *C3 = nullptr, *C4 = nullptr;
+  IRBuilder<> Builder(&I);
+
+  // (((a ^ b) + 2 * (a & b)) * C1 + C2) * C3 + C4. The outer affine
+  // transformations cancel out when C1 * C3 == 1 and C2 * C3 + C4 == 0
+  // (for MBAAdd, 39 * 151 == 1 and 23 * 151 + 111 == 0 modulo 2^8).
+  auto AddPattern = m_c_Add(
+      m_APInt(C4),
+      m_c_Mul(m_APInt(C3),
+              m_c_Add(m_APInt(C2),
+                      m_c_Mul(m_APInt(C1),
+                              m_c_Add(m_c_Xor(m_Value(A), m_Value(B)),
+                                      m_c_Mul(m_SpecificInt(2),
+                                              m_c_And(m_Deferred(A),
+                                                      m_Deferred(B))))))));
+  if (match(&I, AddPattern) && (*C1 * *C3).isOne() &&
+      (*C2 * *C3 + *C4).isZero()) {
+    ++NumMBAAdd;
+    return Builder.CreateAdd(A, B);
+  }
+
+  // (a + ~b) + 1
+  if (match(&I, m_c_Add(m_c_Add(m_Value(A), m_Not(m_Value(B))), m_One()))) {
+    ++NumMBASub;
+    return Builder.CreateSub(A, B);
+  }
+
+  return nullptr;
+}
+
+Value *MBASimplify::simplify(Instruction &I) {
+  // Analyse the expression. If it contains too many variables, analyse a
+  // smaller part of it (so that the deeper sub-expressions become variables).
+  Signature S;
+  unsigned DepthLimit = MaxDepth;
+  std::optional<LinearMBAAnalyzer> Analyzer;
+  for (;;) {
+    Analyzer.emplace(I, DepthLimit);
+    if (Analyzer->analyze(&I, S))
+      break;
+    if (Analyzer->getOverflowDepth() <= 1)
+      return nullptr;
+    DepthLimit = Analyzer->getOverflowDepth() - 1;
+  }
+
+  ArrayRef<Value *> Vars = Analyzer->getVars();
+  unsigned NumInputs = 1U << Vars.size();
+  S.resize(NumInputs);
+
+  // Option 1: A bitwise expression (only if S is a truth table)
+  std::optional<BitwiseCandidate> Bitwise;
+  if (!Vars.empty() && isBoolean(S))
+    Bitwise = findBitwise(S, Vars.size());
+
+  // Option 2: A linear combination of conjunctions of the variables. The
+  // coefficients are computed from the signature with the Moebius
+  // transform, because the conjunction of the variables in Mask evaluates to
+  // 1 exactly for the inputs that are supersets of Mask.
+  SmallVector<APInt, NumSignatureEntries> Coeffs(S.begin(), S.end());
+  for (unsigned Idx = 0; Idx < Vars.size(); ++Idx)
+    for (unsigned Mask = 0; Mask < NumInputs; ++Mask)
+      if (Mask & (1U << Idx))
+        Coeffs[Mask] -= Coeffs[Mask ^ (1U << Idx)];
+  unsigned LinearCost = 0;
+  buildLinearCombination(Coeffs, Vars, I.getType(), nullptr, LinearCost);
+
+  unsigned NewCost = LinearCost;
+  if (Bitwise)
+    NewCost = std::min(NewCost, Bitwise->getCost());
+  if (NewCost >= Analyzer->getCost())
+    return nullptr;
+
+  IRBuilder<> Builder(&I);
+  ++NumLinearMBA;
+  if (Bitwise && Bitwise->getCost() <= LinearCost)
+    return Bitwise->build(Vars, Builder);
+  return buildLinearCombination(Coeffs, Vars, I.getType(), &Builder,
+                                LinearCost);
+}
+
+PreservedAnalyses MBASimplify::run(llvm::Function &F,
+                                   llvm::FunctionAnalysisManager &) {
+  bool Changed = false;
+
+  // Replacing an expression deletes the instructions that become dead, hence
+  // the weak handles
+  SmallVector<WeakTrackingVH, 32> Worklist;
+  for (auto &BB : F)
+    for (auto &I : BB)
+      if (isa<BinaryOperator>(I) && I.getType()->isIntegerTy())
+        Worklist.push_back(&I);
+
+  // The known idioms are folded first, as the generic simplification of their
+  // sub-expressions would otherwise break them up
+  for (bool KnownIdioms : {true, false}) {
+    for (WeakTrackingVH &VH : Worklist) {
+      // The handle follows the replacements, which may be constants (e.g.
+      // when IRBuilder folds the simplified expression)
+      auto *I = dyn_cast_or_null<Instruction>(VH);
+      if (!I)
+        continue;
+
+      // The new instructions are inserted right before I
+      Instruction *Prev = I->getPrevNode();
+      Value *NewValue = KnownIdioms ? simplifyKnownIdiom(*I) : simplify(*I);
+      if (!NewValue)
+        continue;
+
+      // The following is visible only if you pass -debug on the command line
+      // *and* you have an assert build.
+      LLVM_DEBUG(dbgs() << *I << " -> " << *NewValue << "\n");
+
+      // Keep the name, unless the expression folded into a pre-existing value
+      auto *NewInst = dyn_cast<Instruction>(NewValue);
+      if (NewInst && NewInst->getNextNode() == I && NewInst != Prev &&
+          !NewInst->hasName())
+        NewInst->takeName(I);
+      I->replaceAllUsesWith(NewValue);
+      RecursivelyDeleteTriviallyDeadInstructions(I);
+      Changed = true;
+    }
+  }
+
+  if (!Changed)
+    return PreservedAnalyses::all();
+  PreservedAnalyses PA;
+  PA.preserveSet<CFGAnalyses>();
+  return PA;
+}
+
+//-----------------------------------------------------------------------------
+// New PM Registration
+//-----------------------------------------------------------------------------
+llvm::PassPluginLibraryInfo getMBASimplifyPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "mba-simplify", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, FunctionPassManager &FPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "mba-simplify") {
+                    FPM.addPass(MBASimplify());
+                    return true;
+                  }
+                  return false;
+                });
+          }};
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getMBASimplifyPluginInfo();
+}
@@ -9,20 +9,31 @@
 //      a - b == (a + ~b) + 1
 //    See formula 2.2 (j) in [1].
 //
+//    With `-mba-sub-hot-threshold`, subtractions in hot blocks are obfuscated
+//    only partially (see `-mba-sub-hot-percentage` and HotBlockFilter.h). The
+//    hotness is estimated with BlockFrequencyInfo, scaled by the call counts
+//    from `-mba-sub-profile` (a DynamicCallCounter binary profile) if
+//    provided.
+//
 // USAGE:
 //      $ opt -load-pass-plugin <BUILD_DIR>/lib/libMBASub.so `\`
 //        -passes=-"mba-sub" <bitcode-file>
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libMBASub.so `\`
+//        -passes=-"mba-sub" -mba-sub-hot-threshold=1000 `\`
+//        -mba-sub-profile=<dcc-profile> <bitcode-file>
 //
 //  [1] "Hacker's Delight" by Henry S. Warren, Jr.
 //
 // License: MIT
 //==============================================================================
 #include "MBASub.h"
+#include "HotBlockFilter.h"
 
 #include "llvm/ADT/Statistic.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
 #include <random>
@@ -32,12 +43,34 @@ using namespace llvm;
 #define DEBUG_TYPE "mba-sub"
 
 STATISTIC(SubstCount, "The # of substituted instructions");
+STATISTIC(HotSkipCount, "The # of instructions skipped in hot blocks");
+
+//-----------------------------------------------------------------------------
+// Command line options
+//-----------------------------------------------------------------------------
+static cl::opt<uint64_t> HotThreshold{
+    "mba-sub-hot-threshold",
+    cl::desc{"Blocks estimated to run more than this many times are hot and "
+             "only partially obfuscated (0 = obfuscate all blocks)"},
+    cl::init(0)};
+
+static cl::opt<unsigned> HotPercentage{
+    "mba-sub-hot-percentage",
+    cl::desc{"The percentage of the subtractions in hot blocks to obfuscate"},
+    cl::value_desc{"percent"}, cl::init(0)};
+
+static cl::opt<std::string> ProfileFile{
+    "mba-sub-profile",
+    cl::desc{"The DynamicCallCounter profile with the call counts used to "
+             "identify hot blocks"},
+    cl::value_desc{"filename"}};
 
 //-----------------------------------------------------------------------------
 // MBASub Implementaion
 //-----------------------------------------------------------------------------
-bool MBASub::runOnBasicBlock(BasicBlock &BB) {
+bool MBASub::runOnBasicBlock(BasicBlock &BB, unsigned Percentage) {
   bool Changed = false;
+  unsigned NumEligible = 0;
 
   // Loop over all instructions in the block. Replacing instructions requires
   // iterators, hence a for-range loop wouldn't be suitable.
@@ -53,6 +86,12 @@ bool MBASub::runOnBasicBlock(BasicBlock &BB) {
     if (Opcode != Instruction::Sub || !BinOp->getType()->isIntegerTy())
       continue;
 
+    // Only obfuscate the selected part of the subtractions
+    if (!HotBlockFilter::isSelected(NumEligible++, Percentage)) {
+      ++HotSkipCount;
+      continue;
+    }
+
     // A uniform API for creating instructions and inserting
     // them into basic blocks.
     IRBuilder<> Builder(BinOp);
@@ -79,11 +118,14 @@ bool MBASub::runOnBasicBlock(BasicBlock &BB) {
 }
 
 PreservedAnalyses MBASub::run(llvm::Function &F,
-                              llvm::FunctionAnalysisManager &) {
+                              llvm::FunctionAnalysisManager &FAM) {
   bool Changed = false;
 
+  HotBlockFilter Filter(HotThreshold, HotPercentage, ProfileFile);
+  Filter.startFunction(F, FAM);
+
   for (auto &BB : F) {
-    Changed |= runOnBasicBlock(BB);
+    Changed |= runOnBasicBlock(BB, Filter.getPercentage(BB));
   }
   return (Changed ? llvm::PreservedAnalyses::none()
                   : llvm::PreservedAnalyses::all());
@@ -15,15 +15,38 @@
 //      [  BBsucc  ]                         [  BBsucc  ]                      |
 //       /   |   \                            /   |   \                        V
 //  ----------------------------------------------------------------------------
-//  Only qualifying basic blocks are merged. The edge(s) from (potentially
-//  multiple) BB0 to BB1, must be one of the following instructions:
+//  Only qualifying basic blocks are merged. BB1 and BB2 must end with
+//  equivalent terminators (e.g. unconditional branches to the same BBsucc,
+//  or identical `ret` instructions) and all the edges into BB1 must come from
+//  one of the following instructions:
 //    * conditional branch
 //    * unconditional branch, and
 //    * switch
-//  For the edges from BB1 to BBsucc and BB2 to BBsucc, only unconditional
-//  branch instructions are allowed. Finally, BB1 is identical to BB2 iff all
-//  instructions in BB1 are identical to the instructions in BB2. For finer
-//  details please consult the implementation.
+//  BB1 is identical to BB2 iff all instructions in BB1 are identical to the
+//  corresponding instructions in BB2, i.e. have the same operands or operands
+//  defined by corresponding instructions. The same applies to the values that
+//  the PHI nodes in the successors receive from BB1 and BB2. Blocks that start
+//  with PHI nodes are not merged. For finer details please consult the
+//  implementation.
+//
+//  To avoid comparing every pair of blocks, the candidates are first bucketed
+//  by a structural hash (of the opcodes and operands of their instructions
+//  and of the PHI incoming values in their successors). Blocks are only
+//  compared with the blocks in the same bucket, so the cost is roughly linear
+//  in the number of blocks, even when a function contains e.g. hundreds of
+//  equivalent switch cases.
+//
+//  By default, the function is scanned once and the merged blocks are
+//  deleted at the end. Merging can make more blocks identical though, e.g.
+//  two blocks that branch to BB1 and BB2, respectively, once BB1 is merged
+//  into BB2. With `-merge-bb-worklist`, the blocks are processed from a
+//  worklist instead: after every merge, only the blocks that it may have
+//  changed are revisited, i.e. the predecessors (whose terminators were
+//  updated) and the successors (whose PHI nodes lost an incoming value) of
+//  the removed block, the retained block and the blocks that use the PHI
+//  nodes that may have been folded. A fixpoint is reached in a single run.
+//  In this mode the dominator tree (if available) is updated incrementally
+//  rather than invalidated.
 //
 //  This pass will to some extent revert the modifications introduced by
 //  DuplicateBB. The qualifying clones (lt-clone-1-BBId and lt-clone-2-BBid)
@@ -34,18 +57,25 @@
 // USAGE:
 //    $ opt -load-pass-plugin <BUILD_DIR>/lib/libMergeBB.so `\`
 //      -passes=merge-bb -S <bitcode-file>
+//    $ opt -load-pass-plugin <BUILD_DIR>/lib/libMergeBB.so `\`
+//      -passes=merge-bb -merge-bb-worklist -S <bitcode-file>
 //
 // License: MIT
 //=============================================================================
 #include "MergeBB.h"
 
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
 
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 
 using namespace llvm;
@@ -54,69 +84,154 @@ using namespace llvm;
 
 STATISTIC(NumDedupBBs, "Number of basic blocks merged");
 STATISTIC(OverallNumOfUpdatedBranchTargets, "Number of updated branch targets");
+STATISTIC(NumRevisitedBBs,
+          "Number of basic blocks revisited after a merge (worklist mode)");
+
+static cl::opt<bool> UseWorklist(
+    "merge-bb-worklist",
+    cl::desc("Merge to a fixpoint, revisiting only the blocks affected by "
+             "every merge"),
+    cl::init(false));
+
+//-----------------------------------------------------------------------------
+// Helper functions
+//-----------------------------------------------------------------------------
+// Get the non-debug instructions in BB
+static SmallVector<Instruction *, 8> getNonDbgInstrInBB(BasicBlock *BB) {
+  SmallVector<Instruction *, 8> Insts;
+  for (Instruction &Instr : *BB)
+    if (!isa<DbgInfoIntrinsic>(Instr))
+      Insts.push_back(&Instr);
+  return Insts;
+}
+
+// Is BB a block that MergeBB knows how to merge into another block?
+static bool isCandidate(BasicBlock &BB) {
+  // Do not optimize the entry block
+  if (&BB == &BB.getParent()->getEntryBlock())
+    return false;
+
+  // Blocks without predecessors are dead (there's nothing to redirect) and
+  // the address of the block may be used in ways that can't be updated
+  if (pred_empty(&BB) || BB.hasAddressTaken())
+    return false;
+
+  // Merging blocks with PHI nodes would require new incoming values for the
+  // predecessors of the block that's removed (to keep things relatively
+  // simple, these are not supported)
+  if (isa<PHINode>(BB.front()) || BB.isEHPad())
+    return false;
+
+  // Only merge blocks that end with a branch, switch, return or unreachable
+  // (other terminators have side effects, e.g. invoke, or successors that
+  // can't be safely shared)
+  const Instruction *Term = BB.getTerminator();
+  if (!isa<BranchInst, SwitchInst, ReturnInst, UnreachableInst>(Term))
+    return false;
+
+  // Do not optimize non-branch and non-switch CFG edges (to keep things
+  // relatively simple)
+  for (auto *B : predecessors(&BB))
+    if (!(isa<BranchInst>(B->getTerminator()) ||
+          isa<SwitchInst>(B->getTerminator())))
+      return false;
+
+  return true;
+}
+
+// Computes a hash of BB that's identical for blocks that MergeBB considers
+// identical. Values defined in BB are hashed by their position within BB, the
+// remaining values by their identity.
+static size_t hashBlock(BasicBlock *BB) {
+  DenseMap<const Value *, unsigned> LocalIdx;
+  auto HashValue = [&LocalIdx](const Value *V) {
+    auto Local = LocalIdx.find(V);
+    return (LocalIdx.end() == Local) ? hash_combine(0, V)
+                                     : hash_combine(1, Local->second);
+  };
+
+  hash_code Hash = hash_value(0);
+  unsigned Idx = 0;
+  for (Instruction *Inst : getNonDbgInstrInBB(BB)) {
+    Hash = hash_combine(Hash, Inst->getOpcode(), Inst->getType());
+    for (const Value *Opnd : Inst->operands())
+      Hash = hash_combine(Hash, HashValue(Opnd));
+    LocalIdx[Inst] = Idx++;
+  }
+
+  for (BasicBlock *Succ : successors(BB))
+    for (PHINode &PN : Succ->phis())
+      Hash = hash_combine(Hash, HashValue(PN.getIncomingValueForBlock(BB)));
+
+  return Hash;
+}
 
 //-----------------------------------------------------------------------------
 // MergeBB Implementation
 //-----------------------------------------------------------------------------
 bool MergeBB::canRemoveInst(const Instruction *Inst) {
-  assert(Inst->hasOneUse() && "Inst needs to have exactly one use");
+  const BasicBlock *BB = Inst->getParent();
 
-  auto *PNUse = dyn_cast<PHINode>(*Inst->user_begin());
-  auto *Succ = Inst->getParent()->getTerminator()->getSuccessor(0);
-  auto *User = cast<Instruction>(*Inst->user_begin());
+  for (const Use &U : Inst->uses()) {
+    auto *User = cast<Instruction>(U.getUser());
+    // Users in the same block are removed together with Inst
+    if (User->getParent() == BB)
+      continue;
+
+    // Users in PHI nodes (for the edge from BB) are updated when BB is
+    // removed
+    auto *PNUse = dyn_cast<PHINode>(User);
+    if (PNUse && PNUse->getIncomingBlock(U) == BB)
+      continue;
 
-  bool SameParentBB = (User->getParent() == Inst->getParent());
-  bool UsedInPhi = (PNUse && PNUse->getParent() == Succ &&
-                    PNUse->getIncomingValueForBlock(Inst->getParent()) == Inst);
+    return false;
+  }
 
-  return UsedInPhi || SameParentBB;
+  return true;
 }
 
-bool MergeBB::canMergeInstructions(ArrayRef<Instruction *> Insts) {
+bool MergeBB::canMergeInstructions(ArrayRef<Instruction *> Insts,
+                                   const InstMap &Corresponding) {
   const Instruction *Inst1 = Insts[0];
   const Instruction *Inst2 = Insts[1];
 
   if (!Inst1->isSameOperationAs(Inst2))
     return false;
 
-  // Each instruction must have exactly zero or one use.
-  bool HasUse = !Inst1->user_empty();
-  for (auto *I : Insts) {
-    if (HasUse && !I->hasOneUse())
-      return false;
-    if (!HasUse && !I->user_empty())
-      return false;
-  }
-
-  // Not all instructions that have one use can be merged. Make sure that
-  // instructions that have one use can be safely deleted.
-  if (HasUse) {
-    if (!canRemoveInst(Inst1) || !canRemoveInst(Inst2))
-      return false;
-  }
+  // Make sure that Inst1 can be safely deleted, i.e. that all its users
+  // either go away with it or can be updated.
+  if (!canRemoveInst(Inst1))
+    return false;
 
-  // Make sure that Inst1 and Inst2 have identical operands.
+  // Make sure that Inst1 and Inst2 have identical (or corresponding)
+  // operands.
   assert(Inst2->getNumOperands() == Inst1->getNumOperands());
   auto NumOpnds = Inst1->getNumOperands();
   for (unsigned OpndIdx = 0; OpndIdx != NumOpnds; ++OpndIdx) {
-    if (Inst2->getOperand(OpndIdx) != Inst1->getOperand(OpndIdx))
+    if (!areValuesEquivalent(Inst1->getOperand(OpndIdx),
+                             Inst2->getOperand(OpndIdx), Corresponding))
       return false;
   }
 
   return true;
 }
 
-// Get the number of non-debug instructions in BB
-static unsigned getNumNonDbgInstrInBB(BasicBlock *BB) {
-  unsigned Count = 0;
-  for (Instruction &Instr : *BB)
-    if (!isa<DbgInfoIntrinsic>(Instr))
-      Count++;
-  return Count;
+bool MergeBB::areValuesEquivalent(const Value *V1, const Value *V2,
+                                  const InstMap &Corresponding) {
+  if (V1 == V2)
+    return true;
+
+  auto Match = Corresponding.find(V1);
+  return Corresponding.end() != Match && Match->second == V2;
 }
 
-unsigned MergeBB::updateBranchTargets(BasicBlock *BBToErase, BasicBlock *BBToRetain) {
-  SmallVector<BasicBlock *, 8> BBToUpdate(predecessors(BBToErase));
+unsigned MergeBB::updateBranchTargets(BasicBlock *BBToErase,
+                                      BasicBlock *BBToRetain,
+                                      DomTreeUpdater *DTU) {
+  // A switch with several cases for BBToErase is listed once per case
+  SmallSetVector<BasicBlock *, 8> BBToUpdate(pred_begin(BBToErase),
+                                             pred_end(BBToErase));
+  SmallVector<DominatorTree::UpdateType, 8> Updates;
 
   LLVM_DEBUG(dbgs() << "DEDUP BB: merging duplicated blocks ("
                     << BBToErase->getName() << " into " << BBToRetain->getName()
@@ -128,6 +243,11 @@ unsigned MergeBB::updateBranchTargets(BasicBlock *BBToErase, BasicBlock *BBToRet
     // switch statement. One of its targets should be BBToErase. Replace
     // that target with BBToRetain.
     Instruction *Term = BB0->getTerminator();
+    if (DTU) {
+      Updates.push_back({DominatorTree::Delete, BB0, BBToErase});
+      if (!is_contained(successors(BB0), BBToRetain))
+        Updates.push_back({DominatorTree::Insert, BB0, BBToRetain});
+    }
     for (unsigned OpIdx = 0, NumOpnds = Term->getNumOperands();
          OpIdx != NumOpnds; ++OpIdx) {
       if (Term->getOperand(OpIdx) == BBToErase) {
@@ -137,119 +257,196 @@ unsigned MergeBB::updateBranchTargets(BasicBlock *BBToErase, BasicBlock *BBToRet
     }
   }
 
+  if (DTU)
+    DTU->applyUpdates(Updates);
   return UpdatedTargetsCount;
 }
 
-bool MergeBB::mergeDuplicatedBlock(BasicBlock *BB1,
-                                   SmallPtrSet<BasicBlock *, 8> &DeleteList) {
-  // Do not optimize the entry block
-  if (BB1 == &BB1->getParent()->getEntryBlock())
+bool MergeBB::areBlocksIdentical(BasicBlock *BB1, BasicBlock *BB2) {
+  // BB1 and BB2 are definitely different if the number of instructions is
+  // not identical
+  SmallVector<Instruction *, 8> BB1Insts = getNonDbgInstrInBB(BB1);
+  SmallVector<Instruction *, 8> BB2Insts = getNonDbgInstrInBB(BB2);
+  if (BB1Insts.size() != BB2Insts.size())
     return false;
 
-  // Only merge CFG edges of unconditional branch
-  BranchInst *BB1Term = dyn_cast<BranchInst>(BB1->getTerminator());
-  if (!(BB1Term && BB1Term->isUnconditional()))
-    return false;
-
-  // Do not optimize non-branch and non-switch CFG edges (to keep things
-  // relatively simple)
-  for (auto *B : predecessors(BB1))
-    if (!(isa<BranchInst>(B->getTerminator()) ||
-          isa<SwitchInst>(B->getTerminator())))
+  // Instructions at the same position in BB1 and BB2 correspond to each
+  // other, i.e. are expected to produce the same values
+  InstMap Corresponding;
+  for (auto [Inst1, Inst2] : zip(BB1Insts, BB2Insts))
+    Corresponding[Inst1] = Inst2;
+
+  // Check that all instructions in BB1 and BB2 are identical (this includes
+  // the terminators and hence the successors)
+  for (auto [Inst1, Inst2] : zip(BB1Insts, BB2Insts)) {
+    Instruction *Insts[] = {Inst1, Inst2};
+    if (!canMergeInstructions(Insts, Corresponding))
       return false;
+  }
 
-  BasicBlock *BBSucc = BB1Term->getSuccessor(0);
-
-  BasicBlock::iterator II = BBSucc->begin();
-  const PHINode *PN = dyn_cast<PHINode>(II);
-  Value *InValBB1 = nullptr;
-  Instruction *InInstBB1 = nullptr;
-  BBSucc->getFirstNonPHI();
-  if (nullptr != PN) {
-    // Do not optimize if multiple PHI instructions exist in the successor (to
-    // keep things relatively simple)
-    if (++II != BBSucc->end() && isa<PHINode>(II))
-      return false;
+  // Control flow can be merged if the incoming values to the PHI nodes at the
+  // successors are the same values or corresponding values defined in the
+  // BBs to merge.
+  for (BasicBlock *BBSucc : successors(BB1))
+    for (PHINode &PN : BBSucc->phis())
+      if (!areValuesEquivalent(PN.getIncomingValueForBlock(BB1),
+                               PN.getIncomingValueForBlock(BB2),
+                               Corresponding))
+        return false;
 
-    InValBB1 = PN->getIncomingValueForBlock(BB1);
-    InInstBB1 = dyn_cast<Instruction>(InValBB1);
-  }
+  return true;
+}
 
-  unsigned BB1NumInst = getNumNonDbgInstrInBB(BB1);
-  for (auto *BB2 : predecessors(BBSucc)) {
-    // Do not optimize the entry block
-    if (BB2 == &BB2->getParent()->getEntryBlock())
+bool MergeBB::mergeDuplicatedBlock(BasicBlock *BB1,
+                                   ArrayRef<BasicBlock *> Candidates,
+                                   SmallPtrSet<BasicBlock *, 8> &DeleteList) {
+  // Prefer the last candidate, so that all the blocks from one bucket that
+  // are identical end up merged into the same block.
+  for (BasicBlock *BB2 : reverse(Candidates)) {
+    // Skip basic blocks that have already been marked for merging
+    if (DeleteList.contains(BB2))
       continue;
 
-    // Only merge CFG edges of unconditional branch
-    BranchInst *BB2Term = dyn_cast<BranchInst>(BB2->getTerminator());
-    if (!(BB2Term && BB2Term->isUnconditional()))
+    assert(BB2 != BB1 && "A block cannot be merged into itself");
+    if (!areBlocksIdentical(BB1, BB2))
       continue;
 
-    // Do not optimize non-branch and non-switch CFG edges (to keep things
-    // relatively simple)
-    for (auto *B : predecessors(BB2))
-      if (!(isa<BranchInst>(B->getTerminator()) ||
-            isa<SwitchInst>(B->getTerminator())))
-        continue;
+    // It is safe to de-duplicate - do so.
+    unsigned UpdatedTargets = updateBranchTargets(BB1, BB2);
+    assert(UpdatedTargets && "No branch target was updated");
+    OverallNumOfUpdatedBranchTargets += UpdatedTargets;
+    DeleteList.insert(BB1);
+    NumDedupBBs++;
+
+    return true;
+  }
 
-    // Skip basic blocks that have already been marked for merging
-    if (DeleteList.end() != DeleteList.find(BB2))
-      continue;
+  return false;
+}
 
-    // Make sure that BB2 != BB1
-    if (BB2 == BB1)
-      continue;
+bool MergeBB::mergeToFixpoint(Function &Func, DomTreeUpdater &DTU) {
+  // The candidates that have been visited, bucketed by their hash (as it was
+  // when they were visited)
+  MapVector<size_t, SmallVector<BasicBlock *, 4>> Buckets;
+  DenseMap<BasicBlock *, size_t> BucketOf;
+  // The deleted blocks are kept around by DTU until it's flushed. They are
+  // never looked at again.
+  SmallPtrSet<BasicBlock *, 8> Deleted;
+
+  // Visit the blocks in layout order (the worklist is LIFO), then the
+  // blocks affected by every merge right after it
+  SmallSetVector<BasicBlock *, 32> Worklist;
+  for (BasicBlock &BB : reverse(Func))
+    Worklist.insert(&BB);
+
+  // Queues BB for another visit. Its hash may change, so it's dropped from
+  // its bucket until then.
+  auto Revisit = [&](BasicBlock *BB) {
+    if (Deleted.contains(BB))
+      return;
+    auto Visited = BucketOf.find(BB);
+    if (BucketOf.end() != Visited) {
+      auto &Bucket = Buckets[Visited->second];
+      Bucket.erase(find(Bucket, BB));
+      BucketOf.erase(Visited);
+      NumRevisitedBBs++;
+    }
+    Worklist.insert(BB);
+  };
 
-    // BB1 and BB2 are definitely different if the number of instructions is
-    // not identical
-    if (BB1NumInst != getNumNonDbgInstrInBB(BB2))
+  bool Changed = false;
+  while (!Worklist.empty()) {
+    BasicBlock *BB = Worklist.pop_back_val();
+    if (Deleted.contains(BB) || !isCandidate(*BB))
       continue;
 
-    // Control flow can be merged if incoming values to the PHI node
-    // at the successor are same values or both defined in the BBs to merge.
-    // For the latter case, canMergeInstructions executes further analysis.
-    if (nullptr != PN) {
-      Value *InValBB2 = PN->getIncomingValueForBlock(BB2);
-      Instruction *InInstBB2 = dyn_cast<Instruction>(InValBB2);
-
-      bool areValuesSimilar = (InValBB1 == InValBB2);
-      bool bothValuesDefinedInParent =
-          ((InInstBB1 && InInstBB1->getParent() == BB1) &&
-           (InInstBB2 && InInstBB2->getParent() == BB2));
-      if (!areValuesSimilar && !bothValuesDefinedInParent)
-        continue;
+    // Merge BB into a block from its bucket, if there's an identical one.
+    // Prefer the last visited block (like mergeDuplicatedBlock does).
+    size_t Hash = hashBlock(BB);
+    auto &Bucket = Buckets[Hash];
+    auto Identical = find_if(reverse(Bucket), [&](BasicBlock *Other) {
+      return areBlocksIdentical(BB, Other);
+    });
+    if (Bucket.rend() == Identical) {
+      Bucket.push_back(BB);
+      BucketOf[BB] = Hash;
+      continue;
     }
 
-    // Finally, check that all instructions in BB1 and BB2 are identical
-    LockstepReverseIterator LRI(BB1, BB2);
-    while (LRI.isValid() && canMergeInstructions(*LRI)) {
-      --LRI;
+    // The predecessors now branch to the retained block, so they may have
+    // become identical to other blocks. The PHI nodes in the successors
+    // lose an incoming value and, if only one value is left, are replaced
+    // with that value (which also makes the successors candidates). That
+    // changes the blocks that use these PHI nodes (or, for PHI nodes, the
+    // blocks these values are incoming from) and the hash of the retained
+    // block, which covers its incoming values.
+    SmallVector<BasicBlock *, 8> Affected(predecessors(BB));
+    append_range(Affected, successors(BB));
+    Affected.push_back(*Identical);
+    for (BasicBlock *Succ : successors(BB)) {
+      for (PHINode &PN : Succ->phis()) {
+        for (User *U : PN.users()) {
+          auto *UserPN = dyn_cast<PHINode>(U);
+          if (!UserPN) {
+            Affected.push_back(cast<Instruction>(U)->getParent());
+            continue;
+          }
+          for (unsigned Idx = 0, E = UserPN->getNumIncomingValues(); Idx != E;
+               ++Idx)
+            if (UserPN->getIncomingValue(Idx) == &PN)
+              Affected.push_back(UserPN->getIncomingBlock(Idx));
+        }
+      }
     }
 
-    // Valid iterator  means that a mismatch was found in middle of BB
-    if (LRI.isValid())
-      continue;
-
-    // It is safe to de-duplicate - do so.
-    unsigned UpdatedTargets = updateBranchTargets(BB1, BB2);
+    unsigned UpdatedTargets = updateBranchTargets(BB, *Identical, &DTU);
     assert(UpdatedTargets && "No branch target was updated");
     OverallNumOfUpdatedBranchTargets += UpdatedTargets;
-    DeleteList.insert(BB1);
+    DeleteDeadBlock(BB, &DTU);
+    Deleted.insert(BB);
     NumDedupBBs++;
+    Changed = true;
 
-    return true;
+    for (BasicBlock *AffectedBB : Affected)
+      Revisit(AffectedBB);
   }
 
-  return false;
+  return Changed;
 }
 
 PreservedAnalyses MergeBB::run(llvm::Function &Func,
-                               llvm::FunctionAnalysisManager &) {
+                               llvm::FunctionAnalysisManager &FAM) {
+  if (UseWorklist) {
+    // Keep the dominator tree up to date if it has already been computed
+    // (there's no point in computing it otherwise)
+    DomTreeUpdater DTU(FAM.getCachedResult<DominatorTreeAnalysis>(Func),
+                       DomTreeUpdater::UpdateStrategy::Lazy);
+    if (!mergeToFixpoint(Func, DTU))
+      return llvm::PreservedAnalyses::all();
+
+    DTU.flush();
+    PreservedAnalyses PA;
+    PA.preserve<DominatorTreeAnalysis>();
+    return PA;
+  }
+
+  // Bucket the candidates by their hash. The buckets (and the blocks within
+  // every bucket) are kept in layout order.
+  MapVector<size_t, SmallVector<BasicBlock *, 4>> Buckets;
+  for (auto &BB : Func)
+    if (isCandidate(BB))
+      Buckets[hashBlock(&BB)].push_back(&BB);
+
+  // Only blocks from the same bucket can be identical. Every block is
+  // compared with the blocks that follow it in its bucket.
   bool Changed = false;
   SmallPtrSet<BasicBlock *, 8> DeleteList;
-  for (auto &BB : Func) {
-    Changed |= mergeDuplicatedBlock(&BB, DeleteList);
+  for (auto &[Hash, Blocks] : Buckets) {
+    ArrayRef<BasicBlock *> Bucket(Blocks);
+    for (unsigned Idx = 0, E = Bucket.size(); Idx + 1 < E; ++Idx)
+      Changed |=
+          mergeDuplicatedBlock(Bucket[Idx], Bucket.drop_front(Idx + 1),
+                               DeleteList);
   }
 
   for (BasicBlock *BB : DeleteList) {
@@ -282,50 +479,3 @@ extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
 llvmGetPassPluginInfo() {
   return getMergeBBPluginInfo();
 }
-
-//------------------------------------------------------------------------------
-// Helper data structures
-//------------------------------------------------------------------------------
-LockstepReverseIterator::LockstepReverseIterator(BasicBlock *BB1In,
-                                                 BasicBlock *BB2In)
-    : BB1(BB1In), BB2(BB2In), Fail(false) {
-  Insts.clear();
-
-  Instruction *InstBB1 = getLastNonDbgInst(BB1);
-  if (nullptr == InstBB1)
-    Fail = true;
-
-  Instruction *InstBB2 = getLastNonDbgInst(BB2);
-  if (nullptr == InstBB2)
-    Fail = true;
-
-  Insts.push_back(InstBB1);
-  Insts.push_back(InstBB2);
-}
-
-Instruction *LockstepReverseIterator::getLastNonDbgInst(BasicBlock *BB) {
-  Instruction *Inst = BB->getTerminator();
-
-  do {
-    Inst = Inst->getPrevNode();
-  } while (Inst && isa<DbgInfoIntrinsic>(Inst));
-
-  return Inst;
-}
-
-void LockstepReverseIterator::operator--() {
-  if (Fail)
-    return;
-
-  for (auto *&Inst : Insts) {
-    do {
-      Inst = Inst->getPrevNode();
-    } while (Inst && isa<DbgInfoIntrinsic>(Inst));
-
-    if (!Inst) {
-      // Already at the beginning of BB
-      Fail = true;
-      return;
-    }
-  }
-}
@@ -6,6 +6,17 @@
 //    Visits all instructions in a function and counts how many times every
 //    LLVM IR opcode was used. Prints the output to stderr.
 //
+//    The counts are kept in a dense histogram indexed by the opcode (see
+//    OpcodeHistogram). With `-opcode-counter-by-type`, the printed results
+//    also break down every opcode by the class of the result type. The
+//    per-function histograms can be merged into one for the whole module with
+//    `print<opcode-counter-module>`.
+//
+//    With `-opcode-counter-format=jsonl|binary`, the results are written as
+//    records (one per opcode, and per type class with
+//    `-opcode-counter-by-type`) rather than as a table, see ResultWriter.h.
+//    `-opcode-counter-output=<file>` writes them to a file instead of stderr.
+//
 //    This example demonstrates how to insert your pass at one of the
 //    predefined extension points, e.g. whenever the vectoriser is run (i.e. via
 //    `registerVectorizerStartEPCallback` for the new PM).
@@ -15,6 +26,9 @@
 //      opt -load-pass-plugin libOpcodeCounter.dylib `\`
 //        -passes="print<opcode-counter>" `\`
 //        -disable-output <input-llvm-file>
+//      opt -load-pass-plugin libOpcodeCounter.dylib `\`
+//        -passes="print<opcode-counter-module>" `\`
+//        -disable-output <input-llvm-file>
 //    2. Automatically through an optimisation pipeline - new PM
 //      opt -load-pass-plugin libOpcodeCounter.dylib --passes='default<O1>' `\`
 //        -disable-output <input-llvm-file>
@@ -22,33 +36,58 @@
 // License: MIT
 //=============================================================================
 #include "OpcodeCounter.h"
+#include "FusedAnalysis.h"
 
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
 
 using namespace llvm;
 
+static cl::opt<bool>
+    ByType("opcode-counter-by-type",
+           cl::desc("Break down the opcode counts by the result type"),
+           cl::init(false));
+
+static cl::opt<ResultFormat> OutputFormat(
+    "opcode-counter-format",
+    cl::desc("The format of the results of print<opcode-counter> (and "
+             "print<opcode-counter-module>)"),
+    getResultFormatValues(), cl::init(ResultFormat::Text));
+
+static cl::opt<std::string> OutputFile(
+    "opcode-counter-output",
+    cl::desc("Write the results of print<opcode-counter> (and "
+             "print<opcode-counter-module>) to this file (rather than to "
+             "stderr)"),
+    cl::value_desc("filename"), cl::init(""));
+
 // Pretty-prints the result of this analysis
 static void printOpcodeCounterResult(llvm::raw_ostream &,
                               const ResultOpcodeCounter &OC);
+// Writes the result of this analysis for Scope (a function or a module) as
+// records, one per opcode (and type class)
+static void writeOpcodeCounterResult(llvm::raw_ostream &OutS,
+                                     ResultFormat Format,
+                                     llvm::StringRef ScopeKind,
+                                     llvm::StringRef Scope,
+                                     const ResultOpcodeCounter &OC);
 
 //-----------------------------------------------------------------------------
 // OpcodeCounter implementation
 //-----------------------------------------------------------------------------
 llvm::AnalysisKey OpcodeCounter::Key;
 
+OpcodeCounter::Result OpcodeCounter::createEmptyResult() {
+  return Result(/*TrackTypes=*/ByType);
+}
+
 OpcodeCounter::Result OpcodeCounter::generateOpcodeMap(llvm::Function &Func) {
-  OpcodeCounter::Result OpcodeMap;
+  OpcodeCounter::Result OpcodeMap = createEmptyResult();
 
   for (auto &BB : Func) {
     for (auto &Inst : BB) {
-      StringRef Name = Inst.getOpcodeName();
-
-      if (OpcodeMap.find(Name) == OpcodeMap.end()) {
-        OpcodeMap[Inst.getOpcodeName()] = 1;
-      } else {
-        OpcodeMap[Inst.getOpcodeName()]++;
-      }
+      OpcodeMap.add(Inst);
     }
   }
 
@@ -56,7 +95,11 @@ OpcodeCounter::Result OpcodeCounter::generateOpcodeMap(llvm::Function &Func) {
 }
 
 OpcodeCounter::Result OpcodeCounter::run(llvm::Function &Func,
-                                         llvm::FunctionAnalysisManager &) {
+                                         llvm::FunctionAnalysisManager &FAM) {
+  // Share the walk over the instructions with the other analyses if possible
+  if (FAM.isPassRegistered<FusedAnalysis>())
+    return FAM.getResult<FusedAnalysis>(Func).Opcodes;
+
   return generateOpcodeMap(Func);
 }
 
@@ -64,6 +107,12 @@ PreservedAnalyses OpcodeCounterPrinter::run(Function &Func,
                                             FunctionAnalysisManager &FAM) {
   auto &OpcodeMap = FAM.getResult<OpcodeCounter>(Func);
 
+  if (Format != ResultFormat::Text) {
+    writeOpcodeCounterResult(OS, Format, "function", Func.getName(),
+                             OpcodeMap);
+    return PreservedAnalyses::all();
+  }
+
   // In the legacy PM, the following string is printed automatically by the
   // pass manager. For the sake of consistency, we're adding this here so that
   // it's also printed when using the new PM.
@@ -74,6 +123,30 @@ PreservedAnalyses OpcodeCounterPrinter::run(Function &Func,
   return PreservedAnalyses::all();
 }
 
+PreservedAnalyses OpcodeCounterModulePrinter::run(Module &M,
+                                                  ModuleAnalysisManager &MAM) {
+  auto &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+
+  OpcodeHistogram ModuleHistogram;
+  for (auto &Func : M) {
+    if (Func.isDeclaration())
+      continue;
+    ModuleHistogram.merge(FAM.getResult<OpcodeCounter>(Func));
+  }
+
+  if (Format != ResultFormat::Text) {
+    writeOpcodeCounterResult(OS, Format, "module", M.getName(),
+                             ModuleHistogram);
+    return PreservedAnalyses::all();
+  }
+
+  OS << "Printing analysis 'OpcodeCounter Pass' for module '"
+     << M.getName() << "':\n";
+
+  printOpcodeCounterResult(OS, ModuleHistogram);
+  return PreservedAnalyses::all();
+}
+
 //-----------------------------------------------------------------------------
 // New PM Registration
 //-----------------------------------------------------------------------------
@@ -88,7 +161,21 @@ llvm::PassPluginLibraryInfo getOpcodeCounterPluginInfo() {
               [&](StringRef Name, FunctionPassManager &FPM,
                   ArrayRef<PassBuilder::PipelineElement>) {
                 if (Name == "print<opcode-counter>") {
-                  FPM.addPass(OpcodeCounterPrinter(llvm::errs()));
+                  FPM.addPass(OpcodeCounterPrinter(
+                      getResultStream(OutputFile, llvm::errs()),
+                      OutputFormat));
+                  return true;
+                }
+                return false;
+              });
+          // REGISTRATION FOR "opt -passes=print<opcode-counter-module>"
+          PB.registerPipelineParsingCallback(
+              [&](StringRef Name, ModulePassManager &MPM,
+                  ArrayRef<PassBuilder::PipelineElement>) {
+                if (Name == "print<opcode-counter-module>") {
+                  MPM.addPass(OpcodeCounterModulePrinter(
+                      getResultStream(OutputFile, llvm::errs()),
+                      OutputFormat));
                   return true;
                 }
                 return false;
@@ -102,7 +189,8 @@ llvm::PassPluginLibraryInfo getOpcodeCounterPluginInfo() {
           PB.registerVectorizerStartEPCallback(
               [](llvm::FunctionPassManager &PM,
                  llvm::OptimizationLevel Level) {
-                PM.addPass(OpcodeCounterPrinter(llvm::errs()));
+                PM.addPass(OpcodeCounterPrinter(
+                    getResultStream(OutputFile, llvm::errs()), OutputFormat));
               });
           // #3 REGISTRATION FOR "FAM.getResult<OpcodeCounter>(Func)"
           // Register OpcodeCounter as an analysis pass. This is required so that
@@ -135,10 +223,44 @@ static void printOpcodeCounterResult(raw_ostream &OutS,
   OutS << format("%-20s %-10s\n", str1, str2);
   OutS << "-------------------------------------------------"
                << "\n";
-  for (auto &Inst : OpcodeMap) {
-    OutS << format("%-20s %-10lu\n", Inst.first().str().c_str(),
-                           Inst.second);
+  // The names are only needed here
+  for (unsigned Opcode : OpcodeMap.getPrintOrder()) {
+    OutS << format("%-20s %-10lu\n", Instruction::getOpcodeName(Opcode),
+                           OpcodeMap.Counts[Opcode]);
+    if (OpcodeMap.CountsByType.empty())
+      continue;
+    for (unsigned TC = 0; TC < OpcodeHistogram::NumTypeClasses; ++TC) {
+      if (0 == OpcodeMap.CountsByType[Opcode][TC])
+        continue;
+      OutS << format("  %-18s %-10lu\n", OpcodeHistogram::getTypeClassName(TC),
+                     OpcodeMap.CountsByType[Opcode][TC]);
+    }
   }
   OutS << "-------------------------------------------------"
                << "\n\n";
 }
+
+static void writeOpcodeCounterResult(raw_ostream &OutS, ResultFormat Format,
+                                     StringRef ScopeKind, StringRef Scope,
+                                     const ResultOpcodeCounter &OpcodeMap) {
+  ResultWriter Writer(OutS, Format, "opcode-counter");
+  for (unsigned Opcode : OpcodeMap.getPrintOrder()) {
+    Writer.beginRecord();
+    Writer.attribute(ScopeKind, Scope);
+    Writer.attribute("opcode", Instruction::getOpcodeName(Opcode));
+    Writer.attribute("count", OpcodeMap.Counts[Opcode]);
+    Writer.endRecord();
+    if (OpcodeMap.CountsByType.empty())
+      continue;
+    for (unsigned TC = 0; TC < OpcodeHistogram::NumTypeClasses; ++TC) {
+      if (0 == OpcodeMap.CountsByType[Opcode][TC])
+        continue;
+      Writer.beginRecord();
+      Writer.attribute(ScopeKind, Scope);
+      Writer.attribute("opcode", Instruction::getOpcodeName(Opcode));
+      Writer.attribute("type", OpcodeHistogram::getTypeClassName(TC));
+      Writer.attribute("count", OpcodeMap.CountsByType[Opcode][TC]);
+      Writer.endRecord();
+    }
+  }
+}
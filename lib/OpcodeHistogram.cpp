@@ -0,0 +1,64 @@
+//==============================================================================
+// FILE:
+//    OpcodeHistogram.cpp
+//
+// DESCRIPTION:
+//    Implements OpcodeHistogram (see OpcodeHistogram.h).
+//
+// License: MIT
+//==============================================================================
+#include "OpcodeHistogram.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Type.h"
+
+using namespace llvm;
+
+OpcodeHistogram::TypeClass OpcodeHistogram::getTypeClass(const Type *Ty) {
+  if (Ty->isVoidTy())
+    return Void;
+  if (Ty->isIntegerTy())
+    return Int;
+  if (Ty->isFloatingPointTy())
+    return FP;
+  if (Ty->isPointerTy())
+    return Ptr;
+  if (Ty->isVectorTy())
+    return Vector;
+  return Other;
+}
+
+const char *OpcodeHistogram::getTypeClassName(unsigned TC) {
+  static const char *Names[NumTypeClasses] = {"void",  "int",    "fp",
+                                              "ptr",   "vector", "other"};
+  return Names[TC];
+}
+
+void OpcodeHistogram::merge(const OpcodeHistogram &Other) {
+  if (!Other.CountsByType.empty())
+    CountsByType.resize(NumOpcodes);
+
+  for (unsigned Opcode : Other.Opcodes) {
+    if (0 == Counts[Opcode])
+      Opcodes.push_back(Opcode);
+    Counts[Opcode] += Other.Counts[Opcode];
+    if (Other.CountsByType.empty())
+      continue;
+    for (unsigned TC = 0; TC < NumTypeClasses; ++TC)
+      CountsByType[Opcode][TC] += Other.CountsByType[Opcode][TC];
+  }
+}
+
+llvm::SmallVector<unsigned, 16> OpcodeHistogram::getPrintOrder() const {
+  // The results have always been printed by iterating over a StringMap keyed
+  // by the opcode names. Inserting the names in the order of their first
+  // occurrence yields exactly that order.
+  StringMap<unsigned> Names;
+  for (unsigned Opcode : Opcodes)
+    Names[Instruction::getOpcodeName(Opcode)] = Opcode;
+
+  SmallVector<unsigned, 16> Order;
+  for (auto &Entry : Names)
+    Order.push_back(Entry.second);
+  return Order;
+}
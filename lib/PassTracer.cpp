@@ -0,0 +1,344 @@
+//========================================================================
+// FILE:
+//    PassTracer.cpp
+//
+// DESCRIPTION:
+//    A plugin that doesn't add any pass. Instead, it registers
+//    PassInstrumentationCallbacks that record every pass and every analysis
+//    run by the new pass manager: the IR unit it ran on, its wall time (with
+//    and without the nested passes/analyses) and the change of the resident
+//    set size (RSS) of the process. When the process exits, it
+//      * writes all the events to -pass-trace-file in the Chrome trace
+//        format (open it in chrome://tracing or https://ui.perfetto.dev),
+//      * prints the -pass-trace-top passes and functions that took the most
+//        time (excluding the nested passes/analyses, so that pass managers and
+//        adaptors don't hide the passes that actually do the work).
+//
+//    Every thread records its events into its own buffer, so the callbacks
+//    take no locks (apart from the first event of every thread).
+//
+//    The RSS is read from /proc/self/statm on Linux and from task_info on
+//    Darwin (it's reported as 0 elsewhere). It's the RSS of the whole process,
+//    so with several threads running pipelines the deltas are only indicative.
+//
+// USAGE:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libPassTracer.so `\`
+//        -load-pass-plugin <BUILD_DIR>/lib/libMBAAdd.so `\`
+//        -passes="mba-add,default<O2>" -pass-trace-file=trace.json `\`
+//        -pass-trace-top=10 <input-llvm-file> -o /dev/null
+//      $ clang -fpass-plugin=<BUILD_DIR>/lib/libPassTracer.so `\`
+//        -mllvm -pass-trace-file=trace.json -O2 -c <input-file>
+//
+// License: MIT
+//========================================================================
+#include "PassTracer.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Analysis/LazyCallGraph.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+using namespace llvm;
+
+//-----------------------------------------------------------------------------
+// Command line options
+//-----------------------------------------------------------------------------
+static cl::opt<std::string> TraceFile{
+    "pass-trace-file",
+    cl::desc{"Write the Chrome trace of all the passes to this file"},
+    cl::value_desc{"filename"}, cl::init("")};
+
+static cl::opt<unsigned> TopN{
+    "pass-trace-top",
+    cl::desc{"Print the N passes and functions that take the most time on "
+             "exit (0 = no summary)"},
+    cl::value_desc{"N"}, cl::init(10)};
+
+//-----------------------------------------------------------------------------
+// Helper functions
+//-----------------------------------------------------------------------------
+// Returns the current resident set size of this process in KiB (0 if
+// unknown)
+static uint64_t getCurrentRSSKB() {
+#if defined(__linux__)
+  // The file is kept open, so that every sample costs one pread
+  static int StatmFD = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+  static uint64_t PageKB = sys::Process::getPageSizeEstimate() / 1024;
+  if (StatmFD < 0)
+    return 0;
+  char Buf[128];
+  ssize_t Size = pread(StatmFD, Buf, sizeof(Buf) - 1, 0);
+  if (Size <= 0)
+    return 0;
+  Buf[Size] = '\0';
+  // The 2nd field is the RSS in pages
+  unsigned long long Pages = 0;
+  if (sscanf(Buf, "%*llu %llu", &Pages) != 1)
+    return 0;
+  return Pages * PageKB;
+#elif defined(__APPLE__)
+  mach_task_basic_info_data_t Info;
+  mach_msg_type_number_t Count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                reinterpret_cast<task_info_t>(&Info), &Count) != KERN_SUCCESS)
+    return 0;
+  return Info.resident_size / 1024;
+#else
+  return 0;
+#endif
+}
+
+// Sets IRName to the name of the IR unit and FunctionName to the function
+// that contains it (if any)
+static void getIRNames(const Any &IR, std::string &IRName,
+                       std::string &FunctionName) {
+  if (const auto *M = any_cast<const Module *>(&IR)) {
+    IRName = (*M)->getModuleIdentifier();
+  } else if (const auto *F = any_cast<const Function *>(&IR)) {
+    IRName = FunctionName = (*F)->getName().str();
+  } else if (const auto *L = any_cast<const Loop *>(&IR)) {
+    FunctionName = (*L)->getHeader()->getParent()->getName().str();
+    IRName = FunctionName + "/" + (*L)->getName().str();
+  } else if (const auto *C = any_cast<const LazyCallGraph::SCC *>(&IR)) {
+    IRName = (*C)->getName();
+  }
+}
+
+//-----------------------------------------------------------------------------
+// PassTracer Implementation
+//-----------------------------------------------------------------------------
+// The buffer of the current thread (there's only one PassTracer per process)
+static thread_local void *CurrentThreadBuffer = nullptr;
+
+PassTracer::PassTracer() : Start(std::chrono::steady_clock::now()) {}
+
+PassTracer::~PassTracer() {
+  if (!TraceFile.empty()) {
+    std::error_code EC;
+    raw_fd_ostream OS(TraceFile, EC, sys::fs::OF_TextWithCRLF);
+    if (EC)
+      errs() << "warning: cannot write the pass trace to " << TraceFile
+             << ": " << EC.message() << "\n";
+    else
+      writeChromeTrace(OS);
+  }
+
+  if (TopN)
+    printSummary(errs(), TopN);
+}
+
+PassTracer::ThreadBuffer &PassTracer::getThreadBuffer() {
+  if (CurrentThreadBuffer)
+    return *static_cast<ThreadBuffer *>(CurrentThreadBuffer);
+
+  std::lock_guard<std::mutex> Guard(BuffersLock);
+  Buffers.push_back(std::make_unique<ThreadBuffer>());
+  Buffers.back()->ThreadIdx = Buffers.size();
+  CurrentThreadBuffer = Buffers.back().get();
+  return *Buffers.back();
+}
+
+uint64_t PassTracer::now() const {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - Start)
+      .count();
+}
+
+void PassTracer::begin(StringRef PassName, const Any &IR, bool IsAnalysis) {
+  ThreadBuffer &Buffer = getThreadBuffer();
+  OpenFrame Frame{PassName, "", "", 0, 0, getCurrentRSSKB(), IsAnalysis};
+  getIRNames(IR, Frame.IRName, Frame.FunctionName);
+  // Read the clock last, so that the overhead of the tracer is not included
+  Frame.BeginNs = now();
+  Buffer.Stack.push_back(std::move(Frame));
+}
+
+void PassTracer::end() {
+  uint64_t EndNs = now();
+  ThreadBuffer &Buffer = getThreadBuffer();
+  if (Buffer.Stack.empty())
+    return;
+
+  OpenFrame Frame = Buffer.Stack.pop_back_val();
+  Event E;
+  E.PassName = Frame.PassName;
+  E.IRName = std::move(Frame.IRName);
+  E.FunctionName = std::move(Frame.FunctionName);
+  E.BeginNs = Frame.BeginNs;
+  E.DurationNs = EndNs - Frame.BeginNs;
+  E.SelfNs = E.DurationNs - std::min(E.DurationNs, Frame.ChildNs);
+  E.RSSDeltaKB = int64_t(getCurrentRSSKB()) - int64_t(Frame.RSSKB);
+  E.IsAnalysis = Frame.IsAnalysis;
+  if (!Buffer.Stack.empty())
+    Buffer.Stack.back().ChildNs += E.DurationNs;
+  Buffer.Events.push_back(std::move(E));
+}
+
+void PassTracer::registerCallbacks(PassInstrumentationCallbacks &PIC) {
+  PIC.registerBeforeNonSkippedPassCallback(
+      [this](StringRef P, Any IR) { begin(P, IR, /*IsAnalysis=*/false); });
+  PIC.registerAfterPassCallback(
+      [this](StringRef, Any, const PreservedAnalyses &) { end(); });
+  PIC.registerAfterPassInvalidatedCallback(
+      [this](StringRef, const PreservedAnalyses &) { end(); });
+  PIC.registerBeforeAnalysisCallback(
+      [this](StringRef P, Any IR) { begin(P, IR, /*IsAnalysis=*/true); });
+  PIC.registerAfterAnalysisCallback([this](StringRef, Any) { end(); });
+}
+
+void PassTracer::writeChromeTrace(raw_ostream &OS) const {
+  std::lock_guard<std::mutex> Guard(BuffersLock);
+  int64_t Pid = sys::Process::getProcessId();
+
+  json::OStream J(OS);
+  J.objectBegin();
+  J.attribute("displayTimeUnit", "ms");
+  J.attributeBegin("traceEvents");
+  J.arrayBegin();
+  for (const auto &Buffer : Buffers) {
+    // Sorted by start time (the events are recorded when they end)
+    std::vector<const Event *> Sorted;
+    for (const Event &E : Buffer->Events)
+      Sorted.push_back(&E);
+    llvm::stable_sort(Sorted, [](const Event *A, const Event *B) {
+      return A->BeginNs < B->BeginNs;
+    });
+
+    for (const Event *E : Sorted) {
+      // New line per event, so that the file can be grepped
+      OS << "\n";
+      J.object([&] {
+        J.attribute("name", E->PassName);
+        J.attribute("cat", E->IsAnalysis ? "analysis" : "pass");
+        J.attribute("ph", "X");
+        J.attribute("pid", Pid);
+        J.attribute("tid", int64_t(Buffer->ThreadIdx));
+        // In microseconds (like -ftime-trace)
+        J.attribute("ts", int64_t(E->BeginNs / 1000));
+        J.attribute("dur", int64_t(E->DurationNs / 1000));
+        J.attributeObject("args", [&] {
+          J.attribute("ir", E->IRName);
+          J.attribute("self_us", int64_t(E->SelfNs / 1000));
+          J.attribute("rss_delta_kb", E->RSSDeltaKB);
+        });
+      });
+    }
+  }
+  J.arrayEnd();
+  J.attributeEnd();
+  J.objectEnd();
+  OS << "\n";
+}
+
+void PassTracer::printSummary(raw_ostream &OS, unsigned N) const {
+  struct PassStats {
+    StringRef Name;
+    bool IsAnalysis = false;
+    uint64_t Count = 0;
+    uint64_t SelfNs = 0;
+    uint64_t TotalNs = 0;
+    int64_t RSSDeltaKB = 0;
+  };
+  StringMap<PassStats> ByPass;
+  StringMap<uint64_t> ByFunction;
+
+  {
+    std::lock_guard<std::mutex> Guard(BuffersLock);
+    for (const auto &Buffer : Buffers) {
+      for (const Event &E : Buffer->Events) {
+        PassStats &Stats = ByPass[E.PassName];
+        Stats.Name = E.PassName;
+        Stats.IsAnalysis = E.IsAnalysis;
+        Stats.Count++;
+        Stats.SelfNs += E.SelfNs;
+        Stats.TotalNs += E.DurationNs;
+        Stats.RSSDeltaKB += E.RSSDeltaKB;
+        if (!E.FunctionName.empty())
+          ByFunction[E.FunctionName] += E.SelfNs;
+      }
+    }
+  }
+
+  std::vector<const PassStats *> Passes;
+  for (const auto &Entry : ByPass)
+    Passes.push_back(&Entry.getValue());
+  llvm::sort(Passes, [](const PassStats *A, const PassStats *B) {
+    return std::tie(B->SelfNs, A->Name) < std::tie(A->SelfNs, B->Name);
+  });
+  std::vector<std::pair<StringRef, uint64_t>> Functions;
+  for (const auto &Entry : ByFunction)
+    Functions.emplace_back(Entry.getKey(), Entry.getValue());
+  llvm::sort(Functions, [](const auto &A, const auto &B) {
+    return std::tie(B.second, A.first) < std::tie(A.second, B.first);
+  });
+
+  OS << "================================================="
+     << "\n";
+  OS << "LLVM-TUTOR: PassTracer results (top " << N << ")\n";
+  OS << "=================================================\n";
+  OS << formatv("{0,-40} {1,-9} {2,8} {3,12} {4,12} {5,12}\n", "PASS", "KIND",
+                "#RUNS", "SELF (ms)", "TOTAL (ms)", "RSS (KiB)");
+  OS << "-------------------------------------------------"
+     << "\n";
+  for (const PassStats *Stats : ArrayRef(Passes).take_front(N))
+    OS << format("%-40s %-9s %8llu %12.3f %12.3f %12lld\n",
+                 Stats->Name.str().c_str(),
+                 Stats->IsAnalysis ? "analysis" : "pass",
+                 (unsigned long long)Stats->Count, Stats->SelfNs / 1e6,
+                 Stats->TotalNs / 1e6, (long long)Stats->RSSDeltaKB);
+  OS << "-------------------------------------------------"
+     << "\n";
+  OS << formatv("{0,-40} {1,12}\n", "FUNCTION", "SELF (ms)");
+  OS << "-------------------------------------------------"
+     << "\n";
+  for (const auto &[Name, SelfNs] : ArrayRef(Functions).take_front(N))
+    OS << format("%-40s %12.3f\n", Name.str().c_str(), SelfNs / 1e6);
+  OS << "-------------------------------------------------"
+     << "\n\n";
+}
+
+//-----------------------------------------------------------------------------
+// New PM Registration
+//-----------------------------------------------------------------------------
+// There's one tracer per process. It's destroyed (i.e. the results are
+// written) on exit, before the command line options that it reads.
+static PassTracer &getPassTracer() {
+  static PassTracer Tracer;
+  return Tracer;
+}
+
+llvm::PassPluginLibraryInfo getPassTracerPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "pass-tracer", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            if (PassInstrumentationCallbacks *PIC =
+                    PB.getPassInstrumentationCallbacks())
+              getPassTracer().registerCallbacks(*PIC);
+          }};
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getPassTracerPluginInfo();
+}
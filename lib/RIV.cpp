@@ -25,6 +25,23 @@
 //      RIV_M = {RIV_N, v_N}
 //    -------------------------------------------------------------------------
 //
+//    The sets are not copied from BB_N to BB_M. Instead, v_N is stored once
+//    (as a node that links to the node holding v_N's immediate dominator)
+//    and RIV_M refers to that node, i.e. {v_N, RIV_N} is represented as a
+//    chain (see RIVChains in RIV.h). Both the time and the memory required
+//    are linear in the size of the function.
+//
+//    LazyRIV answers the same queries (the number of RIVs in a block, the
+//    K-th RIV and whether a value is a RIV) on demand, without running the
+//    algorithm above. The RIV_M sets are never built: v_N is only computed
+//    when a query walks through BB_N, and reachability is checked with the
+//    DFS numbering of the dominator tree.
+//
+//    With `-riv-format=jsonl|binary`, the results are written as records
+//    (one per block and RIV, naming both) rather than as a table, see
+//    ResultWriter.h. `-riv-output=<file>` writes them to a file instead of
+//    stderr.
+//
 // REFERENCES:
 //    Based on examples from:
 //    "Building, Testing and Debugging a Simple out-of-tree LLVM Pass", Serge
@@ -34,80 +51,103 @@
 //=============================================================================
 #include "RIV.h"
 
+#include "llvm/ADT/SmallString.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/ModuleSlotTracker.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Format.h"
 
-#include <deque>
+#include <optional>
 
 using namespace llvm;
 
 // DominatorTree node types used in RIV. One could use auto instead, but IMO
 // being verbose makes it easier to follow.
 using NodeTy = DomTreeNodeBase<llvm::BasicBlock> *;
-// A map that a basic block BB holds a set of pointers to values defined in BB.
-using DefValMapTy = RIV::Result;
 
-// Pretty-prints the result of this analysis
-static void printRIVResult(llvm::raw_ostream &OutS, const RIV::Result &RIVMap);
+static cl::opt<ResultFormat> OutputFormat(
+    "riv-format",
+    cl::desc("The format of the results of print<riv> and print<lazy-riv>"),
+    getResultFormatValues(), cl::init(ResultFormat::Text));
+
+static cl::opt<std::string>
+    OutputFile("riv-output",
+               cl::desc("Write the results of print<riv> and print<lazy-riv> "
+                        "to this file (rather than to stderr)"),
+               cl::value_desc("filename"), cl::init(""));
+
+// Prints the result of this analysis in the requested format
+static void printRIVResult(llvm::raw_ostream &OutS, const Function &F,
+                           const RIV::Result &RIVMap, ResultFormat Format);
+static void printLazyRIVResult(llvm::raw_ostream &OutS, Function &F,
+                               const DominatorTree &DT, LazyRIVResult &RIVs,
+                               ResultFormat Format);
 
 //-----------------------------------------------------------------------------
 // RIV Implementation
 //-----------------------------------------------------------------------------
+unsigned RIVResult::addNode(unsigned Parent, unsigned Begin, unsigned End) {
+  size_t ChainSize = End - Begin;
+  if (RIVChains::NoParent != Parent)
+    ChainSize += Chains->Nodes[Parent].ChainSize;
+  Chains->Nodes.push_back({Parent, Begin, End, ChainSize});
+  return Chains->Nodes.size() - 1;
+}
+
+void RIVResult::addBlock(const BasicBlock *BB, unsigned Head) {
+  BlockIdx[BB] = Blocks.size();
+  Blocks.emplace_back(BB, RIVSet(Chains.get(), Head));
+}
+
 RIV::Result RIV::buildRIV(Function &F, NodeTy CFGRoot) {
   Result ResultMap;
+  RIVChains &Chains = ResultMap.getChains();
 
-  // Initialise a double-ended queue that will be used to traverse all BBs in F
-  std::deque<NodeTy> BBsToProcess;
-  BBsToProcess.push_back(CFGRoot);
-
-  // STEP 1: For every basic block BB compute the set of integer values defined
-  // in BB
-  DefValMapTy DefinedValuesMap;
-  for (BasicBlock &BB : F) {
-    auto &Values = DefinedValuesMap[&BB];
+  // Appends the integer values defined in BB to Chains.Values and returns a
+  // new node (linked to Parent) for them
+  auto AddNode = [&](unsigned Parent, BasicBlock &BB) {
+    unsigned Begin = Chains.Values.size();
     for (Instruction &Inst : BB)
       if (Inst.getType()->isIntegerTy())
-        Values.insert(&Inst);
-  }
+        Chains.Values.push_back(&Inst);
+    return ResultMap.addNode(Parent, Begin, Chains.Values.size());
+  };
 
-  // STEP 2: Compute the RIVs for the entry BB. This will include global
+  // STEP 1: Compute the RIVs for the entry BB. This will include global
   // variables and input arguments.
-  auto &EntryBBValues = ResultMap[&F.getEntryBlock()];
-
+  unsigned Begin = Chains.Values.size();
   for (auto &Global : F.getParent()->globals())
     if (Global.getValueType()->isIntegerTy())
-      EntryBBValues.insert(&Global);
-
+      Chains.Values.push_back(&Global);
   for (Argument &Arg : F.args())
     if (Arg.getType()->isIntegerTy())
-      EntryBBValues.insert(&Arg);
+      Chains.Values.push_back(&Arg);
+  unsigned EntryRIVs =
+      ResultMap.addNode(RIVChains::NoParent, Begin, Chains.Values.size());
+  ResultMap.addBlock(CFGRoot->getBlock(), EntryRIVs);
+
+  // Initialise a stack that will be used to traverse all BBs in F. Every
+  // entry holds a node of the dominator tree and its RIV chain.
+  std::vector<std::pair<NodeTy, unsigned>> BBsToProcess;
+  BBsToProcess.emplace_back(CFGRoot, EntryRIVs);
 
-  // STEP 3: Traverse the CFG for every BB in F calculate its RIVs
+  // STEP 2: Traverse the dominator tree. The RIVs of every child of Parent
+  // are the values defined in Parent (STEP 1 of the algorithm, done lazily
+  // here) followed by the RIVs of Parent.
   while (!BBsToProcess.empty()) {
-    auto *Parent = BBsToProcess.back();
+    auto [Parent, ParentRIVs] = BBsToProcess.back();
     BBsToProcess.pop_back();
 
-    // Get the values defined in Parent
-    auto &ParentDefs = DefinedValuesMap[Parent->getBlock()];
-    // Get the RIV set of for Parent
-    // (Since RIVMap is updated on every iteration, its contents are likely to
-    // be moved around when resizing. This means that we need a copy of it
-    // (i.e. a reference is not sufficient).
-    llvm::SmallPtrSet<llvm::Value *, 8> ParentRIVs =
-        ResultMap[Parent->getBlock()];
+    // Leaves don't contribute their definitions to any RIV set
+    if (Parent->isLeaf())
+      continue;
 
-    // Loop over all BBs that Parent dominates and update their RIV sets
+    unsigned ChildRIVs = AddNode(ParentRIVs, *Parent->getBlock());
     for (NodeTy Child : *Parent) {
-      BBsToProcess.push_back(Child);
-      auto ChildBB = Child->getBlock();
-
-      // Add values defined in Parent to the current child's set of RIV
-      ResultMap[ChildBB].insert(ParentDefs.begin(), ParentDefs.end());
-
-      // Add Parent's set of RIVs to the current child's RIV
-      ResultMap[ChildBB].insert(ParentRIVs.begin(), ParentRIVs.end());
+      BBsToProcess.emplace_back(Child, ChildRIVs);
+      ResultMap.addBlock(Child->getBlock(), ChildRIVs);
     }
   }
 
@@ -121,12 +161,195 @@ RIV::Result RIV::run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM) {
   return Res;
 }
 
+//-----------------------------------------------------------------------------
+// LazyRIV Implementation
+//-----------------------------------------------------------------------------
+ArrayRef<Value *> LazyRIVResult::getEntryRIVs() {
+  if (!EntryRIVsCollected) {
+    EntryRIVsCollected = true;
+    unsigned Begin = Values.size();
+    for (auto &Global : F.getParent()->globals())
+      if (Global.getValueType()->isIntegerTy())
+        Values.push_back(&Global);
+    for (Argument &Arg : F.args())
+      if (Arg.getType()->isIntegerTy())
+        Values.push_back(&Arg);
+    EntryRIVsRange = {Begin, Values.size()};
+  }
+
+  return ArrayRef<Value *>(Values).slice(
+      EntryRIVsRange.first, EntryRIVsRange.second - EntryRIVsRange.first);
+}
+
+ArrayRef<Value *> LazyRIVResult::getDefs(const BasicBlock *BB) {
+  auto [Entry, Inserted] = DefsRange.try_emplace(BB);
+  if (Inserted) {
+    unsigned Begin = Values.size();
+    for (const Instruction &Inst : *BB)
+      if (Inst.getType()->isIntegerTy())
+        Values.push_back(const_cast<Instruction *>(&Inst));
+    Entry->second = {Begin, Values.size()};
+  }
+
+  auto [Begin, End] = Entry->second;
+  return ArrayRef<Value *>(Values).slice(Begin, End - Begin);
+}
+
+bool LazyRIVResult::isReachable(const Value *V, const BasicBlock *BB) {
+  const DomTreeNode *Node = DT.getNode(BB);
+  if (nullptr == Node)
+    return false;
+
+  if (auto *Global = dyn_cast<GlobalVariable>(V))
+    return Global->getParent() == F.getParent() &&
+           Global->getValueType()->isIntegerTy();
+  if (!V->getType()->isIntegerTy())
+    return false;
+  if (auto *Arg = dyn_cast<Argument>(V))
+    return Arg->getParent() == &F;
+
+  auto *Inst = dyn_cast<Instruction>(V);
+  if (nullptr == Inst || Inst->getFunction() != &F)
+    return false;
+
+  // The values defined in a block are reachable in the blocks that it
+  // strictly dominates
+  const DomTreeNode *DefNode = DT.getNode(Inst->getParent());
+  if (nullptr == DefNode || DefNode == Node)
+    return false;
+  if (!DFSNumbersValid) {
+    DT.updateDFSNumbers();
+    DFSNumbersValid = true;
+  }
+  return Node->getDFSNumIn() >= DefNode->getDFSNumIn() &&
+         Node->getDFSNumOut() <= DefNode->getDFSNumOut();
+}
+
+size_t LazyRIVResult::getNumRIVs(const BasicBlock *BB) {
+  const DomTreeNode *Node = DT.getNode(BB);
+  if (nullptr == Node)
+    return 0;
+
+  // Walk up the dominator tree until a block with a known count (or the
+  // entry block) is found...
+  SmallVector<const DomTreeNode *, 8> Path;
+  size_t Count = 0;
+  for (;; Node = Node->getIDom()) {
+    auto Known = NumRIVs.find(Node->getBlock());
+    if (NumRIVs.end() != Known) {
+      Count = Known->second;
+      break;
+    }
+    if (nullptr == Node->getIDom()) {
+      Count = getEntryRIVs().size();
+      NumRIVs[Node->getBlock()] = Count;
+      break;
+    }
+    Path.push_back(Node);
+  }
+
+  // ... and then compute (and memoise) the counts on the way back down
+  for (const DomTreeNode *N : reverse(Path)) {
+    Count += getDefs(N->getIDom()->getBlock()).size();
+    NumRIVs[N->getBlock()] = Count;
+  }
+
+  return Count;
+}
+
+Value *LazyRIVResult::getRIV(const BasicBlock *BB, size_t K) {
+  assert(K < getNumRIVs(BB) && "RIV index out of range");
+
+  for (const DomTreeNode *Node = DT.getNode(BB)->getIDom(); Node;
+       Node = Node->getIDom()) {
+    ArrayRef<Value *> Defs = getDefs(Node->getBlock());
+    if (K < Defs.size())
+      return Defs[K];
+    K -= Defs.size();
+  }
+
+  return getEntryRIVs()[K];
+}
+
+void LazyRIVResult::getRIVs(
+    ArrayRef<std::pair<const BasicBlock *, size_t>> Queries,
+    SmallVectorImpl<Value *> &Results) {
+  Results.assign(Queries.size(), nullptr);
+  if (Queries.empty())
+    return;
+
+  DenseMap<const BasicBlock *, SmallVector<unsigned, 1>> QueriesFor;
+  for (unsigned Idx = 0; Idx != Queries.size(); ++Idx)
+    QueriesFor[Queries[Idx].first].push_back(Idx);
+
+  // The RIVs of the block being visited, in reverse order (i.e. the K-th RIV
+  // is Stack[Stack.size() - 1 - K]). Entering a child of BB pushes the
+  // values defined in BB, leaving it pops them.
+  ArrayRef<Value *> EntryRIVs = getEntryRIVs();
+  std::vector<Value *> Stack(EntryRIVs.rbegin(), EntryRIVs.rend());
+
+  struct Frame {
+    const DomTreeNode *Node;
+    DomTreeNode::const_iterator NextChild;
+    size_t StackSize;
+  };
+  SmallVector<Frame, 16> Frames;
+  size_t NumAnswered = 0;
+
+  auto Enter = [&](const DomTreeNode *Node) {
+    auto Pending = QueriesFor.find(Node->getBlock());
+    if (QueriesFor.end() != Pending) {
+      for (unsigned Idx : Pending->second) {
+        assert(Queries[Idx].second < Stack.size() && "RIV index out of range");
+        Results[Idx] = Stack[Stack.size() - 1 - Queries[Idx].second];
+      }
+      NumAnswered += Pending->second.size();
+    }
+
+    size_t StackSize = Stack.size();
+    if (!Node->isLeaf()) {
+      ArrayRef<Value *> Defs = getDefs(Node->getBlock());
+      Stack.insert(Stack.end(), Defs.rbegin(), Defs.rend());
+    }
+    Frames.push_back({Node, Node->begin(), StackSize});
+  };
+
+  Enter(DT.getRootNode());
+  while (!Frames.empty() && NumAnswered != Queries.size()) {
+    Frame &Top = Frames.back();
+    if (Top.NextChild == Top.Node->end()) {
+      Stack.resize(Top.StackSize);
+      Frames.pop_back();
+      continue;
+    }
+    Enter(*Top.NextChild++);
+  }
+}
+
+bool LazyRIVResult::invalidate(Function &F, const PreservedAnalyses &PA,
+                               FunctionAnalysisManager::Invalidator &Inv) {
+  auto PAC = PA.getChecker<LazyRIV>();
+  return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>()) ||
+         Inv.invalidate<DominatorTreeAnalysis>(F, PA);
+}
+
+LazyRIV::Result LazyRIV::run(Function &F, FunctionAnalysisManager &FAM) {
+  return LazyRIVResult(F, FAM.getResult<DominatorTreeAnalysis>(F));
+}
+
+PreservedAnalyses LazyRIVPrinter::run(Function &Func,
+                                      FunctionAnalysisManager &FAM) {
+  printLazyRIVResult(OS, Func, FAM.getResult<DominatorTreeAnalysis>(Func),
+                     FAM.getResult<LazyRIV>(Func), Format);
+  return PreservedAnalyses::all();
+}
+
 PreservedAnalyses RIVPrinter::run(Function &Func,
                                   FunctionAnalysisManager &FAM) {
 
-  auto RIVMap = FAM.getResult<RIV>(Func);
+  auto &RIVMap = FAM.getResult<RIV>(Func);
 
-  printRIVResult(OS, RIVMap);
+  printRIVResult(OS, Func, RIVMap, Format);
   return PreservedAnalyses::all();
 }
 
@@ -134,6 +357,7 @@ PreservedAnalyses RIVPrinter::run(Function &Func,
 // New PM Registration
 //-----------------------------------------------------------------------------
 AnalysisKey RIV::Key;
+AnalysisKey LazyRIV::Key;
 
 llvm::PassPluginLibraryInfo getRIVPluginInfo() {
   return {LLVM_PLUGIN_API_VERSION, "riv", LLVM_VERSION_STRING,
@@ -143,15 +367,25 @@ llvm::PassPluginLibraryInfo getRIVPluginInfo() {
                 [&](StringRef Name, FunctionPassManager &FPM,
                     ArrayRef<PassBuilder::PipelineElement>) {
                   if (Name == "print<riv>") {
-                    FPM.addPass(RIVPrinter(llvm::errs()));
+                    FPM.addPass(RIVPrinter(
+                        getResultStream(OutputFile, llvm::errs()),
+                        OutputFormat));
+                    return true;
+                  }
+                  if (Name == "print<lazy-riv>") {
+                    FPM.addPass(LazyRIVPrinter(
+                        getResultStream(OutputFile, llvm::errs()),
+                        OutputFormat));
                     return true;
                   }
                   return false;
                 });
-            // #2 REGISTRATION FOR "FAM.getResult<RIV>(Function)"
+            // #2 REGISTRATION FOR "FAM.getResult<RIV>(Function)" and
+            // "FAM.getResult<LazyRIV>(Function)"
             PB.registerAnalysisRegistrationCallback(
                 [](FunctionAnalysisManager &FAM) {
                   FAM.registerPass([&] { return RIV(); });
+                  FAM.registerPass([&] { return LazyRIV(); });
                 });
           }};
 };
@@ -164,7 +398,7 @@ llvmGetPassPluginInfo() {
 //------------------------------------------------------------------------------
 // Helper functions
 //------------------------------------------------------------------------------
-static void printRIVResult(raw_ostream &OutS, const RIV::Result &RIVMap) {
+static void printRIVHeader(raw_ostream &OutS) {
   OutS << "=================================================\n";
   OutS << "LLVM-TUTOR: RIV analysis results\n";
   OutS << "=================================================\n";
@@ -173,21 +407,88 @@ static void printRIVResult(raw_ostream &OutS, const RIV::Result &RIVMap) {
   const char *Str2 = "Reachable Integer Values";
   OutS << format("%-10s %-30s\n", Str1, Str2);
   OutS << "-------------------------------------------------\n";
+}
+
+// Prints the results of one function, one block at a time. All the values
+// are printed with one slot tracker (rather than numbering the function for
+// every value) into one reused buffer.
+class RIVBlockPrinter {
+public:
+  RIVBlockPrinter(raw_ostream &OutS, const Function &F, ResultFormat Format,
+                  StringRef Analysis)
+      : OutS(OutS), F(F),
+        MST(F.getParent(), /*ShouldInitializeAllMetadata=*/false) {
+    MST.incorporateFunction(F);
+    if (Format == ResultFormat::Text)
+      printRIVHeader(OutS);
+    else
+      Writer.emplace(OutS, Format, Analysis);
+  }
+  ~RIVBlockPrinter() {
+    if (!Writer)
+      OutS << "\n\n";
+  }
+
+  template <typename RangeTy>
+  void printBlock(const BasicBlock *BB, RangeTy &&IntegerValues) {
+    if (Writer) {
+      // One record per RIV
+      for (auto const *IntegerValue : IntegerValues) {
+        Writer->beginRecord();
+        Writer->attribute("function", F.getName());
+        Writer->attribute("block", *BB, MST, /*AsOperand=*/true);
+        Writer->attribute("value", *IntegerValue, MST, /*AsOperand=*/true);
+        Writer->endRecord();
+      }
+      return;
+    }
 
-  const char *EmptyStr = "";
-
-  for (auto const &KV : RIVMap) {
-    std::string DummyStr;
-    raw_string_ostream BBIdStream(DummyStr);
-    KV.first->printAsOperand(BBIdStream, false);
-    OutS << format("BB %-12s %-30s\n", BBIdStream.str().c_str(), EmptyStr);
-    for (auto const *IntegerValue : KV.second) {
-      std::string DummyStr;
-      raw_string_ostream InstrStr(DummyStr);
-      IntegerValue->print(InstrStr);
-      OutS << format("%-12s %-30s\n", EmptyStr, InstrStr.str().c_str());
+    // The same layout as format("%-12s %-30s\n", ...), without the
+    // temporary strings
+    Scratch.clear();
+    raw_svector_ostream ScratchOS(Scratch);
+    BB->printAsOperand(ScratchOS, false, MST);
+    OutS << "BB " << left_justify(Scratch, 12) << ' ';
+    OutS.indent(30) << '\n';
+    for (auto const *IntegerValue : IntegerValues) {
+      Scratch.clear();
+      IntegerValue->print(ScratchOS, MST);
+      OutS.indent(13) << left_justify(Scratch, 30) << '\n';
     }
   }
 
-  OutS << "\n\n";
+private:
+  raw_ostream &OutS;
+  const Function &F;
+  ModuleSlotTracker MST;
+  std::optional<ResultWriter> Writer;
+  SmallString<128> Scratch;
+};
+
+static void printRIVResult(raw_ostream &OutS, const Function &F,
+                           const RIV::Result &RIVMap, ResultFormat Format) {
+  RIVBlockPrinter Printer(OutS, F, Format, "riv");
+  for (auto const &KV : RIVMap)
+    Printer.printBlock(KV.first, KV.second);
+}
+
+static void printLazyRIVResult(raw_ostream &OutS, Function &F,
+                               const DominatorTree &DT, LazyRIVResult &RIVs,
+                               ResultFormat Format) {
+  RIVBlockPrinter Printer(OutS, F, Format, "lazy-riv");
+  SmallVector<Value *, 16> IntegerValues;
+  for (const BasicBlock &BB : F) {
+    // Like RIV, ignore the unreachable blocks
+    if (!DT.isReachableFromEntry(&BB))
+      continue;
+
+    size_t NumRIVs = RIVs.getNumRIVs(&BB);
+    IntegerValues.clear();
+    for (size_t K = 0; K < NumRIVs; ++K) {
+      IntegerValues.push_back(RIVs.getRIV(&BB, K));
+      assert(RIVs.isReachable(IntegerValues.back(), &BB) &&
+             "Inconsistent LazyRIV results");
+    }
+    Printer.printBlock(&BB, IntegerValues);
+  }
 }
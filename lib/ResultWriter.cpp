@@ -0,0 +1,136 @@
+//==============================================================================
+// FILE:
+//    ResultWriter.cpp
+//
+// DESCRIPTION:
+//    Implements ResultWriter (see ResultWriter.h).
+//
+// License: MIT
+//==============================================================================
+#include "ResultWriter.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/ModuleSlotTracker.h"
+#include "llvm/IR/Value.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LEB128.h"
+
+#include <memory>
+#include <mutex>
+
+using namespace llvm;
+
+cl::ValuesClass getResultFormatValues() {
+  return cl::values(
+      clEnumValN(ResultFormat::Text, "text", "Human-readable tables"),
+      clEnumValN(ResultFormat::JSONLines, "jsonl",
+                 "JSON lines (one record per line)"),
+      clEnumValN(ResultFormat::Binary, "binary",
+                 "Compact binary records (see `dcc-profdata show`)"));
+}
+
+raw_ostream &getResultStream(StringRef Path, raw_ostream &Default) {
+  if (Path.empty())
+    return Default;
+
+  static std::mutex StreamsLock;
+  static StringMap<std::unique_ptr<raw_fd_ostream>> Streams;
+
+  std::lock_guard<std::mutex> Guard(StreamsLock);
+  auto &Stream = Streams[Path];
+  if (!Stream) {
+    std::error_code EC;
+    Stream = std::make_unique<raw_fd_ostream>(Path, EC, sys::fs::OF_None);
+    if (EC) {
+      errs() << "warning: cannot write the results to " << Path << ": "
+             << EC.message() << "\n";
+      Streams.erase(Path);
+      return Default;
+    }
+  }
+  return *Stream;
+}
+
+//------------------------------------------------------------------------------
+// ResultWriter implementation
+//------------------------------------------------------------------------------
+ResultWriter::ResultWriter(raw_ostream &OS, ResultFormat Format,
+                           StringRef Analysis)
+    : OS(OS), Format(Format), Analysis(Analysis) {
+  assert(Format != ResultFormat::Text && "Text is printed by the printers");
+  if (Format == ResultFormat::Binary) {
+    ResultStreamHeader Header{ResultStreamMagic, ResultStreamVersion, 0};
+    OS.write(reinterpret_cast<const char *>(&Header), sizeof(Header));
+  }
+}
+
+void ResultWriter::beginRecord() {
+  if (Format == ResultFormat::JSONLines) {
+    JOS.emplace(OS);
+    JOS->objectBegin();
+  } else {
+    OS << char(ResultRecordTag);
+  }
+  attribute("analysis", Analysis);
+}
+
+void ResultWriter::endRecord() {
+  if (Format == ResultFormat::JSONLines) {
+    JOS->objectEnd();
+    JOS.reset();
+    OS << '\n';
+  } else {
+    OS << char(ResultRecordEnd);
+  }
+}
+
+void ResultWriter::attribute(StringRef Key, StringRef Value) {
+  if (Format == ResultFormat::JSONLines) {
+    JOS->attribute(Key, Value);
+    return;
+  }
+  writeKey(Key);
+  OS << char(ResultFieldString);
+  writeString(Value);
+}
+
+void ResultWriter::attribute(StringRef Key, uint64_t Value) {
+  if (Format == ResultFormat::JSONLines) {
+    JOS->attribute(Key, Value);
+    return;
+  }
+  writeKey(Key);
+  OS << char(ResultFieldUnsigned);
+  encodeULEB128(Value, OS);
+}
+
+void ResultWriter::attribute(StringRef Key, const Value &V,
+                             ModuleSlotTracker &MST, bool AsOperand) {
+  Scratch.clear();
+  raw_svector_ostream ScratchOS(Scratch);
+  if (AsOperand)
+    V.printAsOperand(ScratchOS, /*PrintType=*/false, MST);
+  else
+    V.print(ScratchOS, MST);
+  // Instructions are printed with the indentation of a function body
+  attribute(Key, StringRef(Scratch).ltrim());
+}
+
+void ResultWriter::writeKey(StringRef Key) {
+  // There are only a handful of distinct names, a linear search is the
+  // fastest lookup
+  for (size_t Idx = 0, E = Keys.size(); Idx != E; ++Idx) {
+    if (Keys[Idx] == Key) {
+      encodeULEB128(Idx + 1, OS);
+      return;
+    }
+  }
+  Keys.push_back(Key);
+  encodeULEB128(Keys.size(), OS);
+  writeString(Key);
+}
+
+void ResultWriter::writeString(StringRef Str) {
+  encodeULEB128(Str.size(), OS);
+  OS << Str;
+}
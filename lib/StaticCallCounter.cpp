@@ -13,23 +13,51 @@
 //    that is a wrapper around StaticCallCounter. `static` allows you to run
 //    StaticCallCounter without `opt`.
 //
+//    With `-static-cc-format=jsonl|binary`, the results are written as
+//    records (one per callee) rather than as a table, see ResultWriter.h.
+//    `-static-cc-output=<file>` writes them to a file instead of stderr.
+//
 // USAGE:
 //      opt -load-pass-plugin libStaticCallCounter.dylib `\`
 //        -passes="print<static-cc>" `\`
 //        -disable-output <input-llvm-file>
+//      opt -load-pass-plugin libStaticCallCounter.dylib `\`
+//        -passes="print<static-cc>" -static-cc-format=jsonl `\`
+//        -static-cc-output=<output-file> -disable-output <input-llvm-file>
 //
 // License: MIT
 //==============================================================================
 #include "StaticCallCounter.h"
+#include "FusedAnalysis.h"
 
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+
+#include <optional>
 
 using namespace llvm;
 
-// Pretty-prints the result of this analysis
+static cl::opt<ResultFormat>
+    OutputFormat("static-cc-format",
+                 cl::desc("The format of the results of print<static-cc>"),
+                 getResultFormatValues(), cl::init(ResultFormat::Text));
+
+static cl::opt<std::string>
+    OutputFile("static-cc-output",
+               cl::desc("Write the results of print<static-cc> to this file "
+                        "(rather than to stderr)"),
+               cl::value_desc("filename"), cl::init(""));
+
+// Prints the result of this analysis in the requested format
 static void printStaticCCResult(llvm::raw_ostream &OutS,
-                         const ResultStaticCC &DirectCalls);
+                                const ResultStaticCC &DirectCalls,
+                                ResultFormat Format);
+// Pretty-prints the header and the footer of the results table
+static void printStaticCCHeader(llvm::raw_ostream &OutS);
+static void printStaticCCFooter(llvm::raw_ostream &OutS);
 
 //------------------------------------------------------------------------------
 // StaticCallCounter Implementation
@@ -37,34 +65,38 @@ static void printStaticCCResult(llvm::raw_ostream &OutS,
 StaticCallCounter::Result StaticCallCounter::runOnModule(Module &M) {
   llvm::MapVector<const llvm::Function *, unsigned> Res;
 
-  for (auto &Func : M) {
-    for (auto &BB : Func) {
-      for (auto &Ins : BB) {
+  for (auto &Func : M)
+    countCallsInFunction(Func, Res);
 
-        // If this is a call instruction then CB will be not null.
-        auto *CB = dyn_cast<CallBase>(&Ins);
-        if (nullptr == CB) {
-          continue;
-        }
+  return Res;
+}
 
-        // If CB is a direct function call then DirectInvoc will be not null.
-        auto DirectInvoc = CB->getCalledFunction();
-        if (nullptr == DirectInvoc) {
-          continue;
-        }
-
-        // We have a direct function call - update the count for the function
-        // being called.
-        auto CallCount = Res.find(DirectInvoc);
-        if (Res.end() == CallCount) {
-          CallCount = Res.insert(std::make_pair(DirectInvoc, 0)).first;
-        }
-        ++CallCount->second;
+void StaticCallCounter::countCallsInFunction(const Function &Func,
+                                             Result &Res) {
+  for (auto &BB : Func) {
+    for (auto &Ins : BB) {
+
+      // If this is a call instruction then CB will be not null.
+      auto *CB = dyn_cast<CallBase>(&Ins);
+      if (nullptr == CB) {
+        continue;
+      }
+
+      // If CB is a direct function call then DirectInvoc will be not null.
+      auto DirectInvoc = CB->getCalledFunction();
+      if (nullptr == DirectInvoc) {
+        continue;
       }
+
+      // We have a direct function call - update the count for the function
+      // being called.
+      auto CallCount = Res.find(DirectInvoc);
+      if (Res.end() == CallCount) {
+        CallCount = Res.insert(std::make_pair(DirectInvoc, 0)).first;
+      }
+      ++CallCount->second;
     }
   }
-
-  return Res;
 }
 
 PreservedAnalyses
@@ -73,12 +105,29 @@ StaticCallCounterPrinter::run(Module &M,
 
   auto DirectCalls = MAM.getResult<StaticCallCounter>(M);
 
-  printStaticCCResult(OS, DirectCalls);
+  printStaticCCResult(OS, DirectCalls, Format);
   return PreservedAnalyses::all();
 }
 
 StaticCallCounter::Result
-StaticCallCounter::run(llvm::Module &M, llvm::ModuleAnalysisManager &) {
+StaticCallCounter::run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM) {
+  // Share the walk over the instructions with the function analyses if
+  // possible
+  if (MAM.isPassRegistered<FunctionAnalysisManagerModuleProxy>()) {
+    auto &FAM =
+        MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+    if (FAM.isPassRegistered<FusedAnalysis>()) {
+      Result Res;
+      for (auto &Func : M) {
+        if (Func.isDeclaration())
+          continue;
+        for (auto &CallCount : FAM.getResult<FusedAnalysis>(Func).DirectCalls)
+          Res[CallCount.first] += CallCount.second;
+      }
+      return Res;
+    }
+  }
+
   return runOnModule(M);
 }
 
@@ -95,7 +144,9 @@ llvm::PassPluginLibraryInfo getStaticCallCounterPluginInfo() {
                 [&](StringRef Name, ModulePassManager &MPM,
                     ArrayRef<PassBuilder::PipelineElement>) {
                   if (Name == "print<static-cc>") {
-                    MPM.addPass(StaticCallCounterPrinter(llvm::errs()));
+                    MPM.addPass(StaticCallCounterPrinter(
+                        getResultStream(OutputFile, llvm::errs()),
+                        OutputFormat));
                     return true;
                   }
                   return false;
@@ -116,8 +167,7 @@ llvmGetPassPluginInfo() {
 //------------------------------------------------------------------------------
 // Helper functions
 //------------------------------------------------------------------------------
-static void printStaticCCResult(raw_ostream &OutS,
-                                const ResultStaticCC &DirectCalls) {
+static void printStaticCCHeader(raw_ostream &OutS) {
   OutS << "================================================="
        << "\n";
   OutS << "LLVM-TUTOR: static analysis results\n";
@@ -127,12 +177,89 @@ static void printStaticCCResult(raw_ostream &OutS,
   OutS << format("%-20s %-10s\n", str1, str2);
   OutS << "-------------------------------------------------"
        << "\n";
+}
 
-  for (auto &CallCount : DirectCalls) {
-    OutS << format("%-20s %-10lu\n", CallCount.first->getName().str().c_str(),
-                   CallCount.second);
-  }
-
+static void printStaticCCFooter(raw_ostream &OutS) {
   OutS << "-------------------------------------------------"
        << "\n\n";
 }
+
+// Prints one row of the results (in any format). The names are padded
+// in place rather than copied into a NUL-terminated string for format().
+static void printStaticCCRow(raw_ostream &OutS, ResultWriter *Writer,
+                             StringRef Name, uint64_t Count) {
+  if (!Writer) {
+    OutS << left_justify(Name, 20) << format(" %-10lu\n", Count);
+    return;
+  }
+  Writer->beginRecord();
+  Writer->attribute("callee", Name);
+  Writer->attribute("calls", Count);
+  Writer->endRecord();
+}
+
+static void printStaticCCResult(raw_ostream &OutS,
+                                const ResultStaticCC &DirectCalls,
+                                ResultFormat Format) {
+  std::optional<ResultWriter> Writer;
+  if (Format == ResultFormat::Text)
+    printStaticCCHeader(OutS);
+  else
+    Writer.emplace(OutS, Format, "static-cc");
+
+  for (auto &CallCount : DirectCalls)
+    printStaticCCRow(OutS, Writer ? &*Writer : nullptr,
+                     CallCount.first->getName(), CallCount.second);
+
+  if (Format == ResultFormat::Text)
+    printStaticCCFooter(OutS);
+}
+
+void printStaticCCResult(raw_ostream &OutS, const NamedResultStaticCC &Result,
+                         ResultFormat Format) {
+  std::optional<ResultWriter> Writer;
+  if (Format == ResultFormat::Text)
+    printStaticCCHeader(OutS);
+  else
+    Writer.emplace(OutS, Format, "static-cc");
+
+  for (auto &CallCount : Result)
+    printStaticCCRow(OutS, Writer ? &*Writer : nullptr, CallCount.first,
+                     CallCount.second);
+
+  if (Format == ResultFormat::Text)
+    printStaticCCFooter(OutS);
+}
+
+// Adds Count calls to Name in Result. Index maps the names in Result to their
+// positions.
+static void addStaticCCCount(NamedResultStaticCC &Result,
+                             StringMap<size_t> &Index, StringRef Name,
+                             unsigned Count) {
+  auto Entry = Index.try_emplace(Name, Result.size());
+  if (Entry.second)
+    Result.emplace_back(Name.str(), 0);
+  Result[Entry.first->second].second += Count;
+}
+
+static StringMap<size_t> indexStaticCCResult(const NamedResultStaticCC &Result) {
+  StringMap<size_t> Index;
+  for (size_t Idx = 0, E = Result.size(); Idx < E; ++Idx)
+    Index[Result[Idx].first] = Idx;
+  return Index;
+}
+
+void mergeStaticCCResult(NamedResultStaticCC &Result,
+                         const ResultStaticCC &DirectCalls) {
+  StringMap<size_t> Index = indexStaticCCResult(Result);
+  for (auto &CallCount : DirectCalls)
+    addStaticCCCount(Result, Index, CallCount.first->getName(),
+                     CallCount.second);
+}
+
+void mergeStaticCCResult(NamedResultStaticCC &Result,
+                         const NamedResultStaticCC &Other) {
+  StringMap<size_t> Index = indexStaticCCResult(Result);
+  for (auto &CallCount : Other)
+    addStaticCCCount(Result, Index, CallCount.first, CallCount.second);
+}
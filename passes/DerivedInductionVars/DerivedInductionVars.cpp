@@ -4,36 +4,164 @@
  * For affine derived IVs (SCEVAddRecExpr && isAffine()), we synthesize
  * `start + step * canonicalIV` directly in the loop header (first non-PHI).
  *
+ * With -derived-iv-mode=strength-reduce, the pass does the opposite: every
+ * multiply (or shift) and GEP in the loop that computes an affine function
+ * of the IV (`a * IV + b`, e.g. a row offset) is replaced with a new header
+ * PHI that starts at `b` and is incremented by `a` in the latch. The
+ * per-iteration multiplies become additions (GEPs become byte-offset GEPs
+ * on a pointer recurrence).
+ *
+ * With -derived-iv-widen, an IV widening stage runs first. For every sext or
+ * zext of an IV in the loop (e.g. a 32-bit counter extended to index a GEP),
+ * SCEV has to prove that the extended value is itself an affine recurrence,
+ * i.e. that the narrow IV doesn't wrap (nsw for sext, nuw for zext). Then
+ * the extensions are replaced with a wide IV and the exit compares are
+ * rewritten in terms of it, so that the narrow IV usually becomes dead.
+ *
+ * All the loops of a function share one SCEVExpander and one expansion
+ * cache, so an expression (e.g. the same start or step) needed by several
+ * PHIs or loops of a nest is only materialized once, provided the first
+ * expansion dominates the later uses. Pass -derived-iv-verbose to print what
+ * the pass finds and does.
+ *
+ * With -derived-iv-min-trip-count=N, the loops that ran fewer than N
+ * iterations per entry (on average, as measured by LoopTripCounter and
+ * attached by `loop-tc-annotate`) are skipped: the new recurrences and
+ * expansions cost more than they save there. Their inner loops are still
+ * processed, and so are the loops without a profile.
+ *
  * Compatible with New Pass Manager
  */
 
+#include "LoopTripCounter.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/IR/Value.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Local.h"
 #include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
 #include "llvm/IR/IRBuilder.h"
 
 using namespace llvm;
 
+#define DEBUG_TYPE "derived-iv"
+
+STATISTIC(NumExpanded, "Number of SCEV expressions expanded");
+STATISTIC(NumExpansionsReused, "Number of SCEV expansions reused");
+STATISTIC(NumSkippedLoops, "Number of loops skipped due to low trip counts");
+
 namespace {
 
+enum class DerivedIVMode {
+  // Rewrite derived IV PHIs as `start + step * canonicalIV`
+  Expand,
+  // Rewrite `a * IV + b` computations as additive recurrences
+  StrengthReduce
+};
+
+cl::opt<DerivedIVMode> IVMode(
+    "derived-iv-mode", cl::desc("The transformation applied by derived-iv"),
+    cl::values(clEnumValN(DerivedIVMode::Expand, "expand",
+                          "Express derived IVs via the canonical IV "
+                          "(default)"),
+               clEnumValN(DerivedIVMode::StrengthReduce, "strength-reduce",
+                          "Replace multiplies of IVs with additive "
+                          "recurrences")),
+    cl::init(DerivedIVMode::Expand));
+
+cl::opt<bool> WidenIVs(
+    "derived-iv-widen",
+    cl::desc("Widen the IVs that are sign/zero-extended in the loop (if SCEV "
+             "can prove that they don't overflow)"),
+    cl::init(false));
+
+cl::opt<unsigned> MinTripCount(
+    "derived-iv-min-trip-count",
+    cl::desc("Skip the loops that ran fewer than this many iterations per "
+             "entry on average (see loop-tc-annotate; 0 disables the check)"),
+    cl::init(0));
+
+cl::opt<bool> Verbose("derived-iv-verbose",
+                      cl::desc("Print the loops and IVs processed by "
+                               "derived-iv to stderr"),
+                      cl::init(false));
+
+raw_ostream& log(unsigned Indent = 0) {
+  return Verbose ? errs().indent(Indent) : nulls();
+}
+
+// Materializes SCEV expressions for a whole function with one expander. An
+// expression that has already been expanded (for another PHI or another loop)
+// is reused when the earlier expansion dominates the new insertion point.
+class ExpansionCache {
+ public:
+  ExpansionCache(ScalarEvolution& SE, DominatorTree& DT, const DataLayout& DL,
+                 bool CanonicalMode)
+      : Expander(SE, DL, "iv.expanded"), DT(DT) {
+    if (!CanonicalMode) Expander.disableCanonicalMode();
+  }
+
+  Value* expand(const SCEV* S, Type* Ty, Instruction* InsertPt) {
+    SmallVector<WeakTrackingVH, 2>& Expansions = Cache[{S, Ty}];
+    for (WeakTrackingVH& VH : Expansions) {
+      auto* I = dyn_cast_or_null<Instruction>(VH);
+      if (I && DT.dominates(I, InsertPt)) {
+        ++NumExpansionsReused;
+        return I;
+      }
+    }
+
+    Value* V = Expander.expandCodeFor(S, Ty, InsertPt);
+    ++NumExpanded;
+    // Constants and arguments are free to "expand" again
+    if (isa<Instruction>(V)) Expansions.emplace_back(V);
+    return V;
+  }
+
+  SCEVExpander& getExpander() { return Expander; }
+
+ private:
+  SCEVExpander Expander;
+  DominatorTree& DT;
+  DenseMap<std::pair<const SCEV*, Type*>, SmallVector<WeakTrackingVH, 2>>
+      Cache;
+};
+
 class DerivedInductionVars : public PassInfoMixin<DerivedInductionVars> {
  public:
   PreservedAnalyses run(Function& F, FunctionAnalysisManager& AM) {
-    errs() << "--- DerivedInductionVar Pass START ---\n";
+    log() << "--- DerivedInductionVar Pass START ---\n";
     auto& LI = AM.getResult<LoopAnalysis>(F);
     auto& SE = AM.getResult<ScalarEvolutionAnalysis>(F);
+    auto& DT = AM.getResult<DominatorTreeAnalysis>(F);
 
     bool changed = false;
-    for (Loop* L : LI) {
-      if (analyzeLoopRecursively(L, SE)) changed = true;
+    SmallVector<WeakTrackingVH, 8> NewRecs;
+    {
+      ExpansionCache Cache(SE, DT, F.getParent()->getDataLayout(),
+                           /*CanonicalMode=*/IVMode == DerivedIVMode::Expand);
+      for (Loop* L : LI) {
+        if (analyzeLoopRecursively(L, SE, Cache, NewRecs)) changed = true;
+      }
+    }
+
+    // A recurrence is dead if the instruction that it replaced was only used
+    // by other candidates (e.g. a GEP feeding another GEP). These are deleted
+    // once the expander is gone, as that may delete expanded values too.
+    for (WeakTrackingVH& Rec : NewRecs) {
+      if (auto* PN = dyn_cast_or_null<PHINode>(Rec))
+        RecursivelyDeleteDeadPHINode(PN);
     }
 
     if (changed) {
@@ -43,9 +171,11 @@ class DerivedInductionVars : public PassInfoMixin<DerivedInductionVars> {
     }
   }
 
-  bool analyzeLoopRecursively(Loop* L, ScalarEvolution& SE) {
-    errs().indent(L->getLoopDepth() * 2);
-    errs() << "Analyzing Loop: " << L->getHeader()->getName() << "\n";
+  bool analyzeLoopRecursively(Loop* L, ScalarEvolution& SE,
+                              ExpansionCache& Cache,
+                              SmallVectorImpl<WeakTrackingVH>& NewRecs) {
+    log(L->getLoopDepth() * 2)
+        << "Analyzing Loop: " << L->getHeader()->getName() << "\n";
     bool loop_flag = false;
 
     SmallVector<PHINode*, 8> DeadPHIs;
@@ -53,11 +183,20 @@ class DerivedInductionVars : public PassInfoMixin<DerivedInductionVars> {
     BasicBlock* Header = L->getHeader();
     if (!Header) return false;
 
+    if (isBelowMinTripCount(*L, MinTripCount)) {
+      log(L->getLoopDepth() * 2 + 2)
+          << "Low trip count; skipping loop: " << Header->getName() << "\n";
+      ++NumSkippedLoops;
+      for (auto* SubLoop : L->getSubLoops())
+        loop_flag |= analyzeLoopRecursively(SubLoop, SE, Cache, NewRecs);
+      return loop_flag;
+    }
+
     Instruction* HeaderInsert = Header->getFirstNonPHI();
     if (!HeaderInsert) {
-      errs().indent(L->getLoopDepth() * 2 + 2);
-      errs() << "Header has no non-PHI instruction; skipping loop: "
-             << Header->getName() << "\n";
+      log(L->getLoopDepth() * 2 + 2)
+          << "Header has no non-PHI instruction; skipping loop: "
+          << Header->getName() << "\n";
       return false;
     }
 
@@ -67,7 +206,17 @@ class DerivedInductionVars : public PassInfoMixin<DerivedInductionVars> {
     if (Preheader)
       PreheaderInsert = Preheader->getTerminator();
 
-    SCEVExpander Expander(SE, Header->getModule()->getDataLayout(), "iv.expanded");
+    if (WidenIVs) loop_flag |= widenIVs(L, SE, Cache);
+
+    if (IVMode == DerivedIVMode::StrengthReduce) {
+      // The expander isn't in the canonical mode here, so the start values
+      // that are recurrences of the outer loops are expanded as recurrences
+      // too (rather than via a canonical IV and a multiply)
+      loop_flag |= strengthReduce(L, SE, Cache, NewRecs);
+      for (auto* SubLoop : L->getSubLoops())
+        loop_flag |= analyzeLoopRecursively(SubLoop, SE, Cache, NewRecs);
+      return loop_flag;
+    }
 
     for (PHINode& PN : Header->phis()) {
       if (!PN.getType()->isIntegerTy()) continue;
@@ -82,18 +231,28 @@ class DerivedInductionVars : public PassInfoMixin<DerivedInductionVars> {
 
           PHINode* BasicIV = L->getCanonicalInductionVariable();
           if (!BasicIV) {
-            errs().indent(L->getLoopDepth() * 2 + 2);
-            errs() << "No canonical IV; skipping: " << PN.getName() << "\n";
+            log(L->getLoopDepth() * 2 + 2)
+                << "No canonical IV; skipping: " << PN.getName() << "\n";
+            continue;
+          }
+
+          // After widening, the canonical IV can be wider than PN (truncating
+          // it is fine, the arithmetic is modular), but not narrower
+          if (BasicIV->getType()->getIntegerBitWidth() <
+              PN.getType()->getIntegerBitWidth()) {
+            log(L->getLoopDepth() * 2 + 2)
+                << "Canonical IV is too narrow; skipping: " << PN.getName()
+                << "\n";
             continue;
           }
 
           const SCEV* BasicIV_SCEV = SE.getSCEV(BasicIV);
           const SCEV* DerivedIV_SCEV = S;
 
-          if (!Expander.isSafeToExpand(DerivedIV_SCEV) ||
+          if (!Cache.getExpander().isSafeToExpand(DerivedIV_SCEV) ||
               DerivedIV_SCEV == BasicIV_SCEV) {
-            errs().indent(L->getLoopDepth() * 2 + 2);
-            errs() << "Skipping unsafe-to-expand IV: " << PN.getName() << "\n";
+            log(L->getLoopDepth() * 2 + 2)
+                << "Skipping unsafe-to-expand IV: " << PN.getName() << "\n";
             continue;
           }
 
@@ -109,24 +268,26 @@ class DerivedInductionVars : public PassInfoMixin<DerivedInductionVars> {
 
           if (!StartVal || !StepVal) {
             if (!PreheaderInsert) {
-              errs().indent(L->getLoopDepth() * 2 + 2);
-              errs() << "No preheader available to materialize non-constant start/step; skipping: "
-                     << PN.getName() << "\n";
+              log(L->getLoopDepth() * 2 + 2)
+                  << "No preheader available to materialize non-constant start/step; skipping: "
+                  << PN.getName() << "\n";
               continue;
             }
             if (!StartVal) {
-              StartVal = Expander.expandCodeFor(StartSCEV, PN.getType(), PreheaderInsert);
+              StartVal = Cache.expand(StartSCEV, PN.getType(), PreheaderInsert);
               if (!StartVal) {
-                errs().indent(L->getLoopDepth() * 2 + 2);
-                errs() << "Failed to materialize Start for: " << PN.getName() << "\n";
+                log(L->getLoopDepth() * 2 + 2)
+                    << "Failed to materialize Start for: " << PN.getName()
+                    << "\n";
                 continue;
               }
             }
             if (!StepVal) {
-              StepVal = Expander.expandCodeFor(StepSCEV, PN.getType(), PreheaderInsert);
+              StepVal = Cache.expand(StepSCEV, PN.getType(), PreheaderInsert);
               if (!StepVal) {
-                errs().indent(L->getLoopDepth() * 2 + 2);
-                errs() << "Failed to materialize Step for: " << PN.getName() << "\n";
+                log(L->getLoopDepth() * 2 + 2)
+                    << "Failed to materialize Step for: " << PN.getName()
+                    << "\n";
                 continue;
               }
             }
@@ -134,7 +295,8 @@ class DerivedInductionVars : public PassInfoMixin<DerivedInductionVars> {
 
           IRBuilder<> B(HeaderInsert);
 
-          Value *Mul = B.CreateMul(BasicIV, StepVal, PN.getName() + ".stepmul");
+          Value *IV = B.CreateTruncOrBitCast(BasicIV, PN.getType());
+          Value *Mul = B.CreateMul(IV, StepVal, PN.getName() + ".stepmul");
           Value *NewVal = B.CreateAdd(StartVal, Mul, PN.getName() + ".expanded");
 
           PN.replaceAllUsesWith(NewVal);
@@ -142,9 +304,9 @@ class DerivedInductionVars : public PassInfoMixin<DerivedInductionVars> {
           DeadPHIs.push_back(&PN);
           loop_flag = true;
 
-          errs().indent(L->getLoopDepth() * 2 + 2);
-          errs() << "Found Derived IV: " << PN.getName() << " = {" << *StartSCEV
-                 << ",+, " << *StepSCEV << "}\n";
+          log(L->getLoopDepth() * 2 + 2)
+              << "Found Derived IV: " << PN.getName() << " = {" << *StartSCEV
+              << ",+, " << *StepSCEV << "}\n";
         }
       }
     }
@@ -153,10 +315,230 @@ class DerivedInductionVars : public PassInfoMixin<DerivedInductionVars> {
       Dead->eraseFromParent();
     }
 
-    for (auto* SubLoop : L->getSubLoops()) analyzeLoopRecursively(SubLoop, SE);
+    for (auto* SubLoop : L->getSubLoops())
+      loop_flag |= analyzeLoopRecursively(SubLoop, SE, Cache, NewRecs);
 
     return loop_flag;
   }
+
+  // A wide copy of a narrow IV: {ext(start),+,ext(step)}
+  struct WideIV {
+    PHINode* Phi = nullptr;
+    Value* Next = nullptr;
+    const SCEV* PhiSCEV = nullptr;
+    const SCEV* NextSCEV = nullptr;
+  };
+
+  // Replaces the sign/zero extensions of the header PHIs of L (and of their
+  // increments) with wide IVs, where SCEV proves that to be equivalent.
+  bool widenIVs(Loop* L, ScalarEvolution& SE, ExpansionCache& Cache) {
+    BasicBlock* Header = L->getHeader();
+    BasicBlock* Preheader = L->getLoopPreheader();
+    BasicBlock* Latch = L->getLoopLatch();
+    if (!Preheader || !Latch) return false;
+    Instruction* PreheaderInsert = Preheader->getTerminator();
+
+    SmallVector<PHINode*, 4> NarrowIVs;
+    for (PHINode& PN : Header->phis()) {
+      auto* AR = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(&PN));
+      if (PN.getType()->isIntegerTy() && AR && AR->getLoop() == L &&
+          AR->isAffine())
+        NarrowIVs.push_back(&PN);
+    }
+
+    bool Changed = false;
+    for (PHINode* PN : NarrowIVs) {
+      auto* AR = cast<SCEVAddRecExpr>(SE.getSCEV(PN));
+      Value* Next = PN->getIncomingValueForBlock(Latch);
+
+      // Only one wide type per IV is handled, so that the compares below can
+      // be rewritten in terms of it. The wide IV is materialized on first use.
+      WideIV W;
+      Type* WideTy = nullptr;
+      bool Signed = false;
+      const SCEV* WideStart = nullptr;
+      const SCEV* WideStep = nullptr;
+      auto SetWideType = [&](Type* Ty, bool IsSigned) {
+        WideTy = Ty;
+        Signed = IsSigned;
+        auto Extend = [&](const SCEV* S) {
+          return Signed ? SE.getSignExtendExpr(S, WideTy)
+                        : SE.getZeroExtendExpr(S, WideTy);
+        };
+        WideStart = Extend(AR->getStart());
+        WideStep = Extend(AR->getStepRecurrence(SE));
+        W.PhiSCEV = SE.getAddRecExpr(WideStart, WideStep, L, SCEV::FlagAnyWrap);
+        W.NextSCEV = SE.getAddExpr(W.PhiSCEV, WideStep);
+      };
+      auto Materialize = [&]() {
+        if (W.Phi) return;
+        Value* StartVal = Cache.expand(WideStart, WideTy,
+                                                 PreheaderInsert);
+        Value* StepVal = Cache.expand(WideStep, WideTy,
+                                                PreheaderInsert);
+        IRBuilder<> HeaderBuilder(Header, Header->begin());
+        W.Phi = HeaderBuilder.CreatePHI(WideTy, 2, PN->getName() + ".wide");
+        // Right after the narrow increment, so that it dominates the same
+        // users (e.g. the exit compare)
+        auto* NextInst = dyn_cast<Instruction>(Next);
+        Instruction* NextPos = (NextInst && !isa<PHINode>(NextInst))
+                                   ? NextInst->getNextNode()
+                                   : Latch->getTerminator();
+        IRBuilder<> LatchBuilder(NextPos);
+        W.Next = LatchBuilder.CreateAdd(W.Phi, StepVal,
+                                        PN->getName() + ".wide.next");
+        W.Phi->addIncoming(StartVal, Preheader);
+        W.Phi->addIncoming(W.Next, Latch);
+      };
+
+      // Replace the extensions. The SCEV of an extension is only an add
+      // recurrence when the extended value is known not to wrap.
+      SmallVector<CastInst*, 8> Exts;
+      for (Value* V : {static_cast<Value*>(PN), Next}) {
+        for (User* U : V->users()) {
+          auto* Ext = dyn_cast<CastInst>(U);
+          if (Ext && (isa<SExtInst>(Ext) || isa<ZExtInst>(Ext)) &&
+              L->contains(Ext))
+            Exts.push_back(Ext);
+        }
+      }
+
+      for (CastInst* Ext : Exts) {
+        const SCEV* ExtSCEV = SE.getSCEV(Ext);
+        auto* ExtAR = dyn_cast<SCEVAddRecExpr>(ExtSCEV);
+        if (!ExtAR || ExtAR->getLoop() != L) continue;
+        if (!W.Phi) SetWideType(Ext->getType(), isa<SExtInst>(Ext));
+        if (WideTy != Ext->getType() || Signed != isa<SExtInst>(Ext)) continue;
+
+        bool IsNext = (ExtSCEV == W.NextSCEV);
+        if (!IsNext && ExtSCEV != W.PhiSCEV) continue;
+        Materialize();
+        Value* Replacement = IsNext ? W.Next : static_cast<Value*>(W.Phi);
+
+        log(L->getLoopDepth() * 2 + 2) << "Widened: " << *Ext << "\n";
+        SE.forgetValue(Ext);
+        Ext->replaceAllUsesWith(Replacement);
+        Ext->eraseFromParent();
+        Changed = true;
+      }
+
+      if (!W.Phi) continue;
+
+      // Rewrite the compares of the narrow IV against loop-invariant values
+      // (typically the exit condition). sext preserves both the signed and
+      // the unsigned order, zext only the unsigned one.
+      for (Value* V : {static_cast<Value*>(PN), Next}) {
+        const SCEV* NarrowSCEV = SE.getSCEV(V);
+        const SCEV* WideSCEV = (V == PN) ? W.PhiSCEV : W.NextSCEV;
+        const SCEV* ExtNarrow = Signed
+                                    ? SE.getSignExtendExpr(NarrowSCEV, WideTy)
+                                    : SE.getZeroExtendExpr(NarrowSCEV, WideTy);
+        if (ExtNarrow != WideSCEV) continue;
+        Value* WideV = (V == PN) ? static_cast<Value*>(W.Phi) : W.Next;
+
+        for (User* U : make_early_inc_range(V->users())) {
+          auto* Cmp = dyn_cast<ICmpInst>(U);
+          if (!Cmp || !L->contains(Cmp)) continue;
+          if (!Signed && Cmp->isSigned()) continue;
+
+          unsigned NarrowIdx = (Cmp->getOperand(0) == V) ? 0 : 1;
+          Value* Other = Cmp->getOperand(1 - NarrowIdx);
+          if (!L->isLoopInvariant(Other)) continue;
+
+          IRBuilder<> Builder(PreheaderInsert);
+          Value* WideOther = Signed
+                                 ? Builder.CreateSExt(Other, WideTy)
+                                 : Builder.CreateZExt(Other, WideTy);
+          Cmp->setOperand(NarrowIdx, WideV);
+          Cmp->setOperand(1 - NarrowIdx, WideOther);
+          SE.forgetValue(Cmp);
+        }
+      }
+
+      // The narrow IV is dead unless it has other users
+      SE.forgetValue(PN);
+      RecursivelyDeleteDeadPHINode(PN);
+    }
+
+    return Changed;
+  }
+
+  // Replaces the multiplies/shifts and GEPs in L that compute {b,+,a}<L> with
+  // a new recurrence: PHI [b, preheader], [PHI + a, latch].
+  bool strengthReduce(Loop* L, ScalarEvolution& SE, ExpansionCache& Cache,
+                      SmallVectorImpl<WeakTrackingVH>& NewRecs) {
+    BasicBlock* Header = L->getHeader();
+    BasicBlock* Preheader = L->getLoopPreheader();
+    BasicBlock* Latch = L->getLoopLatch();
+    if (!Preheader || !Latch) {
+      log(L->getLoopDepth() * 2 + 2)
+          << "No preheader or no single latch; skipping loop: "
+          << Header->getName() << "\n";
+      return false;
+    }
+    Instruction* PreheaderInsert = Preheader->getTerminator();
+    const DataLayout& DL = Header->getModule()->getDataLayout();
+
+    // Collect the candidates first - the rewrites below change the SCEVs
+    SmallVector<std::pair<Instruction*, const SCEVAddRecExpr*>, 8> Candidates;
+    for (BasicBlock* BB : L->blocks()) {
+      for (Instruction& I : *BB) {
+        bool IsMul = I.getOpcode() == Instruction::Mul ||
+                     I.getOpcode() == Instruction::Shl;
+        bool IsGEP = isa<GetElementPtrInst>(I) &&
+                     !cast<GetElementPtrInst>(I).hasAllConstantIndices();
+        if (!(IsMul && I.getType()->isIntegerTy()) && !IsGEP) continue;
+        if (!SE.isSCEVable(I.getType())) continue;
+
+        auto* AR = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(&I));
+        if (!AR || AR->getLoop() != L || !AR->isAffine()) continue;
+        if (AR->getStepRecurrence(SE)->isZero()) continue;
+        SCEVExpander& Expander = Cache.getExpander();
+        if (!Expander.isSafeToExpandAt(AR->getStart(), PreheaderInsert) ||
+            !Expander.isSafeToExpandAt(AR->getStepRecurrence(SE),
+                                       PreheaderInsert))
+          continue;
+
+        Candidates.emplace_back(&I, AR);
+      }
+    }
+
+    bool Changed = false;
+    for (auto [I, AR] : Candidates) {
+      // The step of a pointer recurrence is a byte offset
+      Type* Ty = I->getType();
+      Type* StepTy = Ty->isPointerTy() ? DL.getIndexType(Ty) : Ty;
+      Value* StartVal = Cache.expand(AR->getStart(), Ty,
+                                               PreheaderInsert);
+      Value* StepVal = Cache.expand(AR->getStepRecurrence(SE),
+                                              StepTy, PreheaderInsert);
+
+      IRBuilder<> HeaderBuilder(Header, Header->begin());
+      PHINode* Rec = HeaderBuilder.CreatePHI(Ty, 2, I->getName() + ".sr");
+      IRBuilder<> LatchBuilder(Latch->getTerminator());
+      Value* Next =
+          Ty->isPointerTy()
+              ? LatchBuilder.CreateGEP(LatchBuilder.getInt8Ty(), Rec, StepVal,
+                                       I->getName() + ".sr.next")
+              : LatchBuilder.CreateAdd(Rec, StepVal, I->getName() + ".sr.next");
+      Rec->addIncoming(StartVal, Preheader);
+      Rec->addIncoming(Next, Latch);
+
+      raw_ostream& OS = log(L->getLoopDepth() * 2 + 2);
+      OS << "Strength-reduced: ";
+      I->printAsOperand(OS, /*PrintType=*/false);
+      OS << " = {" << *AR->getStart() << ",+, "
+             << *AR->getStepRecurrence(SE) << "}\n";
+
+      SE.forgetValue(I);
+      I->replaceAllUsesWith(Rec);
+      RecursivelyDeleteTriviallyDeadInstructions(I);
+      NewRecs.push_back(Rec);
+      Changed = true;
+    }
+
+    return Changed;
+  }
 };
 
 }  // namespace
@@ -0,0 +1,604 @@
+/* LoopTiling.cpp
+ *
+ * This pass interchanges and tiles perfectly nested loops (e.g. the i-j-k
+ * nest of a matrix multiplication) to improve the locality of the memory
+ * accesses.
+ *
+ * A nest is handled when:
+ *   * every loop is in the rotated form that clang emits (with mem2reg and
+ *     loop-simplify): the latch is the only exiting block and the IV is
+ *     `{start,+,step}` with a constant step > 0, incremented in the latch and
+ *     compared (slt/ult) against a bound,
+ *   * the starts and the bounds of all the IVs are invariant in the whole
+ *     nest, i.e. the iteration space is rectangular,
+ *   * apart from the IV updates, all the code is in the innermost loop, it
+ *     only accesses memory via simple loads and stores, and none of its
+ *     values is used outside of the nest.
+ *
+ * Interchange: the loop that gives the innermost loop the fewest non-unit
+ * stride memory accesses is moved innermost, provided DependenceAnalysis
+ * shows that the new order preserves every dependence. As the nest is
+ * rectangular, this is done by permuting the ranges (start, step, bound) of
+ * the loops and the IVs used by the body - the CFG is unchanged.
+ *
+ * Tiling: if every dependence is carried forward (or not at all) by every
+ * loop of the nest, each loop is strip-mined by -loop-tile-size iterations
+ * and the new tile loops are placed around the nest:
+ *
+ *   for (ii = start; ii < N; ii += T * step)               <- new
+ *     ...
+ *       for (i = ii; i < min(ii + T * step, N); i += step)  <- original
+ *
+ * Compatible with New Pass Manager
+ *
+ * Usage:
+ *   opt -load-pass-plugin libLoopTiling.so -passes='loop-simplify,loop-tile' \
+ *     -loop-tile-size=32 -S <input-file>
+ *   # Add -debug-only=loop-tile (with an assertions-enabled LLVM) to see
+ *   # which nests are interchanged and tiled (or why not)
+ */
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/DependenceAnalysis.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+
+#define DEBUG_TYPE "loop-tile"
+
+using namespace llvm;
+
+STATISTIC(NumInterchanged, "Number of loop nests interchanged");
+STATISTIC(NumTiled, "Number of loops tiled");
+
+namespace {
+
+cl::opt<unsigned> TileSize(
+    "loop-tile-size",
+    cl::desc("The number of iterations of every loop in a tile (0 disables "
+             "tiling)"),
+    cl::init(32));
+
+cl::opt<bool> EnableInterchange(
+    "loop-tile-interchange",
+    cl::desc("Interchange the loops of a nest to make the innermost memory "
+             "accesses unit-stride"),
+    cl::init(true));
+
+// Deeper nests aren't worth enumerating the dependence directions for
+constexpr unsigned MaxNestDepth = 8;
+
+// The control of one loop of a nest:
+//   header: IV = phi [Start, Preheader], [Next, Latch]
+//   latch:  Next = add IV, Step
+//           br (icmp Pred Next, Bound), header, Exit
+struct LoopControl {
+  Loop* L;
+  BasicBlock* Preheader;
+  BasicBlock* Latch;
+  BasicBlock* Exit;
+  PHINode* IV;
+  BinaryOperator* Next;
+  ICmpInst* Cmp;
+  Value* Start;
+  ConstantInt* Step;
+  Value* Bound;
+  ICmpInst::Predicate Pred;
+  // Of the range above (0 if unknown)
+  unsigned TripCount = 0;
+};
+
+// What to do with one nest (decided before any nest is transformed)
+struct NestPlan {
+  SmallVector<LoopControl, 4> Nest;
+  // Order[Q] is the (original) loop whose range and IV are used at depth Q
+  SmallVector<unsigned, 4> Order;
+  bool Tile = false;
+};
+
+// Sign of every component of a dependence distance vector
+using DistanceSigns = SmallVector<int, 8>;
+
+bool isSimpleLoadOrStore(const Instruction& I) {
+  if (auto* LI = dyn_cast<LoadInst>(&I)) return LI->isSimple();
+  if (auto* SI = dyn_cast<StoreInst>(&I)) return SI->isSimple();
+  return false;
+}
+
+// The sign of the first non-zero component (0 if there's none)
+int getLexicographicSign(ArrayRef<int> Signs) {
+  for (int S : Signs)
+    if (S) return S;
+  return 0;
+}
+
+class LoopTiling : public PassInfoMixin<LoopTiling> {
+ public:
+  PreservedAnalyses run(Function& F, FunctionAnalysisManager& AM) {
+    auto& LI = AM.getResult<LoopAnalysis>(F);
+    auto& SE = AM.getResult<ScalarEvolutionAnalysis>(F);
+    auto& DI = AM.getResult<DependenceAnalysis>(F);
+    const DataLayout& DL = F.getParent()->getDataLayout();
+
+    // Plan everything first - the transformations invalidate LoopInfo and
+    // ScalarEvolution
+    SmallVector<NestPlan, 4> Plans;
+    SmallPtrSet<const Loop*, 8> InNest;
+    for (Loop* L : LI.getLoopsInPreorder()) {
+      if (InNest.count(L)) continue;
+      std::optional<SmallVector<LoopControl, 4>> Nest = getPerfectNest(L);
+      if (!Nest) continue;
+      for (const LoopControl& C : *Nest) InNest.insert(C.L);
+
+      NestPlan Plan;
+      Plan.Nest = std::move(*Nest);
+      if (planNest(Plan, SE, DI, DL)) Plans.push_back(std::move(Plan));
+    }
+
+    for (NestPlan& Plan : Plans) {
+      if (!isIdentity(Plan.Order)) {
+        permuteLoops(Plan.Nest, Plan.Order);
+        ++NumInterchanged;
+      }
+      if (Plan.Tile) tileNest(F, Plan.Nest, SE);
+    }
+
+    return Plans.empty() ? PreservedAnalyses::all() : PreservedAnalyses::none();
+  }
+
+ private:
+  // Recognises the control of L. Start and Bound have to be invariant in
+  // Outermost (the outermost loop of the nest).
+  std::optional<LoopControl> getLoopControl(Loop* L, Loop* Outermost) {
+    LoopControl C;
+    C.L = L;
+    C.Preheader = L->getLoopPreheader();
+    C.Latch = L->getLoopLatch();
+    C.Exit = L->getExitBlock();
+    if (!C.Preheader || !C.Latch || !C.Exit ||
+        L->getExitingBlock() != C.Latch)
+      return std::nullopt;
+
+    // The IV has to be the only PHI (there are no other values carried
+    // between the iterations of a perfect nest)
+    BasicBlock* Header = L->getHeader();
+    auto PHIs = Header->phis();
+    if (std::distance(PHIs.begin(), PHIs.end()) != 1) return std::nullopt;
+    C.IV = &*PHIs.begin();
+    if (!C.IV->getType()->isIntegerTy()) return std::nullopt;
+
+    C.Next = dyn_cast<BinaryOperator>(C.IV->getIncomingValueForBlock(C.Latch));
+    if (!C.Next || C.Next->getOpcode() != Instruction::Add ||
+        C.Next->getOperand(0) != C.IV)
+      return std::nullopt;
+    C.Step = dyn_cast<ConstantInt>(C.Next->getOperand(1));
+    if (!C.Step || !C.Step->getValue().isStrictlyPositive())
+      return std::nullopt;
+
+    auto* Br = dyn_cast<BranchInst>(C.Latch->getTerminator());
+    if (!Br || !Br->isConditional() || Br->getSuccessor(0) != Header)
+      return std::nullopt;
+    C.Cmp = dyn_cast<ICmpInst>(Br->getCondition());
+    if (!C.Cmp || C.Cmp->getOperand(0) != C.Next) return std::nullopt;
+    C.Pred = C.Cmp->getPredicate();
+    if (C.Pred != ICmpInst::ICMP_SLT && C.Pred != ICmpInst::ICMP_ULT)
+      return std::nullopt;
+
+    // The update and the compare are only used by the loop control
+    if (!C.Next->hasNUses(2) || !C.Cmp->hasOneUse()) return std::nullopt;
+
+    C.Start = C.IV->getIncomingValueForBlock(C.Preheader);
+    C.Bound = C.Cmp->getOperand(1);
+    if (!Outermost->isLoopInvariant(C.Start) ||
+        !Outermost->isLoopInvariant(C.Bound))
+      return std::nullopt;
+
+    return C;
+  }
+
+  // Returns the perfect nest rooted at Outermost (at least 2 loops deep)
+  std::optional<SmallVector<LoopControl, 4>> getPerfectNest(Loop* Outermost) {
+    SmallVector<LoopControl, 4> Nest;
+    for (Loop* L = Outermost;;) {
+      std::optional<LoopControl> C = getLoopControl(L, Outermost);
+      if (!C) {
+        LLVM_DEBUG(dbgs() << "loop-tile: unsupported loop control in "
+                          << L->getHeader()->getName() << "\n");
+        return std::nullopt;
+      }
+      Nest.push_back(*C);
+      if (L->getSubLoops().empty()) break;
+      if (L->getSubLoops().size() != 1) return std::nullopt;
+
+      // Only the loop control may be outside of the inner loop
+      Loop* Inner = L->getSubLoops().front();
+      for (BasicBlock* BB : L->blocks()) {
+        if (Inner->contains(BB)) continue;
+        for (Instruction& I : *BB) {
+          if (&I == C->IV || &I == C->Next || &I == C->Cmp ||
+              isa<BranchInst>(I))
+            continue;
+          LLVM_DEBUG(dbgs() << "loop-tile: not perfectly nested: " << I
+                            << "\n");
+          return std::nullopt;
+        }
+      }
+      L = Inner;
+    }
+    if (Nest.size() < 2 || Nest.size() > MaxNestDepth) return std::nullopt;
+
+    Loop* Innermost = Nest.back().L;
+    for (BasicBlock* BB : Innermost->blocks()) {
+      for (Instruction& I : *BB) {
+        if (I.mayReadOrWriteMemory() && !isSimpleLoadOrStore(I))
+          return std::nullopt;
+        if (I.mayThrow()) return std::nullopt;
+        // The last iteration changes, so nothing may be used after the nest
+        for (User* U : I.users())
+          if (!Outermost->contains(cast<Instruction>(U))) return std::nullopt;
+      }
+    }
+
+    return Nest;
+  }
+
+  // Picks the loop order and checks whether tiling is legal. Returns false
+  // if there's nothing to do.
+  bool planNest(NestPlan& Plan, ScalarEvolution& SE, DependenceInfo& DI,
+                const DataLayout& DL) {
+    MutableArrayRef<LoopControl> Nest = Plan.Nest;
+    unsigned Depth = Nest.size();
+    for (unsigned Q = 0; Q < Depth; ++Q) Plan.Order.push_back(Q);
+    for (LoopControl& C : Plan.Nest)
+      C.TripCount = SE.getSmallConstantTripCount(C.L);
+
+    SmallVector<Instruction*, 8> MemInsts;
+    for (BasicBlock* BB : Nest.back().L->blocks())
+      for (Instruction& I : *BB)
+        if (isa<LoadInst>(I) || isa<StoreInst>(I)) MemInsts.push_back(&I);
+
+    std::optional<SmallVector<DistanceSigns, 16>> Distances =
+        getDependenceDistances(Nest, MemInsts, DI);
+    if (!Distances) {
+      LLVM_DEBUG(dbgs() << "loop-tile: unknown dependences in the nest at "
+                        << Nest.front().L->getHeader()->getName() << "\n");
+      return false;
+    }
+
+    if (EnableInterchange && allIVsHaveSameType(Nest)) {
+      SmallVector<unsigned, 4> Order =
+          getBetterOrder(Nest, MemInsts, SE, DL);
+      if (!isIdentity(Order)) {
+        if (isLegalOrder(*Distances, Order, Nest.front().L->getLoopDepth())) {
+          Plan.Order = Order;
+          LLVM_DEBUG(dbgs() << "loop-tile: interchanging the nest at "
+                            << Nest.front().L->getHeader()->getName()
+                            << "\n");
+        } else {
+          LLVM_DEBUG(dbgs() << "loop-tile: interchange would break a "
+                               "dependence\n");
+        }
+      }
+    }
+
+    if (TileSize > 1) {
+      Plan.Tile =
+          isFullyPermutable(*Distances, Nest.front().L->getLoopDepth());
+      LLVM_DEBUG(if (!Plan.Tile) dbgs()
+                 << "loop-tile: the nest isn't fully permutable\n");
+    }
+
+    return Plan.Tile || !isIdentity(Plan.Order);
+  }
+
+  static bool isIdentity(ArrayRef<unsigned> Order) {
+    for (unsigned Q = 0; Q < Order.size(); ++Q)
+      if (Order[Q] != Q) return false;
+    return true;
+  }
+
+  static bool allIVsHaveSameType(ArrayRef<LoopControl> Nest) {
+    for (const LoopControl& C : Nest)
+      if (C.IV->getType() != Nest.front().IV->getType()) return false;
+    return true;
+  }
+
+  // Enumerates the distance vectors (as signs, one per loop enclosing the
+  // innermost loop) that DependenceAnalysis allows between the memory
+  // accesses. DA describes these by a set of directions per level, so the
+  // vectors are their cartesian product. The signs are the ones of
+  // iteration(Dst) - iteration(Src), where Src precedes Dst in the body.
+  // Returns std::nullopt if a dependence can't be analysed.
+  std::optional<SmallVector<DistanceSigns, 16>> getDependenceDistances(
+      ArrayRef<LoopControl> Nest, ArrayRef<Instruction*> MemInsts,
+      DependenceInfo& DI) {
+    unsigned Levels = Nest.back().L->getLoopDepth();
+    SmallVector<DistanceSigns, 16> Distances;
+    for (unsigned I = 0; I < MemInsts.size(); ++I) {
+      for (unsigned J = I; J < MemInsts.size(); ++J) {
+        Instruction* Src = MemInsts[I];
+        Instruction* Dst = MemInsts[J];
+        if (!isa<StoreInst>(Src) && !isa<StoreInst>(Dst)) continue;
+
+        std::unique_ptr<Dependence> D = DI.depends(Src, Dst);
+        if (!D) continue;
+        if (D->isConfused() || D->getLevels() != Levels) return std::nullopt;
+
+        SmallVector<DistanceSigns, 16> Partial(1);
+        for (unsigned Level = 1; Level <= Levels; ++Level) {
+          unsigned Dir = D->getDirection(Level);
+          SmallVector<DistanceSigns, 16> Extended;
+          for (const DistanceSigns& Prefix : Partial) {
+            for (auto [Bit, Sign] : {std::pair{Dependence::DVEntry::LT, 1},
+                                     std::pair{Dependence::DVEntry::EQ, 0},
+                                     std::pair{Dependence::DVEntry::GT, -1}}) {
+              if (!(Dir & Bit)) continue;
+              Extended.push_back(Prefix);
+              Extended.back().push_back(Sign);
+            }
+          }
+          Partial = std::move(Extended);
+        }
+        Distances.append(Partial.begin(), Partial.end());
+      }
+    }
+    return Distances;
+  }
+
+  // Is executing the loops in Order (at the depths of the nest, starting at
+  // NestDepth) consistent with every dependence, i.e. does every pair of
+  // dependent accesses run in the same order as before?
+  static bool isLegalOrder(ArrayRef<DistanceSigns> Distances,
+                           ArrayRef<unsigned> Order, unsigned NestDepth) {
+    for (const DistanceSigns& Signs : Distances) {
+      DistanceSigns Permuted(Signs.begin(), Signs.end());
+      for (unsigned Q = 0; Q < Order.size(); ++Q)
+        Permuted[NestDepth - 1 + Q] = Signs[NestDepth - 1 + Order[Q]];
+      if (getLexicographicSign(Permuted) != getLexicographicSign(Signs))
+        return false;
+    }
+    return true;
+  }
+
+  // Tiling is legal if no dependence (that isn't carried by a loop outside of
+  // the nest) goes backwards in any loop of the nest
+  static bool isFullyPermutable(ArrayRef<DistanceSigns> Distances,
+                                unsigned NestDepth) {
+    for (const DistanceSigns& Signs : Distances) {
+      // Signs of the dependence in the order of execution
+      int Direction = getLexicographicSign(Signs);
+      if (Direction == 0) continue;
+      ArrayRef<int> Outer = ArrayRef<int>(Signs).take_front(NestDepth - 1);
+      if (getLexicographicSign(Outer) != 0) continue;
+      for (int S : ArrayRef<int>(Signs).drop_front(NestDepth - 1))
+        if (S * Direction < 0) return false;
+    }
+    return true;
+  }
+
+  // Returns the stride of the address S in the loop L (nullptr if unknown)
+  static const SCEV* getStride(const SCEV* S, const Loop* L,
+                               ScalarEvolution& SE) {
+    while (auto* AR = dyn_cast<SCEVAddRecExpr>(S)) {
+      if (AR->getLoop() == L) return AR->getStepRecurrence(SE);
+      if (!AR->isAffine()) return nullptr;
+      S = AR->getStart();
+    }
+    return SE.isLoopInvariant(S, L) ? SE.getZero(S->getType()) : nullptr;
+  }
+
+  // Moves the loop with the fewest non-unit stride accesses innermost
+  // (keeping the order of the other loops)
+  SmallVector<unsigned, 4> getBetterOrder(ArrayRef<LoopControl> Nest,
+                                          ArrayRef<Instruction*> MemInsts,
+                                          ScalarEvolution& SE,
+                                          const DataLayout& DL) {
+    unsigned Best = Nest.size() - 1;
+    unsigned BestCost = ~0U;
+    for (unsigned Q = Nest.size(); Q-- > 0;) {
+      unsigned Cost = 0;
+      for (Instruction* I : MemInsts) {
+        const SCEV* Ptr = SE.getSCEV(getLoadStorePointerOperand(I));
+        const SCEV* Stride = getStride(Ptr, Nest[Q].L, SE);
+        auto* Const = dyn_cast_or_null<SCEVConstant>(Stride);
+        uint64_t Size = DL.getTypeStoreSize(getLoadStoreType(I));
+        if (!Const || !(Const->isZero() ||
+                        Const->getAPInt().abs() == Size))
+          ++Cost;
+      }
+      LLVM_DEBUG(dbgs() << "loop-tile: " << Cost
+                        << " non-unit stride accesses with "
+                        << Nest[Q].L->getHeader()->getName()
+                        << " innermost\n");
+      // Ties are resolved in favour of the current order
+      if (Cost < BestCost) {
+        Best = Q;
+        BestCost = Cost;
+      }
+    }
+
+    SmallVector<unsigned, 4> Order;
+    for (unsigned Q = 0; Q < Nest.size(); ++Q)
+      if (Q != Best) Order.push_back(Q);
+    Order.push_back(Best);
+    return Order;
+  }
+
+  // The loop at depth Q takes over the range and the IV uses of the loop
+  // Order[Q]. That's the interchange, as the nest is rectangular.
+  void permuteLoops(MutableArrayRef<LoopControl> Nest,
+                    ArrayRef<unsigned> Order) {
+    SmallVector<SmallVector<Use*, 8>, 4> BodyUses(Nest.size());
+    for (unsigned Q = 0; Q < Nest.size(); ++Q)
+      for (Use& U : Nest[Q].IV->uses())
+        if (U.getUser() != Nest[Q].Next) BodyUses[Q].push_back(&U);
+
+    // The names go with the ranges, so that the body still reads the same
+    SmallVector<std::string, 4> IVNames, NextNames, CmpNames;
+    for (LoopControl& C : Nest) {
+      IVNames.push_back(C.IV->getName().str());
+      NextNames.push_back(C.Next->getName().str());
+      CmpNames.push_back(C.Cmp->getName().str());
+    }
+    for (unsigned Q = 0; Q < Nest.size(); ++Q) {
+      if (Order[Q] == Q) continue;
+      Nest[Q].IV->setName("");
+      Nest[Q].Next->setName("");
+      Nest[Q].Cmp->setName("");
+    }
+
+    SmallVector<LoopControl, 4> Old(Nest.begin(), Nest.end());
+    for (unsigned Q = 0; Q < Nest.size(); ++Q) {
+      if (Order[Q] == Q) continue;
+      LoopControl& C = Nest[Q];
+      const LoopControl& From = Old[Order[Q]];
+      C.Start = From.Start;
+      C.Step = From.Step;
+      C.Bound = From.Bound;
+      C.Pred = From.Pred;
+      C.TripCount = From.TripCount;
+
+      C.IV->setIncomingValueForBlock(C.Preheader, C.Start);
+      C.Next->setOperand(1, C.Step);
+      // The flags were only known to hold for the old range
+      C.Next->dropPoisonGeneratingFlags();
+      C.Cmp->setPredicate(C.Pred);
+      C.Cmp->setOperand(1, C.Bound);
+      for (Use* U : BodyUses[Order[Q]]) U->set(C.IV);
+      C.IV->setName(IVNames[Order[Q]]);
+      C.Next->setName(NextNames[Order[Q]]);
+      C.Cmp->setName(CmpNames[Order[Q]]);
+    }
+  }
+
+  // Can the tile IV, i.e. up to max(Start, Bound) + TileStep, overflow?
+  static bool mayTileIVOverflow(const LoopControl& C, const APInt& TileStep,
+                                ScalarEvolution& SE) {
+    bool Signed = C.Pred == ICmpInst::ICMP_SLT;
+    for (Value* V : {C.Start, C.Bound}) {
+      const SCEV* S = SE.getSCEV(V);
+      APInt Max = Signed ? SE.getSignedRangeMax(S) : SE.getUnsignedRangeMax(S);
+      bool Overflow = false;
+      if (Signed)
+        (void)Max.sadd_ov(TileStep, Overflow);
+      else
+        (void)Max.uadd_ov(TileStep, Overflow);
+      if (Overflow) return true;
+    }
+    return false;
+  }
+
+  // Wraps the nest in one tile loop per tiled loop and limits the original
+  // loops to a tile
+  void tileNest(Function& F, MutableArrayRef<LoopControl> Nest,
+                ScalarEvolution& SE) {
+    SmallVector<unsigned, 4> Tiled;
+    SmallVector<APInt, 4> TileSteps;
+    for (unsigned Q = 0; Q < Nest.size(); ++Q) {
+      const LoopControl& C = Nest[Q];
+      // Loops that fit in a single tile are left alone
+      if (C.TripCount && C.TripCount <= TileSize) continue;
+
+      bool Overflow = false;
+      APInt TileStep = C.Step->getValue().umul_ov(
+          APInt(C.Step->getBitWidth(), TileSize), Overflow);
+      if (Overflow || mayTileIVOverflow(C, TileStep, SE)) continue;
+      Tiled.push_back(Q);
+      TileSteps.push_back(TileStep);
+    }
+    if (Tiled.empty()) return;
+
+    LLVMContext& Ctx = F.getContext();
+    LoopControl& Outermost = Nest.front();
+    BasicBlock* Header = Outermost.L->getHeader();
+    SmallVector<BasicBlock*, 4> TileHeaders, TileLatches;
+    for (unsigned T = 0; T < Tiled.size(); ++T)
+      TileHeaders.push_back(BasicBlock::Create(Ctx, "tile.header", &F, Header));
+    // Laid out innermost first, as that's how they run
+    TileLatches.resize(Tiled.size());
+    for (unsigned T = Tiled.size(); T-- > 0;)
+      TileLatches[T] =
+          BasicBlock::Create(Ctx, "tile.latch", &F, Outermost.Exit);
+
+    for (unsigned T = 0; T < Tiled.size(); ++T) {
+      LoopControl& C = Nest[Tiled[T]];
+      bool Signed = C.Pred == ICmpInst::ICMP_SLT;
+      StringRef Name = C.IV->getName();
+      Value* TileStep = ConstantInt::get(C.IV->getType(), TileSteps[T]);
+
+      // tile.header: the start of this tile and the bound of the point loop
+      IRBuilder<> HeaderBuilder(TileHeaders[T]);
+      PHINode* TileIV =
+          HeaderBuilder.CreatePHI(C.IV->getType(), 2, Name + ".tile");
+      TileIV->addIncoming(C.Start,
+                          T ? TileHeaders[T - 1] : Outermost.Preheader);
+      Value* TileEnd = HeaderBuilder.CreateAdd(TileIV, TileStep,
+                                               Name + ".tile.next",
+                                               /*HasNUW=*/!Signed,
+                                               /*HasNSW=*/Signed);
+      // Also the condition for moving on to the next tile
+      Value* HasNextTile = HeaderBuilder.CreateICmp(C.Pred, TileEnd, C.Bound,
+                                                    Name + ".tile.cond");
+      Value* PointBound = HeaderBuilder.CreateSelect(
+          HasNextTile, TileEnd, C.Bound, Name + ".tile.bound");
+      HeaderBuilder.CreateBr(T + 1 < Tiled.size() ? TileHeaders[T + 1]
+                                                  : Header);
+
+      // tile.latch: the next tile
+      IRBuilder<> LatchBuilder(TileLatches[T]);
+      TileIV->addIncoming(TileEnd, TileLatches[T]);
+      LatchBuilder.CreateCondBr(HasNextTile, TileHeaders[T],
+                                T ? TileLatches[T - 1] : Outermost.Exit);
+
+      // The original loop only iterates over the tile
+      C.IV->setIncomingValueForBlock(C.Preheader, TileIV);
+      C.Cmp->setOperand(1, PointBound);
+      ++NumTiled;
+    }
+
+    // Hook the tile loops in between the nest and its preheader/exit
+    Outermost.Preheader->getTerminator()->replaceSuccessorWith(
+        Header, TileHeaders.front());
+    Header->replacePhiUsesWith(Outermost.Preheader, TileHeaders.back());
+    Outermost.Latch->getTerminator()->replaceSuccessorWith(
+        Outermost.Exit, TileLatches.back());
+    Outermost.Exit->replacePhiUsesWith(Outermost.Latch, TileLatches.front());
+  }
+};
+
+}  // namespace
+
+// Register the pass
+llvm::PassPluginLibraryInfo getLoopTilingPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "LoopTiling", LLVM_VERSION_STRING,
+          [](PassBuilder& PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, FunctionPassManager& FPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "loop-tile") {
+                    FPM.addPass(LoopTiling());
+                    return true;
+                  }
+                  return false;
+                });
+          }};
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getLoopTilingPluginInfo();
+}
@@ -3,46 +3,162 @@
  * This pass hoists loop-invariant code before the loop when it is safe to do
  * so.
  *
+ * Loads are hoisted too, as long as nothing in the loop may write to the
+ * memory that they read. That's checked with MemorySSA when the pass runs in
+ * a `loop-mssa(...)` pipeline, and with alias analysis otherwise.
+ *
+ * Loads and stores of a loop-invariant pointer that no other instruction in
+ * the loop may access are promoted to registers: the memory is read once in
+ * the preheader, the loop works on SSA values, and the final value is stored
+ * once in every exit block. For example, a memory accumulator (`*sum += ...`)
+ * becomes a PHI node.
+ *
+ * With -simple-licm-nest-aware, every instruction is moved straight to the
+ * preheader of the outermost loop in which it's invariant, rather than one
+ * level per visit of the enclosing loops.
+ *
+ * With -simple-licm-min-trip-count=N, the loops that ran fewer than N
+ * iterations per entry (on average, as measured by LoopTripCounter and
+ * attached by `loop-tc-annotate`) are left alone - hoisting out of them saves
+ * little, but may compute values that the loop doesn't need. Nest-aware
+ * hoisting doesn't move instructions out of such loops either. Loops without
+ * a profile are always processed.
+ *
  * Compatible with New Pass Manage
+ *
+ * Usage:
+ *   opt -load-pass-plugin libSimpleLICM.so \
+ *     -passes='loop-mssa(simple-licm)' -S <input-file>
+ *   # Add -debug-only=simple-licm (with an assertions-enabled LLVM) to see
+ *   # what's hoisted and promoted
  */
 
+#include "LoopTripCounter.h"
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/Analysis/LoopAnalysisManager.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/LoopIterator.h"
 #include "llvm/Analysis/LoopPass.h"
+#include "llvm/Analysis/MemorySSA.h"
+#include "llvm/Analysis/MemorySSAUpdater.h"
+#include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/CFG.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/Pass.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/LoopUtils.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
 #include "llvm/Transforms/Utils/ValueMapper.h"
 
+#include <memory>
+
+#define DEBUG_TYPE "simple-licm"
+
+STATISTIC(NumHoisted, "Number of instructions hoisted out of loops");
+STATISTIC(NumPromoted, "Number of memory locations promoted to registers");
+STATISTIC(NumSkippedLoops, "Number of loops skipped due to low trip counts");
+
 using namespace llvm;
 
+static cl::opt<bool> NestAware(
+    "simple-licm-nest-aware",
+    cl::desc("Hoist every invariant instruction to the outermost loop in "
+             "which it is invariant"),
+    cl::init(false));
+
+static cl::opt<unsigned> MinTripCount(
+    "simple-licm-min-trip-count",
+    cl::desc("Skip the loops that ran fewer than this many iterations per "
+             "entry on average (see loop-tc-annotate; 0 disables the check)"),
+    cl::init(0));
+
+namespace {
+// Rewrites the loads and stores of one pointer in terms of SSA values and
+// stores the final value in every exit block.
+class MemoryPromoter : public LoadAndStorePromoter {
+ public:
+  MemoryPromoter(ArrayRef<const Instruction*> Insts, SSAUpdater& SSA,
+                 Value* Ptr, ArrayRef<BasicBlock*> ExitBlocks, Align Alignment,
+                 MemorySSAUpdater* MSSAU)
+      : LoadAndStorePromoter(Insts, SSA),
+        Ptr(Ptr),
+        ExitBlocks(ExitBlocks),
+        Alignment(Alignment),
+        MSSAU(MSSAU) {}
+
+  void doExtraRewritesBeforeFinalDeletion() override {
+    for (BasicBlock* ExitBB : ExitBlocks) {
+      Value* LiveOut = SSA.GetValueInMiddleOfBlock(ExitBB);
+      IRBuilder<> Builder(&*ExitBB->getFirstInsertionPt());
+      StoreInst* NewSI = Builder.CreateAlignedStore(LiveOut, Ptr, Alignment);
+      if (MSSAU) {
+        MemoryAccess* NewMA = MSSAU->createMemoryAccessInBB(
+            NewSI, nullptr, ExitBB, MemorySSA::Beginning);
+        MSSAU->insertDef(cast<MemoryDef>(NewMA), /*RenameUses=*/true);
+      }
+    }
+  }
+
+  void instructionDeleted(Instruction* I) const override {
+    if (MSSAU) MSSAU->removeMemoryAccess(I);
+  }
+
+ private:
+  Value* Ptr;
+  ArrayRef<BasicBlock*> ExitBlocks;
+  Align Alignment;
+  MemorySSAUpdater* MSSAU;
+};
+
+bool isSimpleLoadOrStore(const Instruction* I) {
+  if (auto* LI = dyn_cast<LoadInst>(I)) return LI->isSimple();
+  if (auto* SI = dyn_cast<StoreInst>(I)) return SI->isSimple();
+  return false;
+}
+}  // namespace
+
 struct SimpleLICM : public PassInfoMixin<SimpleLICM> {
   PreservedAnalyses run(Loop& L, LoopAnalysisManager& AM,
                         LoopStandardAnalysisResults& AR, LPMUpdater&) {
     DominatorTree& DT = AR.DT;
+    std::unique_ptr<MemorySSAUpdater> MSSAU;
+    if (AR.MSSA) MSSAU = std::make_unique<MemorySSAUpdater>(AR.MSSA);
 
     BasicBlock* Preheader = L.getLoopPreheader();
     if (!Preheader) {
-      errs() << "No preheader, skipping loop\n";
+      LLVM_DEBUG(dbgs() << "No preheader, skipping loop\n");
+      return PreservedAnalyses::all();
+    }
+
+    if (isBelowMinTripCount(L, MinTripCount)) {
+      LLVM_DEBUG(dbgs() << "Low trip count, skipping loop\n");
+      ++NumSkippedLoops;
       return PreservedAnalyses::all();
     }
 
+    DenseMap<const Loop*, bool> MayThrowCache;
+    bool MayThrow = loopMayThrow(L, MayThrowCache);
+    bool Changed = false;
     SmallPtrSet<Instruction*, 8> InvariantSet;
     bool Change = true;
     SmallVector<Instruction*, 16> Worklist;
 
     for (auto* BB : L.getBlocks()) {
       for (auto& I : *BB) {
-        if (isa<PHINode>(I) || I.mayReadOrWriteMemory()) {
+        if (isa<PHINode>(I) || !isHoistCandidate(I, L, AR)) {
           continue;
         }
         bool allOperandsInvariant = true;
@@ -71,7 +187,7 @@ struct SimpleLICM : public PassInfoMixin<SimpleLICM> {
 
         // Basic filters for the user instruction U
         if (!U || !L.contains(U) || InvariantSet.count(U) || isa<PHINode>(U) ||
-            U->mayReadOrWriteMemory()) {
+            !isHoistCandidate(*U, L, AR)) {
           continue;
         }
 
@@ -92,20 +208,241 @@ struct SimpleLICM : public PassInfoMixin<SimpleLICM> {
       }
     }
 
-    // Worklist algorithm to identify loop invariant instructions
-    /*************************************/
-    /* Your code goes here */
-    /*************************************/
+    // Actually hoist the instructions. Visit them in reverse post-order, so
+    // that the definitions are hoisted before their users. An instruction
+    // whose operands could not be hoisted stays in the loop.
+    LoopBlocksRPO RPOT(&L);
+    RPOT.perform(&AR.LI);
+    for (BasicBlock* BB : RPOT) {
+      for (Instruction& I : make_early_inc_range(*BB)) {
+        if (!InvariantSet.count(&I)) continue;
+
+        bool operandsHoisted = none_of(I.operands(), [&L](Value* Op) {
+          Instruction* OpInst = dyn_cast<Instruction>(Op);
+          return OpInst && L.contains(OpInst);
+        });
+        if (!operandsHoisted || !canHoist(I, L, AR, MayThrow)) continue;
 
-    // Actually hoist the instructions
-    for (Instruction* I : InvariantSet) {
-      if (isSafeToSpeculativelyExecute(I) && dominatesAllLoopExits(I, &L, DT)) {
-        errs() << "Hoisting: " << *I << "\n";
-        I->moveBefore(Preheader->getTerminator());
+        BasicBlock* Dest = Preheader;
+        if (NestAware)
+          Dest = getOutermostHoistLoop(I, L, AR, MayThrowCache)
+                     ->getLoopPreheader();
+
+        LLVM_DEBUG(dbgs() << "Hoisting: " << I << " to " << Dest->getName()
+                          << "\n");
+        I.moveBefore(Dest->getTerminator());
+        if (MSSAU) {
+          if (MemoryUseOrDef* MA = AR.MSSA->getMemoryAccess(&I))
+            MSSAU->moveToPlace(MA, Dest, MemorySSA::BeforeTerminator);
+        }
+        ++NumHoisted;
+        Changed = true;
       }
     }
 
-    return PreservedAnalyses::none();
+    if (promoteMemoryToRegisters(L, AR, MSSAU.get(), MayThrow)) {
+      formLCSSARecursively(L, DT, &AR.LI, &AR.SE);
+      Changed = true;
+    }
+
+    if (!Changed) return PreservedAnalyses::all();
+
+    // Only instructions were moved (the CFG is unchanged), so DT and LoopInfo
+    // remain valid. SCEV is kept, but the loops that values are invariant in
+    // have changed.
+    AR.SE.forgetLoopDispositions();
+    PreservedAnalyses PA = getLoopPassPreservedAnalyses();
+    // MemorySSA has been kept up to date (a loop-mssa pipeline requires that)
+    if (MSSAU) {
+      if (VerifyMemorySSA) AR.MSSA->verifyMemorySSA();
+      PA.preserve<MemorySSAAnalysis>();
+    }
+    return PA;
+  }
+
+  // Returns true if I can be hoisted once its operands are loop-invariant,
+  // i.e. it doesn't access memory or is a load from memory that's not
+  // written in the loop.
+  bool isHoistCandidate(Instruction& I, Loop& L,
+                        LoopStandardAnalysisResults& AR) {
+    if (!I.mayReadOrWriteMemory()) return true;
+
+    auto* LI = dyn_cast<LoadInst>(&I);
+    if (!LI || !LI->isSimple()) return false;
+
+    // With MemorySSA, the load is invariant if its nearest clobber is outside
+    // the loop
+    if (AR.MSSA) {
+      MemoryAccess* Clobber =
+          AR.MSSA->getWalker()->getClobberingMemoryAccess(LI);
+      return AR.MSSA->isLiveOnEntryDef(Clobber) ||
+             !L.contains(Clobber->getBlock());
+    }
+
+    // Without it, check every instruction in the loop that writes to memory
+    MemoryLocation Loc = MemoryLocation::get(LI);
+    for (BasicBlock* BB : L.getBlocks()) {
+      for (Instruction& J : *BB) {
+        if (J.mayWriteToMemory() && isModSet(AR.AA.getModRefInfo(&J, Loc)))
+          return false;
+      }
+    }
+    return true;
+  }
+
+  // Returns the outermost loop, out of L and the loops that contain it, from
+  // which I (invariant in L) can be hoisted
+  Loop* getOutermostHoistLoop(Instruction& I, Loop& L,
+                              LoopStandardAnalysisResults& AR,
+                              DenseMap<const Loop*, bool>& MayThrowCache) {
+    Loop* Outermost = &L;
+    for (Loop* Parent = L.getParentLoop();
+         Parent && Parent->getLoopPreheader() &&
+         !isBelowMinTripCount(*Parent, MinTripCount);
+         Parent = Parent->getParentLoop()) {
+      bool operandsInvariant = none_of(I.operands(), [Parent](Value* Op) {
+        Instruction* OpInst = dyn_cast<Instruction>(Op);
+        return OpInst && Parent->contains(OpInst);
+      });
+      if (!operandsInvariant || !isHoistCandidate(I, *Parent, AR) ||
+          !canHoist(I, *Parent, AR, loopMayThrow(*Parent, MayThrowCache)))
+        break;
+      Outermost = Parent;
+    }
+    return Outermost;
+  }
+
+  bool canHoist(Instruction& I, Loop& L, LoopStandardAnalysisResults& AR,
+                bool MayThrow) {
+    // A load that's executed whenever the loop is entered can be hoisted even
+    // if it could trap - the trap just happens earlier
+    if (isa<LoadInst>(I)) {
+      return isSafeToSpeculativelyExecute(&I, L.getLoopPreheader()->getTerminator(),
+                                          &AR.AC, &AR.DT, &AR.TLI) ||
+             isGuaranteedToExecute(I, L, AR.DT, MayThrow);
+    }
+    return isSafeToSpeculativelyExecute(&I) &&
+           dominatesAllLoopExits(&I, &L, AR.DT);
+  }
+
+  // Promotes the loads and stores of the loop-invariant pointers that no other
+  // instruction in L accesses. Returns true if anything was promoted.
+  bool promoteMemoryToRegisters(Loop& L, LoopStandardAnalysisResults& AR,
+                                MemorySSAUpdater* MSSAU, bool MayThrow) {
+    BasicBlock* Preheader = L.getLoopPreheader();
+    SmallVector<BasicBlock*, 8> ExitBlocks;
+    L.getUniqueExitBlocks(ExitBlocks);
+    // The final values are stored at the beginning of the exit blocks, so
+    // these must only be reachable from the loop
+    if (ExitBlocks.empty() || !L.hasDedicatedExits()) return false;
+    for (BasicBlock* ExitBB : ExitBlocks) {
+      if (ExitBB->getFirstInsertionPt() == ExitBB->end()) return false;
+    }
+
+    // Group the simple loads and stores by their (loop-invariant) pointer
+    MapVector<Value*, SmallVector<Instruction*, 4>> Accesses;
+    SmallVector<Instruction*, 16> MemInsts;
+    for (BasicBlock* BB : L.getBlocks()) {
+      for (Instruction& I : *BB) {
+        if (!I.mayReadOrWriteMemory()) continue;
+        MemInsts.push_back(&I);
+        Value* Ptr = getLoadStorePointerOperand(&I);
+        if (Ptr && isSimpleLoadOrStore(&I) && L.isLoopInvariant(Ptr))
+          Accesses[Ptr].push_back(&I);
+      }
+    }
+
+    const DataLayout& DL = Preheader->getModule()->getDataLayout();
+    bool Changed = false;
+    for (auto& [Ptr, Group] : Accesses) {
+      Type* AccessTy = getLoadStoreType(Group.front());
+      if (any_of(Group, [AccessTy](Instruction* I) {
+            return getLoadStoreType(I) != AccessTy;
+          }))
+        continue;
+
+      // Writing the final value in the exit blocks is only safe if the loop
+      // always writes it too. That store also guarantees that the memory can
+      // be read in the preheader.
+      StoreInst* GuaranteedStore = nullptr;
+      for (Instruction* I : Group) {
+        auto* SI = dyn_cast<StoreInst>(I);
+        if (SI && isGuaranteedToExecute(*SI, L, AR.DT, MayThrow)) {
+          GuaranteedStore = SI;
+          break;
+        }
+      }
+      if (!GuaranteedStore) continue;
+
+      // Nothing else in the loop may access the promoted memory
+      MemoryLocation Loc(Ptr,
+                         LocationSize::precise(DL.getTypeStoreSize(AccessTy)));
+      SmallPtrSet<Instruction*, 4> GroupSet(Group.begin(), Group.end());
+      if (any_of(MemInsts, [&](Instruction* I) {
+            return !GroupSet.count(I) &&
+                   isModOrRefSet(AR.AA.getModRefInfo(I, Loc));
+          }))
+        continue;
+
+      LLVM_DEBUG(dbgs() << "Promoting: " << *Ptr << "\n");
+      Align Alignment = GuaranteedStore->getAlign();
+      SmallVector<const Instruction*, 8> ConstGroup(Group.begin(),
+                                                    Group.end());
+      SSAUpdater SSA;
+      MemoryPromoter Promoter(ConstGroup, SSA, Ptr, ExitBlocks, Alignment,
+                              MSSAU);
+
+      IRBuilder<> Builder(Preheader->getTerminator());
+      LoadInst* PreheaderLoad = Builder.CreateAlignedLoad(
+          AccessTy, Ptr, Alignment, Ptr->getName() + ".promoted");
+      if (MSSAU) {
+        MemoryAccess* PreheaderLoadMA = MSSAU->createMemoryAccessInBB(
+            PreheaderLoad, nullptr, Preheader, MemorySSA::BeforeTerminator);
+        MSSAU->insertUse(cast<MemoryUse>(PreheaderLoadMA),
+                         /*RenameUses=*/true);
+      }
+      SSA.AddAvailableValue(Preheader, PreheaderLoad);
+
+      // The promoted loads and stores are erased, later groups must not look
+      // at them
+      erase_if(MemInsts, [&](Instruction* I) { return GroupSet.count(I); });
+      Promoter.run(Group);
+
+      // E.g. a store that's sunk out of the loop doesn't need the old value
+      if (PreheaderLoad->use_empty()) {
+        if (MSSAU) MSSAU->removeMemoryAccess(PreheaderLoad);
+        PreheaderLoad->eraseFromParent();
+      }
+      ++NumPromoted;
+      Changed = true;
+    }
+
+    return Changed;
+  }
+
+  // Returns true if some instruction in L may not transfer the execution to
+  // its successor (e.g. a call that may throw). The results are cached in
+  // Cache.
+  bool loopMayThrow(Loop& L, DenseMap<const Loop*, bool>& Cache) {
+    auto Cached = Cache.find(&L);
+    if (Cached != Cache.end()) return Cached->second;
+
+    bool MayThrow = any_of(L.getBlocks(), [](BasicBlock* BB) {
+      return any_of(*BB, [](Instruction& I) {
+        return !isGuaranteedToTransferExecutionToSuccessor(&I);
+      });
+    });
+    Cache[&L] = MayThrow;
+    return MayThrow;
+  }
+
+  // Returns true if I is executed whenever the loop is entered
+  bool isGuaranteedToExecute(Instruction& I, Loop& L, DominatorTree& DT,
+                             bool MayThrow) {
+    SmallVector<BasicBlock*, 8> ExitBlocks;
+    L.getExitBlocks(ExitBlocks);
+    return !MayThrow && !ExitBlocks.empty() &&
+           dominatesAllLoopExits(&I, &L, DT);
   }
 
   bool dominatesAllLoopExits(Instruction* I, Loop* L, DominatorTree& DT) {
@@ -119,7 +456,6 @@ struct SimpleLICM : public PassInfoMixin<SimpleLICM> {
 };
 
 llvm::PassPluginLibraryInfo getSimpleLICMPluginInfo() {
-  errs() << "SimpleLICM plugin: getSimpleLICMPluginInfo() called\n";
   return {LLVM_PLUGIN_API_VERSION, "simple-licm", LLVM_VERSION_STRING,
           [](PassBuilder& PB) {
             PB.registerPipelineParsingCallback(
@@ -136,6 +472,5 @@ llvm::PassPluginLibraryInfo getSimpleLICMPluginInfo() {
 
 extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
 llvmGetPassPluginInfo() {
-  errs() << "SimpleLICM plugin: llvmGetPassPluginInfo() called\n";
   return getSimpleLICMPluginInfo();
 }
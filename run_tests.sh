@@ -28,9 +28,42 @@ echo "SimpleLICM pass finished. Output is in outputs/matmul_licm.ll"
 # --- Run IVE Pass ---
 echo -e "\n--- Running DerivedInductionVar pass on test-derived-iv.ll ---"
 opt -load-pass-plugin ./build/lib/libDerivedInductionVars.dylib \
-                -passes='loop-simplify,derived-iv' -S \
+                -passes='loop-simplify,derived-iv' -derived-iv-verbose -S \
                 -o outputs/test-derived-iv.ll.optimized \
                 test-inputs/test-derived-iv.ll
 echo "DerivedInductionVar pass finished. Output is in outputs/test-derived-iv.ll.optimized"
 
+# --- Run LoopTiling Pass ---
+# LoopTiling runs before SimpleLICM and DerivedInductionVar. The untiled
+# version goes through the same pipeline, just without loop-tile.
+echo -e "\n--- Running LoopTiling pass on matmul-perfect.ll ---"
+LOOP_PLUGINS="-load-pass-plugin ./build/lib/libLoopTiling.dylib \
+  -load-pass-plugin ./build/lib/libSimpleLICM.dylib \
+  -load-pass-plugin ./build/lib/libDerivedInductionVars.dylib"
+opt ${LOOP_PLUGINS} \
+                -passes='function(loop-simplify,loop-mssa(simple-licm),derived-iv)' -S \
+                -o outputs/matmul_untiled.ll \
+                test-inputs/matmul-perfect.ll
+opt ${LOOP_PLUGINS} \
+                -passes='function(loop-simplify,loop-tile,loop-mssa(simple-licm),derived-iv)' -S \
+                -o outputs/matmul_tiled.ll \
+                test-inputs/matmul-perfect.ll
+echo "LoopTiling pass finished. Output is in outputs/matmul_tiled.ll"
+
+# --- Compare the tiled and untiled versions ---
+# -O0, so that only the passes above change the IR
+echo -e "\n--- Comparing outputs/matmul_tiled.ll against outputs/matmul_untiled.ll ---"
+TIMEFORMAT="%R s"
+for variant in untiled tiled; do
+  ${LLVM_INSTALL_DIR}/bin/clang -O0 -Wno-override-module \
+    outputs/matmul_${variant}.ll -o outputs/matmul_${variant}
+  echo -n "${variant}: "
+  { time ./outputs/matmul_${variant} > outputs/matmul_${variant}.out ; } 2>&1
+done
+if ! diff -q outputs/matmul_untiled.out outputs/matmul_tiled.out > /dev/null; then
+  echo "The tiled matmul computes a different result!"
+  exit 1
+fi
+echo "Both versions compute $(cat outputs/matmul_tiled.out)"
+
 echo -e "\n--- All tests completed successfully! ---"
\ No newline at end of file
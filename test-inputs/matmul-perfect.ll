@@ -0,0 +1,148 @@
+; ModuleID = 'matmul-perfect.ll'
+source_filename = "matmul-perfect.c"
+target datalayout = "e-m:o-i64:64-i128:128-n32:64-S128"
+target triple = "arm64-apple-macosx14.0.0"
+
+@.str = private unnamed_addr constant [4 x i8] c"%f\0A\00", align 1
+
+; The same multiplication as in matmul-canonical.ll, but accumulated in memory
+; (C[i][j] += A[i][k] * B[k][j]) so that the i-j-k nest is perfect, and with
+; restrict-qualified matrices.
+; Function Attrs: noinline nounwind ssp uwtable(sync)
+define void @matmul(ptr noalias noundef %0, ptr noalias noundef %1, ptr noalias noundef %2) #0 {
+  br label %4
+
+4:                                                ; preds = %3, %29
+  %.03 = phi i32 [ 0, %3 ], [ %30, %29 ]
+  br label %5
+
+5:                                                ; preds = %4, %25
+  %.02 = phi i32 [ 0, %4 ], [ %26, %25 ]
+  br label %6
+
+6:                                                ; preds = %5, %21
+  %.01 = phi i32 [ 0, %5 ], [ %22, %21 ]
+  %7 = sext i32 %.03 to i64
+  %8 = getelementptr inbounds [512 x double], ptr %0, i64 %7
+  %9 = sext i32 %.01 to i64
+  %10 = getelementptr inbounds [512 x double], ptr %8, i64 0, i64 %9
+  %11 = load double, ptr %10, align 8
+  %12 = sext i32 %.01 to i64
+  %13 = getelementptr inbounds [512 x double], ptr %1, i64 %12
+  %14 = sext i32 %.02 to i64
+  %15 = getelementptr inbounds [512 x double], ptr %13, i64 0, i64 %14
+  %16 = load double, ptr %15, align 8
+  %17 = getelementptr inbounds [512 x double], ptr %2, i64 %7
+  %18 = getelementptr inbounds [512 x double], ptr %17, i64 0, i64 %14
+  %19 = load double, ptr %18, align 8
+  %20 = call double @llvm.fmuladd.f64(double %11, double %16, double %19)
+  store double %20, ptr %18, align 8
+  br label %21
+
+21:                                               ; preds = %6
+  %22 = add nsw i32 %.01, 1
+  %23 = icmp slt i32 %22, 512
+  br i1 %23, label %6, label %24, !llvm.loop !5
+
+24:                                               ; preds = %21
+  br label %25
+
+25:                                               ; preds = %24
+  %26 = add nsw i32 %.02, 1
+  %27 = icmp slt i32 %26, 512
+  br i1 %27, label %5, label %28, !llvm.loop !7
+
+28:                                               ; preds = %25
+  br label %29
+
+29:                                               ; preds = %28
+  %30 = add nsw i32 %.03, 1
+  %31 = icmp slt i32 %30, 512
+  br i1 %31, label %4, label %32, !llvm.loop !8
+
+32:                                               ; preds = %29
+  ret void
+}
+
+; Function Attrs: nocallback nofree nosync nounwind speculatable willreturn memory(none)
+declare double @llvm.fmuladd.f64(double, double, double) #1
+
+; Function Attrs: noinline nounwind ssp uwtable(sync)
+define i32 @main() #0 {
+  %1 = alloca [512 x [512 x double]], align 8
+  %2 = alloca [512 x [512 x double]], align 8
+  %3 = alloca [512 x [512 x double]], align 8
+  br label %4
+
+4:                                                ; preds = %0, %26
+  %.02 = phi i32 [ 0, %0 ], [ %27, %26 ]
+  br label %5
+
+5:                                                ; preds = %4, %22
+  %.01 = phi i32 [ 0, %4 ], [ %23, %22 ]
+  %6 = add nsw i32 %.02, %.01
+  %7 = sitofp i32 %6 to double
+  %8 = sext i32 %.02 to i64
+  %9 = getelementptr inbounds [512 x [512 x double]], ptr %1, i64 0, i64 %8
+  %10 = sext i32 %.01 to i64
+  %11 = getelementptr inbounds [512 x double], ptr %9, i64 0, i64 %10
+  store double %7, ptr %11, align 8
+  %12 = sub nsw i32 %.02, %.01
+  %13 = sitofp i32 %12 to double
+  %14 = sext i32 %.02 to i64
+  %15 = getelementptr inbounds [512 x [512 x double]], ptr %2, i64 0, i64 %14
+  %16 = sext i32 %.01 to i64
+  %17 = getelementptr inbounds [512 x double], ptr %15, i64 0, i64 %16
+  store double %13, ptr %17, align 8
+  %18 = sext i32 %.02 to i64
+  %19 = getelementptr inbounds [512 x [512 x double]], ptr %3, i64 0, i64 %18
+  %20 = sext i32 %.01 to i64
+  %21 = getelementptr inbounds [512 x double], ptr %19, i64 0, i64 %20
+  store double 0.000000e+00, ptr %21, align 8
+  br label %22
+
+22:                                               ; preds = %5
+  %23 = add nsw i32 %.01, 1
+  %24 = icmp slt i32 %23, 512
+  br i1 %24, label %5, label %25, !llvm.loop !9
+
+25:                                               ; preds = %22
+  br label %26
+
+26:                                               ; preds = %25
+  %27 = add nsw i32 %.02, 1
+  %28 = icmp slt i32 %27, 512
+  br i1 %28, label %4, label %29, !llvm.loop !10
+
+29:                                               ; preds = %26
+  %30 = getelementptr inbounds [512 x [512 x double]], ptr %1, i64 0, i64 0
+  %31 = getelementptr inbounds [512 x [512 x double]], ptr %2, i64 0, i64 0
+  %32 = getelementptr inbounds [512 x [512 x double]], ptr %3, i64 0, i64 0
+  call void @matmul(ptr noundef %30, ptr noundef %31, ptr noundef %32)
+  %33 = getelementptr inbounds [512 x [512 x double]], ptr %3, i64 0, i64 511
+  %34 = getelementptr inbounds [512 x double], ptr %33, i64 0, i64 511
+  %35 = load double, ptr %34, align 8
+  %36 = call i32 (ptr, ...) @printf(ptr noundef @.str, double noundef %35)
+  ret i32 0
+}
+
+declare i32 @printf(ptr noundef, ...) #2
+
+attributes #0 = { noinline nounwind ssp uwtable(sync) "frame-pointer"="non-leaf" "no-trapping-math"="true" "stack-protector-buffer-size"="8" "target-cpu"="apple-m1" "target-features"="+aes,+crc,+dotprod,+fp-armv8,+fp16fml,+fullfp16,+lse,+neon,+ras,+rcpc,+rdm,+sha2,+sha3,+v8.1a,+v8.2a,+v8.3a,+v8.4a,+v8.5a,+v8a,+zcm,+zcz" }
+attributes #1 = { nocallback nofree nosync nounwind speculatable willreturn memory(none) }
+attributes #2 = { "frame-pointer"="non-leaf" "no-trapping-math"="true" "stack-protector-buffer-size"="8" "target-cpu"="apple-m1" "target-features"="+aes,+crc,+dotprod,+fp-armv8,+fp16fml,+fullfp16,+lse,+neon,+ras,+rcpc,+rdm,+sha2,+sha3,+v8.1a,+v8.2a,+v8.3a,+v8.4a,+v8.5a,+v8a,+zcm,+zcz" }
+
+!llvm.module.flags = !{!0, !1, !2, !3}
+!llvm.ident = !{!4}
+
+!0 = !{i32 1, !"wchar_size", i32 4}
+!1 = !{i32 8, !"PIC Level", i32 2}
+!2 = !{i32 7, !"uwtable", i32 1}
+!3 = !{i32 7, !"frame-pointer", i32 1}
+!4 = !{!"Homebrew clang version 17.0.6"}
+!5 = distinct !{!5, !6}
+!6 = !{!"llvm.loop.mustprogress"}
+!7 = distinct !{!7, !6}
+!8 = distinct !{!8, !6}
+!9 = distinct !{!9, !6}
+!10 = distinct !{!10, !6}
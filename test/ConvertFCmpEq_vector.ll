@@ -0,0 +1,90 @@
+; RUN: opt -load-pass-plugin=%shlibdir/libFindFCmpEq%shlibext \
+; RUN:   -load-pass-plugin=%shlibdir/libConvertFCmpEq%shlibext \
+; RUN:   --passes=convert-fcmp-eq -S %s | FileCheck %s --check-prefix=BITCAST
+; RUN: opt -load-pass-plugin=%shlibdir/libFindFCmpEq%shlibext \
+; RUN:   -load-pass-plugin=%shlibdir/libConvertFCmpEq%shlibext \
+; RUN:   --passes=convert-fcmp-eq -convert-fcmp-eq-lowering=fabs -S %s \
+; RUN:   | FileCheck %s --check-prefix=FABS
+; RUN: opt -load-pass-plugin=%shlibdir/libFindFCmpEq%shlibext \
+; RUN:   -load-pass-plugin=%shlibdir/libConvertFCmpEq%shlibext \
+; RUN:   --passes="convert-fcmp-eq,loop-vectorize" -convert-fcmp-eq-lowering=fabs \
+; RUN:   -force-vector-width=4 -force-vector-interleave=1 -S %s \
+; RUN:   | FileCheck %s --check-prefix=VECTORIZE
+
+; Verify that the conversion uses the epsilon and the integer type that match
+; the type of the operands, and that vectors are compared element-wise (the
+; constants are splatted).
+
+define i1 @fcmp_float(float %a, float %b) {
+  %cmp = fcmp oeq float %a, %b
+  ret i1 %cmp
+}
+
+; BITCAST-LABEL: @fcmp_float
+; BITCAST-NEXT:  %1 = fsub float %a, %b
+; BITCAST-NEXT:  %2 = bitcast float %1 to i32
+; BITCAST-NEXT:  %3 = and i32 %2, 2147483647
+; BITCAST-NEXT:  %4 = bitcast i32 %3 to float
+; BITCAST-NEXT:  %cmp = fcmp olt float %4, 0x3E80000000000000
+
+; FABS-LABEL: @fcmp_float
+; FABS-NEXT:  %1 = fsub float %a, %b
+; FABS-NEXT:  %2 = call float @llvm.fabs.f32(float %1)
+; FABS-NEXT:  %cmp = fcmp olt float %2, 0x3E80000000000000
+
+define <4 x i1> @fcmp_v4f32(<4 x float> %a, <4 x float> %b) {
+  %cmp = fcmp une <4 x float> %a, %b
+  ret <4 x i1> %cmp
+}
+
+; BITCAST-LABEL: @fcmp_v4f32
+; BITCAST-NEXT:  %1 = fsub <4 x float> %a, %b
+; BITCAST-NEXT:  %2 = bitcast <4 x float> %1 to <4 x i32>
+; BITCAST-NEXT:  %3 = and <4 x i32> %2, {{.*}}i32 2147483647
+; BITCAST-NEXT:  %4 = bitcast <4 x i32> %3 to <4 x float>
+; BITCAST-NEXT:  %cmp = fcmp uge <4 x float> %4, {{.*}}float 0x3E80000000000000
+
+; FABS-LABEL: @fcmp_v4f32
+; FABS-NEXT:  %1 = fsub <4 x float> %a, %b
+; FABS-NEXT:  %2 = call <4 x float> @llvm.fabs.v4f32(<4 x float> %1)
+; FABS-NEXT:  %cmp = fcmp uge <4 x float> %2, {{.*}}float 0x3E80000000000000
+
+define <2 x i1> @fcmp_v2f64(<2 x double> %a, <2 x double> %b) {
+  %cmp = fcmp oeq <2 x double> %a, %b
+  ret <2 x i1> %cmp
+}
+
+; FABS-LABEL: @fcmp_v2f64
+; FABS-NEXT:  %1 = fsub <2 x double> %a, %b
+; FABS-NEXT:  %2 = call <2 x double> @llvm.fabs.v2f64(<2 x double> %1)
+; FABS-NEXT:  %cmp = fcmp olt <2 x double> %2, {{.*}}double 0x3CB0000000000000
+
+; Counts the elements of A and B that are equal. After the conversion with
+; llvm.fabs, the loop is still vectorized.
+define i32 @count_equal(ptr noalias %A, ptr noalias %B, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %count = phi i32 [ 0, %entry ], [ %count.next, %loop ]
+  %pa = getelementptr inbounds double, ptr %A, i64 %i
+  %pb = getelementptr inbounds double, ptr %B, i64 %i
+  %a = load double, ptr %pa
+  %b = load double, ptr %pb
+  %cmp = fcmp oeq double %a, %b
+  %inc = zext i1 %cmp to i32
+  %count.next = add i32 %count, %inc
+  %i.next = add nuw nsw i64 %i, 1
+  %done = icmp eq i64 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i32 %count.next
+}
+
+; VECTORIZE-LABEL: @count_equal
+; VECTORIZE:       vector.body:
+; VECTORIZE:         [[DIFF:%.*]] = fsub <4 x double>
+; VECTORIZE-NEXT:    [[ABS:%.*]] = call <4 x double> @llvm.fabs.v4f64(<4 x double> [[DIFF]])
+; VECTORIZE-NEXT:    fcmp olt <4 x double> [[ABS]]
@@ -0,0 +1,42 @@
+; RUN: opt -load-pass-plugin %shlibdir/libDerivedInductionVars%shlibext -passes='loop-simplify,derived-iv' -derived-iv-mode=strength-reduce -S %s | FileCheck %s
+
+; Verify that the expansions are shared by the loops of a nest: both GEPs are
+; strength-reduced to recurrences with the step 8 * %n. It's expanded in the
+; preheader of the outer loop and reused (rather than expanded again) in the
+; preheader of the inner loop.
+
+define void @rows(ptr %a, ptr %b, i64 %n) {
+; CHECK-LABEL: @rows
+; CHECK-LABEL: entry:
+; CHECK:         [[STEP:%.*]] = shl i64 %n, 3
+; CHECK-NOT:     shl
+; CHECK:         %pb.sr.next = getelementptr i8, ptr %pb.sr, i64 [[STEP]]
+; CHECK-NOT:     shl
+; CHECK:         %pa.sr.next = getelementptr i8, ptr %pa.sr, i64 [[STEP]]
+entry:
+  br label %outer
+
+outer:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %outer.latch ]
+  %ia = mul i64 %i, %n
+  %pa = getelementptr inbounds double, ptr %a, i64 %ia
+  store double 0.0, ptr %pa, align 8
+  br label %inner
+
+inner:
+  %j = phi i64 [ 0, %outer ], [ %j.next, %inner ]
+  %jb = mul i64 %j, %n
+  %pb = getelementptr inbounds double, ptr %b, i64 %jb
+  store double 1.0, ptr %pb, align 8
+  %j.next = add nuw nsw i64 %j, 1
+  %inner.cond = icmp ult i64 %j.next, 64
+  br i1 %inner.cond, label %inner, label %outer.latch
+
+outer.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %outer.cond = icmp ult i64 %i.next, 64
+  br i1 %outer.cond, label %outer, label %exit
+
+exit:
+  ret void
+}
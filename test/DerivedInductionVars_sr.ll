@@ -0,0 +1,33 @@
+; RUN: opt -load-pass-plugin %shlibdir/libDerivedInductionVars%shlibext -passes='loop-simplify,derived-iv' -derived-iv-mode=strength-reduce -S %s | FileCheck %s
+
+; Verify that in the strength-reduce mode the multiplies of the IV (and the GEPs
+; that they feed) are replaced with additive recurrences:
+;   * %col = %i * %n is reduced to {0,+,%n}
+;   * %p = %a + 8 * (%i * %n + %j) is reduced to {%a + 8 * %j,+,8 * %n}
+; The recurrence for %col is only used by the GEP, so it's deleted.
+
+define void @column(ptr %a, i64 %n, i64 %j, i64 %len) {
+; CHECK-LABEL: @column
+; CHECK-LABEL: {{^}}loop:
+; CHECK-NEXT:    %p.sr = phi ptr [ {{%.*}}, %entry ], [ %p.sr.next, %loop ]
+; CHECK-NEXT:    %i = phi i64
+; CHECK-NOT:     mul
+; CHECK:         store double 0.000000e+00, ptr %p.sr, align 8
+; CHECK:         %p.sr.next = getelementptr i8, ptr %p.sr, i64 {{%.*}}
+; CHECK-NOT:     %col.sr
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %col = mul i64 %i, %n
+  %idx = add i64 %col, %j
+  %p = getelementptr inbounds double, ptr %a, i64 %idx
+  store double 0.0, ptr %p, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %cond = icmp ult i64 %i.next, %len
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  ret void
+}
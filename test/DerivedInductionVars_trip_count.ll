@@ -0,0 +1,79 @@
+; RUN: opt -load-pass-plugin %shlibdir/libDerivedInductionVars%shlibext -passes='loop-simplify,derived-iv' -derived-iv-mode=strength-reduce -derived-iv-min-trip-count=8 -derived-iv-verbose -S %s 2>%t.log | FileCheck %s
+; RUN: FileCheck %s --input-file=%t.log --check-prefix=LOG
+
+; Verify that with -derived-iv-min-trip-count the loops whose measured mean
+; trip count (the `llvm-tutor.loop.trip_count` metadata attached by
+; loop-tc-annotate) is below the threshold are skipped, but their inner loops
+; are still processed.
+
+; LOG:      Analyzing Loop: loop
+; LOG-NEXT:   Low trip count; skipping loop: loop
+; LOG:      Analyzing Loop: outer
+; LOG-NEXT:   Low trip count; skipping loop: outer
+; LOG-NEXT:   Analyzing Loop: inner
+; LOG-NEXT:     Strength-reduced: %row = {0,+, %n}
+
+define void @short(ptr %a, i64 %n, i64 %len) {
+; CHECK-LABEL: @short
+; CHECK-LABEL: {{^}}loop:
+; CHECK:         %col = mul i64 %i, %n
+; CHECK:         %p = getelementptr inbounds double, ptr %a, i64 %col
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %col = mul i64 %i, %n
+  %p = getelementptr inbounds double, ptr %a, i64 %col
+  store double 0.0, ptr %p, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %cond = icmp ult i64 %i.next, %len
+  br i1 %cond, label %loop, label %exit, !llvm.loop !0
+
+exit:
+  ret void
+}
+
+define void @nest(ptr %a, i64 %n, i64 %len) {
+; CHECK-LABEL: @nest
+; CHECK-LABEL: {{^}}outer:
+; CHECK-NOT:     .sr = phi
+; CHECK-LABEL: {{^}}inner:
+; CHECK-NEXT:    %p.sr = phi ptr
+; CHECK-NOT:     mul
+; CHECK:         store double 0.000000e+00, ptr %p.sr, align 8
+entry:
+  br label %outer
+
+outer:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %j = phi i64 [ 0, %outer ], [ %j.next, %inner ]
+  %row = mul i64 %j, %n
+  %idx = add i64 %row, %i
+  %p = getelementptr inbounds double, ptr %a, i64 %idx
+  store double 0.0, ptr %p, align 8
+  %j.next = add nuw nsw i64 %j, 1
+  %inner.cond = icmp ult i64 %j.next, %len
+  br i1 %inner.cond, label %inner, label %outer.latch, !llvm.loop !2
+
+outer.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %outer.cond = icmp ult i64 %i.next, 2
+  br i1 %outer.cond, label %outer, label %exit, !llvm.loop !4
+
+exit:
+  ret void
+}
+
+; Entered 10 times, 15 iterations in total (a mean of 1.5)
+!0 = distinct !{!0, !1}
+!1 = !{!"llvm-tutor.loop.trip_count", i64 10, i64 15, i64 2}
+; Entered 10 times, 1000 iterations in total (a mean of 100)
+!2 = distinct !{!2, !3}
+!3 = !{!"llvm-tutor.loop.trip_count", i64 10, i64 1000, i64 100}
+; Entered 10 times, 20 iterations in total (a mean of 2)
+!4 = distinct !{!4, !5}
+!5 = !{!"llvm-tutor.loop.trip_count", i64 10, i64 20, i64 2}
@@ -0,0 +1,68 @@
+; RUN: opt -load-pass-plugin %shlibdir/libDerivedInductionVars%shlibext -passes='loop-simplify,derived-iv' -derived-iv-mode=strength-reduce -derived-iv-widen -S %s | FileCheck %s
+
+; Verify that the 32-bit IVs that are sign-extended to index the GEPs are
+; replaced with 64-bit IVs (in both loops of the nest). The exit compares are
+; rewritten in terms of the wide IVs, so the narrow IVs are deleted.
+
+define void @zero(ptr %a) {
+; CHECK-LABEL: @zero
+; CHECK-LABEL: {{^}}outer:
+; CHECK:         %i.wide = phi i64 [ 0, %entry ], [ %i.wide.next, %outer.latch ]
+; CHECK-NOT:     %i = phi i32
+; CHECK-LABEL: {{^}}inner:
+; CHECK:         %j.wide = phi i64 [ 0, %outer ], [ %j.wide.next, %inner ]
+; CHECK-NOT:     %j = phi i32
+; CHECK-NOT:     sext
+; CHECK:         %j.wide.next = add i64 %j.wide, 1
+; CHECK-NEXT:    %inner.cond = icmp slt i64 %j.wide.next, 512
+; CHECK-LABEL: {{^}}outer.latch:
+; CHECK:         %i.wide.next = add i64 %i.wide, 1
+; CHECK-NEXT:    %outer.cond = icmp slt i64 %i.wide.next, 512
+entry:
+  br label %outer
+
+outer:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %j = phi i32 [ 0, %outer ], [ %j.next, %inner ]
+  %i.ext = sext i32 %i to i64
+  %j.ext = sext i32 %j to i64
+  %p = getelementptr inbounds [512 x double], ptr %a, i64 %i.ext, i64 %j.ext
+  store double 0.0, ptr %p, align 8
+  %j.next = add nsw i32 %j, 1
+  %inner.cond = icmp slt i32 %j.next, 512
+  br i1 %inner.cond, label %inner, label %outer.latch
+
+outer.latch:
+  %i.next = add nsw i32 %i, 1
+  %outer.cond = icmp slt i32 %i.next, 512
+  br i1 %outer.cond, label %outer, label %exit
+
+exit:
+  ret void
+}
+
+; The IV may wrap (no nsw and an unknown trip count), so the sext can't be
+; removed.
+define void @may_wrap(ptr %a, i32 %n) {
+; CHECK-LABEL: @may_wrap
+; CHECK:         %i = phi i32
+; CHECK:         %i.ext = sext i32 %i to i64
+; CHECK-NOT:     .wide
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %i.ext = sext i32 %i to i64
+  %p = getelementptr inbounds double, ptr %a, i64 %i.ext
+  store double 0.0, ptr %p, align 8
+  %i.next = add i32 %i, 1
+  %cond = icmp ne i32 %i.next, %n
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  ret void
+}
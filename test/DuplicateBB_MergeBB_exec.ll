@@ -2,6 +2,10 @@
 ; RUN:   | opt  -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libDuplicateBB%shlibext -passes=duplicate-bb -S -o - \
 ; RUN:   | opt  -load-pass-plugin %shlibdir/libMergeBB%shlibext -passes=merge-bb -S -o %t.ll
 ; RUN: %clang %t.ll -o %t.bin
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_mba.c -o - \
+; RUN:   | opt  -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libDuplicateBB%shlibext -passes=duplicate-bb -S -o - \
+; RUN:   | opt  -load-pass-plugin %shlibdir/libMergeBB%shlibext -passes=merge-bb -merge-bb-worklist -S -o %t.worklist.ll
+; RUN: %clang %t.worklist.ll -o %t.worklist.bin
 
 ; Verify that after applying DuplicaateBB + MergeBB the output generated by the
 ; input module (input_for_mba.c) doesn't change.
@@ -20,3 +24,9 @@
 ; RUN: not %t.bin 1 2 3 -7
 ; RUN: not %t.bin 13 13 -13 13
 ; RUN: not %t.bin -11101 100 1000 10000
+
+; The same for the worklist mode of MergeBB
+; RUN: %t.worklist.bin 0 0 0 0
+; RUN: %t.worklist.bin -11100 100 1000 10000
+; RUN: not %t.worklist.bin 0 0 0 1
+; RUN: not %t.worklist.bin -11101 100 1000 10000
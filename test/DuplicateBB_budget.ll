@@ -0,0 +1,43 @@
+; RUN: opt -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libDuplicateBB%shlibext -passes=duplicate-bb -duplicate-bb-max-growth=100 -S %s | FileCheck --check-prefix=BUDGET %s
+; RUN: opt -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libDuplicateBB%shlibext -passes=duplicate-bb -duplicate-bb-cold-only -S %s | FileCheck --check-prefix=COLD %s
+
+; Verify that DuplicateBB respects the growth budget and the cold-only mode.
+; @foo contains 9 instructions and all of its blocks are suitable for cloning.
+;   * With a budget of 100%, only the entry block (which adds 6 instructions)
+;     fits - duplicating any other block would exceed 9 new instructions.
+;   * In the cold-only mode, only %cold is duplicated. Based on the branch
+;     weights, %loop is hot and %entry and %exit run as often as the entry.
+
+define i32 @foo(i32 %a) {
+entry:
+  %c = icmp eq i32 %a, 0
+  br i1 %c, label %cold, label %loop, !prof !0
+
+cold:
+  %x = add i32 %a, 1
+  br label %exit
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %a
+  br i1 %done, label %exit, label %loop, !prof !1
+
+exit:
+  ret i32 0
+}
+
+!0 = !{!"branch_weights", i32 1, i32 1000}
+!1 = !{!"branch_weights", i32 1, i32 1000}
+
+; BUDGET-LABEL: @foo
+; BUDGET-NEXT:  lt-if-then-else-0:
+; BUDGET-NEXT:    %0 = icmp eq i32 %a, 0
+; BUDGET-NOT:   lt-if-then-else-1
+
+; COLD-LABEL: @foo
+; COLD-NEXT:  entry:
+; COLD:       lt-if-then-else-0:
+; COLD:       lt-clone-1-0:
+; COLD-NEXT:    %{{[0-9]+}} = add i32 %a, 1
+; COLD-NOT:   lt-if-then-else-1
@@ -0,0 +1,26 @@
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc,verify" -dynamic-cc-counter=atomic %S/Inputs/CallCounterInput.ll -o %t.bin
+; RUN: lli %t.bin | FileCheck %s --check-prefix=EXEC
+
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc,verify" -dynamic-cc-counter=atomic -S %s | FileCheck %s
+
+; Instrument this file with DynamicCallCounter in the atomic mode and verify
+; that the counters are 64-bit and are incremented with relaxed atomics.
+
+; CHECK: @CounterFor_foo = common global i64 0, align 8
+
+define void @foo() {
+; CHECK-LABEL: @foo(
+; CHECK-NEXT:    {{%.*}} = atomicrmw add ptr @CounterFor_foo, i64 1 monotonic, align 8
+; CHECK-NEXT:    ret void
+;
+  ret void
+}
+
+; CHECK: define void @printf_wrapper() {
+; CHECK:  {{%.*}} = load atomic i64, ptr @CounterFor_foo monotonic, align 8
+
+; The results are identical to the ones generated with plain counters
+; EXEC: bar                  2
+; EXEC-NEXT: main                 1
+; EXEC-NEXT: foo                  13
+; EXEC-NEXT: fez                  1
@@ -0,0 +1,59 @@
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc,verify" -dynamic-cc-output=binary -dynamic-cc-profile-file=%t.profdata %S/Inputs/CallCounterInput.ll -o %t.bin
+; RUN: rm -f %t.profdata
+; RUN: lli %t.bin
+; RUN: ../bin/dcc-profdata show %t.profdata | FileCheck %s --check-prefix=SHOW
+
+; Profiles from multiple runs can be merged
+; RUN: ../bin/dcc-profdata merge -o %t.merged.profdata %t.profdata %t.profdata
+; RUN: ../bin/dcc-profdata show %t.merged.profdata | FileCheck %s --check-prefix=MERGED
+
+; The same profile is generated when using sharded counters
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc,verify" -dynamic-cc-output=binary -dynamic-cc-counter=sharded -dynamic-cc-profile-file=%t.sharded.profdata %S/Inputs/CallCounterInput.ll -S -o %t.ll
+; RUN: %clang %t.ll -o %t.sharded.bin
+; RUN: %t.sharded.bin
+; RUN: ../bin/dcc-profdata show %t.sharded.profdata | FileCheck %s --check-prefix=SHOW
+
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc,verify" -dynamic-cc-output=binary -dynamic-cc-profile-file=prof.%p -S %s | FileCheck %s
+
+; Instrument this file with DynamicCallCounter and verify that the counters
+; and the names are stored in one global variable in a dedicated section and
+; that the profile is written on exit.
+
+; CHECK: @DynamicCallCounterProfile = internal global { { i64, i32, i32, i64 }, [2 x { i64, i32, i32 }], [6 x i8] } { { i64, i32, i32, i64 } { i64 31634475929857279, i32 1, i32 2, i64 6 }, [2 x { i64, i32, i32 }] [{ i64, i32, i32 } { i64 0, i32 0, i32 3 }, { i64, i32, i32 } { i64 0, i32 3, i32 3 }], [6 x i8] c"foobar" }, section "lt_dcc_prof", align 64
+; CHECK-NOT: @CounterFor_foo
+; CHECK: @llvm.used = appending global {{.*}} @DynamicCallCounterProfile
+; CHECK: @llvm.global_dtors = appending global
+; CHECK-SAME: @dcc_write_profile
+
+define void @foo() {
+; CHECK-LABEL: @foo(
+; CHECK-NEXT:    [[TMP1:%.*]] = load i64, ptr {{.*}}@DynamicCallCounterProfile
+; CHECK-NEXT:    [[TMP2:%.*]] = add i64 1, [[TMP1]]
+; CHECK-NEXT:    store i64 [[TMP2]], ptr {{.*}}@DynamicCallCounterProfile
+; CHECK-NEXT:    ret void
+;
+  ret void
+}
+
+define void @bar() {
+; CHECK-LABEL: @bar(
+; CHECK-NEXT:    [[TMP1:%.*]] = load i64, ptr {{.*}}@DynamicCallCounterProfile
+  ret void
+}
+
+; The profile is written in one go: 24 (header) + 2 * 16 (records) + 6 (names)
+; CHECK: define internal void @dcc_write_profile() {
+; CHECK:   {{%.*}} = call i32 (ptr, i64, ptr, ...) @snprintf(
+; CHECK:   {{%.*}} = call ptr @fopen(
+; CHECK:   {{%.*}} = call i64 @fwrite(ptr @DynamicCallCounterProfile, i64 1, i64 62, ptr {{%.*}})
+; CHECK:   {{%.*}} = call i32 @fclose(
+
+; SHOW: foo                  13
+; SHOW-NEXT: bar                  2
+; SHOW-NEXT: fez                  1
+; SHOW-NEXT: main                 1
+
+; MERGED: foo                  26
+; MERGED-NEXT: bar                  4
+; MERGED-NEXT: fez                  2
+; MERGED-NEXT: main                 2
@@ -0,0 +1,103 @@
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc,verify" -dynamic-cc-edges -dynamic-cc-profile-file=%t.profdata %s -o %t.bin
+; RUN: rm -f %t.profdata
+; RUN: lli %t.bin
+; RUN: ../bin/dcc-profdata show %t.profdata | FileCheck %s --check-prefix=SHOW
+
+; Call-edge profiles are converted into sample profiles that llvm-profdata
+; (and clang) can read
+; RUN: ../bin/dcc-profdata merge -o %t.prof %t.profdata
+; RUN: FileCheck %s --input-file=%t.prof --check-prefix=SAMPLE
+; RUN: llvm-profdata show -sample -function=main %t.prof | FileCheck %s --check-prefix=LLVM-PROFDATA
+
+; The same profile is generated with atomic counters
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc,verify" -dynamic-cc-edges -dynamic-cc-counter=atomic -dynamic-cc-profile-file=%t.atomic.profdata %s -o %t.atomic.bin
+; RUN: lli %t.atomic.bin
+; RUN: ../bin/dcc-profdata merge -o %t.atomic.prof %t.atomic.profdata
+; RUN: diff %t.prof %t.atomic.prof
+
+; With only one slot per indirect call site, the remaining target is unknown
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc,verify" -dynamic-cc-edges -dynamic-cc-icall-targets=1 -dynamic-cc-profile-file=%t.one.profdata %s -o %t.one.bin
+; RUN: lli %t.one.bin
+; RUN: ../bin/dcc-profdata show %t.one.profdata | FileCheck %s --check-prefix=ONE
+
+; Call sites are identified by the line relative to the start of the caller.
+; `main` calls `foo` 10 times directly and 6 times through a pointer. The
+; call to `bar` in `exit` is 64K lines below `main` and has no location.
+; SHOW:      Function: foo (entry count: 16)
+; SHOW:      Function: main (entry count: 1)
+; SHOW:      CALL SITE            CALLEE               #N CALLS
+; SHOW-NEXT: -------------------------------------------------
+; SHOW-NEXT: 3                    foo                  10
+; SHOW-NEXT: 4                    pick                 10
+; SHOW-NEXT: 5                    bar                  4
+; SHOW-NEXT: 5                    foo                  6
+; SHOW-NEXT: ?                    bar                  1
+
+; SAMPLE:      foo:16:16
+; SAMPLE-NEXT: bar:5:5
+; SAMPLE-NEXT: pick:10:10
+; SAMPLE-NEXT: main:31:1
+; SAMPLE-NEXT:  3: 10 foo:10
+; SAMPLE-NEXT:  4: 10 pick:10
+; SAMPLE-NEXT:  5: 10 bar:4 foo:6
+
+; LLVM-PROFDATA: Function: main: 31, 1, 3 sampled lines
+; LLVM-PROFDATA: 5: 10, calls: foo:6 bar:4
+
+; ONE:      5                    bar                  4
+; ONE-NEXT: 5                    <unknown>            6
+
+define i32 @foo(i32 %x) !dbg !10 {
+  %r = add i32 %x, 1
+  ret i32 %r
+}
+
+define i32 @bar(i32 %x) !dbg !11 {
+  %r = mul i32 %x, 2
+  ret i32 %r
+}
+
+define ptr @pick(i32 %i) !dbg !12 {
+  %is.zero = icmp eq i32 %i, 0
+  %fp = select i1 %is.zero, ptr @bar, ptr @foo
+  ret ptr %fp
+}
+
+define i32 @main() !dbg !13 {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %s = phi i32 [ 0, %entry ], [ %s.next, %loop ]
+  %a = call i32 @foo(i32 %i), !dbg !20
+  %m = urem i32 %i, 3
+  %fp = call ptr @pick(i32 %m), !dbg !21
+  %b = call i32 %fp(i32 %i), !dbg !22
+  %s.a = add i32 %s, %a
+  %s.next = add i32 %s.a, %b
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, 10
+  br i1 %done, label %exit, label %loop
+
+exit:
+  %c = call i32 @bar(i32 %s.next), !dbg !23
+  ret i32 0
+}
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!2}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C99, file: !1, producer: "llvm-tutor", isOptimized: false, runtimeVersion: 0, emissionKind: LineTablesOnly)
+!1 = !DIFile(filename: "edges.c", directory: "/")
+!2 = !{i32 2, !"Debug Info Version", i32 3}
+!3 = !DISubroutineType(types: !4)
+!4 = !{}
+!10 = distinct !DISubprogram(name: "foo", scope: !1, file: !1, line: 1, type: !3, scopeLine: 1, spFlags: DISPFlagDefinition, unit: !0)
+!11 = distinct !DISubprogram(name: "bar", scope: !1, file: !1, line: 2, type: !3, scopeLine: 2, spFlags: DISPFlagDefinition, unit: !0)
+!12 = distinct !DISubprogram(name: "pick", scope: !1, file: !1, line: 3, type: !3, scopeLine: 3, spFlags: DISPFlagDefinition, unit: !0)
+!13 = distinct !DISubprogram(name: "main", scope: !1, file: !1, line: 5, type: !3, scopeLine: 5, spFlags: DISPFlagDefinition, unit: !0)
+!20 = !DILocation(line: 8, column: 10, scope: !13)
+!21 = !DILocation(line: 9, column: 22, scope: !13)
+!22 = !DILocation(line: 10, column: 10, scope: !13)
+!23 = !DILocation(line: 65541, column: 10, scope: !13)
@@ -0,0 +1,39 @@
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc,verify" -dynamic-cc-sample-period=3 %S/Inputs/CallCounterInput.ll -S -o %t.ll
+; RUN: %clang %t.ll -o %t.bin
+; RUN: %t.bin | FileCheck %s --check-prefix=EXEC
+
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc,verify" -dynamic-cc-counter=atomic -dynamic-cc-sample-period=3 -S %s | FileCheck %s
+
+; Instrument this file with DynamicCallCounter in the sampling mode and verify
+; that every entry decrements a thread-local countdown and that the counter is
+; only incremented (by the sampling period) when the countdown reaches 0.
+
+; CHECK: @DynamicCallCounterCountdown = internal thread_local(initialexec) global i32 3
+
+define void @foo() {
+; CHECK-LABEL: @foo(
+; CHECK-NEXT:    [[TLS:%.*]] = call ptr @llvm.threadlocal.address.p0(ptr @DynamicCallCounterCountdown)
+; CHECK-NEXT:    [[COUNT:%.*]] = load i32, ptr [[TLS]]
+; CHECK-NEXT:    [[NEW:%.*]] = sub i32 [[COUNT]], 1
+; CHECK-NEXT:    store i32 [[NEW]], ptr [[TLS]]
+; CHECK-NEXT:    [[SAMPLED:%.*]] = icmp eq i32 [[NEW]], 0
+; CHECK-NEXT:    br i1 [[SAMPLED]], label %[[THEN:.*]], label %[[CONT:.*]], !prof [[PROF:![0-9]+]]
+; CHECK:       [[THEN]]:
+; CHECK-NEXT:    store i32 3, ptr [[TLS]]
+; CHECK-NEXT:    {{%.*}} = atomicrmw add ptr @CounterFor_foo, i64 3 monotonic, align 8
+; CHECK-NEXT:    br label %[[CONT]]
+; CHECK:       [[CONT]]:
+; CHECK-NEXT:    ret void
+;
+  ret void
+}
+
+; CHECK: [[PROF]] = !{!"branch_weights", i32 1, i32 2}
+
+; The entries are: main, foo, bar, foo, fez, bar, foo and then foo 10 times.
+; With a sampling period of 3, the 3rd, 6th, 9th, 12th and 15th entries are
+; recorded, so bar is reported as called 2 * 3 times and foo 3 * 3 times.
+; EXEC: bar                  6
+; EXEC-NEXT: main                 0
+; EXEC-NEXT: foo                  9
+; EXEC-NEXT: fez                  0
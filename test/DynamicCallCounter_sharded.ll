@@ -0,0 +1,34 @@
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc,verify" -dynamic-cc-counter=sharded -dynamic-cc-shards=4 %S/Inputs/CallCounterInput.ll -S -o %t.ll
+; RUN: %clang %t.ll -o %t.bin
+; RUN: %t.bin | FileCheck %s --check-prefix=EXEC
+
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc,verify" -dynamic-cc-counter=sharded -dynamic-cc-shards=3 -S %s | FileCheck %s
+
+; Instrument this file with DynamicCallCounter in the sharded mode and verify
+; that every thread increments the counter in its own, cache-line aligned row.
+; Note that the number of shards is rounded up to a power of 2 (3 -> 4) and
+; that every row is padded to 64 bytes (1 -> 8 counters).
+
+; CHECK: @DynamicCallCounterShards = internal global [4 x [8 x i64]] zeroinitializer, align 64
+; CHECK: @DynamicCallCounterShardId = internal thread_local(initialexec) global i32 0
+; CHECK-NOT: @CounterFor_foo
+
+define void @foo() {
+; CHECK-LABEL: @foo(
+; CHECK-NEXT:    [[SHARD:%.*]] = call i64 @dcc_shard_index()
+; CHECK-NEXT:    [[SLOT:%.*]] = getelementptr inbounds [4 x [8 x i64]], ptr @DynamicCallCounterShards, i64 0, i64 [[SHARD]], i64 0
+; CHECK-NEXT:    {{%.*}} = atomicrmw add ptr [[SLOT]], i64 1 monotonic, align 8
+; CHECK-NEXT:    ret void
+;
+  ret void
+}
+
+; The shards are summed before printing
+; CHECK: define void @printf_wrapper() {
+; CHECK:   {{%.*}} = call i64 @dcc_read_counter(i64 0)
+
+; The results are identical to the ones generated with plain counters
+; EXEC: bar                  2
+; EXEC-NEXT: main                 1
+; EXEC-NEXT: foo                  13
+; EXEC-NEXT: fez                  1
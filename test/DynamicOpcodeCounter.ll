@@ -0,0 +1,15 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicOpcodeCounter%shlibext -passes="dynamic-opcode-counter,verify" %S/Inputs/CallCounterInput.ll -o %t.bin
+; RUN: lli %t.bin | FileCheck %s
+
+; Test DynamicOpcodeCounter: the loop in main is executed 10 times, foo is
+; called 13 times, bar twice and fez once.
+
+; CHECK: LLVM-TUTOR: dynamic OpcodeCounter results
+; CHECK-DAG: alloca               2
+; CHECK-DAG: store                13
+; CHECK-DAG: load                 21
+; CHECK-DAG: icmp                 11
+; CHECK-DAG: add                  10
+; CHECK-DAG: br                   32
+; CHECK-DAG: call                 16
+; CHECK-DAG: ret                  17
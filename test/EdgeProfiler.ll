@@ -0,0 +1,92 @@
+; RUN: opt -load-pass-plugin %shlibdir/libEdgeProfiler%shlibext -passes="edge-prof,verify" -edge-prof-file=%t.profdata %s -o %t.bin
+; RUN: rm -f %t.profdata
+; RUN: lli %t.bin
+; RUN: ../bin/dcc-profdata show %t.profdata | FileCheck %s --check-prefix=SHOW
+
+; Edge profiles from multiple runs can be merged
+; RUN: ../bin/dcc-profdata merge -o %t.merged.profdata %t.profdata %t.profdata
+; RUN: ../bin/dcc-profdata show %t.merged.profdata | FileCheck %s --check-prefix=MERGED
+
+; RUN: opt -load-pass-plugin %shlibdir/libEdgeProfiler%shlibext -passes="edge-prof,verify" -edge-prof-atomic -S %s | FileCheck %s
+
+; Instrument this file with EdgeProfiler and verify that only the edges that
+; are not on the spanning tree are instrumented (foo has 5 blocks and 8 edges,
+; including the virtual ones, so 8 - 5 = 3 edges need a counter). The counts
+; of the remaining edges are reconstructed by dcc-profdata.
+
+; CHECK: @EdgeProfile = internal global { { i64, i32, i32, i32, i32, i64 }, [2 x { i32, i32, i32, i32, i32, i32 }], [4 x i64], [10 x { i32, i32, i32 }], [7 x i8] } { { i64, i32, i32, i32, i32, i64 } { i64 8098993185792224511, i32 1, i32 2, i32 4, i32 10, i64 7 }
+; CHECK-SAME: section "lt_edge_prof", align 64
+; CHECK: @llvm.used = appending global {{.*}} @EdgeProfile
+; CHECK: @llvm.global_dtors = appending global
+; CHECK-SAME: @edge_prof_write_profile
+
+; CHECK-LABEL: @foo(
+; CHECK-COUNT-3: atomicrmw add ptr {{.*}}@EdgeProfile{{.*}}, i64 1 monotonic
+; CHECK-NOT: atomicrmw
+; The call to foo may unwind, so the exit edge of main can't be instrumented
+; (the entry edge is instrumented instead)
+; CHECK-LABEL: @main(
+; CHECK-NEXT: entry:
+; CHECK-NEXT: atomicrmw add ptr {{.*}}@EdgeProfile{{.*}}, i64 1 monotonic
+; CHECK-NEXT: %res = call i32 @foo(i32 10)
+; CHECK-NEXT: ret i32 0
+
+; 32 (header) + 2 * 24 (functions) + 4 * 8 (counters) + 10 * 12 (edges) +
+; 7 (names)
+; CHECK: define internal void @edge_prof_write_profile() {
+; CHECK:   {{%.*}} = call ptr @fopen(
+; CHECK:   {{%.*}} = call i64 @fwrite(ptr @EdgeProfile, i64 1, i64 239, ptr {{%.*}})
+
+define i32 @foo(i32 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inc, %latch ]
+  %odd = and i32 %i, 1
+  %is.even = icmp eq i32 %odd, 0
+  br i1 %is.even, label %even, label %latch
+
+even:
+  br label %latch
+
+latch:
+  %inc = add i32 %i, 1
+  %done = icmp eq i32 %inc, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i32 %inc
+}
+
+define i32 @main() {
+entry:
+  %res = call i32 @foo(i32 10)
+  ret i32 0
+}
+
+; SHOW:      Function: foo (entry count: 1)
+; SHOW:      1                    1
+; SHOW-NEXT: 2                    10
+; SHOW-NEXT: 3                    5
+; SHOW-NEXT: 4                    10
+; SHOW-NEXT: 5                    1
+; SHOW:      <entry> -> 1         1
+; SHOW-NEXT: 1 -> 2               1
+; SHOW-NEXT: 2 -> 3               5
+; SHOW-NEXT: 2 -> 4               5
+; SHOW-NEXT: 3 -> 4               5
+; SHOW-NEXT: 4 -> 5               1
+; SHOW-NEXT: 4 -> 2               9
+; SHOW-NEXT: 5 -> <exit>          1
+; SHOW:      Function: main (entry count: 1)
+
+; MERGED:      Function: foo (entry count: 2)
+; MERGED:      <entry> -> 1         2
+; MERGED-NEXT: 1 -> 2               2
+; MERGED-NEXT: 2 -> 3               10
+; MERGED-NEXT: 2 -> 4               10
+; MERGED-NEXT: 3 -> 4               10
+; MERGED-NEXT: 4 -> 5               2
+; MERGED-NEXT: 4 -> 2               18
+; MERGED-NEXT: 5 -> <exit>          2
@@ -0,0 +1,68 @@
+; RUN: opt -load-pass-plugin %shlibdir/libEdgeProfiler%shlibext -passes="edge-prof,verify" -edge-prof-file=%t.profdata -S %s -o %t.ll
+; RUN: %clang %t.ll -o %t.bin
+; RUN: rm -f %t.profdata
+; RUN: %t.bin
+; RUN: ../bin/dcc-profdata show %t.profdata | FileCheck %s
+
+; Verify that the edge counts are correct when the execution leaves a
+; function in the middle of a block. @check calls exit (which doesn't return)
+; on its 4th invocation. The call to @check in %loop (and the call to @run in
+; @main) may not return either, so these blocks get an (uninstrumented) edge
+; to <exit>.
+
+; CHECK:      Function: check (entry count: 4)
+; CHECK:      <entry> -> 1         4
+; CHECK-NEXT: 1 -> 2               1
+; CHECK-NEXT: 1 -> 3               3
+; CHECK-NEXT: 2 -> <exit>          1
+; CHECK-NEXT: 3 -> <exit>          3
+
+; CHECK:      Function: run (entry count: 1)
+; CHECK:      1                    1
+; CHECK-NEXT: 2                    4
+; CHECK-NEXT: 3                    0
+; CHECK:      <entry> -> 1         1
+; CHECK-NEXT: 1 -> 2               1
+; CHECK-NEXT: 2 -> <exit>          1
+; CHECK-NEXT: 2 -> 3               0
+; CHECK-NEXT: 2 -> 2               3
+; CHECK-NEXT: 3 -> <exit>          0
+
+; CHECK:      Function: main (entry count: 1)
+; CHECK:      1 -> <exit>          1
+
+declare void @exit(i32) noreturn
+
+define void @check(i32 %i) {
+entry:
+  %c = icmp eq i32 %i, 3
+  br i1 %c, label %fail, label %ok
+
+fail:
+  call void @exit(i32 0)
+  unreachable
+
+ok:
+  ret void
+}
+
+define void @run(i32 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inc, %loop ]
+  call void @check(i32 %i)
+  %inc = add i32 %i, 1
+  %done = icmp eq i32 %inc, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+define i32 @main() {
+entry:
+  call void @run(i32 10)
+  ret i32 1
+}
@@ -0,0 +1,37 @@
+; RUN: opt -load-pass-plugin %shlibdir/libEdgeProfiler%shlibext -passes="edge-prof,verify" -edge-prof-file=%t.profdata %s -o %t.bin
+; RUN: rm -f %t.profdata
+; RUN: lli %t.bin
+; RUN: ../bin/dcc-profdata show %t.profdata | FileCheck %s --check-prefix=SHOW
+
+; RUN: opt -load-pass-plugin %shlibdir/libEdgeProfiler%shlibext -passes="edge-prof,verify" -edge-prof-atomic -S %s | FileCheck %s
+
+; The counter of an exit edge goes before the musttail call that ends the
+; block, as nothing may separate the call from the return. The virtual edge
+; to the entry block of @forward is on the spanning tree, so its exit edge is
+; the one that gets the counter.
+
+; CHECK-LABEL: @forward(
+; CHECK-NEXT:    atomicrmw add ptr {{.*}}, i64 1 monotonic
+; CHECK-NEXT:    %r = musttail call i32 @leaf(i32 %x)
+; CHECK-NEXT:    ret i32 %r
+
+; SHOW:      Function: forward (entry count: 3)
+; SHOW:      1 -> <exit>          3
+
+define i32 @leaf(i32 %x) nounwind {
+  %r = add i32 %x, 1
+  ret i32 %r
+}
+
+define i32 @forward(i32 %x) {
+  %r = musttail call i32 @leaf(i32 %x)
+  ret i32 %r
+}
+
+define i32 @main() {
+entry:
+  %a = call i32 @forward(i32 0)
+  %b = call i32 @forward(i32 1)
+  %c = call i32 @forward(i32 2)
+  ret i32 0
+}
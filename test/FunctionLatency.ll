@@ -0,0 +1,61 @@
+; RUN: %clang -c -emit-llvm %S/../inputs/input_for_hello.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libFunctionLatency%shlibext -passes="func-latency,verify" -S -o %t.ll
+; RUN: %clang %t.ll -o %t.bin
+; RUN: not %t.bin | FileCheck %s --check-prefix=EXEC
+
+; RUN: opt -load-pass-plugin %shlibdir/libFunctionLatency%shlibext -passes="func-latency,verify" -S %s | FileCheck %s
+
+; Instrument this file with FunctionLatency and verify that the cycle counter
+; is read on entry and that the latency is recorded on every exit, including
+; when an exception propagates out of the function.
+
+; CHECK: @llvm.global_dtors = appending global
+; CHECK-SAME: @func_latency_dump
+
+declare void @may_throw()
+
+define i32 @foo(i32 %a) nounwind {
+; CHECK-LABEL: @foo(
+; CHECK-NEXT:    [[ADDR:%.*]] = alloca i32
+; CHECK-NEXT:    [[START:%.*]] = call i64 @llvm.readcyclecounter()
+; CHECK:         call void @func_latency_record(i32 0, i64 [[START]])
+; CHECK-NEXT:    ret i32 0
+; CHECK:         call void @func_latency_record(i32 0, i64 [[START]])
+; CHECK-NEXT:    ret i32 1
+  %addr = alloca i32
+  %cmp = icmp eq i32 %a, 0
+  br i1 %cmp, label %zero, label %nonzero
+
+zero:
+  ret i32 0
+
+nonzero:
+  ret i32 1
+}
+
+define void @bar() {
+; CHECK-LABEL: @bar(
+; CHECK-NEXT:    [[START:%.*]] = call i64 @llvm.readcyclecounter()
+; CHECK-NEXT:    invoke void @may_throw()
+; CHECK-NEXT:            to label %[[CONT:.*]] unwind label %func_latency_cleanup
+; CHECK:       [[CONT]]:
+; CHECK-NEXT:    call void @func_latency_record(i32 1, i64 [[START]])
+; CHECK-NEXT:    ret void
+; CHECK:       func_latency_cleanup:
+; CHECK-NEXT:    [[LP:%.*]] = landingpad { ptr, i32 }
+; CHECK-NEXT:            cleanup
+; CHECK-NEXT:    call void @func_latency_record(i32 1, i64 [[START]])
+; CHECK-NEXT:    resume { ptr, i32 } [[LP]]
+  call void @may_throw()
+  ret void
+}
+
+; The histograms of all the threads are merged and printed on exit
+; CHECK: define internal void @func_latency_dump() {
+; CHECK:   call void @func_latency_print(ptr {{.*}}, ptr @FunctionLatencyHistograms)
+
+; EXEC: NAME                 #N CALLS   P50        P99
+; EXEC: foo                  3          {{[0-9]+}} {{[0-9]+}}
+; EXEC-NEXT: bar                  2          {{[0-9]+}} {{[0-9]+}}
+; EXEC-NEXT: fez                  1          {{[0-9]+}} {{[0-9]+}}
+; EXEC-NEXT: main                 1          {{[0-9]+}} {{[0-9]+}}
@@ -0,0 +1,46 @@
+; The combined plugin computes the results of OpcodeCounter, FindFCmpEq and
+; StaticCallCounter in one walk (FusedAnalysis) - they must be the same as
+; the results from the individual plugins
+; RUN: opt -load-pass-plugin %shlibdir/libLLVMTutor%shlibext \
+; RUN:   -passes='function(print<opcode-counter>,print<find-fcmp-eq>),print<static-cc>' \
+; RUN:   -disable-output %s > %t.combined.out 2> %t.combined.err
+; RUN: opt -load-pass-plugin %shlibdir/libOpcodeCounter%shlibext \
+; RUN:   -load-pass-plugin %shlibdir/libFindFCmpEq%shlibext \
+; RUN:   -load-pass-plugin %shlibdir/libStaticCallCounter%shlibext \
+; RUN:   -passes='function(print<opcode-counter>,print<find-fcmp-eq>),print<static-cc>' \
+; RUN:   -disable-output %s > %t.separate.out 2> %t.separate.err
+; RUN: diff %t.combined.out %t.separate.out
+; RUN: diff %t.combined.err %t.separate.err
+; RUN: FileCheck %s --input-file=%t.combined.out --check-prefix=FCMP
+; RUN: FileCheck %s --input-file=%t.combined.err --check-prefix=COUNTS
+
+; The cached results are dropped once ConvertFCmpEq rewrites the comparisons
+; RUN: opt -load-pass-plugin %shlibdir/libLLVMTutor%shlibext \
+; RUN:   -passes='function(print<find-fcmp-eq>,convert-fcmp-eq,print<find-fcmp-eq>)' \
+; RUN:   -disable-output %s | FileCheck %s --check-prefix=CONVERT
+
+; FCMP:      Floating-point equality comparisons in "is_zero":
+; FCMP-NEXT:   %cmp = fcmp oeq double %x, 0.000000e+00
+; FCMP-NOT:  Floating-point equality comparisons
+
+; COUNTS-LABEL: Printing analysis 'OpcodeCounter Pass' for function 'is_zero'
+; COUNTS:       fcmp                 1
+; COUNTS-LABEL: Printing analysis 'OpcodeCounter Pass' for function 'main'
+; COUNTS:       call                 2
+; COUNTS:       is_zero              2
+
+; CONVERT:     Floating-point equality comparisons in "is_zero":
+; CONVERT-NOT: Floating-point equality comparisons
+
+define i1 @is_zero(double %x) {
+  %cmp = fcmp oeq double %x, 0.000000e+00
+  ret i1 %cmp
+}
+
+define i32 @main() {
+  %a = call i1 @is_zero(double 1.000000e+00)
+  %b = call i1 @is_zero(double 0.000000e+00)
+  %c = and i1 %a, %b
+  %r = zext i1 %c to i32
+  ret i32 %r
+}
@@ -0,0 +1,122 @@
+; RUN: opt -load-pass-plugin %shlibdir/libLoopTiling%shlibext -passes='loop-simplify,loop-tile' -loop-tile-size=16 -S %s | FileCheck %s
+; RUN: opt -load-pass-plugin %shlibdir/libLoopTiling%shlibext -passes='loop-simplify,loop-tile' -loop-tile-size=0 -S %s | FileCheck %s --check-prefix=INTERCHANGE
+
+; C[i][j] += A[i][k] * B[k][j]: the k loop is moved outside of the j loop (so
+; that B and C are accessed with unit stride) and the nest is tiled by 16.
+define void @matmul(ptr noalias %a, ptr noalias %b, ptr noalias %c) {
+; CHECK-LABEL: @matmul
+; CHECK:       tile.header:
+; CHECK-NEXT:    %i.tile = phi i64 [ 0, %entry ], [ %i.tile.next, %tile.latch{{[0-9]*}} ]
+; CHECK-NEXT:    %i.tile.next = add nuw i64 %i.tile, 16
+; CHECK-NEXT:    %i.tile.cond = icmp ult i64 %i.tile.next, 64
+; CHECK-NEXT:    %i.tile.bound = select i1 %i.tile.cond, i64 %i.tile.next, i64 64
+; CHECK:       tile.header{{[0-9]+}}:
+; CHECK-NEXT:    %k.tile = phi i64
+; CHECK:       tile.header{{[0-9]+}}:
+; CHECK-NEXT:    %j.tile = phi i64
+; CHECK:       i.loop:
+; CHECK-NEXT:    %i = phi i64 [ %i.tile, %{{.*}} ], [ %i.next, %i.latch ]
+; CHECK:       j.loop:
+; CHECK-NEXT:    %k = phi i64 [ %k.tile, %i.loop ], [ %k.next, %j.latch ]
+; CHECK:       k.loop:
+; CHECK-NEXT:    %j = phi i64 [ %j.tile, %j.loop ], [ %j.next, %k.loop ]
+; CHECK-NEXT:    %pa = getelementptr inbounds [64 x double], ptr %a, i64 %i, i64 %k
+; CHECK-NEXT:    %pb = getelementptr inbounds [64 x double], ptr %b, i64 %k, i64 %j
+; CHECK-NEXT:    %pc = getelementptr inbounds [64 x double], ptr %c, i64 %i, i64 %j
+; CHECK:         %j.next = add i64 %j, 1
+; CHECK-NEXT:    %j.cond = icmp ult i64 %j.next, %j.tile.bound
+; CHECK:       j.latch:
+; CHECK-NEXT:    %k.next = add i64 %k, 1
+; CHECK-NEXT:    %k.cond = icmp ult i64 %k.next, %k.tile.bound
+; CHECK:       i.latch:
+; CHECK-NEXT:    %i.next = add nuw nsw i64 %i, 1
+; CHECK-NEXT:    %i.cond = icmp ult i64 %i.next, %i.tile.bound
+; CHECK-NEXT:    br i1 %i.cond, label %i.loop, label %tile.latch
+; CHECK:       tile.latch:
+; CHECK-NEXT:    br i1 %j.tile.cond, label %tile.header{{[0-9]+}}, label %tile.latch{{[0-9]+}}
+
+; INTERCHANGE-LABEL: @matmul
+; INTERCHANGE-NOT:   tile
+; INTERCHANGE:       j.loop:
+; INTERCHANGE-NEXT:    %k = phi i64 [ 0, %i.loop ], [ %k.next, %j.latch ]
+; INTERCHANGE:       k.loop:
+; INTERCHANGE-NEXT:    %j = phi i64 [ 0, %j.loop ], [ %j.next, %k.loop ]
+; INTERCHANGE:         %pb = getelementptr inbounds [64 x double], ptr %b, i64 %k, i64 %j
+entry:
+  br label %i.loop
+
+i.loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %i.latch ]
+  br label %j.loop
+
+j.loop:
+  %j = phi i64 [ 0, %i.loop ], [ %j.next, %j.latch ]
+  br label %k.loop
+
+k.loop:
+  %k = phi i64 [ 0, %j.loop ], [ %k.next, %k.loop ]
+  %pa = getelementptr inbounds [64 x double], ptr %a, i64 %i, i64 %k
+  %pb = getelementptr inbounds [64 x double], ptr %b, i64 %k, i64 %j
+  %pc = getelementptr inbounds [64 x double], ptr %c, i64 %i, i64 %j
+  %va = load double, ptr %pa, align 8
+  %vb = load double, ptr %pb, align 8
+  %vc = load double, ptr %pc, align 8
+  %mul = fmul double %va, %vb
+  %add = fadd double %vc, %mul
+  store double %add, ptr %pc, align 8
+  %k.next = add nuw nsw i64 %k, 1
+  %k.cond = icmp ult i64 %k.next, 64
+  br i1 %k.cond, label %k.loop, label %j.latch
+
+j.latch:
+  %j.next = add nuw nsw i64 %j, 1
+  %j.cond = icmp ult i64 %j.next, 64
+  br i1 %j.cond, label %j.loop, label %i.latch
+
+i.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %i.cond = icmp ult i64 %i.next, 64
+  br i1 %i.cond, label %i.loop, label %exit
+
+exit:
+  ret void
+}
+
+; A[j][i] = A[j + 1][i - 1] - the dependence has the distance (1, -1), so
+; neither the interchange (that would make the access unit-stride) nor tiling
+; is legal.
+define void @skewed(ptr %a) {
+; CHECK-LABEL: @skewed
+; CHECK-NOT:   tile
+; CHECK:       i.loop:
+; CHECK-NEXT:    %i = phi i64 [ 1, %entry ], [ %i.next, %i.latch ]
+; CHECK:       j.loop:
+; CHECK-NEXT:    %j = phi i64 [ 0, %i.loop ], [ %j.next, %j.loop ]
+; CHECK:         %dst = getelementptr inbounds [64 x double], ptr %a, i64 %j, i64 %i
+entry:
+  br label %i.loop
+
+i.loop:
+  %i = phi i64 [ 1, %entry ], [ %i.next, %i.latch ]
+  br label %j.loop
+
+j.loop:
+  %j = phi i64 [ 0, %i.loop ], [ %j.next, %j.loop ]
+  %j.src = add nuw nsw i64 %j, 1
+  %i.src = add nsw i64 %i, -1
+  %src = getelementptr inbounds [64 x double], ptr %a, i64 %j.src, i64 %i.src
+  %dst = getelementptr inbounds [64 x double], ptr %a, i64 %j, i64 %i
+  %v = load double, ptr %src, align 8
+  store double %v, ptr %dst, align 8
+  %j.next = add nuw nsw i64 %j, 1
+  %j.cond = icmp ult i64 %j.next, 63
+  br i1 %j.cond, label %j.loop, label %i.latch
+
+i.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %i.cond = icmp ult i64 %i.next, 64
+  br i1 %i.cond, label %i.loop, label %exit
+
+exit:
+  ret void
+}
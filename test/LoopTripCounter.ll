@@ -0,0 +1,119 @@
+; RUN: opt -load-pass-plugin %shlibdir/libLoopTripCounter%shlibext -passes="loop-tc,verify" -loop-tc-file=%t.profdata %s -o %t.bin
+; RUN: rm -f %t.profdata
+; RUN: lli %t.bin
+; RUN: ../bin/dcc-profdata show %t.profdata | FileCheck %s --check-prefix=SHOW
+
+; Loop profiles from multiple runs can be merged
+; RUN: ../bin/dcc-profdata merge -o %t.merged.profdata %t.profdata %t.profdata
+; RUN: ../bin/dcc-profdata show %t.merged.profdata | FileCheck %s --check-prefix=MERGED
+
+; The trip counts are attached to the loops of the (uninstrumented) input
+; RUN: opt -load-pass-plugin %shlibdir/libLoopTripCounter%shlibext -passes=loop-tc-annotate -loop-tc-profile=%t.merged.profdata -S %s | FileCheck %s --check-prefix=ANNOTATE
+; Annotating twice replaces the previous trip counts
+; RUN: opt -load-pass-plugin %shlibdir/libLoopTripCounter%shlibext -passes=loop-tc-annotate -loop-tc-profile=%t.merged.profdata -S %s \
+; RUN:   | opt -load-pass-plugin %shlibdir/libLoopTripCounter%shlibext -passes=loop-tc-annotate -loop-tc-profile=%t.profdata -S \
+; RUN:   | FileCheck %s --check-prefix=REANNOTATE
+
+; RUN: opt -load-pass-plugin %shlibdir/libLoopTripCounter%shlibext -passes="loop-tc,verify" -loop-tc-atomic -S %s | FileCheck %s
+
+; Instrument this file with LoopTripCounter and verify the trip counts of the
+; two loops in main: the outer loop is entered once and runs 4 iterations,
+; the inner loop is entered 4 times and runs 1, 2, 3 and 4 iterations.
+
+; CHECK: @LoopProfile = internal global { { i64, i32, i32, i32, i32, i64 }, [1 x { i32, i32, i32, i32, i32, i32 }], [2 x { i32, i32, i64, i64, i64, [16 x i64] }], [4 x i8] }
+; CHECK-SAME: section "lt_loop_prof", align 64
+; CHECK: @llvm.used = appending global {{.*}} @LoopProfile
+; CHECK: @llvm.global_dtors = appending global
+; CHECK-SAME: @loop_tc_write_profile
+
+; CHECK-LABEL: @main(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    [[OUTER_TC:%.*]] = alloca i64
+; CHECK-NEXT:    [[INNER_TC:%.*]] = alloca i64
+; CHECK-NEXT:    store i64 0, ptr [[OUTER_TC]]
+; CHECK-LABEL: outer:
+; CHECK:         store i64 {{%.*}}, ptr [[OUTER_TC]]
+; CHECK:         store i64 0, ptr [[INNER_TC]]
+; CHECK-LABEL: inner:
+; CHECK:         store i64 {{%.*}}, ptr [[INNER_TC]]
+; CHECK-LABEL: outer.latch:
+; CHECK-NEXT:    [[TRIP:%.*]] = load i64, ptr [[INNER_TC]]
+; CHECK-NEXT:    call void @loop_tc_record(ptr {{.*}}@LoopProfile{{.*}}, i64 [[TRIP]])
+; CHECK-LABEL: exit:
+; CHECK-NEXT:    [[TRIP:%.*]] = load i64, ptr [[OUTER_TC]]
+; CHECK-NEXT:    call void @loop_tc_record(ptr {{.*}}@LoopProfile{{.*}}, i64 [[TRIP]])
+
+; CHECK-LABEL: define internal void @loop_tc_record(ptr %0, i64 %1)
+; CHECK:         atomicrmw add ptr {{%.*}}, i64 1 monotonic
+; CHECK:         atomicrmw add ptr {{%.*}}, i64 %1 monotonic
+; CHECK:         atomicrmw umax ptr {{%.*}}, i64 %1 monotonic
+; CHECK:         call i64 @llvm.ctlz.i64(i64 %1, i1 false)
+; CHECK:         atomicrmw add ptr {{%.*}}, i64 1 monotonic
+
+; 32 (header) + 24 (function) + 2 * 160 (loops) + 4 (names)
+; CHECK: define internal void @loop_tc_write_profile() {
+; CHECK:   {{%.*}} = call ptr @fopen(
+; CHECK:   {{%.*}} = call i64 @fwrite(ptr @LoopProfile, i64 1, i64 380, ptr {{%.*}})
+
+; SHOW:      LLVM-TUTOR: loop trip count results
+; SHOW:      Function: main
+; SHOW-NEXT: HEADER   DEPTH  #N ENTRIES   MEAN TRIPS   MAX TRIPS
+; SHOW-NEXT: -------------------------------------------------
+; SHOW-NEXT: 2        1      1            4.00         4
+; SHOW-NEXT:   trips 4-7      1
+; SHOW-NEXT: 3        2      4            2.50         4
+; SHOW-NEXT:   trips 1        1
+; SHOW-NEXT:   trips 2-3      2
+; SHOW-NEXT:   trips 4-7      1
+; SHOW-NOT:  Function
+
+; MERGED:      Function: main
+; MERGED:      2        1      2            4.00         4
+; MERGED-NEXT:   trips 4-7      2
+; MERGED-NEXT: 3        2      8            2.50         4
+; MERGED-NEXT:   trips 1        2
+; MERGED-NEXT:   trips 2-3      4
+; MERGED-NEXT:   trips 4-7      2
+
+; ANNOTATE-LABEL: inner:
+; ANNOTATE:         br i1 %inner.cond, label %inner, label %outer.latch, !llvm.loop [[INNER:![0-9]+]]
+; ANNOTATE-LABEL: outer.latch:
+; ANNOTATE:         br i1 %outer.cond, label %outer, label %exit, !llvm.loop [[OUTER:![0-9]+]]
+; ANNOTATE-DAG: [[OUTER]] = distinct !{[[OUTER]], [[OUTER_UNROLL:![0-9]+]], [[OUTER_TC:![0-9]+]], [[OUTER_HIST:![0-9]+]]}
+; ANNOTATE-DAG: [[OUTER_UNROLL]] = !{!"llvm.loop.unroll.disable"}
+; ANNOTATE-DAG: [[OUTER_TC]] = !{!"llvm-tutor.loop.trip_count", i64 2, i64 8, i64 4}
+; ANNOTATE-DAG: [[OUTER_HIST]] = !{!"llvm-tutor.loop.trip_count.histogram", i64 0, i64 0, i64 0, i64 2}
+; ANNOTATE-DAG: [[INNER]] = distinct !{[[INNER]], [[INNER_TC:![0-9]+]], [[INNER_HIST:![0-9]+]]}
+; ANNOTATE-DAG: [[INNER_TC]] = !{!"llvm-tutor.loop.trip_count", i64 8, i64 20, i64 4}
+; ANNOTATE-DAG: [[INNER_HIST]] = !{!"llvm-tutor.loop.trip_count.histogram", i64 0, i64 2, i64 4, i64 2}
+
+; REANNOTATE: !{!"llvm-tutor.loop.trip_count", i64 4, i64 10, i64 4}
+; REANNOTATE: !{!"llvm-tutor.loop.trip_count", i64 1, i64 4, i64 4}
+; REANNOTATE-NOT: !"llvm-tutor.loop.trip_count",
+
+define i32 @main() {
+entry:
+  br label %outer
+
+outer:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %outer.latch ]
+  %n = add i64 %i, 1
+  br label %inner
+
+inner:
+  %j = phi i64 [ 0, %outer ], [ %j.next, %inner ]
+  %j.next = add i64 %j, 1
+  %inner.cond = icmp ult i64 %j.next, %n
+  br i1 %inner.cond, label %inner, label %outer.latch
+
+outer.latch:
+  %i.next = add i64 %i, 1
+  %outer.cond = icmp ult i64 %i.next, 4
+  br i1 %outer.cond, label %outer, label %exit, !llvm.loop !0
+
+exit:
+  ret i32 0
+}
+
+!0 = distinct !{!0, !1}
+!1 = !{!"llvm.loop.unroll.disable"}
@@ -0,0 +1,95 @@
+; RUN: opt -load-pass-plugin %shlibdir/libLoopTripCounter%shlibext -passes="loop-tc,verify" -loop-tc-file=%t.profdata %s -o %t.bin
+; RUN: rm -f %t.profdata
+; RUN: lli %t.bin
+; RUN: ../bin/dcc-profdata show %t.profdata | FileCheck %s --check-prefix=SHOW
+
+; RUN: opt -load-pass-plugin %shlibdir/libLoopTripCounter%shlibext -passes="loop-tc,verify" -S %s | FileCheck %s
+
+; The trip counts are numbers of iterations whatever the form of the loop:
+;   * @guarded is a rotated loop, entered 3 times for 0, 0 and 3 iterations.
+;     The first two entries are skipped by the guard and never reach the
+;     preheader.
+;   * @while checks the exit condition in the header, and is entered 2 times
+;     for 0 and 2 iterations.
+
+; CHECK-LABEL: @guarded(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    [[TC:%.*]] = alloca i64
+; CHECK-NEXT:    %enter = icmp ne i64 %n, 0
+; CHECK-NEXT:    [[SKIP:%.*]] = xor i1 %enter, true
+; CHECK-NEXT:    [[SKIP64:%.*]] = zext i1 [[SKIP]] to i64
+; CHECK:         add i64 {{%.*}}, [[SKIP64]]
+; CHECK:         add i64 {{%.*}}, [[SKIP64]]
+; CHECK:         br i1 %enter, label %loop.ph, label %end
+; CHECK-LABEL: loop.ph:
+; CHECK-NEXT:    store i64 0, ptr [[TC]]
+
+; CHECK-LABEL: @while(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    [[TC:%.*]] = alloca i64
+; CHECK-NEXT:    store i64 -1, ptr [[TC]]
+; CHECK-NEXT:    br label %header
+
+; CHECK-LABEL: define internal void @loop_tc_record(ptr %0, i64 %1)
+; CHECK:         call i64 @llvm.ctlz.i64(i64 %1, i1 false)
+
+; SHOW:      Function: guarded
+; SHOW-NEXT: HEADER   DEPTH  #N ENTRIES   MEAN TRIPS   MAX TRIPS
+; SHOW-NEXT: -------------------------------------------------
+; SHOW-NEXT: 3        1      3            1.00         3
+; SHOW-NEXT:   trips 0        2
+; SHOW-NEXT:   trips 2-3      1
+; SHOW:      Function: while
+; SHOW-NEXT: HEADER   DEPTH  #N ENTRIES   MEAN TRIPS   MAX TRIPS
+; SHOW-NEXT: -------------------------------------------------
+; SHOW-NEXT: 2        1      2            1.00         2
+; SHOW-NEXT:   trips 0        1
+; SHOW-NEXT:   trips 2-3      1
+
+define void @guarded(i64 %n) {
+entry:
+  %enter = icmp ne i64 %n, 0
+  br i1 %enter, label %loop.ph, label %end
+
+loop.ph:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %loop.ph ], [ %i.next, %loop ]
+  %i.next = add i64 %i, 1
+  %cond = icmp ult i64 %i.next, %n
+  br i1 %cond, label %loop, label %loop.exit
+
+loop.exit:
+  br label %end
+
+end:
+  ret void
+}
+
+define void @while(i64 %n) {
+entry:
+  br label %header
+
+header:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %body ]
+  %cond = icmp ult i64 %i, %n
+  br i1 %cond, label %body, label %exit
+
+body:
+  %i.next = add i64 %i, 1
+  br label %header
+
+exit:
+  ret void
+}
+
+define i32 @main() {
+entry:
+  call void @guarded(i64 0)
+  call void @guarded(i64 0)
+  call void @guarded(i64 3)
+  call void @while(i64 0)
+  call void @while(i64 2)
+  ret i32 0
+}
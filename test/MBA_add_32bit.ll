@@ -8,11 +8,48 @@ define signext i32 @foo(i32 signext, i32 signext, i32 signext, i32 signext) {
   ret i32 %7
 }
 
-; Verify that the additions in foo are _not_ substituted (because MBAAdd
-; is only meant for 8-bit additions)
+; Verify that the additions in foo are correctly substituted with:
+;    a + b == (((a ^ b) + 2 * (a & b)) * 39 + 23) * C3 + C4
+; where C3 = 39^-1 (mod 2^32) = -1762037865 and C4 = -23 * C3 = 1872165231
 
 ; CHECK-LABEL: @foo
-; CHECK-NEXT:  %5 = add i32 %1, %0
-; CHECK-NEXT:  %6 = add i32 %5, %2
-; CHECK-NEXT:  %7 = add i32 %6, %3
-; CHECK-NEXT:  ret i32 %7
+; 1st addition
+; CHECK-DAG:   {{%[0-9]+}} = xor i32 {{%[0-9]+}}, {{%[0-9]+}}
+; CHECK-DAG:   {{%[0-9]+}} = and i32 {{%[0-9]+}}, {{%[0-9]+}}
+; CHECK-DAG:   {{%[0-9]+}} = mul i32 2, {{%[0-9]+}}
+; CHECK-DAG:   [[REG_1:%[0-9]+]] = add i32 {{%[0-9]+}}, {{%[0-9]+}}
+; CHECK-NEXT:  [[REG_2:%[0-9]+]] = mul i32 39, [[REG_1]]
+; CHECK-NEXT:  [[REG_3:%[0-9]+]] = add i32 23, [[REG_2]]
+; CHECK-NEXT:  [[REG_4:%[0-9]+]] = mul i32 -1762037865, [[REG_3]]
+; CHECK-NEXT:  [[REG_5:%[0-9]+]] = add i32 1872165231, [[REG_4]]
+;
+; 2nd addition
+; CHECK-DAG:   {{%[0-9]+}} = xor i32 [[REG_5]], {{%[0-9]+}}
+; CHECK-DAG:   {{%[0-9]+}} = and i32 [[REG_5]], {{%[0-9]+}}
+; CHECK-DAG:   {{%[0-9]+}} = mul i32 2, {{%[0-9]+}}
+; CHECK-DAG:   [[REG_6:%[0-9]+]] = add i32 {{%[0-9]+}}, {{%[0-9]+}}
+; CHECK-NEXT:  [[REG_7:%[0-9]+]] = mul i32 39, [[REG_6]]
+; CHECK-NEXT:  [[REG_8:%[0-9]+]] = add i32 23, [[REG_7]]
+; CHECK-NEXT:  [[REG_9:%[0-9]+]] = mul i32 -1762037865, [[REG_8]]
+; CHECK-NEXT:  [[REG_10:%[0-9]+]] = add i32 1872165231, [[REG_9]]
+;
+; 3rd addition
+; CHECK-DAG:   {{%[0-9]+}} = xor i32 [[REG_10]], {{%[0-9]+}}
+; CHECK-DAG:   {{%[0-9]+}} = and i32 [[REG_10]], {{%[0-9]+}}
+; CHECK-DAG:   {{%[0-9]+}} = mul i32 2, {{%[0-9]+}}
+; CHECK-DAG:   [[REG_11:%[0-9]+]] = add i32 {{%[0-9]+}}, {{%[0-9]+}}
+; CHECK-NEXT:  [[REG_12:%[0-9]+]] = mul i32 39, [[REG_11]]
+; CHECK-NEXT:  [[REG_13:%[0-9]+]] = add i32 23, [[REG_12]]
+; CHECK-NEXT:  [[REG_14:%[0-9]+]] = mul i32 -1762037865, [[REG_13]]
+; CHECK-NEXT:  [[REG_15:%[0-9]+]] = add i32 1872165231, [[REG_14]]
+; CHECK-NEXT:  ret i32 [[REG_15]]
+
+; Additions narrower than 8 bits are not substituted
+define i4 @narrow(i4 %a, i4 %b) {
+  %res = add i4 %a, %b
+  ret i4 %res
+}
+
+; CHECK-LABEL: @narrow
+; CHECK-NEXT:  %res = add i4 %a, %b
+; CHECK-NEXT:  ret i4 %res
@@ -0,0 +1,98 @@
+; Hot blocks identified with BlockFrequencyInfo
+; RUN: opt -load-pass-plugin=%shlibdir/libMBAAdd%shlibext -passes="mba-add" \
+; RUN:   -mba-add-hot-threshold=4 -S %s | FileCheck %s --check-prefix=SKIP
+; RUN: opt -load-pass-plugin=%shlibdir/libMBAAdd%shlibext -passes="mba-add" \
+; RUN:   -mba-add-hot-threshold=4 -mba-add-hot-percentage=50 -S %s \
+; RUN:   | FileCheck %s --check-prefix=PARTIAL
+; RUN: opt -load-pass-plugin=%shlibdir/libMBASub%shlibext -passes="mba-sub" \
+; RUN:   -mba-sub-hot-threshold=4 -S %s | FileCheck %s --check-prefix=SUB
+
+; Hot functions identified with a DynamicCallCounter profile
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext \
+; RUN:   -passes="dynamic-cc" -dynamic-cc-output=binary \
+; RUN:   -dynamic-cc-profile-file=%t.profdata %s -o %t.bin
+; RUN: rm -f %t.profdata
+; RUN: lli %t.bin
+; RUN: opt -load-pass-plugin=%shlibdir/libMBAAdd%shlibext -passes="mba-add" \
+; RUN:   -mba-add-hot-threshold=10 -mba-add-profile=%t.profdata -S %s \
+; RUN:   | FileCheck %s --check-prefix=PROFILE
+
+; The entry block runs once per call, the loop body is estimated to run many
+; times per call
+define i32 @sum(i32 %n, i32 %a, i32 %b) {
+entry:
+  %start = add i32 %a, %b
+  %diff = sub i32 %a, %b
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %acc = phi i32 [ %start, %entry ], [ %acc.next, %loop ]
+  %t1 = add i32 %acc, %a
+  %t2 = add i32 %t1, %b
+  %acc.next = sub i32 %t2, %diff
+  %i.next = add i32 %i, 1
+  %cond = icmp slt i32 %i.next, %n
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  ret i32 %acc.next
+}
+
+; Only the additions in the entry block are obfuscated
+; SKIP-LABEL: @sum
+; SKIP:       mul i32 39
+; SKIP-LABEL: loop:
+; SKIP-NEXT:    %i = phi
+; SKIP-NEXT:    %acc = phi
+; SKIP-NEXT:    %t1 = add i32 %acc, %a
+; SKIP-NEXT:    %t2 = add i32 %t1, %b
+; SKIP-NEXT:    %acc.next = sub i32 %t2, %diff
+; SKIP-NEXT:    %i.next = add i32 %i, 1
+
+; Every second addition in the loop is obfuscated
+; PARTIAL-LABEL: loop:
+; PARTIAL-NEXT:    %i = phi
+; PARTIAL-NEXT:    %acc = phi
+; PARTIAL-NEXT:    %t1 = add i32 %acc, %a
+; PARTIAL:         mul i32 39
+; PARTIAL:         %acc.next = sub i32
+; PARTIAL-NEXT:    %i.next = add i32 %i, 1
+
+; SUB-LABEL: @sum
+; SUB:       %diff = add i32
+; SUB-LABEL: loop:
+; SUB:       %acc.next = sub i32 %t2, %diff
+
+define i32 @hot(i32 %a, i32 %b) {
+  %res = add i32 %a, %b
+  ret i32 %res
+}
+
+define i32 @cold(i32 %a, i32 %b) {
+  %res = add i32 %a, %b
+  ret i32 %res
+}
+
+define i32 @main() {
+entry:
+  %c = call i32 @cold(i32 1, i32 2)
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %h = call i32 @hot(i32 %i, i32 %c)
+  %i.next = add i32 %i, 1
+  %cond = icmp slt i32 %i.next, 100
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  ret i32 0
+}
+
+; @hot is called 100 times, so it is not obfuscated at all
+; PROFILE-LABEL: @hot
+; PROFILE-NEXT:    %res = add i32 %a, %b
+; PROFILE-NEXT:    ret i32 %res
+; PROFILE-LABEL: @cold
+; PROFILE:         mul i32 39
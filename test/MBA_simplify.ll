@@ -0,0 +1,127 @@
+; RUN: opt -load-pass-plugin=%shlibdir/libMBAAdd%shlibext \
+; RUN:   -load-pass-plugin=%shlibdir/libMBASub%shlibext \
+; RUN:   -load-pass-plugin=%shlibdir/libMBASimplify%shlibext \
+; RUN:   -passes="mba-add,mba-sub,mba-simplify" -S %s | FileCheck %s
+; RUN: opt -load-pass-plugin=%shlibdir/libMBASimplify%shlibext \
+; RUN:   -passes="mba-simplify" -S %s | FileCheck %s --check-prefix=LINEAR
+
+; Verify that MBASimplify undoes the obfuscation performed by MBAAdd and
+; MBASub, i.e. that the original additions and subtractions are recovered.
+
+define i8 @add(i8 %a, i8 %b, i8 %c, i8 %d) {
+  %1 = add i8 %b, %a
+  %2 = add i8 %1, %c
+  %3 = add i8 %2, %d
+  ret i8 %3
+}
+
+; CHECK-LABEL: @add
+; CHECK-NEXT:  [[REG_1:%[0-9]+]] = add i8 %b, %a
+; CHECK-NEXT:  [[REG_2:%[0-9]+]] = add i8 [[REG_1]], %c
+; CHECK-NEXT:  [[REG_3:%[0-9]+]] = add i8 [[REG_2]], %d
+; CHECK-NEXT:  ret i8 [[REG_3]]
+
+define i32 @sub(i32 %a, i32 %b, i32 %c) {
+  %1 = sub i32 %a, %b
+  %2 = sub i32 %1, %c
+  ret i32 %2
+}
+
+; CHECK-LABEL: @sub
+; CHECK-NEXT:  [[REG_1:%[0-9]+]] = sub i32 %a, %b
+; CHECK-NEXT:  [[REG_2:%[0-9]+]] = sub i32 [[REG_1]], %c
+; CHECK-NEXT:  ret i32 [[REG_2]]
+
+; Linear MBA expressions other than the ones generated by MBAAdd and MBASub,
+; for various bit widths
+
+; (a | b) + (a & b) == a + b
+define i32 @or_plus_and(i32 %a, i32 %b) {
+  %or = or i32 %a, %b
+  %and = and i32 %a, %b
+  %res = add i32 %or, %and
+  ret i32 %res
+}
+
+; LINEAR-LABEL: @or_plus_and
+; LINEAR-NEXT:  %res = add i32 %a, %b
+; LINEAR-NEXT:  ret i32 %res
+
+; (a ^ b) - 2 * (~a & b) == a - b
+define i16 @sub_16bit(i16 %a, i16 %b) {
+  %xor = xor i16 %a, %b
+  %not.a = xor i16 %a, -1
+  %and = and i16 %not.a, %b
+  %mul = mul i16 %and, 2
+  %res = sub i16 %xor, %mul
+  ret i16 %res
+}
+
+; LINEAR-LABEL: @sub_16bit
+; LINEAR-NEXT:  %res = sub i16 %a, %b
+; LINEAR-NEXT:  ret i16 %res
+
+; (a + b) - 2 * (a & b) == a ^ b
+define i64 @xor_64bit(i64 %a, i64 %b) {
+  %sum = add i64 %a, %b
+  %and = and i64 %a, %b
+  %twice = shl i64 %and, 1
+  %res = sub i64 %sum, %twice
+  ret i64 %res
+}
+
+; LINEAR-LABEL: @xor_64bit
+; LINEAR-NEXT:  %res = xor i64 %a, %b
+; LINEAR-NEXT:  ret i64 %res
+
+; (a ^ b) + 2 * (a & b) == a + b, where a = x * y is not linear (and hence is
+; a variable)
+define i8 @opaque_operand(i8 %x, i8 %y, i8 %b) {
+  %a = mul i8 %x, %y
+  %xor = xor i8 %a, %b
+  %and = and i8 %a, %b
+  %mul = mul i8 2, %and
+  %res = add i8 %xor, %mul
+  ret i8 %res
+}
+
+; LINEAR-LABEL: @opaque_operand
+; LINEAR-NEXT:  %a = mul i8 %x, %y
+; LINEAR-NEXT:  %res = add i8 %a, %b
+; LINEAR-NEXT:  ret i8 %res
+
+; Already as simple as it gets - nothing to do
+define i32 @no_simplification(i32 %a, i32 %b) {
+  %and = and i32 %a, %b
+  %res = mul i32 %and, 3
+  ret i32 %res
+}
+
+; LINEAR-LABEL: @no_simplification
+; LINEAR-NEXT:  %and = and i32 %a, %b
+; LINEAR-NEXT:  %res = mul i32 %and, 3
+; LINEAR-NEXT:  ret i32 %res
+
+; (3 + ~5) + 1 is folded (by IRBuilder) into a constant, which the generic
+; simplification must skip
+define i32 @folded_constant() {
+  %not = xor i32 5, -1
+  %sum = add i32 3, %not
+  %res = add i32 %sum, 1
+  ret i32 %res
+}
+
+; LINEAR-LABEL: @folded_constant
+; LINEAR-NEXT:  ret i32 -2
+
+; %res folds into the (pre-existing) unnamed operand, which keeps its name
+define i8 @unnamed_operand(i8 %a, i8 %x, i8 %y) {
+  %zero = sub i8 %a, %a
+  %1 = mul i8 %x, %y
+  %res = add i8 %1, %zero
+  ret i8 %res
+}
+
+; LINEAR-LABEL: @unnamed_operand
+; LINEAR-NEXT:  %1 = mul i8 %x, %y
+; LINEAR-NEXT:  ret i8 %1
@@ -0,0 +1,75 @@
+; RUN: opt -load-pass-plugin %shlibdir/libMergeBB%shlibext -passes=merge-bb -S %s | FileCheck  %s
+
+; Verify that MergeBB merges blocks that:
+;   * feed multiple PHI nodes in the successor (@switch_cases),
+;   * use values defined earlier in the same block (@switch_cases),
+;   * end with identical `ret` instructions (@returns).
+; %case.3 differs from %case.1 and %case.2 (it adds 2 rather than 1), so it's
+; not merged.
+
+define i32 @switch_cases(i32 %a, i32 %b) {
+entry:
+  switch i32 %a, label %default [
+    i32 1, label %case.1
+    i32 2, label %case.2
+    i32 3, label %case.3
+  ]
+
+case.1:
+  %x.1 = add i32 %b, 1
+  %y.1 = mul i32 %x.1, 3
+  br label %exit
+
+case.2:
+  %x.2 = add i32 %b, 1
+  %y.2 = mul i32 %x.2, 3
+  br label %exit
+
+case.3:
+  %x.3 = add i32 %b, 2
+  %y.3 = mul i32 %x.3, 3
+  br label %exit
+
+default:
+  br label %exit
+
+exit:
+  %p = phi i32 [ %x.1, %case.1 ], [ %x.2, %case.2 ], [ %x.3, %case.3 ], [ 0, %default ]
+  %q = phi i32 [ %y.1, %case.1 ], [ %y.2, %case.2 ], [ %y.3, %case.3 ], [ 0, %default ]
+  %r = add i32 %p, %q
+  ret i32 %r
+}
+
+; CHECK-LABEL: @switch_cases
+; CHECK:         switch i32 %a, label %default [
+; CHECK-NEXT:      i32 1, label %case.2
+; CHECK-NEXT:      i32 2, label %case.2
+; CHECK-NEXT:      i32 3, label %case.3
+; CHECK-NEXT:    ]
+; CHECK-NOT:   case.1:
+; CHECK:       case.2:
+; CHECK:       case.3:
+; CHECK:       exit:
+; CHECK-NEXT:    %p = phi i32 [ %x.2, %case.2 ], [ %x.3, %case.3 ], [ 0, %default ]
+; CHECK-NEXT:    %q = phi i32 [ %y.2, %case.2 ], [ %y.3, %case.3 ], [ 0, %default ]
+
+define i32 @returns(i32 %a) {
+entry:
+  %c = icmp eq i32 %a, 19
+  br i1 %c, label %ret.1, label %ret.2
+
+ret.1:
+  %m.1 = mul i32 %a, 7
+  ret i32 %m.1
+
+ret.2:
+  %m.2 = mul i32 %a, 7
+  ret i32 %m.2
+}
+
+; CHECK-LABEL: @returns
+; CHECK:         br i1 %c, label %ret.2, label %ret.2
+; CHECK-NOT:   ret.1:
+; CHECK:       ret.2:
+; CHECK-NEXT:    %m.2 = mul i32 %a, 7
+; CHECK-NEXT:    ret i32 %m.2
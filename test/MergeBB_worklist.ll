@@ -0,0 +1,151 @@
+; RUN: opt -load-pass-plugin %shlibdir/libMergeBB%shlibext -passes=merge-bb -merge-bb-worklist -S %s | FileCheck %s
+; RUN: opt -load-pass-plugin %shlibdir/libMergeBB%shlibext -passes=merge-bb -S %s | FileCheck %s --check-prefix=SINGLE
+; RUN: opt -load-pass-plugin %shlibdir/libMergeBB%shlibext -passes='require<domtree>,merge-bb,print<domtree>' -merge-bb-worklist -disable-output %s 2>&1 | FileCheck %s --check-prefix=DT
+
+; Verify that with -merge-bb-worklist MergeBB also merges the blocks that only
+; become identical once other blocks are merged:
+;   * %y branches to %l2 and %x to %l1, they're identical once %l2 is merged
+;     into %l1 (@successors),
+;   * the PHI node in %join is removed once %b is merged into %a, then %join
+;     is identical to %z (@phis),
+;   * %m uses that PHI node (replaced with %x), so it's identical to %z even
+;     though it was visited (and is not a neighbour of %a/%b) (@users).
+; A single pass (SINGLE) only merges %l1/%l2 and %a/%b.
+;
+; The dominator tree is updated rather than invalidated (DT): once %l2 is
+; merged into %l1, %l1 is no longer dominated by %p (@idom).
+
+define i32 @successors(i1 %c, i32 %a) {
+; CHECK-LABEL: @successors
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    br i1 %c, label %x, label %x
+; CHECK:       x:
+; CHECK-NEXT:    %x.add = add i32 %a, 1
+; CHECK-NEXT:    br label %l1
+; CHECK:       l1:
+; CHECK-NEXT:    ret i32 0
+; CHECK-NEXT:  }
+; SINGLE-LABEL: @successors
+; SINGLE:       x:
+; SINGLE:       y:
+; SINGLE-NOT:   l1:
+; SINGLE:       l2:
+entry:
+  br i1 %c, label %x, label %y
+
+x:
+  %x.add = add i32 %a, 1
+  br label %l1
+
+y:
+  %y.add = add i32 %a, 1
+  br label %l2
+
+l1:
+  ret i32 0
+
+l2:
+  ret i32 0
+}
+
+define i32 @phis(i32 %s, i32 %x) {
+; CHECK-LABEL: @phis
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    switch i32 %s, label %z [
+; CHECK-NEXT:      i32 0, label %a
+; CHECK-NEXT:      i32 1, label %a
+; CHECK-NEXT:    ]
+; CHECK:       z:
+; CHECK-NEXT:    ret i32 %x
+; CHECK:       a:
+; CHECK-NEXT:    br label %z
+; CHECK-NEXT:  }
+; SINGLE-LABEL: @phis
+; SINGLE:       z:
+; SINGLE:       b:
+; SINGLE:       join:
+; SINGLE-NEXT:    ret i32 %x
+entry:
+  switch i32 %s, label %z [
+    i32 0, label %a
+    i32 1, label %b
+  ]
+
+z:
+  ret i32 %x
+
+a:
+  br label %join
+
+b:
+  br label %join
+
+join:
+  %p = phi i32 [ %x, %a ], [ %x, %b ]
+  ret i32 %p
+}
+
+define i32 @users(i32 %s, i32 %x) {
+; CHECK-LABEL: @users
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    switch i32 %s, label %z [
+; CHECK-NEXT:      i32 0, label %a
+; CHECK-NEXT:      i32 1, label %a
+; CHECK-NEXT:    ]
+; CHECK:       z:
+; CHECK-NEXT:    ret i32 %x
+; CHECK:       a:
+; CHECK-NEXT:    br label %join
+; CHECK:       join:
+; CHECK-NEXT:    br label %z
+; CHECK-NEXT:  }
+; SINGLE-LABEL: @users
+; SINGLE:       m:
+; SINGLE-NEXT:    ret i32 %x
+entry:
+  switch i32 %s, label %z [
+    i32 0, label %a
+    i32 1, label %b
+  ]
+
+z:
+  ret i32 %x
+
+m:
+  ret i32 %p
+
+a:
+  br label %join
+
+b:
+  br label %join
+
+join:
+  %p = phi i32 [ %x, %a ], [ %x, %b ]
+  br label %m
+}
+
+; DT-LABEL: function: idom
+; DT:         [1] %entry
+; DT-NEXT:      [2] %p
+; DT-NEXT:      [2] %q
+; DT-NEXT:      [2] %l1
+; DT-NEXT:  Roots: %entry
+define i32 @idom(i1 %c, i32 %a) {
+entry:
+  br i1 %c, label %p, label %q
+
+p:
+  %p.add = add i32 %a, 1
+  br label %l1
+
+q:
+  %q.mul = mul i32 %a, 3
+  br label %l2
+
+l1:
+  ret i32 0
+
+l2:
+  ret i32 0
+}
@@ -0,0 +1,25 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libOpcodeCounter%shlibext -passes="print<opcode-counter-module>" %S/Inputs/CallCounterInput.ll -disable-output 2>&1\
+; RUN:   | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libOpcodeCounter%shlibext -passes="print<opcode-counter>" -opcode-counter-by-type %S/Inputs/CallCounterInput.ll -disable-output 2>&1\
+; RUN:   | FileCheck %s --check-prefix=BY-TYPE
+
+; Test the module-level histogram (the per-function results merged) and the
+; breakdown by the result type.
+
+; CHECK: Printing analysis 'OpcodeCounter Pass' for module
+; CHECK-DAG: ret                  4
+; CHECK-DAG: call                 6
+; CHECK-DAG: store                4
+; CHECK-DAG: load                 2
+; CHECK-DAG: alloca               2
+; CHECK-DAG: icmp                 1
+; CHECK-DAG: add                  1
+; CHECK-DAG: br                   4
+
+; BY-TYPE-LABEL: for function 'main'
+; BY-TYPE: load                 2
+; BY-TYPE-NEXT:   int                2
+; BY-TYPE: alloca               2
+; BY-TYPE-NEXT:   ptr                2
+; BY-TYPE: store                4
+; BY-TYPE-NEXT:   void               4
@@ -0,0 +1,50 @@
+; RUN: opt -load-pass-plugin %shlibdir/libPassTracer%shlibext \
+; RUN:   -passes='function(instcombine,loop(loop-rotate))' \
+; RUN:   -pass-trace-file=%t.json -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=SUMMARY
+; RUN: FileCheck %s --input-file=%t.json --check-prefix=TRACE
+; RUN: opt -load-pass-plugin %shlibdir/libPassTracer%shlibext \
+; RUN:   -passes='function(instcombine)' -pass-trace-top=1 -disable-output %s \
+; RUN:   2>&1 | FileCheck %s --check-prefix=TOP1
+
+; The summary lists both passes and analyses, and the functions they ran on
+; SUMMARY:      LLVM-TUTOR: PassTracer results (top 10)
+; SUMMARY:      PASS  KIND  #RUNS  SELF (ms)  TOTAL (ms)  RSS (KiB)
+; SUMMARY-DAG:  InstCombinePass pass 2
+; SUMMARY-DAG:  {{Analysis|AAManager}} analysis
+; SUMMARY:      FUNCTION  SELF (ms)
+; SUMMARY-DAG:  foo
+; SUMMARY-DAG:  bar
+
+; Every event is a "complete" event with the IR unit it ran on (loops are
+; named after their function and header)
+; TRACE:      "traceEvents":[
+; TRACE-DAG:  {"name":"InstCombinePass","cat":"pass","ph":"X",{{.*}}"args":{"ir":"foo",
+; TRACE-DAG:  {"name":"InstCombinePass","cat":"pass","ph":"X",{{.*}}"args":{"ir":"bar",
+; TRACE-DAG:  {"name":"LoopRotatePass","cat":"pass","ph":"X",{{.*}}"args":{"ir":"foo/loop",
+; TRACE-DAG:  {"name":"DominatorTreeAnalysis","cat":"analysis","ph":"X",{{.*}}"args":{"ir":"foo",
+; TRACE:      ]}
+
+; TOP1:      LLVM-TUTOR: PassTracer results (top 1)
+; TOP1:      ---
+; TOP1-NEXT: {{[A-Za-z<>:, ]+}} {{pass|analysis}}
+; TOP1-NEXT: ---
+
+define i32 @foo(i32 %a) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %i.next = add i32 %i, 1
+  %cond = icmp slt i32 %i.next, %a
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  ret i32 %i.next
+}
+
+define i32 @bar(i32 %a) {
+  %res = add i32 %a, 1
+  ret i32 %res
+}
@@ -0,0 +1,51 @@
+; RUN: opt -load-pass-plugin %shlibdir/libStaticCallCounter%shlibext -passes="print<static-cc>" -static-cc-format=jsonl -disable-output %s 2>&1 | FileCheck %s --check-prefix=STATIC-CC
+; RUN: opt -load-pass-plugin %shlibdir/libOpcodeCounter%shlibext -passes="print<opcode-counter>" -opcode-counter-format=jsonl -opcode-counter-by-type -disable-output %s 2>&1 | FileCheck %s --check-prefix=OPCODES
+; RUN: opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="print<riv>" -riv-format=jsonl -disable-output %s 2>&1 | FileCheck %s --check-prefix=RIV
+; RUN: opt -load-pass-plugin %shlibdir/libFindFCmpEq%shlibext -passes="print<find-fcmp-eq>" -find-fcmp-eq-format=jsonl -disable-output %s | FileCheck %s --check-prefix=FCMP
+
+; The binary records decode to the same JSON lines. Both printers write to
+; the same file.
+; RUN: opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="print<riv>,print<lazy-riv>" -riv-format=binary -riv-output=%t.bin -disable-output %s
+; RUN: ../bin/dcc-profdata show %t.bin | FileCheck %s --check-prefixes=RIV,LAZY-RIV
+; RUN: not ../bin/dcc-profdata merge -o %t.merged %t.bin 2>&1 | FileCheck %s --check-prefix=MERGE
+
+; The static tool uses the same records
+; RUN: ../bin/static -format=jsonl -function-analyses=find-fcmp-eq %s 2>&1 | FileCheck %s --check-prefixes=STATIC-CC,FCMP
+
+; STATIC-CC:      {"analysis":"static-cc","callee":"foo","calls":2}
+; STATIC-CC-NEXT: {"analysis":"static-cc","callee":"llvm.sqrt.f64","calls":1}
+
+; OPCODES:      {"analysis":"opcode-counter","function":"foo","opcode":"add","count":1}
+; OPCODES-NEXT: {"analysis":"opcode-counter","function":"foo","opcode":"add","type":"int","count":1}
+; OPCODES:      {"analysis":"opcode-counter","function":"bar","opcode":"call","count":3}
+; OPCODES-NEXT: {"analysis":"opcode-counter","function":"bar","opcode":"call","type":"int","count":2}
+; OPCODES-NEXT: {"analysis":"opcode-counter","function":"bar","opcode":"call","type":"fp","count":1}
+
+; RIV:      {"analysis":"riv","function":"foo","block":"%entry","value":"%a"}
+; RIV-NEXT: {"analysis":"riv","function":"foo","block":"%0","value":"%add"}
+; RIV-NEXT: {"analysis":"riv","function":"foo","block":"%0","value":"%a"}
+; LAZY-RIV: {"analysis":"lazy-riv","function":"foo","block":"%entry","value":"%a"}
+; LAZY-RIV: {"analysis":"lazy-riv","function":"foo","block":"%0","value":"%add"}
+
+; FCMP: {"analysis":"find-fcmp-eq","function":"bar","instruction":"%cmp = fcmp oeq double %sqrt, %x"}
+
+; MERGE: result streams cannot be merged
+
+define i32 @foo(i32 %a) {
+entry:
+  %add = add i32 %a, 1
+  br label %0
+
+0:
+  ret i32 %add
+}
+
+define i1 @bar(double %x) {
+  %r1 = call i32 @foo(i32 1)
+  %r2 = call i32 @foo(i32 %r1)
+  %sqrt = call double @llvm.sqrt.f64(double %x)
+  %cmp = fcmp oeq double %sqrt, %x
+  ret i1 %cmp
+}
+
+declare double @llvm.sqrt.f64(double)
@@ -0,0 +1,162 @@
+; RUN: opt -load-pass-plugin %shlibdir/libSimpleLICM%shlibext -passes='loop-mssa(simple-licm)' -S %s | FileCheck %s
+; RUN: opt -load-pass-plugin %shlibdir/libSimpleLICM%shlibext -passes='loop(simple-licm)' -S %s | FileCheck %s
+
+; Verify that SimpleLICM hoists invariant loads and promotes memory that's only
+; accessed through one invariant pointer, both with MemorySSA (loop-mssa) and
+; with alias analysis only (loop).
+
+;------------------------------------------------------------------------------
+; CASE 1: Invariant load of a base pointer - hoisted
+;------------------------------------------------------------------------------
+define void @invariant_load(ptr noalias %rows, ptr noalias %out, i64 %n) {
+; CHECK-LABEL: @invariant_load
+; CHECK-LABEL: {{^}}entry:
+; CHECK-NEXT:    %row = load ptr, ptr %rows, align 8
+; CHECK-NEXT:    br label %loop
+; CHECK-LABEL: {{^}}loop:
+; CHECK-NOT:     load ptr
+; CHECK:         store double %v, ptr %dst, align 8
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %row = load ptr, ptr %rows, align 8
+  %addr = getelementptr inbounds double, ptr %row, i64 %i
+  %v = load double, ptr %addr, align 8
+  %dst = getelementptr inbounds double, ptr %out, i64 %i
+  store double %v, ptr %dst, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %cond = icmp ult i64 %i.next, %n
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  ret void
+}
+
+;------------------------------------------------------------------------------
+; CASE 2: Accumulator in memory - promoted to a PHI node
+;------------------------------------------------------------------------------
+define void @accumulate(ptr noalias %sum, ptr noalias %a, i64 %n) {
+; CHECK-LABEL: @accumulate
+; CHECK-LABEL: {{^}}entry:
+; CHECK-NEXT:    %sum.promoted = load double, ptr %sum, align 8
+; CHECK-LABEL: {{^}}loop:
+; CHECK-NEXT:    [[ACC:%.*]] = phi double [ %sum.promoted, %entry ], [ %acc.next, %loop ]
+; CHECK-NOT:     store
+; CHECK:         %acc.next = fadd double [[ACC]], %x
+; CHECK-NOT:     store
+; CHECK-LABEL: {{^}}exit:
+; CHECK-NEXT:    [[LCSSA:%.*]] = phi double [ %acc.next, %loop ]
+; CHECK-NEXT:    store double [[LCSSA]], ptr %sum, align 8
+; CHECK-NEXT:    ret void
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %addr = getelementptr inbounds double, ptr %a, i64 %i
+  %x = load double, ptr %addr, align 8
+  %acc = load double, ptr %sum, align 8
+  %acc.next = fadd double %acc, %x
+  store double %acc.next, ptr %sum, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %cond = icmp ult i64 %i.next, %n
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  ret void
+}
+
+;------------------------------------------------------------------------------
+; CASE 3: Store to an invariant pointer - sunk into the exit block
+;------------------------------------------------------------------------------
+define void @sink_store(ptr noalias %last, ptr noalias %a, i64 %n) {
+; CHECK-LABEL: @sink_store
+; CHECK-LABEL: {{^}}entry:
+; CHECK-NEXT:    br label %loop
+; CHECK-LABEL: {{^}}loop:
+; CHECK-NOT:     store i64 %i, ptr %last
+; CHECK-LABEL: {{^}}exit:
+; CHECK-NEXT:    [[LCSSA:%.*]] = phi i64 [ %i, %loop ]
+; CHECK-NEXT:    store i64 [[LCSSA]], ptr %last, align 8
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %addr = getelementptr inbounds i64, ptr %a, i64 %i
+  store i64 %i, ptr %addr, align 8
+  store i64 %i, ptr %last, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %cond = icmp ult i64 %i.next, %n
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  ret void
+}
+
+;------------------------------------------------------------------------------
+; CASE 4: Two accumulators in memory - both promoted
+;------------------------------------------------------------------------------
+define void @two_accumulators(ptr noalias %sum, ptr noalias %prod, ptr noalias %a, i64 %n) {
+; CHECK-LABEL: @two_accumulators
+; CHECK-LABEL: {{^}}entry:
+; CHECK-DAG:     %sum.promoted = load double, ptr %sum, align 8
+; CHECK-DAG:     %prod.promoted = load double, ptr %prod, align 8
+; CHECK-LABEL: {{^}}loop:
+; CHECK-NOT:     store
+; CHECK:         %sum.next = fadd double
+; CHECK-NOT:     store
+; CHECK:         %prod.next = fmul double
+; CHECK-NOT:     store
+; CHECK-LABEL: {{^}}exit:
+; CHECK-DAG:     store double {{%.*}}, ptr %sum, align 8
+; CHECK-DAG:     store double {{%.*}}, ptr %prod, align 8
+; CHECK:         ret void
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %addr = getelementptr inbounds double, ptr %a, i64 %i
+  %x = load double, ptr %addr, align 8
+  %s = load double, ptr %sum, align 8
+  %sum.next = fadd double %s, %x
+  store double %sum.next, ptr %sum, align 8
+  %p = load double, ptr %prod, align 8
+  %prod.next = fmul double %p, %x
+  store double %prod.next, ptr %prod, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %cond = icmp ult i64 %i.next, %n
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  ret void
+}
+
+;------------------------------------------------------------------------------
+; CASE 5: The accumulator may alias the other store - not promoted
+;------------------------------------------------------------------------------
+define void @may_alias(ptr %sum, ptr %a, i64 %n) {
+; CHECK-LABEL: @may_alias
+; CHECK-LABEL: {{^}}loop:
+; CHECK:         %acc = load double, ptr %sum, align 8
+; CHECK:         store double %acc.next, ptr %sum, align 8
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %addr = getelementptr inbounds double, ptr %a, i64 %i
+  store double 0.0, ptr %addr, align 8
+  %acc = load double, ptr %sum, align 8
+  %acc.next = fadd double %acc, 1.0
+  store double %acc.next, ptr %sum, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %cond = icmp ult i64 %i.next, %n
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  ret void
+}
@@ -0,0 +1,49 @@
+; RUN: opt -load-pass-plugin %shlibdir/libSimpleLICM%shlibext -passes='loop-mssa(simple-licm)' -simple-licm-nest-aware -S %s | FileCheck %s
+
+; Verify that in the nest-aware mode the instructions that are invariant in
+; the whole loop nest are moved straight to the preheader of the outer loop,
+; and that the ones that only are invariant in the inner loop are moved to the
+; preheader of the inner loop.
+
+define void @nest(ptr noalias %p, ptr noalias %out, i64 %a, i64 %b, i64 %n) {
+; CHECK-LABEL: @nest
+; CHECK-LABEL: {{^}}entry:
+; CHECK-NEXT:    %base = load i64, ptr %p, align 8
+; CHECK-NEXT:    %ab = mul i64 %a, %b
+; CHECK-NEXT:    %val = add i64 %base, %ab
+; CHECK-NEXT:    br label %outer
+; CHECK-LABEL: {{^}}outer:
+; CHECK-NEXT:    %i = phi i64
+; CHECK-NEXT:    %row = mul i64 %i, %n
+; CHECK-NEXT:    br label %inner
+; CHECK-LABEL: {{^}}inner:
+; CHECK-NEXT:    %j = phi i64
+; CHECK-NEXT:    %idx = add i64 %row, %j
+entry:
+  br label %outer
+
+outer:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %j = phi i64 [ 0, %outer ], [ %j.next, %inner ]
+  %base = load i64, ptr %p, align 8
+  %ab = mul i64 %a, %b
+  %row = mul i64 %i, %n
+  %idx = add i64 %row, %j
+  %val = add i64 %base, %ab
+  %dst = getelementptr inbounds i64, ptr %out, i64 %idx
+  store i64 %val, ptr %dst, align 8
+  %j.next = add nuw nsw i64 %j, 1
+  %inner.cond = icmp ult i64 %j.next, %n
+  br i1 %inner.cond, label %inner, label %outer.latch
+
+outer.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %outer.cond = icmp ult i64 %i.next, %n
+  br i1 %outer.cond, label %outer, label %exit
+
+exit:
+  ret void
+}
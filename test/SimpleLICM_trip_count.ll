@@ -0,0 +1,118 @@
+; RUN: opt -load-pass-plugin %shlibdir/libSimpleLICM%shlibext -passes='loop-mssa(simple-licm)' -simple-licm-min-trip-count=8 -S %s | FileCheck %s
+; RUN: opt -load-pass-plugin %shlibdir/libSimpleLICM%shlibext -passes='loop-mssa(simple-licm)' -simple-licm-nest-aware -simple-licm-min-trip-count=8 -S %s | FileCheck %s --check-prefix=NEST
+; RUN: opt -load-pass-plugin %shlibdir/libSimpleLICM%shlibext -passes='loop-mssa(simple-licm)' -S %s | FileCheck %s --check-prefix=ALL
+
+; Verify that with -simple-licm-min-trip-count the loops whose measured mean
+; trip count (the `llvm-tutor.loop.trip_count` metadata attached by
+; loop-tc-annotate) is below the threshold are left alone, while the loops
+; above it and the loops without a profile are processed as usual.
+
+define void @short(ptr %out, i64 %a, i64 %b, i64 %n) {
+; CHECK-LABEL: @short
+; CHECK-LABEL: {{^}}loop:
+; CHECK:         %ab = mul i64 %a, %b
+; ALL-LABEL:   @short
+; ALL-LABEL:   {{^}}entry:
+; ALL-NEXT:      %ab = mul i64 %a, %b
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %ab = mul i64 %a, %b
+  %p = getelementptr inbounds i64, ptr %out, i64 %i
+  store i64 %ab, ptr %p, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %cond = icmp ult i64 %i.next, %n
+  br i1 %cond, label %loop, label %exit, !llvm.loop !0
+
+exit:
+  ret void
+}
+
+define void @long(ptr %out, i64 %a, i64 %b, i64 %n) {
+; CHECK-LABEL: @long
+; CHECK-LABEL: {{^}}entry:
+; CHECK-NEXT:    %ab = mul i64 %a, %b
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %ab = mul i64 %a, %b
+  %p = getelementptr inbounds i64, ptr %out, i64 %i
+  store i64 %ab, ptr %p, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %cond = icmp ult i64 %i.next, %n
+  br i1 %cond, label %loop, label %exit, !llvm.loop !2
+
+exit:
+  ret void
+}
+
+define void @unprofiled(ptr %out, i64 %a, i64 %b, i64 %n) {
+; CHECK-LABEL: @unprofiled
+; CHECK-LABEL: {{^}}entry:
+; CHECK-NEXT:    %ab = mul i64 %a, %b
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %ab = mul i64 %a, %b
+  %p = getelementptr inbounds i64, ptr %out, i64 %i
+  store i64 %ab, ptr %p, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %cond = icmp ult i64 %i.next, %n
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  ret void
+}
+
+; The outer loop runs 2 iterations per entry, so in the nest-aware mode %ab
+; is only hoisted out of the inner loop
+define void @nest(ptr %out, i64 %a, i64 %b, i64 %n) {
+; NEST-LABEL: @nest
+; NEST-LABEL: {{^}}entry:
+; NEST-NEXT:    br label %outer
+; NEST-LABEL: {{^}}outer:
+; NEST-NEXT:    %i = phi i64
+; NEST-NEXT:    %ab = mul i64 %a, %b
+; NEST-NEXT:    br label %inner
+entry:
+  br label %outer
+
+outer:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %j = phi i64 [ 0, %outer ], [ %j.next, %inner ]
+  %ab = mul i64 %a, %b
+  %p = getelementptr inbounds i64, ptr %out, i64 %j
+  store i64 %ab, ptr %p, align 8
+  %j.next = add nuw nsw i64 %j, 1
+  %inner.cond = icmp ult i64 %j.next, %n
+  br i1 %inner.cond, label %inner, label %outer.latch, !llvm.loop !6
+
+outer.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %outer.cond = icmp ult i64 %i.next, 2
+  br i1 %outer.cond, label %outer, label %exit, !llvm.loop !4
+
+exit:
+  ret void
+}
+
+; Entered 10 times, 15 iterations in total (a mean of 1.5)
+!0 = distinct !{!0, !1}
+!1 = !{!"llvm-tutor.loop.trip_count", i64 10, i64 15, i64 2}
+; Entered 10 times, 1000 iterations in total (a mean of 100)
+!2 = distinct !{!2, !3}
+!3 = !{!"llvm-tutor.loop.trip_count", i64 10, i64 1000, i64 100}
+; Entered 10 times, 20 iterations in total (a mean of 2)
+!4 = distinct !{!4, !5}
+!5 = !{!"llvm-tutor.loop.trip_count", i64 10, i64 20, i64 2}
+; The inner loop of the nest (a mean of 100)
+!6 = distinct !{!6, !3}
@@ -0,0 +1,40 @@
+; RUN: %clang -c -emit-llvm %S/../inputs/input_for_hello.c -o - \
+; RUN:   | opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call,verify" -inject-func-call-sample-period=2 -S -o %t.ll
+; RUN: %clang %t.ll -o %t.bin
+; RUN: not %t.bin | FileCheck %s --check-prefix=EXEC
+
+; RUN: opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call,verify" -inject-func-call-sample-period=2 -S %s | FileCheck %s
+
+; Sample every 2nd function entry. The entries are: main, foo, bar, foo, fez,
+; bar, foo, so only the following calls are reported.
+; EXEC: (llvm-tutor) Hello from: foo
+; EXEC-NEXT: (llvm-tutor)   number of arguments: 1
+; EXEC-NEXT: (llvm-tutor) Hello from: foo
+; EXEC-NEXT: (llvm-tutor)   number of arguments: 1
+; EXEC-NEXT: (llvm-tutor) Hello from: bar
+; EXEC-NEXT: (llvm-tutor)   number of arguments: 2
+; EXEC-NOT: Hello from
+
+; CHECK: @InjectFuncCallCountdown = internal thread_local(initialexec) global i32 2
+
+; Unsampled entries only decrement the countdown. The static allocas stay in
+; the entry block.
+define i32 @foo(i32 %a) {
+; CHECK-LABEL: @foo(
+; CHECK-NEXT:    [[ADDR:%.*]] = alloca i32
+; CHECK-NEXT:    [[TLS:%.*]] = call ptr @llvm.threadlocal.address.p0(ptr @InjectFuncCallCountdown)
+; CHECK-NEXT:    [[COUNT:%.*]] = load i32, ptr [[TLS]]
+; CHECK-NEXT:    [[NEW:%.*]] = sub i32 [[COUNT]], 1
+; CHECK-NEXT:    store i32 [[NEW]], ptr [[TLS]]
+; CHECK-NEXT:    [[SAMPLED:%.*]] = icmp eq i32 [[NEW]], 0
+; CHECK-NEXT:    br i1 [[SAMPLED]], label %[[THEN:.*]], label %[[CONT:.*]], !prof
+; CHECK:       [[THEN]]:
+; CHECK-NEXT:    store i32 2, ptr [[TLS]]
+; CHECK-NEXT:    {{%.*}} = call i32 (ptr, ...) @printf(
+; CHECK-NEXT:    br label %[[CONT]]
+; CHECK:       [[CONT]]:
+; CHECK-NEXT:    store i32 %a, ptr [[ADDR]]
+  %addr = alloca i32
+  store i32 %a, ptr %addr
+  ret i32 %a
+}
@@ -0,0 +1,69 @@
+; RUN: %clang -c -emit-llvm %S/../inputs/input_for_hello.c -o - \
+; RUN:   | opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call,verify" -inject-func-call-output=trace -inject-func-call-trace-buffer-size=2 -inject-func-call-trace-file=%t.trace -S -o %t.ll
+; RUN: %clang %t.ll -o %t.bin
+; RUN: rm -f %t.trace
+; RUN: not %t.bin
+; RUN: ../bin/dcc-profdata show %t.trace | FileCheck %s --check-prefix=SHOW
+
+; RUN: opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call,verify" -inject-func-call-output=trace -S %s | FileCheck %s
+
+; Instrument this file with InjectFuncCall in the tracing mode and verify
+; that every function calls `ifc_trace` with its index and its number of
+; arguments. The names are only stored once, in the trace header.
+
+; CHECK: @InjectFuncCallTraceHeader = internal constant { { i64, i32, i32, i64 }, [2 x { i32, i32 }], [8 x i8] } { { i64, i32, i32, i64 } { i64 32760388805487871, i32 1, i32 2, i64 8 }, [2 x { i32, i32 }] [{ i32, i32 } { i32 0, i32 3 }, { i32, i32 } { i32 3, i32 3 }], [8 x i8] c"foobar\00\00" }, align 8
+; CHECK: @llvm.global_ctors = appending global
+; CHECK-SAME: @ifc_trace_init
+; CHECK: @llvm.global_dtors = appending global
+; CHECK-SAME: @ifc_trace_fini
+
+define i32 @foo(i32 %a) {
+; CHECK-LABEL: @foo(
+; CHECK-NEXT:    call void @ifc_trace(i32 0, i32 1)
+; CHECK-NEXT:    ret i32 %a
+  ret i32 %a
+}
+
+define void @bar(i32 %a, i32 %b) {
+; CHECK-LABEL: @bar(
+; CHECK-NEXT:    call void @ifc_trace(i32 1, i32 2)
+; CHECK-NEXT:    ret void
+  ret void
+}
+
+; The buffers are written to the trace under a lock
+; CHECK: define internal void @ifc_trace_flush(ptr %0) {
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   call void @ifc_trace_lock()
+; CHECK-NEXT:   call void @ifc_trace_write(ptr %0)
+; CHECK-NEXT:   {{%.*}} = getelementptr
+; CHECK-NEXT:   store atomic i32 0, ptr {{%.*}} monotonic, align 4
+; CHECK-NEXT:   call void @ifc_trace_unlock()
+
+; The record is written to a per-thread buffer that's flushed once full
+; CHECK: define internal void @ifc_trace(i32 %0, i32 %1) {
+; CHECK:   {{%.*}} = call ptr @ifc_trace_get_buffer()
+; CHECK:   {{%.*}} = call i64 @llvm.readcyclecounter()
+; CHECK:   store atomic i32 {{%.*}}, ptr {{%.*}} release, align 4
+; CHECK:   call void @ifc_trace_flush(ptr {{%.*}})
+
+; On exit, the remaining records are written and the trace is closed while
+; holding the lock, so that the other threads can't write to a closed file
+; CHECK: define internal void @ifc_trace_fini() {
+; CHECK:   call void @ifc_trace_lock()
+; CHECK:   call void @ifc_trace_write(ptr %buf)
+; CHECK:   call i32 @fclose(
+; CHECK:   store ptr null, ptr @InjectFuncCallTraceFile
+; CHECK:   call void @ifc_trace_unlock()
+
+; The buffer holds 2 records, so the trace consists of 4 chunks. The calls
+; are still reported in order.
+; SHOW:      THREAD     TIMESTAMP            NAME                 #N ARGS
+; SHOW:      0          {{[0-9]+}} main                 2
+; SHOW-NEXT: 0          {{[0-9]+}} foo                  1
+; SHOW-NEXT: 0          {{[0-9]+}} bar                  2
+; SHOW-NEXT: 0          {{[0-9]+}} foo                  1
+; SHOW-NEXT: 0          {{[0-9]+}} fez                  3
+; SHOW-NEXT: 0          {{[0-9]+}} bar                  2
+; SHOW-NEXT: 0          {{[0-9]+}} foo                  1
+; SHOW-NOT:  {{.}}
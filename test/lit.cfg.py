@@ -53,7 +53,7 @@ llvm_config.add_tool_substitutions(tool_substitutions)
 
 # The list of tools required for testing - prepend them with the path specified
 # during configuration (i.e. LT_LLVM_TOOLS_DIR/bin)
-tools = ["opt", "lli", "not", "FileCheck", "clang"]
+tools = ["opt", "lli", "not", "FileCheck", "clang", "llvm-profdata"]
 llvm_config.add_tool_substitutions(tools, config.llvm_tools_dir)
 
 # The LIT variable to hold the file extension for shared libraries (this is
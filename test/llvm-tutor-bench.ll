@@ -0,0 +1,28 @@
+; RUN: ../bin/llvm-tutor-bench -sizes=64,256 -repeat=1 | FileCheck %s
+; RUN: ../bin/llvm-tutor-bench -sizes=64 -repeat=1 -passes=simple-licm \
+; RUN:   -shapes=loops -loop-depth=2 -csv | FileCheck %s --check-prefix=CSV
+; RUN: not ../bin/llvm-tutor-bench -passes=no-such-pass 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=ERROR
+
+; Smoke test for the benchmark driver (the modules are generated, so this file
+; contains no IR). Verify that every pass runs on every shape and size.
+
+; CHECK:      PASS   SHAPE   BLOCKS INSTRUCTIONS TIME (ms) PEAK (KiB) EXPONENT
+; CHECK-NEXT: riv            chain       64
+; CHECK-NEXT: riv            chain      256
+; CHECK-NEXT: riv            diamonds    64
+; CHECK-NEXT: riv            diamonds   256
+; CHECK-NEXT: riv            switch      64
+; CHECK-NEXT: riv            switch     256
+; CHECK-NEXT: riv            loops       65
+; CHECK-NEXT: riv            loops      257
+; CHECK:      lazy-riv       loops      257
+; CHECK:      opcode-counter loops      257
+; CHECK:      merge-bb       loops      257
+; CHECK:      duplicate-bb   loops      257
+; CHECK:      simple-licm    loops      257
+
+; CSV:      pass,shape,blocks,instructions,time_ms,peak_kb,exponent
+; CSV-NEXT: simple-licm,loops,65,{{[0-9]+}},{{[0-9.]+}},{{[0-9]+}},{{$}}
+
+; ERROR: Error: no such pass or shape
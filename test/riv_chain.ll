@@ -0,0 +1,39 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="print<riv>" -disable-output %s 2>&1 | FileCheck %s
+
+; Verifies the RIV sets along a chain of dominators, some of which define no
+; integer values, and for an unreachable block (which has no RIV set).
+
+define i32 @foo(i32 %a, float %f) {
+entry:
+  %x = add i32 %a, 1
+  br label %b1
+
+b1:
+  %g = fadd float %f, 1.000000e+00
+  br label %b2
+
+b2:
+  %y = mul i32 %x, 2
+  br label %b3
+
+b3:
+  ret i32 %y
+
+dead:
+  %z = add i32 %a, 2
+  ret i32 %z
+}
+
+; CHECK-LABEL: BB %entry
+; CHECK-NEXT:        i32 %a
+; CHECK-LABEL: BB %b1
+; CHECK-NEXT:          %x = add i32 %a, 1
+; CHECK-NEXT:        i32 %a
+; CHECK-LABEL: BB %b2
+; CHECK-NEXT:          %x = add i32 %a, 1
+; CHECK-NEXT:        i32 %a
+; CHECK-LABEL: BB %b3
+; CHECK-NEXT:          %y = mul i32 %x, 2
+; CHECK-NEXT:          %x = add i32 %a, 1
+; CHECK-NEXT:        i32 %a
+; CHECK-NOT: BB %dead
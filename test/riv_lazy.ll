@@ -0,0 +1,47 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="print<lazy-riv>" -disable-output %S/riv_integer.ll 2>&1 | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="print<lazy-riv>" -disable-output %S/riv_chain.ll 2>&1 | FileCheck %s --check-prefix=CHAIN
+
+; Verifies that the LazyRIV queries give the same results as RIV (the blocks
+; are printed in the layout order rather than in the order of the traversal
+; of the dominator tree).
+
+; CHECK-LABEL: BB %entry
+; CHECK-NEXT:        i32 %a
+; CHECK-NEXT:        i32 %b
+; CHECK-NEXT:        i32 %c
+; CHECK-LABEL: BB %if.then
+; CHECK-NEXT:          %add = add nsw i32 %a, 123
+; CHECK-NEXT:          %cmp = icmp sgt i32 %a, 0
+; CHECK-NEXT:        i32 %a
+; CHECK-NEXT:        i32 %b
+; CHECK-NEXT:        i32 %c
+; CHECK-LABEL: BB %if.then2
+; CHECK-NEXT:          %mul = mul nsw i32 %b, %a
+; CHECK-NEXT:          %div = sdiv i32 %b, %c
+; CHECK-NEXT:          %cmp1 = icmp eq i32 %mul, %div
+; CHECK-NEXT:          %add = add nsw i32 %a, 123
+; CHECK-NEXT:          %cmp = icmp sgt i32 %a, 0
+; CHECK-NEXT:        i32 %a
+; CHECK-NEXT:        i32 %b
+; CHECK-NEXT:        i32 %c
+; CHECK-LABEL: BB %if.else
+; CHECK-NEXT:          %mul = mul nsw i32 %b, %a
+; CHECK-NEXT:          %div = sdiv i32 %b, %c
+; CHECK-NEXT:          %cmp1 = icmp eq i32 %mul, %div
+; CHECK-NEXT:          %add = add nsw i32 %a, 123
+; CHECK-NEXT:          %cmp = icmp sgt i32 %a, 0
+; CHECK-NEXT:        i32 %a
+; CHECK-NEXT:        i32 %b
+; CHECK-NEXT:        i32 %c
+; CHECK-LABEL: BB %if.end8
+; CHECK-NEXT:          %add = add nsw i32 %a, 123
+; CHECK-NEXT:          %cmp = icmp sgt i32 %a, 0
+; CHECK-NEXT:        i32 %a
+; CHECK-NEXT:        i32 %b
+; CHECK-NEXT:        i32 %c
+
+; CHAIN-LABEL: BB %b3
+; CHAIN-NEXT:          %y = mul i32 %x, 2
+; CHAIN-NEXT:          %x = add i32 %a, 1
+; CHAIN-NEXT:        i32 %a
+; CHAIN-NOT: BB %dead
@@ -0,0 +1,56 @@
+; RUN: ../bin/static -function-analyses=opcode-counter,find-fcmp-eq,riv -j 4 \
+; RUN:   %s 2>&1 | FileCheck %s
+; The output doesn't depend on the number of threads
+; RUN: ../bin/static -function-analyses=opcode-counter,find-fcmp-eq,riv -j 1 \
+; RUN:   %s 2> %t.j1
+; RUN: ../bin/static -function-analyses=opcode-counter,find-fcmp-eq,riv -j 4 \
+; RUN:   %s 2> %t.j4
+; RUN: diff %t.j1 %t.j4
+; The same results with many input files and in the lazy mode
+; RUN: opt %s -o %t.bc
+; RUN: ../bin/static -function-analyses=find-fcmp-eq -lazy %t.bc 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=LAZY
+
+; Test the function analyses in static. The results of every function are
+; printed in the order of the functions in the module, after the call counts.
+
+; CHECK:      foo                  2
+; CHECK:      Printing analysis 'OpcodeCounter Pass' for function 'cmp':
+; CHECK:      fcmp
+; CHECK:      Floating-point equality comparisons in "cmp":
+; CHECK-NEXT:   %eq = fcmp oeq double %a, %b
+; CHECK:      Printing analysis 'OpcodeCounter Pass' for function 'sum':
+; CHECK:      BB %entry
+; CHECK-NEXT:        i32 %n
+; CHECK:      Printing analysis 'OpcodeCounter Pass' for function 'caller':
+; CHECK:      call
+
+; LAZY:      Floating-point equality comparisons in "cmp":
+; LAZY-NEXT:   %eq = fcmp oeq double %a, %b
+
+declare void @foo()
+
+define i1 @cmp(double %a, double %b) {
+  %eq = fcmp oeq double %a, %b
+  ret i1 %eq
+}
+
+define i32 @sum(i32 %n) {
+entry:
+  %pos = icmp sgt i32 %n, 0
+  br i1 %pos, label %then, label %exit
+
+then:
+  %twice = add i32 %n, %n
+  br label %exit
+
+exit:
+  %res = phi i32 [ %twice, %then ], [ 0, %entry ]
+  ret i32 %res
+}
+
+define void @caller() {
+  call void @foo()
+  call void @foo()
+  ret void
+}
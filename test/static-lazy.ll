@@ -0,0 +1,14 @@
+; RUN: opt %S/Inputs/CallCounterInput.ll -o %t.bc
+; RUN: ../bin/static -lazy %t.bc 2>&1 | FileCheck %s
+; RUN: ../bin/static -lazy %t.bc %t.bc 2>&1 | FileCheck %s --check-prefix=MULTI
+
+; Test static when the functions are materialized (and counted) one at a
+; time. The results must be identical to the non-lazy mode.
+
+; CHECK: foo                  3
+; CHECK-NEXT: bar                  2
+; CHECK-NEXT: fez                  1
+
+; MULTI: foo                  6
+; MULTI-NEXT: bar                  4
+; MULTI-NEXT: fez                  2
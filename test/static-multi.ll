@@ -0,0 +1,23 @@
+; RUN: ../bin/static -j 2 %S/Inputs/CallCounterInput.ll %s 2>&1 | FileCheck %s
+; RUN: echo "%S/Inputs/CallCounterInput.ll %s" > %t.rsp
+; RUN: ../bin/static @%t.rsp 2>&1 | FileCheck %s
+; RUN: not ../bin/static %s %t.missing.ll 2>&1 | FileCheck %s --check-prefix=ERR
+
+; Test static with multiple input modules. The results for the individual
+; modules are merged by the callee name, in the order of the inputs.
+
+; CHECK: foo                  4
+; CHECK-NEXT: bar                  2
+; CHECK-NEXT: fez                  1
+; CHECK-NEXT: baz                  1
+
+; ERR: Error reading bitcode file: {{.*}}.missing.ll
+
+declare void @foo()
+declare void @baz()
+
+define void @qux() {
+  call void @foo()
+  call void @baz()
+  ret void
+}
@@ -0,0 +1,508 @@
+//========================================================================
+// FILE:
+//    BenchMain.cpp
+//
+// DESCRIPTION:
+//    A compile-time scaling benchmark for the llvm-tutor passes. It generates
+//    synthetic modules of increasing size and runs each pass on them
+//    in-process (through PassBuilder), reporting the time and the peak memory
+//    usage of every pass against the size of the input. The passes are linked
+//    into this tool (see tools/CMakeLists.txt) and registered through their
+//    plugin entry points, exactly as `opt -load-pass-plugin` would do.
+//
+//    Every module contains one function with (at least) the requested number
+//    of basic blocks, in one of the following shapes:
+//      * chain    - a straight line of blocks, i.e. a dominator tree that is
+//                   as deep as the function is long
+//      * diamonds - a sequence of if-then-else diamonds with identical arms
+//      * switch   - one wide switch whose cases fall into 16 groups of
+//                   identical blocks (i.e. a dominator tree that is as wide
+//                   as the function is long)
+//      * loops    - a sequence of loop nests (of depth -loop-depth), every
+//                   level with loop-invariant code
+//
+//    Every measurement runs in a child process (on Unix), so that the peak
+//    memory usage is attributed to one pass and one input. The reported
+//    memory is the growth of the peak resident set size while the pass runs
+//    (i.e. on top of the generated module). The time is the best of -repeat
+//    runs, every run on a freshly generated module.
+//
+//    For every pass and shape, the "scaling exponent" k between two
+//    consecutive sizes is such that time ~ size^k. Linear passes are close to
+//    1, quadratic ones close to 2. With `-max-exponent`, the tool fails if
+//    any (sufficiently long) measurement scales worse than that.
+//
+// USAGE:
+//      <BUILD/DIR>/bin/llvm-tutor-bench [-sizes=1000,10000,100000,1000000] `\`
+//        [-passes=riv,merge-bb,...] [-shapes=chain,loops,...] `\`
+//        [-repeat=<N>] [-csv] [-max-exponent=<k>]
+//
+// License: MIT
+//========================================================================
+#include "OpcodeCounter.h"
+#include "RIV.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <optional>
+
+#ifdef LLVM_ON_UNIX
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace llvm;
+
+// The entry points of the plugins linked into this tool
+llvm::PassPluginLibraryInfo getRIVPluginInfo();
+llvm::PassPluginLibraryInfo getMergeBBPluginInfo();
+llvm::PassPluginLibraryInfo getDuplicateBBPluginInfo();
+llvm::PassPluginLibraryInfo getOpcodeCounterPluginInfo();
+llvm::PassPluginLibraryInfo getSimpleLICMPluginInfo();
+
+//===----------------------------------------------------------------------===//
+// The benchmarks
+//===----------------------------------------------------------------------===//
+namespace {
+enum class Shape { Chain, Diamonds, Switch, Loops };
+
+struct ShapeInfo {
+  Shape Kind;
+  const char *Name;
+};
+
+constexpr ShapeInfo Shapes[] = {{Shape::Chain, "chain"},
+                                {Shape::Diamonds, "diamonds"},
+                                {Shape::Switch, "switch"},
+                                {Shape::Loops, "loops"}};
+
+struct PassBenchmark {
+  const char *Name;
+  // Adds the pass (and whatever it needs) to MPM
+  std::function<void(PassBuilder &, ModulePassManager &)> AddPasses;
+};
+
+// Adds the passes described by Pipeline (in the format of `opt -passes`)
+void addPipeline(PassBuilder &PB, ModulePassManager &MPM, StringRef Pipeline) {
+  if (Error E = PB.parsePassPipeline(MPM, Pipeline))
+    report_fatal_error(std::move(E));
+}
+
+const PassBenchmark Benchmarks[] = {
+    // The analyses are only computed (not printed)
+    {"riv",
+     [](PassBuilder &, ModulePassManager &MPM) {
+       MPM.addPass(createModuleToFunctionPassAdaptor(
+           RequireAnalysisPass<RIV, Function>()));
+     }},
+    {"lazy-riv",
+     [](PassBuilder &, ModulePassManager &MPM) {
+       MPM.addPass(createModuleToFunctionPassAdaptor(
+           RequireAnalysisPass<LazyRIV, Function>()));
+     }},
+    {"opcode-counter",
+     [](PassBuilder &, ModulePassManager &MPM) {
+       MPM.addPass(createModuleToFunctionPassAdaptor(
+           RequireAnalysisPass<OpcodeCounter, Function>()));
+     }},
+    {"merge-bb",
+     [](PassBuilder &PB, ModulePassManager &MPM) {
+       addPipeline(PB, MPM, "function(merge-bb)");
+     }},
+    {"duplicate-bb",
+     [](PassBuilder &PB, ModulePassManager &MPM) {
+       addPipeline(PB, MPM, "function(duplicate-bb)");
+     }},
+    // This includes loop-simplify and lcssa, which the loop pass adaptor
+    // always runs first
+    {"simple-licm",
+     [](PassBuilder &PB, ModulePassManager &MPM) {
+       addPipeline(PB, MPM, "function(loop-mssa(simple-licm))");
+     }},
+};
+
+struct Measurement {
+  uint64_t NumBlocks = 0;
+  uint64_t NumInsts = 0;
+  double Seconds = 0;
+  // The growth of the peak RSS in KiB (0 if unknown)
+  uint64_t PeakKB = 0;
+};
+} // namespace
+
+//===----------------------------------------------------------------------===//
+// Command line options
+//===----------------------------------------------------------------------===//
+static cl::OptionCategory BenchCategory{"llvm-tutor-bench options"};
+
+static cl::list<unsigned> Sizes{
+    "sizes",
+    cl::desc{"The sizes (in basic blocks) of the generated functions "
+             "(default: 1000,10000,100000)"},
+    cl::CommaSeparated, cl::cat{BenchCategory}};
+
+static cl::list<std::string> PassNames{
+    "passes",
+    cl::desc{"The passes to benchmark (default: all of riv, lazy-riv, "
+             "opcode-counter, merge-bb, duplicate-bb, simple-licm)"},
+    cl::CommaSeparated, cl::cat{BenchCategory}};
+
+static cl::list<std::string> ShapeNames{
+    "shapes",
+    cl::desc{"The shapes of the generated functions (default: all of chain, "
+             "diamonds, switch, loops)"},
+    cl::CommaSeparated, cl::cat{BenchCategory}};
+
+static cl::opt<unsigned> Repeat{
+    "repeat", cl::desc{"The number of runs per measurement (the best is kept)"},
+    cl::init(3), cl::cat{BenchCategory}};
+
+static cl::opt<unsigned> LoopDepth{
+    "loop-depth", cl::desc{"The depth of the loop nests in the `loops` shape"},
+    cl::init(8), cl::cat{BenchCategory}};
+
+static cl::opt<bool> CSV{"csv",
+                         cl::desc{"Print the results as comma-separated "
+                                  "values"},
+                         cl::init(false), cl::cat{BenchCategory}};
+
+static cl::opt<double> MaxExponent{
+    "max-exponent",
+    cl::desc{"Fail if any measurement that takes at least 10ms scales worse "
+             "than size^k (0 = never fail)"},
+    cl::value_desc{"k"}, cl::init(0), cl::cat{BenchCategory}};
+
+static cl::opt<bool> InProcess{
+    "in-process",
+    cl::desc{"Run all the measurements in this process (the peak memory "
+             "usage is then not reported)"},
+    cl::init(false), cl::cat{BenchCategory}};
+
+//===----------------------------------------------------------------------===//
+// Module generation
+//===----------------------------------------------------------------------===//
+// Emits a loop nest of depth Depth, entered from Preheader (which is
+// terminated by this function). Returns the (unterminated) exit block. Every
+// level computes `A * B`, which is loop-invariant, and stores `IV + A * B`.
+static BasicBlock *emitLoopNest(BasicBlock *Preheader, unsigned Depth,
+                                Value *A, Value *B, Value *Ptr) {
+  Function *F = Preheader->getParent();
+  LLVMContext &Ctx = F->getContext();
+  IRBuilder<> Builder(Preheader);
+
+  BasicBlock *Header = BasicBlock::Create(Ctx, "header", F);
+  Builder.CreateBr(Header);
+  Builder.SetInsertPoint(Header);
+  PHINode *IV = Builder.CreatePHI(Builder.getInt32Ty(), 2, "iv");
+  IV->addIncoming(Builder.getInt32(0), Preheader);
+  Value *Inv = Builder.CreateMul(A, B);
+  Builder.CreateStore(Builder.CreateAdd(IV, Inv), Ptr);
+
+  // The header is the preheader of the inner loop, and the exit of the inner
+  // loop is the latch of this one
+  BasicBlock *Latch =
+      (Depth > 1) ? emitLoopNest(Header, Depth - 1, A, B, Ptr) : Header;
+
+  Builder.SetInsertPoint(Latch);
+  Value *IVNext = Builder.CreateAdd(IV, Builder.getInt32(1));
+  IV->addIncoming(IVNext, Latch);
+  BasicBlock *Exit = BasicBlock::Create(Ctx, "exit", F);
+  Builder.CreateCondBr(Builder.CreateICmpSLT(IVNext, B), Header, Exit);
+  return Exit;
+}
+
+// Generates `i32 @bench(i32 %a, i32 %b, ptr %p)` with at least NumBlocks
+// basic blocks in the shape Kind
+static std::unique_ptr<Module> generateModule(LLVMContext &Ctx, Shape Kind,
+                                              unsigned NumBlocks) {
+  auto M = std::make_unique<Module>("bench", Ctx);
+  IRBuilder<> Builder(Ctx);
+  Type *Int32Ty = Builder.getInt32Ty();
+  auto *FTy = FunctionType::get(
+      Int32Ty, {Int32Ty, Int32Ty, Builder.getPtrTy()}, /*isVarArg=*/false);
+  Function *F =
+      Function::Create(FTy, GlobalValue::ExternalLinkage, "bench", *M);
+  Value *A = F->getArg(0), *B = F->getArg(1), *Ptr = F->getArg(2);
+
+  BasicBlock *BB = BasicBlock::Create(Ctx, "entry", F);
+  Builder.SetInsertPoint(BB);
+  Value *Result = A;
+
+  switch (Kind) {
+  case Shape::Chain:
+    while (F->size() < NumBlocks) {
+      Result = Builder.CreateMul(Builder.CreateAdd(Result, A), B);
+      BB = BasicBlock::Create(Ctx, "bb", F);
+      Builder.CreateBr(BB);
+      Builder.SetInsertPoint(BB);
+    }
+    break;
+  case Shape::Diamonds:
+    // The join block of every diamond is the head of the next one
+    while (F->size() < NumBlocks) {
+      BasicBlock *Then = BasicBlock::Create(Ctx, "then", F);
+      BasicBlock *Else = BasicBlock::Create(Ctx, "else", F);
+      BasicBlock *Join = BasicBlock::Create(Ctx, "join", F);
+      Builder.CreateCondBr(Builder.CreateICmpSLT(Result, B), Then, Else);
+      Value *Arms[2];
+      for (auto [Idx, Arm] : enumerate(ArrayRef<BasicBlock *>{Then, Else})) {
+        Builder.SetInsertPoint(Arm);
+        Arms[Idx] = Builder.CreateAdd(Result, A);
+        Builder.CreateBr(Join);
+      }
+      Builder.SetInsertPoint(Join);
+      PHINode *Phi = Builder.CreatePHI(Int32Ty, 2);
+      Phi->addIncoming(Arms[0], Then);
+      Phi->addIncoming(Arms[1], Else);
+      Result = Phi;
+    }
+    break;
+  case Shape::Switch: {
+    unsigned NumCases = std::max(NumBlocks, 3U) - 2;
+    BasicBlock *Exit = BasicBlock::Create(Ctx, "exit", F);
+    SwitchInst *SI = Builder.CreateSwitch(A, Exit, NumCases);
+    Builder.SetInsertPoint(Exit);
+    PHINode *Phi = Builder.CreatePHI(Int32Ty, NumCases + 1);
+    Phi->addIncoming(A, BB);
+    for (unsigned CaseIdx = 0; CaseIdx < NumCases; ++CaseIdx) {
+      BasicBlock *Case = BasicBlock::Create(Ctx, "case", F);
+      SI->addCase(Builder.getInt32(CaseIdx), Case);
+      Builder.SetInsertPoint(Case);
+      Phi->addIncoming(Builder.CreateAdd(B, Builder.getInt32(CaseIdx % 16)),
+                       Case);
+      Builder.CreateBr(Exit);
+    }
+    Builder.SetInsertPoint(Exit);
+    Result = Phi;
+    break;
+  }
+  case Shape::Loops:
+    while (F->size() < NumBlocks) {
+      BB = emitLoopNest(BB, std::max(1U, unsigned(LoopDepth)), A, B, Ptr);
+      Builder.SetInsertPoint(BB);
+    }
+    break;
+  }
+
+  Builder.CreateRet(Result);
+  return M;
+}
+
+//===----------------------------------------------------------------------===//
+// Measurements
+//===----------------------------------------------------------------------===//
+// Returns the peak resident set size of this process in KiB (0 if unknown)
+static uint64_t getPeakRSSKB() {
+#ifdef LLVM_ON_UNIX
+  struct rusage Usage;
+  if (getrusage(RUSAGE_SELF, &Usage))
+    return 0;
+#ifdef __APPLE__
+  // Reported in bytes on Darwin (and in KiB elsewhere)
+  return Usage.ru_maxrss / 1024;
+#else
+  return Usage.ru_maxrss;
+#endif
+#else
+  return 0;
+#endif
+}
+
+// Runs Bench on a module of the given shape and size (in this process)
+static Measurement runBenchmark(const PassBenchmark &Bench, Shape Kind,
+                                unsigned Size) {
+  Measurement Result;
+  std::optional<double> Best;
+
+  for (unsigned Run = 0; Run < std::max(1U, unsigned(Repeat)); ++Run) {
+    LLVMContext Ctx;
+    std::unique_ptr<Module> M = generateModule(Ctx, Kind, Size);
+    if (verifyModule(*M, &errs()))
+      report_fatal_error("generated an invalid module");
+
+    Function &F = *M->getFunction("bench");
+    Result.NumBlocks = F.size();
+    Result.NumInsts = F.getInstructionCount();
+
+    LoopAnalysisManager LAM;
+    FunctionAnalysisManager FAM;
+    CGSCCAnalysisManager CGAM;
+    ModuleAnalysisManager MAM;
+    PassBuilder PB;
+    for (auto GetInfo :
+         {getRIVPluginInfo, getMergeBBPluginInfo, getDuplicateBBPluginInfo,
+          getOpcodeCounterPluginInfo, getSimpleLICMPluginInfo})
+      GetInfo().RegisterPassBuilderCallbacks(PB);
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    ModulePassManager MPM;
+    Bench.AddPasses(PB, MPM);
+
+    uint64_t PeakBefore = getPeakRSSKB();
+    auto Start = std::chrono::steady_clock::now();
+    MPM.run(*M, MAM);
+    std::chrono::duration<double> Elapsed =
+        std::chrono::steady_clock::now() - Start;
+    uint64_t PeakAfter = getPeakRSSKB();
+
+    Best = std::min(Best.value_or(Elapsed.count()), Elapsed.count());
+    Result.PeakKB = std::max(Result.PeakKB, PeakAfter - PeakBefore);
+  }
+
+  Result.Seconds = *Best;
+  return Result;
+}
+
+// Runs Bench in a child process (if possible), so that the peak memory usage
+// of other measurements does not hide this one
+static std::optional<Measurement>
+measure(const PassBenchmark &Bench, Shape Kind, unsigned Size) {
+#ifdef LLVM_ON_UNIX
+  if (!InProcess) {
+    int Pipe[2];
+    if (pipe(Pipe))
+      return std::nullopt;
+
+    errs().flush();
+    outs().flush();
+    pid_t Child = fork();
+    if (Child < 0)
+      return std::nullopt;
+    if (0 == Child) {
+      close(Pipe[0]);
+      Measurement Result = runBenchmark(Bench, Kind, Size);
+      bool Written = write(Pipe[1], &Result, sizeof(Result)) ==
+                     ssize_t(sizeof(Result));
+      _exit(Written ? 0 : 1);
+    }
+
+    close(Pipe[1]);
+    Measurement Result;
+    bool Read = read(Pipe[0], &Result, sizeof(Result)) ==
+                ssize_t(sizeof(Result));
+    close(Pipe[0]);
+    int Status = 0;
+    waitpid(Child, &Status, 0);
+    if (!Read || !WIFEXITED(Status) || WEXITSTATUS(Status))
+      return std::nullopt;
+    return Result;
+  }
+#endif
+
+  Measurement Result = runBenchmark(Bench, Kind, Size);
+  Result.PeakKB = 0;
+  return Result;
+}
+
+//===----------------------------------------------------------------------===//
+// Main driver code.
+//===----------------------------------------------------------------------===//
+int main(int Argc, char **Argv) {
+  // Hide all options apart from the ones specific to this tool
+  cl::HideUnrelatedOptions(BenchCategory);
+
+  cl::ParseCommandLineOptions(Argc, Argv,
+                              "Measures how the llvm-tutor passes scale "
+                              "with the size of the input IR\n");
+
+  // Makes sure llvm_shutdown() is called (which cleans up LLVM objects)
+  //  http://llvm.org/docs/ProgrammersManual.html#ending-execution-with-llvm-shutdown
+  llvm_shutdown_obj SDO;
+
+  SmallVector<unsigned, 4> SizeList(Sizes.begin(), Sizes.end());
+  if (SizeList.empty())
+    SizeList = {1000, 10000, 100000};
+  llvm::sort(SizeList);
+
+  SmallVector<const PassBenchmark *, 8> SelectedPasses;
+  for (const PassBenchmark &Bench : Benchmarks)
+    if (PassNames.empty() || is_contained(PassNames, Bench.Name))
+      SelectedPasses.push_back(&Bench);
+  SmallVector<const ShapeInfo *, 4> SelectedShapes;
+  for (const ShapeInfo &Info : Shapes)
+    if (ShapeNames.empty() || is_contained(ShapeNames, Info.Name))
+      SelectedShapes.push_back(&Info);
+  if (SelectedPasses.empty() || SelectedShapes.empty()) {
+    errs() << "Error: no such pass or shape (see -help)\n";
+    return -1;
+  }
+
+  raw_ostream &OS = outs();
+  if (CSV)
+    OS << "pass,shape,blocks,instructions,time_ms,peak_kb,exponent\n";
+  else
+    OS << formatv("{0,-16} {1,-10} {2,10} {3,12} {4,12} {5,12} {6,9}\n",
+                  "PASS", "SHAPE", "BLOCKS", "INSTRUCTIONS", "TIME (ms)",
+                  "PEAK (KiB)", "EXPONENT");
+
+  bool Success = true;
+  for (const PassBenchmark *Bench : SelectedPasses) {
+    for (const ShapeInfo *Info : SelectedShapes) {
+      std::optional<Measurement> Previous;
+      for (unsigned Size : SizeList) {
+        std::optional<Measurement> Result = measure(*Bench, Info->Kind, Size);
+        if (!Result) {
+          errs() << "Error: " << Bench->Name << " failed on " << Info->Name
+                 << " with " << Size << " blocks\n";
+          Success = false;
+          break;
+        }
+
+        // Time ~ size^Exponent, based on the previous measurement (the times
+        // below 1ms are too noisy)
+        std::optional<double> Exponent;
+        if (Previous && Previous->Seconds >= 1e-3 &&
+            Result->NumBlocks > Previous->NumBlocks)
+          Exponent = std::log(Result->Seconds / Previous->Seconds) /
+                     std::log(double(Result->NumBlocks) / Previous->NumBlocks);
+
+        std::string ExponentStr =
+            Exponent ? formatv("{0:F2}", *Exponent).str() : "-";
+        double Millis = Result->Seconds * 1e3;
+        if (CSV)
+          OS << Bench->Name << "," << Info->Name << "," << Result->NumBlocks
+             << "," << Result->NumInsts << "," << format("%.3f", Millis)
+             << "," << Result->PeakKB << ","
+             << (Exponent ? ExponentStr : "") << "\n";
+        else
+          OS << format("%-16s %-10s %10llu %12llu %12.3f %12llu %9s\n",
+                       Bench->Name, Info->Name,
+                       (unsigned long long)Result->NumBlocks,
+                       (unsigned long long)Result->NumInsts, Millis,
+                       (unsigned long long)Result->PeakKB,
+                       ExponentStr.c_str());
+        OS.flush();
+
+        if (MaxExponent > 0 && Exponent && *Exponent > MaxExponent &&
+            Result->Seconds >= 1e-2) {
+          errs() << "Error: " << Bench->Name << " scales as size^"
+                 << ExponentStr << " on " << Info->Name << " (limit: "
+                 << format("%.2f", double(MaxExponent)) << ")\n";
+          Success = false;
+        }
+        Previous = Result;
+      }
+    }
+  }
+
+  return Success ? 0 : 1;
+}
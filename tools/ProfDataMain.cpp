@@ -0,0 +1,1196 @@
+//========================================================================
+// FILE:
+//    ProfDataMain.cpp
+//
+// DESCRIPTION:
+//    A command-line tool that reads, prints and merges the binary profiles
+//    generated by modules instrumented with DynamicCallCounter (i.e. with
+//    `-dynamic-cc-output=binary`), EdgeProfiler or LoopTripCounter. It also
+//    prints the traces generated by InjectFuncCall (with
+//    `-inject-func-call-output=trace`) and decodes the binary result streams
+//    of the printer passes (with `-<pass>-format=binary`) into JSON lines -
+//    neither can be merged. The profiles are mmap-ed and read in place - see
+//    DynamicCallCounterProfile.h for the format. The kind of every profile is
+//    detected automatically, but different kinds cannot be mixed.
+//
+//    Edge profiles only contain the counts of the edges that are not on the
+//    spanning tree selected by EdgeProfiler. The counts of the remaining
+//    edges are reconstructed here using flow conservation.
+//
+//    Call-edge profiles (DynamicCallCounter with `-dynamic-cc-edges`) are
+//    merged into a sample profile in LLVM's text format instead. The targets
+//    of indirect calls are recorded by address, which is only meaningful
+//    within the process that wrote the profile, so they are resolved to
+//    names when reading. The resulting file can be passed to clang
+//    (`-fprofile-sample-use`) or processed further with `llvm-profdata merge
+//    -sample` (e.g. to convert it into the binary format).
+//
+//    Profiles are merged by function name, so profiles from different
+//    processes (or even different, but overlapping, modules) can be combined.
+//    Edge (and loop) profiles of a function can only be merged if its CFG
+//    (its loops) is identical in all the inputs.
+//
+// USAGE:
+//    # Print the (merged) call counts recorded in one or more profiles
+//      <BUILD/DIR>/bin/dcc-profdata show <profile> [<profile> ...]
+//    # Merge several profiles into one
+//      <BUILD/DIR>/bin/dcc-profdata merge -o <output> <profile> [...]
+//    # Convert call-edge profiles into a sample profile
+//      <BUILD/DIR>/bin/dcc-profdata merge -o app.prof <profile> [...]
+//      clang -O2 -g -fprofile-sample-use=app.prof <source-files>
+//    # Decode the binary results of a printer pass into JSON lines
+//      <BUILD/DIR>/bin/dcc-profdata show <result-stream>
+//    Response files (@file) are supported, which is handy when merging
+//    thousands of profiles.
+//
+// License: MIT
+//========================================================================
+#include "DynamicCallCounterProfile.h"
+#include "LoopTripCounterProfile.h"
+#include "ResultWriter.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Alignment.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/LEB128.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <vector>
+
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+// Command line options
+//===----------------------------------------------------------------------===//
+static cl::OptionCategory ProfDataCategory{"dcc-profdata options"};
+
+static cl::SubCommand ShowCommand("show",
+                                  "Print the call counts from the profiles");
+static cl::SubCommand MergeCommand("merge",
+                                   "Merge the profiles into one profile");
+
+static cl::list<std::string> InputFiles{cl::Positional,
+                                        cl::desc{"<profile files>"},
+                                        cl::OneOrMore,
+                                        cl::sub(ShowCommand),
+                                        cl::sub(MergeCommand),
+                                        cl::cat{ProfDataCategory}};
+
+static cl::opt<std::string> OutputFile{"o",
+                                       cl::desc{"Output file"},
+                                       cl::value_desc{"filename"},
+                                       cl::Required,
+                                       cl::sub(MergeCommand),
+                                       cl::cat{ProfDataCategory}};
+
+//===----------------------------------------------------------------------===//
+// dcc-profdata - implementation
+//===----------------------------------------------------------------------===//
+// Function name <--> the total number of calls. The names point into the
+// (mmap-ed) input files.
+using MergedProfile = MapVector<StringRef, uint64_t>;
+
+// Validates the profile in Buf and adds its counts to Result
+static Error readProfile(const MemoryBuffer &Buf, MergedProfile &Result) {
+  StringRef Name = Buf.getBufferIdentifier();
+  const char *Data = Buf.getBufferStart();
+  size_t Size = Buf.getBufferSize();
+
+  if (Size < sizeof(DCCProfileHeader))
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: truncated profile header",
+                             Name.str().c_str());
+
+  const auto *Header = reinterpret_cast<const DCCProfileHeader *>(Data);
+  if (Header->Magic != DCCProfileMagic)
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: not a DynamicCallCounter profile (or "
+                             "generated on a host with different endianness)",
+                             Name.str().c_str());
+  if (Header->Version != DCCProfileVersion)
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: unsupported profile version %u (expected "
+                             "%u)",
+                             Name.str().c_str(), Header->Version,
+                             DCCProfileVersion);
+
+  uint64_t RecordsSize =
+      uint64_t(Header->NumFunctions) * sizeof(DCCProfileRecord);
+  if (Size < sizeof(DCCProfileHeader) + RecordsSize + Header->NamesSize)
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: truncated profile", Name.str().c_str());
+
+  const auto *Records = reinterpret_cast<const DCCProfileRecord *>(
+      Data + sizeof(DCCProfileHeader));
+  StringRef Names(Data + sizeof(DCCProfileHeader) + RecordsSize,
+                  Header->NamesSize);
+
+  for (uint32_t Idx = 0; Idx != Header->NumFunctions; ++Idx) {
+    const DCCProfileRecord &Rec = Records[Idx];
+    if (uint64_t(Rec.NameOffset) + Rec.NameSize > Names.size())
+      return createStringError(inconvertibleErrorCode(),
+                               "%s: malformed name for record %u",
+                               Name.str().c_str(), Idx);
+
+    Result[Names.substr(Rec.NameOffset, Rec.NameSize)] += Rec.CallCount;
+  }
+
+  return Error::success();
+}
+
+// Prints Profile in the format used by DynamicCallCounter's `printf_wrapper`
+static void printProfile(raw_ostream &OutS, const MergedProfile &Profile) {
+  OutS << "=================================================\n";
+  OutS << "LLVM-TUTOR: dynamic analysis results\n";
+  OutS << "=================================================\n";
+  const char *Str1 = "NAME";
+  const char *Str2 = "#N DIRECT CALLS";
+  OutS << format("%-20s %-10s\n", Str1, Str2);
+  OutS << "-------------------------------------------------\n";
+
+  for (auto &CallCount : Profile)
+    OutS << format("%-20s %-10lu\n", CallCount.first.str().c_str(),
+                   CallCount.second);
+}
+
+// Writes Profile to Path using the same layout as the instrumented modules
+static Error writeProfile(StringRef Path, const MergedProfile &Profile) {
+  std::error_code EC;
+  raw_fd_ostream OutS(Path, EC, sys::fs::OF_None);
+  if (EC)
+    return createFileError(Path, EC);
+
+  std::string Names;
+  std::vector<DCCProfileRecord> Records;
+  Records.reserve(Profile.size());
+  for (auto &CallCount : Profile) {
+    Records.push_back({CallCount.second, static_cast<uint32_t>(Names.size()),
+                       static_cast<uint32_t>(CallCount.first.size())});
+    Names += CallCount.first;
+  }
+
+  DCCProfileHeader Header{DCCProfileMagic, DCCProfileVersion,
+                          static_cast<uint32_t>(Records.size()),
+                          Names.size()};
+  OutS.write(reinterpret_cast<const char *>(&Header), sizeof(Header));
+  OutS.write(reinterpret_cast<const char *>(Records.data()),
+             Records.size() * sizeof(DCCProfileRecord));
+  OutS << Names;
+
+  return Error::success();
+}
+
+// The (reconstructed) edge profile of one function
+struct FunctionEdgeProfile {
+  uint32_t NumBlocks = 0;
+  std::vector<EdgeProfileEdge> Edges;
+  // The execution count of every edge in Edges
+  std::vector<uint64_t> Counts;
+};
+
+// Function name <--> its edge profile. The names point into the (mmap-ed)
+// input files.
+using MergedEdgeProfile = MapVector<StringRef, FunctionEdgeProfile>;
+
+// Computes the counts of all the edges in Edges given the counts of the
+// instrumented edges. Fails if the counts cannot be reconstructed, i.e. if
+// the non-instrumented edges don't form a spanning tree or if the counts are
+// not consistent (an edge would have to be executed a negative number of
+// times).
+//
+// In the extended CFG the total count of the incoming edges of every node is
+// equal to the total count of its outgoing edges. If only one of the edges of
+// a node is not known, it can be computed from the other edges. Solving that
+// edge may leave only one unknown edge at its other end, and so on - on a
+// tree this eventually solves all the edges (starting from the leaves).
+static Error reconstructEdgeCounts(FunctionEdgeProfile &Func,
+                                   ArrayRef<uint64_t> Counters) {
+  auto MalformedCFG = [] {
+    return createStringError(inconvertibleErrorCode(), "malformed CFG");
+  };
+
+  uint32_t NumNodes = Func.NumBlocks + 1;
+  std::vector<SmallVector<uint32_t, 4>> NodeEdges(NumNodes);
+  std::vector<uint32_t> NumUnknown(NumNodes, 0);
+  std::vector<bool> Known(Func.Edges.size(), false);
+  Func.Counts.assign(Func.Edges.size(), 0);
+
+  for (uint32_t Idx = 0; Idx != Func.Edges.size(); ++Idx) {
+    const EdgeProfileEdge &Edge = Func.Edges[Idx];
+    NodeEdges[Edge.Src].push_back(Idx);
+    if (Edge.Dst != Edge.Src)
+      NodeEdges[Edge.Dst].push_back(Idx);
+
+    if (Edge.CounterIdx != EdgeProfileNoCounter) {
+      Func.Counts[Idx] = Counters[Edge.CounterIdx];
+      Known[Idx] = true;
+      continue;
+    }
+    // Self-loops are never on the spanning tree
+    if (Edge.Src == Edge.Dst)
+      return MalformedCFG();
+    NumUnknown[Edge.Src]++;
+    NumUnknown[Edge.Dst]++;
+  }
+
+  std::deque<uint32_t> Worklist;
+  for (uint32_t Node = 0; Node != NumNodes; ++Node)
+    if (NumUnknown[Node] == 1)
+      Worklist.push_back(Node);
+
+  while (!Worklist.empty()) {
+    uint32_t Node = Worklist.front();
+    Worklist.pop_front();
+    if (NumUnknown[Node] != 1)
+      continue;
+
+    uint64_t In = 0, Out = 0;
+    uint32_t UnknownIdx = 0;
+    for (uint32_t Idx : NodeEdges[Node]) {
+      const EdgeProfileEdge &Edge = Func.Edges[Idx];
+      if (!Known[Idx]) {
+        UnknownIdx = Idx;
+        continue;
+      }
+      if (Edge.Dst == Node)
+        In += Func.Counts[Idx];
+      if (Edge.Src == Node)
+        Out += Func.Counts[Idx];
+    }
+
+    // E.g. the counters of a profile from a different build, or the
+    // execution left the function in a way that's not in the CFG
+    const EdgeProfileEdge &Edge = Func.Edges[UnknownIdx];
+    if ((Edge.Dst == Node) ? Out < In : In < Out)
+      return createStringError(inconvertibleErrorCode(),
+                               "inconsistent edge counts in block %u", Node);
+    Func.Counts[UnknownIdx] = (Edge.Dst == Node) ? Out - In : In - Out;
+    Known[UnknownIdx] = true;
+    NumUnknown[Edge.Src]--;
+    NumUnknown[Edge.Dst]--;
+    uint32_t Other = (Edge.Dst == Node) ? Edge.Src : Edge.Dst;
+    if (NumUnknown[Other] == 1)
+      Worklist.push_back(Other);
+  }
+
+  if (!llvm::all_of(NumUnknown, [](uint32_t N) { return N == 0; }))
+    return MalformedCFG();
+  return Error::success();
+}
+
+// Validates the edge profile in Buf, reconstructs the counts of all the edges
+// and adds them to Result
+static Error readEdgeProfile(const MemoryBuffer &Buf,
+                             MergedEdgeProfile &Result) {
+  StringRef Name = Buf.getBufferIdentifier();
+  const char *Data = Buf.getBufferStart();
+  size_t Size = Buf.getBufferSize();
+
+  if (Size < sizeof(EdgeProfileHeader))
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: truncated profile header",
+                             Name.str().c_str());
+
+  const auto *Header = reinterpret_cast<const EdgeProfileHeader *>(Data);
+  if (Header->Magic != EdgeProfileMagic)
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: not an EdgeProfiler profile",
+                             Name.str().c_str());
+  if (Header->Version != EdgeProfileVersion)
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: unsupported profile version %u (expected "
+                             "%u)",
+                             Name.str().c_str(), Header->Version,
+                             EdgeProfileVersion);
+
+  uint64_t FuncsOffset = sizeof(EdgeProfileHeader);
+  uint64_t CountersOffset =
+      FuncsOffset +
+      uint64_t(Header->NumFunctions) * sizeof(EdgeProfileFunction);
+  uint64_t EdgesOffset =
+      CountersOffset + uint64_t(Header->NumCounters) * sizeof(uint64_t);
+  uint64_t NamesOffset =
+      EdgesOffset + uint64_t(Header->NumEdges) * sizeof(EdgeProfileEdge);
+  if (Size < NamesOffset + Header->NamesSize)
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: truncated profile", Name.str().c_str());
+
+  const auto *Funcs =
+      reinterpret_cast<const EdgeProfileFunction *>(Data + FuncsOffset);
+  ArrayRef<uint64_t> Counters(
+      reinterpret_cast<const uint64_t *>(Data + CountersOffset),
+      Header->NumCounters);
+  const auto *Edges =
+      reinterpret_cast<const EdgeProfileEdge *>(Data + EdgesOffset);
+  StringRef Names(Data + NamesOffset, Header->NamesSize);
+
+  for (uint32_t FuncIdx = 0; FuncIdx != Header->NumFunctions; ++FuncIdx) {
+    const EdgeProfileFunction &Rec = Funcs[FuncIdx];
+    if (uint64_t(Rec.NameOffset) + Rec.NameSize > Names.size() ||
+        uint64_t(Rec.FirstEdge) + Rec.NumEdges > Header->NumEdges)
+      return createStringError(inconvertibleErrorCode(),
+                               "%s: malformed record for function %u",
+                               Name.str().c_str(), FuncIdx);
+    StringRef FuncName = Names.substr(Rec.NameOffset, Rec.NameSize);
+
+    FunctionEdgeProfile Func;
+    Func.NumBlocks = Rec.NumBlocks;
+    Func.Edges.assign(Edges + Rec.FirstEdge,
+                      Edges + Rec.FirstEdge + Rec.NumEdges);
+    bool Valid = llvm::all_of(Func.Edges, [&](const EdgeProfileEdge &Edge) {
+      return Edge.Src <= Rec.NumBlocks && Edge.Dst <= Rec.NumBlocks &&
+             (Edge.CounterIdx == EdgeProfileNoCounter ||
+              Edge.CounterIdx < Header->NumCounters);
+    });
+    if (!Valid)
+      return createStringError(inconvertibleErrorCode(),
+                               "%s: malformed CFG for function %s",
+                               Name.str().c_str(), FuncName.str().c_str());
+    if (Error E = reconstructEdgeCounts(Func, Counters))
+      return createStringError(
+          inconvertibleErrorCode(), "%s: %s for function %s",
+          Name.str().c_str(), toString(std::move(E)).c_str(),
+          FuncName.str().c_str());
+
+    auto [It, Inserted] = Result.try_emplace(FuncName, std::move(Func));
+    if (Inserted)
+      continue;
+
+    // Merge with the counts read from the previous profiles
+    FunctionEdgeProfile &Merged = It->second;
+    bool SameCFG =
+        Merged.NumBlocks == Rec.NumBlocks &&
+        Merged.Edges.size() == Rec.NumEdges &&
+        std::equal(Merged.Edges.begin(), Merged.Edges.end(),
+                   Edges + Rec.FirstEdge,
+                   [](const EdgeProfileEdge &A, const EdgeProfileEdge &B) {
+                     return A.Src == B.Src && A.Dst == B.Dst;
+                   });
+    if (!SameCFG)
+      return createStringError(inconvertibleErrorCode(),
+                               "%s: the CFG of function %s does not match "
+                               "the other profiles",
+                               Name.str().c_str(), FuncName.str().c_str());
+    for (uint32_t Idx = 0; Idx != Merged.Counts.size(); ++Idx)
+      Merged.Counts[Idx] += Func.Counts[Idx];
+  }
+
+  return Error::success();
+}
+
+// Prints the block and edge counts of every function in Profile. Blocks are
+// identified by their position in the function (starting from 1).
+static void printEdgeProfile(raw_ostream &OutS,
+                             const MergedEdgeProfile &Profile) {
+  OutS << "=================================================\n";
+  OutS << "LLVM-TUTOR: edge profile results\n";
+  OutS << "=================================================\n";
+  const char *BlockStr = "BLOCK";
+  const char *EdgeStr = "EDGE";
+  const char *CountStr = "#N EXECUTIONS";
+
+  for (auto &Entry : Profile) {
+    const FunctionEdgeProfile &Func = Entry.second;
+
+    // Every block has at least one outgoing edge in the extended CFG
+    std::vector<uint64_t> BlockCounts(Func.NumBlocks + 1, 0);
+    for (uint32_t Idx = 0; Idx != Func.Edges.size(); ++Idx)
+      BlockCounts[Func.Edges[Idx].Src] += Func.Counts[Idx];
+
+    OutS << "Function: " << Entry.first << " (entry count: "
+         << BlockCounts[EdgeProfileVirtualNode] << ")\n";
+    OutS << format("%-20s %-10s\n", BlockStr, CountStr);
+    OutS << "-------------------------------------------------\n";
+    for (uint32_t Block = 1; Block <= Func.NumBlocks; ++Block)
+      OutS << format("%-20u %-10lu\n", Block, BlockCounts[Block]);
+
+    OutS << format("%-20s %-10s\n", EdgeStr, CountStr);
+    OutS << "-------------------------------------------------\n";
+    for (uint32_t Idx = 0; Idx != Func.Edges.size(); ++Idx) {
+      const EdgeProfileEdge &Edge = Func.Edges[Idx];
+      std::string Src = (Edge.Src == EdgeProfileVirtualNode)
+                            ? "<entry>"
+                            : std::to_string(Edge.Src);
+      std::string Dst = (Edge.Dst == EdgeProfileVirtualNode)
+                            ? "<exit>"
+                            : std::to_string(Edge.Dst);
+      OutS << format("%-20s %-10lu\n", (Src + " -> " + Dst).c_str(),
+                     Func.Counts[Idx]);
+    }
+  }
+}
+
+// Writes Profile to Path using the same layout as the instrumented modules.
+// The edges that were instrumented in the inputs keep their counters.
+static Error writeEdgeProfile(StringRef Path,
+                              const MergedEdgeProfile &Profile) {
+  std::error_code EC;
+  raw_fd_ostream OutS(Path, EC, sys::fs::OF_None);
+  if (EC)
+    return createFileError(Path, EC);
+
+  std::string Names;
+  std::vector<EdgeProfileFunction> Funcs;
+  std::vector<uint64_t> Counters;
+  std::vector<EdgeProfileEdge> Edges;
+  for (auto &Entry : Profile) {
+    const FunctionEdgeProfile &Func = Entry.second;
+    Funcs.push_back({static_cast<uint32_t>(Names.size()),
+                     static_cast<uint32_t>(Entry.first.size()),
+                     Func.NumBlocks, static_cast<uint32_t>(Edges.size()),
+                     static_cast<uint32_t>(Func.Edges.size()), 0});
+    Names += Entry.first;
+
+    for (uint32_t Idx = 0; Idx != Func.Edges.size(); ++Idx) {
+      EdgeProfileEdge Edge = Func.Edges[Idx];
+      if (Edge.CounterIdx != EdgeProfileNoCounter) {
+        Edge.CounterIdx = Counters.size();
+        Counters.push_back(Func.Counts[Idx]);
+      }
+      Edges.push_back(Edge);
+    }
+  }
+
+  EdgeProfileHeader Header{EdgeProfileMagic,
+                           EdgeProfileVersion,
+                           static_cast<uint32_t>(Funcs.size()),
+                           static_cast<uint32_t>(Counters.size()),
+                           static_cast<uint32_t>(Edges.size()),
+                           Names.size()};
+  OutS.write(reinterpret_cast<const char *>(&Header), sizeof(Header));
+  OutS.write(reinterpret_cast<const char *>(Funcs.data()),
+             Funcs.size() * sizeof(EdgeProfileFunction));
+  OutS.write(reinterpret_cast<const char *>(Counters.data()),
+             Counters.size() * sizeof(uint64_t));
+  OutS.write(reinterpret_cast<const char *>(Edges.data()),
+             Edges.size() * sizeof(EdgeProfileEdge));
+  OutS << Names;
+
+  return Error::success();
+}
+
+// The merged loop records of one function
+struct FunctionLoopProfile {
+  uint32_t NumBlocks = 0;
+  std::vector<LoopProfileLoop> Loops;
+};
+
+// Function name <--> its loop records. The names point into the (mmap-ed)
+// input files.
+using MergedLoopProfile = MapVector<StringRef, FunctionLoopProfile>;
+
+// Validates the loop profile in Buf and adds its records to Result
+static Error readLoopProfile(const MemoryBuffer &Buf,
+                             MergedLoopProfile &Result) {
+  StringRef Name = Buf.getBufferIdentifier();
+  const char *Data = Buf.getBufferStart();
+  size_t Size = Buf.getBufferSize();
+
+  if (Size < sizeof(LoopProfileHeader))
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: truncated profile header",
+                             Name.str().c_str());
+
+  const auto *Header = reinterpret_cast<const LoopProfileHeader *>(Data);
+  if (Header->Magic != LoopProfileMagic)
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: not a LoopTripCounter profile",
+                             Name.str().c_str());
+  if (Header->Version != LoopProfileVersion)
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: unsupported profile version %u (expected "
+                             "%u)",
+                             Name.str().c_str(), Header->Version,
+                             LoopProfileVersion);
+
+  uint64_t FuncsOffset = sizeof(LoopProfileHeader);
+  uint64_t LoopsOffset =
+      FuncsOffset +
+      uint64_t(Header->NumFunctions) * sizeof(LoopProfileFunction);
+  uint64_t NamesOffset =
+      LoopsOffset + uint64_t(Header->NumLoops) * sizeof(LoopProfileLoop);
+  if (Size < NamesOffset + Header->NamesSize)
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: truncated profile", Name.str().c_str());
+
+  const auto *Funcs =
+      reinterpret_cast<const LoopProfileFunction *>(Data + FuncsOffset);
+  const auto *Loops =
+      reinterpret_cast<const LoopProfileLoop *>(Data + LoopsOffset);
+  StringRef Names(Data + NamesOffset, Header->NamesSize);
+
+  for (uint32_t FuncIdx = 0; FuncIdx != Header->NumFunctions; ++FuncIdx) {
+    const LoopProfileFunction &Rec = Funcs[FuncIdx];
+    if (uint64_t(Rec.NameOffset) + Rec.NameSize > Names.size() ||
+        uint64_t(Rec.FirstLoop) + Rec.NumLoops > Header->NumLoops)
+      return createStringError(inconvertibleErrorCode(),
+                               "%s: malformed record for function %u",
+                               Name.str().c_str(), FuncIdx);
+    StringRef FuncName = Names.substr(Rec.NameOffset, Rec.NameSize);
+    ArrayRef<LoopProfileLoop> FuncLoops(Loops + Rec.FirstLoop, Rec.NumLoops);
+
+    auto [It, Inserted] = Result.insert({FuncName, FunctionLoopProfile()});
+    FunctionLoopProfile &Merged = It->second;
+    if (Inserted) {
+      Merged.NumBlocks = Rec.NumBlocks;
+      Merged.Loops.assign(FuncLoops.begin(), FuncLoops.end());
+      continue;
+    }
+
+    // Merge with the records read from the previous profiles
+    bool SameLoops =
+        Merged.NumBlocks == Rec.NumBlocks &&
+        Merged.Loops.size() == FuncLoops.size() &&
+        std::equal(Merged.Loops.begin(), Merged.Loops.end(),
+                   FuncLoops.begin(),
+                   [](const LoopProfileLoop &A, const LoopProfileLoop &B) {
+                     return A.Header == B.Header && A.Depth == B.Depth;
+                   });
+    if (!SameLoops)
+      return createStringError(inconvertibleErrorCode(),
+                               "%s: the loops of function %s do not match "
+                               "the other profiles",
+                               Name.str().c_str(), FuncName.str().c_str());
+    for (uint32_t Idx = 0; Idx != FuncLoops.size(); ++Idx) {
+      LoopProfileLoop &Loop = Merged.Loops[Idx];
+      Loop.Entries += FuncLoops[Idx].Entries;
+      Loop.Iterations += FuncLoops[Idx].Iterations;
+      Loop.MaxTripCount =
+          std::max(Loop.MaxTripCount, FuncLoops[Idx].MaxTripCount);
+      for (unsigned Bucket = 0; Bucket != LoopProfileNumBuckets; ++Bucket)
+        Loop.Buckets[Bucket] += FuncLoops[Idx].Buckets[Bucket];
+    }
+  }
+
+  return Error::success();
+}
+
+// Prints the trip counts of every loop in Profile, followed by the non-empty
+// buckets of its histogram. Loops are identified by the position of their
+// header in the function (starting from 1).
+static void printLoopProfile(raw_ostream &OutS,
+                             const MergedLoopProfile &Profile) {
+  OutS << "=================================================\n";
+  OutS << "LLVM-TUTOR: loop trip count results\n";
+  OutS << "=================================================\n";
+  const char *HeaderStr = "HEADER";
+  const char *DepthStr = "DEPTH";
+  const char *EntriesStr = "#N ENTRIES";
+  const char *MeanStr = "MEAN TRIPS";
+  const char *MaxStr = "MAX TRIPS";
+
+  for (auto &Entry : Profile) {
+    OutS << "Function: " << Entry.first << "\n";
+    OutS << format("%-8s %-6s %-12s %-12s %-12s\n", HeaderStr, DepthStr,
+                   EntriesStr, MeanStr, MaxStr);
+    OutS << "-------------------------------------------------\n";
+    for (const LoopProfileLoop &Loop : Entry.second.Loops) {
+      double Mean =
+          Loop.Entries ? double(Loop.Iterations) / double(Loop.Entries) : 0.0;
+      OutS << format("%-8u %-6u %-12lu %-12.2f %-12lu\n", Loop.Header,
+                     Loop.Depth, Loop.Entries, Mean, Loop.MaxTripCount);
+
+      for (unsigned Bucket = 0; Bucket != LoopProfileNumBuckets; ++Bucket) {
+        if (!Loop.Buckets[Bucket])
+          continue;
+        uint64_t Low = Bucket ? uint64_t(1) << (Bucket - 1) : 0;
+        std::string Range = std::to_string(Low);
+        if (Bucket == LoopProfileNumBuckets - 1)
+          Range += "+";
+        else if (Low > 1)
+          Range += "-" + std::to_string(2 * Low - 1);
+        OutS << format("  %-14s %-10lu\n", ("trips " + Range).c_str(),
+                       Loop.Buckets[Bucket]);
+      }
+    }
+  }
+}
+
+// Writes Profile to Path using the same layout as the instrumented modules
+static Error writeLoopProfile(StringRef Path,
+                              const MergedLoopProfile &Profile) {
+  std::error_code EC;
+  raw_fd_ostream OutS(Path, EC, sys::fs::OF_None);
+  if (EC)
+    return createFileError(Path, EC);
+
+  std::string Names;
+  std::vector<LoopProfileFunction> Funcs;
+  std::vector<LoopProfileLoop> Loops;
+  for (auto &Entry : Profile) {
+    const FunctionLoopProfile &Func = Entry.second;
+    Funcs.push_back({static_cast<uint32_t>(Names.size()),
+                     static_cast<uint32_t>(Entry.first.size()),
+                     Func.NumBlocks, static_cast<uint32_t>(Loops.size()),
+                     static_cast<uint32_t>(Func.Loops.size()), 0});
+    Names += Entry.first;
+    Loops.insert(Loops.end(), Func.Loops.begin(), Func.Loops.end());
+  }
+
+  LoopProfileHeader Header{LoopProfileMagic,
+                           LoopProfileVersion,
+                           static_cast<uint32_t>(Funcs.size()),
+                           static_cast<uint32_t>(Loops.size()),
+                           0,
+                           Names.size()};
+  OutS.write(reinterpret_cast<const char *>(&Header), sizeof(Header));
+  OutS.write(reinterpret_cast<const char *>(Funcs.data()),
+             Funcs.size() * sizeof(LoopProfileFunction));
+  OutS.write(reinterpret_cast<const char *>(Loops.data()),
+             Loops.size() * sizeof(LoopProfileLoop));
+  OutS << Names;
+
+  return Error::success();
+}
+
+// The calls made from one location in a function (i.e. from all the call
+// sites with the same line offset and discriminator)
+struct CallSiteCalls {
+  uint64_t Count = 0;
+  // Callee name <--> the number of calls. The indirect calls whose target is
+  // not known are not included.
+  MapVector<StringRef, uint64_t> Targets;
+};
+
+// The call-edge profile of one function
+struct FunctionCallEdges {
+  uint64_t EntryCount = 0;
+  bool IsDefined = false;
+  // (line offset, discriminator) <--> the calls made from that location
+  MapVector<std::pair<uint32_t, uint32_t>, CallSiteCalls> Sites;
+};
+
+// Function name <--> its call-edge profile. The names point into the
+// (mmap-ed) input files.
+using MergedCallEdgeProfile = MapVector<StringRef, FunctionCallEdges>;
+
+// Validates the call-edge profile in Buf, resolves the targets of the
+// indirect calls and adds the counts to Result
+static Error readCallEdgeProfile(const MemoryBuffer &Buf,
+                                 MergedCallEdgeProfile &Result) {
+  StringRef Name = Buf.getBufferIdentifier();
+  const char *Data = Buf.getBufferStart();
+  size_t Size = Buf.getBufferSize();
+
+  if (Size < sizeof(CallEdgeProfileHeader))
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: truncated profile header",
+                             Name.str().c_str());
+
+  const auto *Header = reinterpret_cast<const CallEdgeProfileHeader *>(Data);
+  if (Header->Magic != CallEdgeProfileMagic)
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: not a call-edge profile",
+                             Name.str().c_str());
+  if (Header->Version != CallEdgeProfileVersion)
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: unsupported profile version %u (expected "
+                             "%u)",
+                             Name.str().c_str(), Header->Version,
+                             CallEdgeProfileVersion);
+
+  uint64_t FuncsOffset = sizeof(CallEdgeProfileHeader);
+  uint64_t SitesOffset =
+      FuncsOffset +
+      uint64_t(Header->NumFunctions) * sizeof(CallEdgeProfileFunction);
+  uint64_t TargetsOffset =
+      SitesOffset + uint64_t(Header->NumSites) * sizeof(CallEdgeProfileSite);
+  uint64_t AddressesOffset =
+      TargetsOffset +
+      uint64_t(Header->NumTargets) * sizeof(CallEdgeProfileTarget);
+  uint64_t NamesOffset =
+      AddressesOffset +
+      uint64_t(Header->NumAddresses) * sizeof(CallEdgeProfileAddress);
+  if (Size < NamesOffset + Header->NamesSize)
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: truncated profile", Name.str().c_str());
+
+  const auto *Funcs =
+      reinterpret_cast<const CallEdgeProfileFunction *>(Data + FuncsOffset);
+  const auto *Sites =
+      reinterpret_cast<const CallEdgeProfileSite *>(Data + SitesOffset);
+  const auto *Targets =
+      reinterpret_cast<const CallEdgeProfileTarget *>(Data + TargetsOffset);
+  const auto *Addresses = reinterpret_cast<const CallEdgeProfileAddress *>(
+      Data + AddressesOffset);
+  StringRef Names(Data + NamesOffset, Header->NamesSize);
+
+  std::vector<StringRef> FuncNames;
+  for (uint32_t Idx = 0; Idx != Header->NumFunctions; ++Idx) {
+    const CallEdgeProfileFunction &Rec = Funcs[Idx];
+    if (uint64_t(Rec.NameOffset) + Rec.NameSize > Names.size())
+      return createStringError(inconvertibleErrorCode(),
+                               "%s: malformed name for function %u",
+                               Name.str().c_str(), Idx);
+    FuncNames.push_back(Names.substr(Rec.NameOffset, Rec.NameSize));
+
+    FunctionCallEdges &Func = Result[FuncNames.back()];
+    Func.EntryCount += Rec.EntryCount;
+    Func.IsDefined |= (Rec.IsDefined != 0);
+  }
+
+  // Run-time address <--> function name
+  DenseMap<uint64_t, StringRef> AddressMap;
+  for (uint32_t Idx = 0; Idx != Header->NumAddresses; ++Idx) {
+    if (Addresses[Idx].Function >= Header->NumFunctions)
+      return createStringError(inconvertibleErrorCode(),
+                               "%s: malformed address %u",
+                               Name.str().c_str(), Idx);
+    AddressMap[Addresses[Idx].Address] = FuncNames[Addresses[Idx].Function];
+  }
+
+  for (uint32_t Idx = 0; Idx != Header->NumSites; ++Idx) {
+    const CallEdgeProfileSite &Rec = Sites[Idx];
+    if (Rec.Caller >= Header->NumFunctions ||
+        (Rec.Callee != CallEdgeProfileIndirect &&
+         Rec.Callee >= Header->NumFunctions) ||
+        uint64_t(Rec.FirstTarget) + Rec.NumTargets > Header->NumTargets)
+      return createStringError(inconvertibleErrorCode(),
+                               "%s: malformed call site %u",
+                               Name.str().c_str(), Idx);
+    if (Rec.Count == 0)
+      continue;
+
+    CallSiteCalls &Site = Result[FuncNames[Rec.Caller]]
+                              .Sites[{Rec.LineOffset, Rec.Discriminator}];
+    Site.Count += Rec.Count;
+    if (Rec.Callee != CallEdgeProfileIndirect) {
+      Site.Targets[FuncNames[Rec.Callee]] += Rec.Count;
+      continue;
+    }
+
+    for (uint32_t TargetIdx = Rec.FirstTarget;
+         TargetIdx != Rec.FirstTarget + Rec.NumTargets; ++TargetIdx) {
+      const CallEdgeProfileTarget &Target = Targets[TargetIdx];
+      auto It = AddressMap.find(Target.Address);
+      if (Target.Address != 0 && It != AddressMap.end())
+        Site.Targets[It->second] += Target.Count;
+    }
+  }
+
+  return Error::success();
+}
+
+// Prints the calls made by every function defined in Profile. The call sites
+// are identified by their line offset (and the discriminator, if not 0).
+static void printCallEdgeProfile(raw_ostream &OutS,
+                                 const MergedCallEdgeProfile &Profile) {
+  OutS << "=================================================\n";
+  OutS << "LLVM-TUTOR: call-edge profile results\n";
+  OutS << "=================================================\n";
+  const char *SiteStr = "CALL SITE";
+  const char *CalleeStr = "CALLEE";
+  const char *CountStr = "#N CALLS";
+  const char *UnknownStr = "<unknown>";
+
+  for (auto &Entry : Profile) {
+    const FunctionCallEdges &Func = Entry.second;
+    if (!Func.IsDefined)
+      continue;
+
+    OutS << "Function: " << Entry.first << " (entry count: "
+         << Func.EntryCount << ")\n";
+    OutS << format("%-20s %-20s %-10s\n", SiteStr, CalleeStr, CountStr);
+    OutS << "-------------------------------------------------\n";
+    for (auto &SiteEntry : Func.Sites) {
+      auto [LineOffset, Discriminator] = SiteEntry.first;
+      std::string Location = "?";
+      if (LineOffset != CallEdgeProfileNoLocation) {
+        Location = std::to_string(LineOffset);
+        if (Discriminator)
+          Location += "." + std::to_string(Discriminator);
+      }
+
+      const CallSiteCalls &Site = SiteEntry.second;
+      uint64_t Known = 0;
+      for (auto &Target : Site.Targets) {
+        OutS << format("%-20s %-20s %-10lu\n", Location.c_str(),
+                       Target.first.str().c_str(), Target.second);
+        Known += Target.second;
+      }
+      if (Known < Site.Count)
+        OutS << format("%-20s %-20s %-10lu\n", Location.c_str(), UnknownStr,
+                       Site.Count - Known);
+    }
+  }
+}
+
+// Writes Profile to Path in the text format of LLVM's sample profiles (see
+// "Sample Profile Text Format" in clang's user manual):
+// ```
+//    function:total_samples:head_samples
+//     line_offset[.discriminator]: samples [callee:samples ...]
+// ```
+// The head samples are the entry counts and the body samples are the counts
+// of the call sites (the call sites without a location are left out). The
+// total samples are the sum of both.
+static Error writeSampleProfile(StringRef Path,
+                                const MergedCallEdgeProfile &Profile) {
+  std::error_code EC;
+  raw_fd_ostream OutS(Path, EC, sys::fs::OF_Text);
+  if (EC)
+    return createFileError(Path, EC);
+
+  for (auto &Entry : Profile) {
+    const FunctionCallEdges &Func = Entry.second;
+    if (!Func.IsDefined)
+      continue;
+
+    std::vector<std::pair<std::pair<uint32_t, uint32_t>, const CallSiteCalls *>>
+        Lines;
+    uint64_t TotalSamples = Func.EntryCount;
+    for (auto &SiteEntry : Func.Sites) {
+      if (SiteEntry.first.first == CallEdgeProfileNoLocation)
+        continue;
+      Lines.emplace_back(SiteEntry.first, &SiteEntry.second);
+      TotalSamples += SiteEntry.second.Count;
+    }
+    if (TotalSamples == 0)
+      continue;
+    llvm::sort(Lines, [](const auto &A, const auto &B) {
+      return A.first < B.first;
+    });
+
+    OutS << Entry.first << ':' << TotalSamples << ':' << Func.EntryCount
+         << '\n';
+    for (auto &Line : Lines) {
+      auto [LineOffset, Discriminator] = Line.first;
+      OutS << ' ' << LineOffset;
+      if (Discriminator)
+        OutS << '.' << Discriminator;
+      OutS << ": " << Line.second->Count;
+      for (auto &Target : Line.second->Targets)
+        OutS << ' ' << Target.first << ':' << Target.second;
+      OutS << '\n';
+    }
+  }
+
+  return Error::success();
+}
+
+// Validates the trace in Buf and prints its records, one per line, in the
+// order in which they appear in the trace
+static Error printTrace(raw_ostream &OutS, const MemoryBuffer &Buf) {
+  StringRef Name = Buf.getBufferIdentifier();
+  const char *Data = Buf.getBufferStart();
+  size_t Size = Buf.getBufferSize();
+
+  if (Size < sizeof(TraceHeader))
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: truncated trace header",
+                             Name.str().c_str());
+
+  const auto *Header = reinterpret_cast<const TraceHeader *>(Data);
+  if (Header->Magic != TraceMagic)
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: not an InjectFuncCall trace",
+                             Name.str().c_str());
+  if (Header->Version != TraceVersion)
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: unsupported trace version %u (expected %u)",
+                             Name.str().c_str(), Header->Version,
+                             TraceVersion);
+
+  uint64_t NamesOffset = sizeof(TraceHeader) + uint64_t(Header->NumFunctions) *
+                                                   sizeof(TraceFunction);
+  uint64_t Offset = NamesOffset + Header->NamesSize;
+  if (Size < Offset)
+    return createStringError(inconvertibleErrorCode(), "%s: truncated trace",
+                             Name.str().c_str());
+
+  const auto *Funcs =
+      reinterpret_cast<const TraceFunction *>(Data + sizeof(TraceHeader));
+  StringRef Names(Data + NamesOffset, Header->NamesSize);
+  std::vector<StringRef> FuncNames;
+  for (uint32_t Idx = 0; Idx != Header->NumFunctions; ++Idx) {
+    if (uint64_t(Funcs[Idx].NameOffset) + Funcs[Idx].NameSize > Names.size())
+      return createStringError(inconvertibleErrorCode(),
+                               "%s: malformed name for function %u",
+                               Name.str().c_str(), Idx);
+    FuncNames.push_back(
+        Names.substr(Funcs[Idx].NameOffset, Funcs[Idx].NameSize));
+  }
+
+  OutS << "=================================================\n";
+  OutS << "LLVM-TUTOR: function call trace\n";
+  OutS << "=================================================\n";
+  const char *ThreadStr = "THREAD";
+  const char *TimestampStr = "TIMESTAMP";
+  const char *NameStr = "NAME";
+  const char *ArgsStr = "#N ARGS";
+  OutS << format("%-10s %-20s %-20s %-10s\n", ThreadStr, TimestampStr,
+                 NameStr, ArgsStr);
+  OutS << "-------------------------------------------------\n";
+
+  while (Offset != Size) {
+    if (Size - Offset < sizeof(TraceChunkHeader))
+      return createStringError(inconvertibleErrorCode(),
+                               "%s: truncated chunk header",
+                               Name.str().c_str());
+    const auto *Chunk =
+        reinterpret_cast<const TraceChunkHeader *>(Data + Offset);
+    Offset += sizeof(TraceChunkHeader);
+    if ((Size - Offset) / sizeof(TraceRecord) < Chunk->NumRecords)
+      return createStringError(inconvertibleErrorCode(),
+                               "%s: truncated chunk", Name.str().c_str());
+
+    const auto *Records = reinterpret_cast<const TraceRecord *>(Data + Offset);
+    for (uint32_t Idx = 0; Idx != Chunk->NumRecords; ++Idx) {
+      const TraceRecord &Rec = Records[Idx];
+      if (Rec.FuncIdx >= FuncNames.size())
+        return createStringError(inconvertibleErrorCode(),
+                                 "%s: invalid function index %u",
+                                 Name.str().c_str(), Rec.FuncIdx);
+      OutS << format("%-10u %-20lu %-20s %-10u\n", Chunk->ThreadIdx,
+                     Rec.Timestamp, FuncNames[Rec.FuncIdx].str().c_str(),
+                     Rec.NumArgs);
+    }
+    Offset += uint64_t(Chunk->NumRecords) * sizeof(TraceRecord);
+  }
+
+  return Error::success();
+}
+
+// Decodes the result stream in Buf and prints its records as JSON lines, i.e.
+// exactly as the printer passes do with `-<pass>-format=jsonl`
+static Error printResultStream(raw_ostream &OutS, const MemoryBuffer &Buf) {
+  StringRef Name = Buf.getBufferIdentifier();
+  const auto *Start = reinterpret_cast<const uint8_t *>(Buf.getBufferStart());
+  const auto *End = reinterpret_cast<const uint8_t *>(Buf.getBufferEnd());
+  const uint8_t *Ptr = Start;
+
+  auto Malformed = [&](const char *What) {
+    return createStringError(inconvertibleErrorCode(),
+                             "%s: %s at offset %zu", Name.str().c_str(), What,
+                             size_t(Ptr - Start));
+  };
+  auto ReadULEB = [&](uint64_t &Value) {
+    const char *Err = nullptr;
+    unsigned Size = 0;
+    Value = decodeULEB128(Ptr, &Size, End, &Err);
+    Ptr += Size;
+    return !Err;
+  };
+  auto ReadString = [&](StringRef &Str) {
+    uint64_t Size;
+    if (!ReadULEB(Size) || uint64_t(End - Ptr) < Size)
+      return false;
+    Str = StringRef(reinterpret_cast<const char *>(Ptr), Size);
+    Ptr += Size;
+    return true;
+  };
+
+  struct Field {
+    StringRef Key;
+    uint8_t Type;
+    uint64_t Unsigned;
+    StringRef String;
+  };
+  // The field names of the current chunk (in the order of their numbers)
+  std::vector<StringRef> Keys;
+  SmallVector<Field, 8> Fields;
+  bool InChunk = false;
+  while (Ptr != End) {
+    // Every chunk starts with a header
+    if (*Ptr != ResultRecordTag || !InChunk) {
+      ResultStreamHeader Header;
+      if (size_t(End - Ptr) < sizeof(Header))
+        return Malformed("truncated header");
+      std::memcpy(&Header, Ptr, sizeof(Header));
+      if (Header.Magic != ResultStreamMagic)
+        return Malformed("invalid record");
+      if (Header.Version != ResultStreamVersion)
+        return Malformed("unsupported result stream version");
+      Ptr += sizeof(Header);
+      Keys.clear();
+      InChunk = true;
+      continue;
+    }
+
+    ++Ptr;
+    Fields.clear();
+    while (true) {
+      uint64_t KeyIdx;
+      if (!ReadULEB(KeyIdx))
+        return Malformed("truncated record");
+      if (KeyIdx == ResultRecordEnd)
+        break;
+      if (KeyIdx > Keys.size() + 1)
+        return Malformed("invalid field name");
+      if (KeyIdx == Keys.size() + 1) {
+        StringRef Key;
+        if (!ReadString(Key))
+          return Malformed("truncated field name");
+        Keys.push_back(Key);
+      }
+
+      Field F{Keys[KeyIdx - 1], 0, 0, StringRef()};
+      if (Ptr == End)
+        return Malformed("truncated field");
+      F.Type = *Ptr++;
+      if (F.Type == ResultFieldUnsigned) {
+        if (!ReadULEB(F.Unsigned))
+          return Malformed("truncated field");
+      } else if (F.Type == ResultFieldString) {
+        if (!ReadString(F.String))
+          return Malformed("truncated field");
+      } else {
+        return Malformed("invalid field type");
+      }
+      Fields.push_back(F);
+    }
+
+    json::OStream J(OutS);
+    J.object([&] {
+      for (const Field &F : Fields) {
+        if (F.Type == ResultFieldUnsigned)
+          J.attribute(F.Key, F.Unsigned);
+        else
+          J.attribute(F.Key, F.String);
+      }
+    });
+    OutS << "\n";
+  }
+
+  return Error::success();
+}
+
+enum class ProfileKind { Calls, CallEdges, Edges, Loops, Trace, Results };
+
+// Returns the kind of the profile in Buf based on its magic number. Call
+// profiles are the default, readProfile reports invalid files.
+static ProfileKind getProfileKind(const MemoryBuffer &Buf) {
+  if (Buf.getBufferSize() < sizeof(uint64_t))
+    return ProfileKind::Calls;
+
+  uint64_t Magic = *reinterpret_cast<const uint64_t *>(Buf.getBufferStart());
+  if (Magic == CallEdgeProfileMagic)
+    return ProfileKind::CallEdges;
+  if (Magic == EdgeProfileMagic)
+    return ProfileKind::Edges;
+  if (Magic == LoopProfileMagic)
+    return ProfileKind::Loops;
+  if (Magic == TraceMagic)
+    return ProfileKind::Trace;
+  if (Magic == ResultStreamMagic)
+    return ProfileKind::Results;
+  return ProfileKind::Calls;
+}
+
+//===----------------------------------------------------------------------===//
+// Main driver code.
+//===----------------------------------------------------------------------===//
+int main(int Argc, char **Argv) {
+  // Hide all options apart from the ones specific to this tool
+  cl::HideUnrelatedOptions(ProfDataCategory);
+
+  cl::ParseCommandLineOptions(Argc, Argv,
+                              "Reads and merges DynamicCallCounter, "
+                              "EdgeProfiler and LoopTripCounter profiles "
+                              "(and prints InjectFuncCall traces and "
+                              "result streams)\n");
+
+  if (!ShowCommand && !MergeCommand) {
+    errs() << "Please specify a command (show or merge)\n";
+    return -1;
+  }
+
+  // The buffers own the memory that the function names in Profile refer to
+  std::vector<std::unique_ptr<MemoryBuffer>> Buffers;
+  MergedProfile Profile;
+  MergedEdgeProfile EdgeProfile;
+  MergedCallEdgeProfile CallEdgeProfile;
+  MergedLoopProfile LoopProfile;
+  ProfileKind Kind = ProfileKind::Calls;
+  for (const std::string &Input : InputFiles) {
+    auto BufOrErr = MemoryBuffer::getFile(
+        Input, /*IsText=*/false, /*RequiresNullTerminator=*/false,
+        /*IsVolatile=*/false, Align(alignof(DCCProfileHeader)));
+    if (!BufOrErr) {
+      errs() << "Error reading profile: " << Input << " ("
+             << BufOrErr.getError().message() << ")\n";
+      return -1;
+    }
+
+    ProfileKind CurKind = getProfileKind(**BufOrErr);
+    if (!Buffers.empty() && CurKind != Kind) {
+      errs() << "Error reading profile: " << Input
+             << " (different kinds of profiles cannot be mixed)\n";
+      return -1;
+    }
+    Kind = CurKind;
+
+    auto ReadInput = [&](const MemoryBuffer &Buf) -> Error {
+      switch (Kind) {
+      case ProfileKind::Calls:
+        return readProfile(Buf, Profile);
+      case ProfileKind::CallEdges:
+        return readCallEdgeProfile(Buf, CallEdgeProfile);
+      case ProfileKind::Edges:
+        return readEdgeProfile(Buf, EdgeProfile);
+      case ProfileKind::Loops:
+        return readLoopProfile(Buf, LoopProfile);
+      case ProfileKind::Trace:
+        if (MergeCommand)
+          return createStringError(inconvertibleErrorCode(),
+                                   "%s: traces cannot be merged",
+                                   Input.c_str());
+        return printTrace(outs(), Buf);
+      case ProfileKind::Results:
+        if (MergeCommand)
+          return createStringError(inconvertibleErrorCode(),
+                                   "%s: result streams cannot be merged",
+                                   Input.c_str());
+        return printResultStream(outs(), Buf);
+      }
+      llvm_unreachable("Unknown profile kind");
+    };
+    if (Error Err = ReadInput(**BufOrErr)) {
+      errs() << "Error reading profile: " << toString(std::move(Err)) << "\n";
+      return -1;
+    }
+    Buffers.push_back(std::move(*BufOrErr));
+  }
+
+  // Traces and result streams are printed as they are read
+  if (Kind == ProfileKind::Trace || Kind == ProfileKind::Results)
+    return 0;
+
+  if (ShowCommand) {
+    if (Kind == ProfileKind::CallEdges)
+      printCallEdgeProfile(outs(), CallEdgeProfile);
+    else if (Kind == ProfileKind::Edges)
+      printEdgeProfile(outs(), EdgeProfile);
+    else if (Kind == ProfileKind::Loops)
+      printLoopProfile(outs(), LoopProfile);
+    else
+      printProfile(outs(), Profile);
+    return 0;
+  }
+
+  auto WriteOutput = [&]() -> Error {
+    if (Kind == ProfileKind::CallEdges)
+      return writeSampleProfile(OutputFile, CallEdgeProfile);
+    if (Kind == ProfileKind::Edges)
+      return writeEdgeProfile(OutputFile, EdgeProfile);
+    if (Kind == ProfileKind::Loops)
+      return writeLoopProfile(OutputFile, LoopProfile);
+    return writeProfile(OutputFile, Profile);
+  };
+  if (Error Err = WriteOutput()) {
+    errs() << "Error writing profile: " << toString(std::move(Err)) << "\n";
+    return -1;
+  }
+
+  return 0;
+}
@@ -7,23 +7,68 @@
 //    in the source code) in the input LLVM file. Internally it uses the
 //    StaticCallCounter pass.
 //
+//    When more than one input file is specified, the files are analysed in
+//    parallel on a thread pool (every module is parsed into its own
+//    LLVMContext, so the workers share no IR state) and the results are
+//    merged (by the callee name) into one aggregate report. The order of the
+//    report does not depend on the scheduling: the per-module results are
+//    merged in the order in which the inputs were specified.
+//
+//    With `-lazy`, the bitcode is loaded lazily: the function bodies are
+//    materialized (and counted) one at a time and deleted straight after.
+//    The peak memory usage is then proportional to the largest function
+//    rather than to the whole module, which matters for e.g. merged LTO
+//    modules. (Textual IR cannot be loaded lazily and is always parsed in
+//    full.)
+//
+//    With `-function-analyses`, the tool also runs the selected read-only
+//    function analyses (OpcodeCounter, FindFCmpEq, RIV, LazyRIV) and prints
+//    their results, in the same format as the corresponding `print<...>`
+//    passes in opt. For a single input module, the functions are analysed in
+//    parallel: every worker thread has its own FunctionAnalysisManager and
+//    PassBuilder, and takes the next function to analyse from a shared
+//    counter. The reports are buffered per function and printed in the order
+//    of the functions in the module, so the output does not depend on the
+//    number of threads. (For many input modules, the parallelism is across
+//    the modules and the functions of every module are analysed in order.)
+//
+//    With `-format=jsonl|binary`, all the results are written as records
+//    rather than as tables (see ResultWriter.h).
+//
 // USAGE:
 //    # First, generate an LLVM file:
 //      clang -emit-llvm <input-file> -c -o <output-llvm-file>
 //    # Now you can run this tool as follows:
 //      <BUILD/DIR>/bin/static <output-llvm-file>
+//    # or, for many files (the list can also be read from a response file):
+//      <BUILD/DIR>/bin/static [-j <N>] [-lazy] <file1> ... | @<file-list>
+//    # with function analyses:
+//      <BUILD/DIR>/bin/static -function-analyses=opcode-counter,riv `\`
+//        [-j <N>] <output-llvm-file>
+//    # as JSON lines:
+//      <BUILD/DIR>/bin/static -format=jsonl <output-llvm-file>
 //
 // License: MIT
 //========================================================================
+#include "FindFCmpEq.h"
+#include "FusedAnalysis.h"
+#include "OpcodeCounter.h"
+#include "RIV.h"
 #include "StaticCallCounter.h"
 
 #include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/Error.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <atomic>
+#include <optional>
+
 using namespace llvm;
 
 //===----------------------------------------------------------------------===//
@@ -31,12 +76,123 @@ using namespace llvm;
 //===----------------------------------------------------------------------===//
 static cl::OptionCategory CallCounterCategory{"call counter options"};
 
-static cl::opt<std::string> InputModule{cl::Positional,
-                                        cl::desc{"<Module to analyze>"},
-                                        cl::value_desc{"bitcode filename"},
-                                        cl::init(""),
-                                        cl::Required,
-                                        cl::cat{CallCounterCategory}};
+static cl::list<std::string> InputModules{cl::Positional,
+                                          cl::desc{"<Modules to analyze>"},
+                                          cl::value_desc{"bitcode filenames"},
+                                          cl::OneOrMore,
+                                          cl::cat{CallCounterCategory}};
+
+static cl::opt<unsigned> NumThreads{
+    "j",
+    cl::desc{"The number of worker threads used to analyse multiple input "
+             "files, or the functions of a single input file with "
+             "-function-analyses (0 = one per hardware thread)"},
+    cl::value_desc{"N"}, cl::init(0), cl::cat{CallCounterCategory}};
+
+static cl::opt<bool> LazyLoad{
+    "lazy",
+    cl::desc{"Materialize (and release) one function body at a time instead "
+             "of loading the whole module up-front"},
+    cl::init(false), cl::cat{CallCounterCategory}};
+
+enum class FunctionAnalysisKind { OpcodeCounter, FindFCmpEq, RIV, LazyRIV };
+
+static cl::list<FunctionAnalysisKind> FunctionAnalyses{
+    "function-analyses",
+    cl::desc{"Also run these function analyses and print their results"},
+    cl::values(clEnumValN(FunctionAnalysisKind::OpcodeCounter,
+                          "opcode-counter", "OpcodeCounter"),
+               clEnumValN(FunctionAnalysisKind::FindFCmpEq, "find-fcmp-eq",
+                          "FindFCmpEq"),
+               clEnumValN(FunctionAnalysisKind::RIV, "riv", "RIV"),
+               clEnumValN(FunctionAnalysisKind::LazyRIV, "lazy-riv",
+                          "LazyRIV")),
+    cl::CommaSeparated, cl::cat{CallCounterCategory}};
+
+static cl::opt<ResultFormat> OutputFormat{
+    "format", cl::desc{"The format of the results (of all the analyses)"},
+    getResultFormatValues(), cl::init(ResultFormat::Text),
+    cl::cat{CallCounterCategory}};
+
+//===----------------------------------------------------------------------===//
+// Function analyses
+//===----------------------------------------------------------------------===//
+// Runs the analyses selected with -function-analyses on one function at a
+// time. Every instance has its own analysis manager, so the instances can be
+// used on different threads (as long as they analyse different functions).
+class FunctionAnalysisRunner {
+public:
+  FunctionAnalysisRunner() {
+    FAM.registerPass([&] { return OpcodeCounter(); });
+    FAM.registerPass([&] { return FindFCmpEq(); });
+    FAM.registerPass([&] { return RIV(); });
+    FAM.registerPass([&] { return LazyRIV(); });
+    // OpcodeCounter and FindFCmpEq share one walk over the instructions
+    FAM.registerPass([&] { return FusedAnalysis(); });
+    // For the analyses that the above depend on (e.g. the dominator tree)
+    PB.registerFunctionAnalyses(FAM);
+  }
+
+  // Prints the results of all the selected analyses of F to OS. The results
+  // are not needed afterwards, so they are released straight away.
+  void run(Function &F, raw_ostream &OS) {
+    for (FunctionAnalysisKind Kind : FunctionAnalyses) {
+      switch (Kind) {
+      case FunctionAnalysisKind::OpcodeCounter:
+        OpcodeCounterPrinter(OS, OutputFormat).run(F, FAM);
+        break;
+      case FunctionAnalysisKind::FindFCmpEq:
+        FindFCmpEqPrinter(OS, OutputFormat).run(F, FAM);
+        break;
+      case FunctionAnalysisKind::RIV:
+        RIVPrinter(OS, OutputFormat).run(F, FAM);
+        break;
+      case FunctionAnalysisKind::LazyRIV:
+        LazyRIVPrinter(OS, OutputFormat).run(F, FAM);
+        break;
+      }
+    }
+    FAM.clear(F, F.getName());
+  }
+
+private:
+  PassBuilder PB;
+  FunctionAnalysisManager FAM;
+};
+
+// Runs the selected function analyses on all the functions defined in M, in
+// parallel, and prints the results in the order of the functions in M
+static void runFunctionAnalysesInParallel(Module &M, raw_ostream &OS) {
+  std::vector<Function *> Funcs;
+  for (Function &F : M)
+    if (!F.isDeclaration())
+      Funcs.push_back(&F);
+
+  std::vector<std::string> Reports(Funcs.size());
+  std::atomic<size_t> NextIdx{0};
+  auto Worker = [&] {
+    FunctionAnalysisRunner Runner;
+    for (size_t Idx = NextIdx++; Idx < Funcs.size(); Idx = NextIdx++) {
+      raw_string_ostream ReportOS(Reports[Idx]);
+      Runner.run(*Funcs[Idx], ReportOS);
+    }
+  };
+
+  ThreadPoolStrategy Strategy = hardware_concurrency(NumThreads);
+  size_t NumWorkers =
+      std::min<size_t>(Strategy.compute_thread_count(), Funcs.size());
+  if (NumWorkers <= 1) {
+    Worker();
+  } else {
+    DefaultThreadPool Pool(Strategy);
+    for (size_t Idx = 0; Idx < NumWorkers; ++Idx)
+      Pool.async(Worker);
+    Pool.wait();
+  }
+
+  for (const std::string &Report : Reports)
+    OS << Report;
+}
 
 //===----------------------------------------------------------------------===//
 // static - implementation
@@ -44,7 +200,7 @@ static cl::opt<std::string> InputModule{cl::Positional,
 static void countStaticCalls(Module &M) {
   // Create a module pass manager and add StaticCallCounterPrinter to it.
   ModulePassManager MPM;
-  MPM.addPass(StaticCallCounterPrinter(llvm::errs()));
+  MPM.addPass(StaticCallCounterPrinter(llvm::errs(), OutputFormat));
 
   // Create an analysis manager and register StaticCallCounter with it.
   ModuleAnalysisManager MAM;
@@ -61,6 +217,124 @@ static void countStaticCalls(Module &M) {
   MPM.run(M, MAM);
 }
 
+// Counts the calls in a lazily loaded module, one function at a time (and
+// runs the function analyses, if any, printing them to AnalysesOS). Every
+// function body is deleted once it has been counted. The Function objects
+// themselves (i.e. the keys of the result) stay around until M is destroyed.
+static Expected<ResultStaticCC>
+countStaticCallsLazily(Module &M, raw_ostream &AnalysesOS) {
+  ResultStaticCC DirectCalls;
+  std::optional<FunctionAnalysisRunner> Runner;
+  if (!FunctionAnalyses.empty())
+    Runner.emplace();
+
+  for (Function &F : M) {
+    if (Error E = F.materialize())
+      return std::move(E);
+    if (F.isDeclaration())
+      continue;
+
+    StaticCallCounter::countCallsInFunction(F, DirectCalls);
+    if (Runner)
+      Runner->run(F, AnalysesOS);
+    F.deleteBody();
+  }
+
+  return DirectCalls;
+}
+
+// Parses and analyses one of the input files. This runs on a worker thread,
+// so everything (including the LLVMContext and the diagnostics) is local to
+// this function. The results of the function analyses (if any) are written to
+// Report. Returns std::nullopt (and sets ErrMsg) on failure.
+static std::optional<NamedResultStaticCC>
+countStaticCallsInFile(StringRef Path, const char *ProgName,
+                       std::string &ErrMsg, std::string &Report) {
+  SMDiagnostic Err;
+  LLVMContext Ctx;
+  std::unique_ptr<Module> M =
+      LazyLoad ? getLazyIRFileModule(Path, Err, Ctx,
+                                     /*ShouldLazyLoadMetadata=*/true)
+               : parseIRFile(Path, Err, Ctx);
+
+  if (!M) {
+    raw_string_ostream ErrOS(ErrMsg);
+    ErrOS << "Error reading bitcode file: " << Path << "\n";
+    Err.print(ProgName, ErrOS);
+    return std::nullopt;
+  }
+
+  NamedResultStaticCC Result;
+  raw_string_ostream ReportOS(Report);
+  if (LazyLoad) {
+    Expected<ResultStaticCC> DirectCalls =
+        countStaticCallsLazily(*M, ReportOS);
+    if (!DirectCalls) {
+      ErrMsg = ("Error materializing bitcode file: " + Path + ": " +
+                toString(DirectCalls.takeError()) + "\n")
+                   .str();
+      return std::nullopt;
+    }
+    mergeStaticCCResult(Result, *DirectCalls);
+    return Result;
+  }
+
+  ModuleAnalysisManager MAM;
+  MAM.registerPass([&] { return StaticCallCounter(); });
+  PassBuilder PB;
+  PB.registerModuleAnalyses(MAM);
+
+  // The results refer to the functions in M, so translate them to names
+  // before M (and Ctx) go away.
+  mergeStaticCCResult(Result, MAM.getResult<StaticCallCounter>(*M));
+
+  if (!FunctionAnalyses.empty()) {
+    FunctionAnalysisRunner Runner;
+    for (Function &F : *M)
+      if (!F.isDeclaration())
+        Runner.run(F, ReportOS);
+  }
+  return Result;
+}
+
+// Analyses all the input files on a thread pool and prints one aggregate
+// report. Returns false if any of the inputs could not be read.
+static bool countStaticCallsInFiles(ArrayRef<std::string> Paths,
+                                    const char *ProgName) {
+  std::vector<std::optional<NamedResultStaticCC>> Results(Paths.size());
+  std::vector<std::string> Errors(Paths.size());
+  std::vector<std::string> Reports(Paths.size());
+
+  {
+    DefaultThreadPool Pool(hardware_concurrency(NumThreads));
+    for (size_t Idx = 0, E = Paths.size(); Idx < E; ++Idx)
+      Pool.async([&, Idx] {
+        Results[Idx] = countStaticCallsInFile(Paths[Idx], ProgName,
+                                              Errors[Idx], Reports[Idx]);
+      });
+    Pool.wait();
+  }
+
+  bool Success = true;
+  NamedResultStaticCC Aggregate;
+  for (size_t Idx = 0, E = Paths.size(); Idx < E; ++Idx) {
+    if (!Results[Idx]) {
+      errs() << Errors[Idx];
+      Success = false;
+      continue;
+    }
+    mergeStaticCCResult(Aggregate, *Results[Idx]);
+  }
+
+  if (!Success)
+    return false;
+
+  printStaticCCResult(errs(), Aggregate, OutputFormat);
+  for (const std::string &Report : Reports)
+    errs() << Report;
+  return true;
+}
+
 //===----------------------------------------------------------------------===//
 // Main driver code.
 //===----------------------------------------------------------------------===//
@@ -70,25 +344,32 @@ int main(int Argc, char **Argv) {
 
   cl::ParseCommandLineOptions(Argc, Argv,
                               "Counts the number of static function "
-                              "calls in the input IR file\n");
+                              "calls in the input IR file(s)\n");
 
   // Makes sure llvm_shutdown() is called (which cleans up LLVM objects)
   //  http://llvm.org/docs/ProgrammersManual.html#ending-execution-with-llvm-shutdown
   llvm_shutdown_obj SDO;
 
+  // Many input files - analyse them in parallel and aggregate the results.
+  // The lazy mode is only implemented by that code path.
+  if (InputModules.size() > 1 || LazyLoad)
+    return countStaticCallsInFiles(InputModules, Argv[0]) ? 0 : -1;
+
   // Parse the IR file passed on the command line.
   SMDiagnostic Err;
   LLVMContext Ctx;
-  std::unique_ptr<Module> M = parseIRFile(InputModule.getValue(), Err, Ctx);
+  std::unique_ptr<Module> M = parseIRFile(InputModules[0], Err, Ctx);
 
   if (!M) {
-    errs() << "Error reading bitcode file: " << InputModule << "\n";
+    errs() << "Error reading bitcode file: " << InputModules[0] << "\n";
     Err.print(Argv[0], errs());
     return -1;
   }
 
-  // Run the analysis and print the results
+  // Run the analyses and print the results
   countStaticCalls(*M);
+  if (!FunctionAnalyses.empty())
+    runFunctionAnalysesInParallel(*M, errs());
 
   return 0;
 }
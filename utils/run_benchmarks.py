@@ -0,0 +1,358 @@
+#!/usr/bin/env python3
+# === run_benchmarks.py =======================================================
+#  Measure the run-time effect of the llvm-tutor passes
+#
+#  DESCRIPTION:
+#   Builds every benchmark program (from inputs/ and test-inputs/) once
+#   without any pass (the baseline) and once per pass, runs all the binaries
+#   repeatedly and reports, for every pass, the execution time relative to
+#   the baseline:
+#     * for the transformations (e.g. simple-licm, derived-iv, loop-tile),
+#       a ratio below 1 is a speed-up,
+#     * for the obfuscations (mba-add, duplicate-bb, ...) and the
+#       instrumentation passes (dynamic-cc, inject-func-call, edge-prof), the
+#       ratio is the slowdown factor.
+#   Every ratio comes with a 95% confidence interval (Welch's t-test on the
+#   logarithm of the ratio of the mean run times). A result is "significant"
+#   when the interval does not contain 1. The runs of the baseline and of the
+#   variants are interleaved, so that a drift of the machine (thermal
+#   throttling, other load) affects all the binaries alike.
+#
+#   The binaries are compiled at -O0 (with optnone disabled), so that only
+#   the pass changes the IR. The output (and the exit code) of every binary
+#   is compared against the baseline, apart from the instrumented ones (which
+#   print extra output) and convert-fcmp-eq (which is meant to change the
+#   results of floating-point comparisons).
+#
+#   With --json, one JSON object per (program, pass) is appended to the given
+#   file, together with the date, the git commit and the host. That file can
+#   be accumulated over time and loaded by any dashboard, e.g. with
+#   `pandas.read_json(path, lines=True)`.
+#
+#  USAGE:
+#    # Build llvm-tutor first (see run_tests.sh)
+#    python3 utils/run_benchmarks.py --llvm-dir <llvm/install/dir> `\`
+#      [--build-dir build] [--repetitions 10] [--programs matmul-perfect,...] `\`
+#      [--passes simple-licm,loop-tile,...] [--json results.jsonl]
+#
+#   Use `--list` to see the available programs and passes.
+# =============================================================================
+import argparse
+import datetime
+import json
+import math
+import os
+import platform
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+LLVM_TUTOR_DIR = os.path.abspath(os.path.join(os.path.dirname(__file__), ".."))
+
+
+# --- The benchmarks -----------------------------------------------------------
+class Program:
+    def __init__(self, name, source, args=()):
+        self.name = name
+        self.source = source
+        self.args = list(args)
+
+
+class Pass:
+    # kind is "transform", "obfuscation" or "instrumentation". The output of
+    # the instrumented binaries is not checked (they print extra output).
+    def __init__(self, name, kind, plugins, pipeline, options=(),
+                 check_output=True):
+        self.name = name
+        self.kind = kind
+        self.plugins = plugins
+        self.pipeline = pipeline
+        self.options = list(options)
+        self.check_output = check_output and kind != "instrumentation"
+
+
+PROGRAMS = [
+    Program("matmul-canonical", "test-inputs/matmul-canonical.ll"),
+    Program("matmul-perfect", "test-inputs/matmul-perfect.ll"),
+    Program("cc", "inputs/input_for_cc.c"),
+    Program("fcmp-eq", "inputs/input_for_fcmp_eq.c"),
+    Program("mba", "inputs/input_for_mba.c", args=["1", "2", "3", "4"]),
+    Program("mba-sub", "inputs/input_for_mba_sub.c", args=["1", "2", "3", "4"]),
+]
+
+LOOP_PLUGINS = ["LoopTiling", "SimpleLICM", "DerivedInductionVars"]
+PASSES = [
+    # Transformations
+    Pass("simple-licm", "transform", ["SimpleLICM"],
+         "function(loop-simplify,loop-mssa(simple-licm))"),
+    Pass("derived-iv", "transform", ["DerivedInductionVars"],
+         "function(loop-simplify,derived-iv)"),
+    Pass("loop-tile", "transform", ["LoopTiling"],
+         "function(loop-simplify,loop-tile)"),
+    # The loop pipeline from run_tests.sh
+    Pass("loop-pipeline", "transform", LOOP_PLUGINS,
+         "function(loop-simplify,loop-tile,loop-mssa(simple-licm),derived-iv)"),
+    Pass("merge-bb", "transform", ["MergeBB"], "function(merge-bb)"),
+    # This one may change the results (that's the point of the pass)
+    Pass("convert-fcmp-eq", "transform", ["FindFCmpEq", "ConvertFCmpEq"],
+         "convert-fcmp-eq", check_output=False),
+    # Obfuscations (these are expected to slow the code down)
+    Pass("mba-add", "obfuscation", ["MBAAdd"], "mba-add"),
+    Pass("mba-sub", "obfuscation", ["MBASub"], "mba-sub"),
+    Pass("duplicate-bb", "obfuscation", ["RIV", "DuplicateBB"],
+         "function(duplicate-bb)"),
+    # Instrumentation
+    Pass("dynamic-cc", "instrumentation", ["DynamicCallCounter"],
+         "dynamic-cc"),
+    Pass("inject-func-call", "instrumentation", ["InjectFuncCall"],
+         "inject-func-call"),
+    Pass("edge-prof", "instrumentation", ["EdgeProfiler"], "edge-prof"),
+]
+
+
+# --- Statistics ---------------------------------------------------------------
+# The 97.5% quantiles of Student's t-distribution (two-sided 95% intervals) for
+# 1 to 30 degrees of freedom. Above that, the normal distribution is close
+# enough.
+T_975 = [12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+         2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093,
+         2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045,
+         2.042]
+
+
+def t_quantile(dof):
+    if dof < 1:
+        return float("inf")
+    return T_975[min(int(dof), len(T_975)) - 1] if dof <= 30 else 1.960
+
+
+def summarize(times):
+    """Mean, standard deviation and the 95% confidence interval of the mean"""
+    mean = statistics.mean(times)
+    stdev = statistics.stdev(times) if len(times) > 1 else 0.0
+    half = t_quantile(len(times) - 1) * stdev / math.sqrt(len(times))
+    return {
+        "n": len(times),
+        "mean_s": mean,
+        "median_s": statistics.median(times),
+        "min_s": min(times),
+        "stdev_s": stdev,
+        "ci95_s": [mean - half, mean + half],
+    }
+
+
+def compare(base, variant):
+    """The ratio variant/base of the mean times with its 95% confidence
+    interval. The variance of log(ratio) is estimated with the delta method,
+    the degrees of freedom with the Welch-Satterthwaite equation."""
+    ratio = variant["mean_s"] / base["mean_s"]
+    var_b = (base["stdev_s"] / base["mean_s"]) ** 2 / base["n"]
+    var_v = (variant["stdev_s"] / variant["mean_s"]) ** 2 / variant["n"]
+    var = var_b + var_v
+    if var == 0:
+        return ratio, [ratio, ratio]
+    dof = var ** 2 / (var_b ** 2 / max(base["n"] - 1, 1) +
+                      var_v ** 2 / max(variant["n"] - 1, 1))
+    half = t_quantile(dof) * math.sqrt(var)
+    return ratio, [ratio * math.exp(-half), ratio * math.exp(half)]
+
+
+# --- Building and running -----------------------------------------------------
+def run(cmd, **kwargs):
+    result = subprocess.run(cmd, capture_output=True, text=True, **kwargs)
+    if result.returncode != 0:
+        sys.exit("Error: `{}` failed:\n{}".format(" ".join(cmd), result.stderr))
+    return result
+
+
+class Builder:
+    def __init__(self, args, work_dir):
+        self.opt = os.path.join(args.llvm_dir, "bin", "opt")
+        self.clang = os.path.join(args.llvm_dir, "bin", "clang")
+        self.lib_dir = os.path.join(os.path.abspath(args.build_dir), "lib")
+        self.lib_ext = ".dylib" if platform.system() == "Darwin" else ".so"
+        self.work_dir = work_dir
+
+    def plugin(self, name):
+        path = os.path.join(self.lib_dir, "lib" + name + self.lib_ext)
+        if not os.path.exists(path):
+            sys.exit("Error: {} not found (build llvm-tutor first)".format(path))
+        return path
+
+    def to_ir(self, program):
+        """The unoptimised IR of the program (that the passes can transform)"""
+        source = os.path.join(LLVM_TUTOR_DIR, program.source)
+        if source.endswith(".ll"):
+            return source
+        out = os.path.join(self.work_dir, program.name + ".ll")
+        run([self.clang, "-O0", "-Xclang", "-disable-O0-optnone", "-S",
+             "-emit-llvm", source, "-o", out])
+        return out
+
+    def build(self, program, ir, llvm_pass):
+        """Builds the program with llvm_pass (None for the baseline)"""
+        label = llvm_pass.name if llvm_pass else "baseline"
+        exe = os.path.join(self.work_dir, program.name + "." + label)
+        if llvm_pass:
+            transformed = exe + ".ll"
+            cmd = [self.opt]
+            for plugin in llvm_pass.plugins:
+                cmd += ["-load-pass-plugin", self.plugin(plugin)]
+            run(cmd + ["-passes=" + llvm_pass.pipeline] + llvm_pass.options +
+                ["-S", ir, "-o", transformed])
+            ir = transformed
+        run([self.clang, "-O0", "-Wno-override-module", ir, "-o", exe])
+        return exe
+
+
+def time_run(exe, program, work_dir):
+    """Runs exe once and returns (seconds, exit code, stdout)"""
+    start = time.perf_counter()
+    result = subprocess.run([exe] + program.args, capture_output=True,
+                            text=True, cwd=work_dir)
+    return time.perf_counter() - start, result.returncode, result.stdout
+
+
+def git_commit():
+    try:
+        return subprocess.run(["git", "-C", LLVM_TUTOR_DIR, "rev-parse", "HEAD"],
+                              capture_output=True, text=True,
+                              check=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+# --- Main driver --------------------------------------------------------------
+def select(items, names, what):
+    if not names:
+        return items
+    wanted = names.split(",")
+    unknown = set(wanted) - {item.name for item in items}
+    if unknown:
+        sys.exit("Error: unknown {}: {} (see --list)".format(
+            what, ", ".join(sorted(unknown))))
+    return [item for item in items if item.name in wanted]
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description="Measure the run-time effect of the llvm-tutor passes")
+    parser.add_argument("--llvm-dir", default=os.environ.get("LLVM_DIR", ""),
+                        help="The LLVM installation directory (with bin/opt "
+                        "and bin/clang); defaults to $LLVM_DIR")
+    parser.add_argument("--build-dir", default=os.path.join(LLVM_TUTOR_DIR,
+                                                            "build"),
+                        help="The llvm-tutor build directory")
+    parser.add_argument("--programs", help="Comma-separated list of programs")
+    parser.add_argument("--passes", help="Comma-separated list of passes")
+    parser.add_argument("-r", "--repetitions", type=int, default=10,
+                        help="The number of timed runs per binary")
+    parser.add_argument("--warmup", type=int, default=1,
+                        help="The number of untimed runs per binary")
+    parser.add_argument("--json", help="Append the results (as JSON lines) "
+                        "to this file")
+    parser.add_argument("--keep", action="store_true",
+                        help="Keep the binaries (the directory is printed)")
+    parser.add_argument("--list", action="store_true",
+                        help="List the programs and the passes")
+    return parser.parse_args()
+
+
+def main():
+    args = parse_args()
+    if args.list:
+        print("Programs:", ", ".join(p.name for p in PROGRAMS))
+        print("Passes:  ", ", ".join(p.name for p in PASSES))
+        return 0
+    if not args.llvm_dir:
+        sys.exit("Error: set --llvm-dir (or $LLVM_DIR)")
+    if args.repetitions < 2:
+        sys.exit("Error: at least 2 repetitions are needed")
+
+    programs = select(PROGRAMS, args.programs, "programs")
+    passes = select(PASSES, args.passes, "passes")
+    work_dir = tempfile.mkdtemp(prefix="llvm-tutor-bench-")
+    builder = Builder(args, work_dir)
+
+    metadata = {
+        "date": datetime.datetime.now(datetime.timezone.utc).isoformat(
+            timespec="seconds"),
+        "commit": git_commit(),
+        "host": platform.node(),
+        "machine": platform.machine(),
+        "repetitions": args.repetitions,
+    }
+
+    print("{:<18} {:<18} {:>12} {:>12} {:>8} {:>19}  {}".format(
+        "PROGRAM", "PASS", "BASE (ms)", "PASS (ms)", "RATIO", "95% CI",
+        "SIGNIFICANT"))
+    results = []
+    mismatches = []
+    for program in programs:
+        ir = builder.to_ir(program)
+        exes = {"baseline": builder.build(program, ir, None)}
+        for llvm_pass in passes:
+            exes[llvm_pass.name] = builder.build(program, ir, llvm_pass)
+
+        # The warm-up runs (the first one is also the reference output)
+        outputs = {}
+        for label, exe in exes.items():
+            for _ in range(max(args.warmup, 1)):
+                _, code, stdout = time_run(exe, program, work_dir)
+            outputs[label] = (code, stdout)
+        for llvm_pass in passes:
+            if (llvm_pass.check_output and
+                    outputs[llvm_pass.name] != outputs["baseline"]):
+                mismatches.append((program.name, llvm_pass.name))
+
+        # Interleave the runs of all the binaries
+        times = {label: [] for label in exes}
+        for _ in range(args.repetitions):
+            for label, exe in exes.items():
+                times[label].append(time_run(exe, program, work_dir)[0])
+
+        base = summarize(times["baseline"])
+        for llvm_pass in passes:
+            variant = summarize(times[llvm_pass.name])
+            ratio, ci = compare(base, variant)
+            significant = not (ci[0] <= 1.0 <= ci[1])
+            print("{:<18} {:<18} {:>12.3f} {:>12.3f} {:>8.3f} "
+                  "[{:>7.3f}, {:>7.3f}]  {}".format(
+                      program.name, llvm_pass.name, base["mean_s"] * 1e3,
+                      variant["mean_s"] * 1e3, ratio, ci[0], ci[1],
+                      "yes" if significant else "no"))
+            sys.stdout.flush()
+            results.append(dict(metadata, **{
+                "program": program.name,
+                "pass": llvm_pass.name,
+                "kind": llvm_pass.kind,
+                "baseline": base,
+                "variant": variant,
+                "ratio": ratio,
+                "ratio_ci95": ci,
+                "significant": significant,
+                "output_matches": (program.name, llvm_pass.name)
+                not in mismatches,
+            }))
+
+    if args.json:
+        with open(args.json, "a") as out:
+            for result in results:
+                out.write(json.dumps(result) + "\n")
+
+    if args.keep:
+        print("The binaries are in", work_dir)
+    else:
+        shutil.rmtree(work_dir)
+
+    for program, llvm_pass in mismatches:
+        print("Error: {} changes the output of {}".format(llvm_pass, program),
+              file=sys.stderr)
+    return 1 if mismatches else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())